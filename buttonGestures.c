@@ -0,0 +1,210 @@
+/*
+ * Button gestures
+ *
+ * The setup button used to be sampled every 20mS forever, adding 20mS to a counter each time it read low and
+ * comparing the counter with exactly 3 seconds. Now the GPIO backend reports the button's edges (see
+ * gpioBackend.c; the gpiochip backend's come from the kernel, timestamped and debounced), and the monitor
+ * thread sleeps in poll() in between. The only other time it wakes
+ * is when a gesture is due to complete with no further edge: the button's been held for BUTTON_LONG_PRESS_MS,
+ * or a single press has gone BUTTON_DOUBLE_PRESS_GAP_MS without a second one.
+ *
+ * The gesture logic is a state machine fed with (pressed, timestamp) edges and 'now' timeouts, so it doesn't
+ * care where they come from, and times are always differences between timestamps rather than counted ticks.
+ * If the backend can't report edges (the /dev/mem one), the monitor falls back to sampling the pin every
+ * BUTTON_POLL_MS, and feeds the state machine the edges it sees, timestamped with
+ * CLOCK_MONOTONIC.
+ *
+ * The button is wired to ground, with the internal pull-up enabled, so pressed = low.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "gpioBackend.h"
+#include "buttonGestures.h"
+
+#define NS_PER_MS 1000000ull
+
+typedef struct {
+    unsigned gpioPin;
+    void (*gesture)(int gesture);
+} buttonMonitorArgs;
+
+static uint64_t monotonicNowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+void initButtonGestureState(buttonGestureState *button, int pressed, uint64_t nowNs) {
+    //A button already held at start up counts as pressed now
+    button->pressed = pressed;
+    button->pressedAt = nowNs;
+    button->releasedAt = nowNs;
+    button->shortPresses = 0;
+    button->longPressReported = 0;
+}
+
+int buttonGestureTimeout(buttonGestureState *button, uint64_t nowNs) {
+    /*
+     * Completes any gesture that's due by nowNs without another edge. Call it before buttonGestureEdge() with
+     * the edge's timestamp, and whenever buttonGestureDeadline() passes.
+     * Returns the gesture, or BUTTON_NONE
+     */
+    if (button->pressed) {
+        if ((!button->longPressReported) && (nowNs - button->pressedAt >= BUTTON_LONG_PRESS_MS * NS_PER_MS)) {
+            button->longPressReported = 1;
+            button->shortPresses = 0;
+            return BUTTON_LONG_PRESS;
+        }
+    } else if ((button->shortPresses == 1) && (nowNs - button->releasedAt > BUTTON_DOUBLE_PRESS_GAP_MS * NS_PER_MS)) {
+        button->shortPresses = 0;
+        return BUTTON_PRESS;
+    }
+    return BUTTON_NONE;
+}
+
+int buttonGestureEdge(buttonGestureState *button, int pressed, uint64_t timestampNs) {
+    /*
+     * Feeds in a press (pressed=1) or release at timestampNs.
+     * Returns the gesture it completes, or BUTTON_NONE
+     */
+    if (pressed == button->pressed) return BUTTON_NONE; //Missed the edge in between (queue overflow). Nothing to go on
+    button->pressed = pressed;
+    if (pressed) {
+        button->pressedAt = timestampNs;
+        button->longPressReported = 0;
+        return BUTTON_NONE;
+    }
+
+    button->releasedAt = timestampNs;
+    if (button->longPressReported) return BUTTON_NONE; //Already dealt with
+    uint64_t held = timestampNs - button->pressedAt;
+    if (held >= BUTTON_LONG_PRESS_MS * NS_PER_MS) { //Nobody checked in time, but the timestamps say it was held long enough
+        button->shortPresses = 0;
+        return BUTTON_LONG_PRESS;
+    }
+    if (held > BUTTON_SHORT_PRESS_MAX_MS * NS_PER_MS) { //Neither one thing nor the other
+        button->shortPresses = 0;
+        return BUTTON_NONE;
+    }
+    if (++button->shortPresses == 2) {
+        button->shortPresses = 0;
+        return BUTTON_DOUBLE_PRESS;
+    }
+    return BUTTON_NONE;
+}
+
+uint64_t buttonGestureDeadline(buttonGestureState *button) {
+    //Returns when (CLOCK_MONOTONIC nS) buttonGestureTimeout() next needs calling, or 0 if only an edge can change anything
+    if (button->pressed) {
+        if (!button->longPressReported) return button->pressedAt + BUTTON_LONG_PRESS_MS * NS_PER_MS;
+    } else if (button->shortPresses == 1) return button->releasedAt + BUTTON_DOUBLE_PRESS_GAP_MS * NS_PER_MS + 1;
+    return 0;
+}
+
+const char *buttonGestureToString(int gesture) {
+    switch (gesture) {
+        case BUTTON_PRESS: return "press";
+        case BUTTON_DOUBLE_PRESS: return "double press";
+        case BUTTON_LONG_PRESS: return "long press";
+        default: return "none";
+    }
+}
+
+static void reportButtonGesture(buttonMonitorArgs *args, int gesture) {
+    if (gesture == BUTTON_NONE) return;
+    printf("Setup button: %s\n", buttonGestureToString(gesture));
+    args->gesture(gesture);
+}
+
+static int monitorButtonEdges(buttonMonitorArgs *args, int edgeFd) {
+    /*
+     * Waits for edge events on the button's pin. Only returns (-1) if the events stop working
+     */
+    buttonGestureState button;
+    int level = readGPIO(args->gpioPin);
+    if (level < 0) return -1;
+    initButtonGestureState(&button, !level, monotonicNowNs());
+
+    while (1) {
+        int timeoutMs = -1;
+        uint64_t deadline = buttonGestureDeadline(&button);
+        if (deadline != 0) {
+            uint64_t now = monotonicNowNs();
+            timeoutMs = (deadline > now) ? (int) ((deadline - now + NS_PER_MS - 1) / NS_PER_MS) : 0;
+        }
+        struct pollfd pfd = {edgeFd, POLLIN, 0};
+        int ready = poll(&pfd, 1, timeoutMs);
+        if (ready < 0) continue; //EINTR
+        if ((ready > 0) && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) return -1;
+
+        uint64_t timestamp;
+        int ret;
+        while ((ret = readGPIOEdge(edgeFd, &level, &timestamp)) == 1) {
+            reportButtonGesture(args, buttonGestureTimeout(&button, timestamp)); //Anything completed before this edge
+            reportButtonGesture(args, buttonGestureEdge(&button, !level, timestamp));
+        }
+        if (ret < 0) return -1;
+        reportButtonGesture(args, buttonGestureTimeout(&button, monotonicNowNs()));
+    }
+}
+
+static void monitorButtonPolled(buttonMonitorArgs *args) {
+    /*
+     * Fallback for backends without edge events: samples the pin every BUTTON_POLL_MS. Never returns
+     */
+    setGPIOMode(args->gpioPin, PI_INPUT); //GPIO gpioPin as input
+    setGPIOPullUpDown(args->gpioPin, PI_PUD_UP); //Set internal pull-up
+    buttonGestureState button;
+    initButtonGestureState(&button, readGPIO(args->gpioPin) == 0, monotonicNowNs());
+    while (1) {
+        usleep(BUTTON_POLL_MS * 1000);
+        uint64_t now = monotonicNowNs();
+        int pressed = (readGPIO(args->gpioPin) == 0);
+        reportButtonGesture(args, buttonGestureTimeout(&button, now));
+        reportButtonGesture(args, buttonGestureEdge(&button, pressed, now));
+    }
+}
+
+static void *buttonMonitorThread(void *arg) {
+    /*
+     * PThread: Monitors the button on args->gpioPin, calling args->gesture() for each gesture.
+     * Uses edge events if the GPIO backend has them, otherwise polls
+     */
+    buttonMonitorArgs *args = (buttonMonitorArgs *) arg;
+    int edgeFd = watchGPIOEdges(args->gpioPin, PI_PUD_UP, BUTTON_DEBOUNCE_US);
+    if (edgeFd >= 0) {
+        printf("buttonMonitorThread(): Waiting for edges on GPIO %u\n", args->gpioPin);
+        monitorButtonEdges(args, edgeFd);
+        printf("buttonMonitorThread(): Lost GPIO %u edges\n", args->gpioPin);
+    }
+    printf("buttonMonitorThread(): Polling GPIO %u every %dmS\n", args->gpioPin, BUTTON_POLL_MS);
+    monitorButtonPolled(args);
+    return NULL;
+}
+
+int startButtonMonitor(unsigned gpioPin, void (*gesture)(int gesture)) {
+    /*
+     * Starts a thread watching the button on gpioPin, which calls gesture(BUTTON_PRESS etc.) as they happen.
+     * gesture() is called on that thread, and no more are reported until it returns (they're not lost though:
+     * the edges queue up, with their timestamps).
+     * Returns 0 on success, -1 on failure
+     */
+    buttonMonitorArgs *args = malloc(sizeof (buttonMonitorArgs));
+    if (args == NULL) return -1;
+    args->gpioPin = gpioPin;
+    args->gesture = gesture;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, buttonMonitorThread, args)) {
+        printf("startButtonMonitor(): Error creating button monitor thread.\n");
+        free(args);
+        return -1;
+    }
+    pthread_detach(thread); //Runs for the life of the program
+    return 0;
+}
@@ -0,0 +1,60 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   buttonGestures.h
+ *
+ * Turns a push button's edges into presses, double presses and long presses (see buttonGestures.c)
+ */
+
+#ifndef BUTTONGESTURES_H
+#define BUTTONGESTURES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "buttonGestures.h" TO THE SOURCE FILE
+
+#include <stdint.h>
+
+//Gestures
+#define BUTTON_NONE 0
+#define BUTTON_PRESS 1          //One short press (reported once it can't be the start of a double press)
+#define BUTTON_DOUBLE_PRESS 2   //Two short presses close together
+#define BUTTON_LONG_PRESS 3     //Held for BUTTON_LONG_PRESS_MS (reported while it's still held)
+
+#define BUTTON_LONG_PRESS_MS 3000
+#define BUTTON_SHORT_PRESS_MAX_MS 1000  //Held longer than this (but not long enough to be a long press), it's ignored
+#define BUTTON_DOUBLE_PRESS_GAP_MS 400  //Max time between releasing and pressing again for a double press
+#define BUTTON_DEBOUNCE_US 10000        //Asked of the GPIO backend
+#define BUTTON_POLL_MS 20               //Sampling period when the GPIO backend can't report edges
+
+typedef struct {
+    int pressed;
+    uint64_t pressedAt; //CLOCK_MONOTONIC nS of the last press
+    uint64_t releasedAt; //and release
+    int shortPresses; //Short presses so far that might be part of a double press
+    int longPressReported; //Already reported this press as a long press
+} buttonGestureState;
+
+void initButtonGestureState(buttonGestureState *button, int pressed, uint64_t nowNs);
+int buttonGestureEdge(buttonGestureState *button, int pressed, uint64_t timestampNs);
+int buttonGestureTimeout(buttonGestureState *button, uint64_t nowNs);
+uint64_t buttonGestureDeadline(buttonGestureState *button);
+const char *buttonGestureToString(int gesture);
+int startButtonMonitor(unsigned gpioPin, void (*gesture)(int gesture));
+
+//AND BEFORE HERE
+#endif /* BUTTONGESTURES_H */
@@ -0,0 +1,592 @@
+/*
+ * Versioned snapshots of the config files we write (wpa_supplicant.conf and the generated hostapd config)
+ *
+ * deleteESSIDfromConfigFileByName() used to keep a single .backup copy (overwritten on every delete)
+ * and createWPASupplicantConfig() kept none at all. This keeps every version instead, cheaply:-
+ *
+ * Store layout (by default a hidden directory next to wpa_supplicant.conf, so it's on the same file system):-
+ *      objects/<fnv1a-64 hash>[-n]         One blob per distinct file content. Identical content is only ever stored once
+ *      generations/NNNNNN/<name>           A generation is a directory of hard links to blobs (so costs no data blocks)
+ *      generations/NNNNNN/.reason          Why the snapshot was taken
+ *      current -> generations/NNNNNN       Symlink to the generation that matches the live files
+ *
+ * Blobs are named by a 64 bit FNV-1a hash of their contents. A hash match is confirmed by comparing the
+ * bytes, and on a (very unlikely) collision a -1, -2... suffix is added, so two different contents can
+ * never share a blob.
+ *
+ * Because generations are hard links, 'has anything changed since the current generation' is just a
+ * comparison of inode numbers, and takeConfigSnapshot() doesn't create a new generation if nothing has.
+ *
+ * rollbackConfigSnapshot() copies the blobs back over the live files (write to a temp file, then rename()
+ * so readers never see a half written file) and flips the 'current' symlink (again with rename()).
+ * The live files are deliberately NOT hard linked to the blobs: createWPASupplicantConfig() rewrites
+ * the file in place, which would silently change the stored blob too.
+ *
+ * Generation 0 means 'the live file' in diffConfigSnapshots()
+ *
+ * Writing to the store needs a writeable file system, so call these from inside a
+ * beginReadWriteSession()/endReadWriteSession() pair (see fileSystemTools.c)
+ */
+
+#define _POSIX_C_SOURCE 200809L //For readlink(), symlink(), strdup() etc with -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <time.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "configSnapshots.h"
+
+#define SNAPSHOT_STORE_NAME ".piconfigserver-snapshots" //Created in the same directory as wpa_supplicant.conf
+#define SNAPSHOT_MAX_FILE_SIZE (1024 * 1024) //Config files are small. Anything bigger than this isn't one
+#define SNAPSHOT_MAX_GENERATIONS 50 //Oldest generations (and any blobs only they used) are pruned beyond this
+#define SNAPSHOT_DIFF_MAX_LINES 1024 //Per file, for diffConfigSnapshots()
+
+typedef struct {
+    char name[SNAPSHOT_NAME_LENGTH]; //Name used inside a generation (e.g wpa_supplicant.conf)
+    char livePath[PATH_MAX]; //Where the real file lives
+} trackedConfigFile;
+
+static char snapshotStoreDir[PATH_MAX] = {0};
+static trackedConfigFile trackedFiles[SNAPSHOT_MAX_FILES];
+static int trackedFileCount = 0;
+static pthread_mutex_t snapshotMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t fnv1a64(const unsigned char *data, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t n = 0; n < length; n++) {
+        hash ^= data[n];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static int readWholeFile(char path[], unsigned char **data, size_t *length) {
+    /*
+     * Reads path into a malloc'd buffer (caller frees). Adds a trailing '\0' (not counted in length)
+     * so the buffer can be treated as a string.
+     * Returns 0 on success, 1 if the file doesn't exist, -1 on error
+     */
+    struct stat fileInfo;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) return 1;
+        perror("configSnapshots:readWholeFile():open()");
+        return -1;
+    }
+    if ((fstat(fd, &fileInfo) == -1) || (fileInfo.st_size > SNAPSHOT_MAX_FILE_SIZE)) {
+        printf("configSnapshots:readWholeFile(): Can't read %s (or it's too big)\n", path);
+        close(fd);
+        return -1;
+    }
+    *data = malloc(fileInfo.st_size + 1);
+    if (*data == NULL) {
+        close(fd);
+        return -1;
+    }
+    size_t total = 0;
+    while (total < (size_t) fileInfo.st_size) {
+        ssize_t ret = read(fd, *data + total, fileInfo.st_size - total);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret <= 0) break; //Shrunk underneath us. Take what we got
+        total += ret;
+    }
+    (*data)[total] = 0;
+    *length = total;
+    close(fd);
+    return 0;
+}
+
+static int writeWholeFile(char path[], unsigned char *data, size_t length, mode_t mode) {
+    /*
+     * Writes data to path (creating or truncating it) and fsyncs it. Returns 0 on success, -1 on error
+     */
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    if (fd < 0) {
+        perror("configSnapshots:writeWholeFile():open()");
+        return -1;
+    }
+    size_t total = 0;
+    while (total < length) {
+        ssize_t ret = write(fd, data + total, length - total);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret < 0) {
+            perror("configSnapshots:writeWholeFile():write()");
+            close(fd);
+            return -1;
+        }
+        total += ret;
+    }
+    fsync(fd);
+    close(fd);
+    return 0;
+}
+
+static int makeStoreDirs() {
+    //Creates the store directories if they don't exist yet. Mode 0700 as wpa_supplicant.conf holds passphrases
+    char path[PATH_MAX];
+    if ((mkdir(snapshotStoreDir, 0700) == -1) && (errno != EEXIST)) {
+        perror("configSnapshots:makeStoreDirs():mkdir()");
+        return -1;
+    }
+    snprintf(path, PATH_MAX, "%s/objects", snapshotStoreDir);
+    if ((mkdir(path, 0700) == -1) && (errno != EEXIST)) return -1;
+    snprintf(path, PATH_MAX, "%s/generations", snapshotStoreDir);
+    if ((mkdir(path, 0700) == -1) && (errno != EEXIST)) return -1;
+    return 0;
+}
+
+static int storeBlob(unsigned char *data, size_t length, char blobPath[], unsigned int blobPathLength) {
+    /*
+     * Finds (or creates) the blob holding data, and copies its path into blobPath.
+     * Returns 1 if the blob already existed, 0 if it was created, -1 on error
+     */
+    uint64_t hash = fnv1a64(data, length);
+    for (int suffix = 0; suffix < 100; suffix++) {
+        if (suffix == 0)
+            snprintf(blobPath, blobPathLength, "%s/objects/%016llx", snapshotStoreDir, (unsigned long long) hash);
+        else
+            snprintf(blobPath, blobPathLength, "%s/objects/%016llx-%d", snapshotStoreDir, (unsigned long long) hash, suffix);
+
+        unsigned char *existing = NULL;
+        size_t existingLength = 0;
+        int ret = readWholeFile(blobPath, &existing, &existingLength);
+        if (ret == 1) { //No blob with this name yet, so create it
+            char tempPath[PATH_MAX];
+            snprintf(tempPath, PATH_MAX, "%s/objects/.tmp%d", snapshotStoreDir, (int) getpid());
+            unlink(tempPath); //Left over from an interrupted attempt? (it'd be read-only)
+            if (writeWholeFile(tempPath, data, length, 0400) == -1) return -1;
+            if (rename(tempPath, blobPath) == -1) {
+                perror("configSnapshots:storeBlob():rename()");
+                unlink(tempPath);
+                return -1;
+            }
+            return 0;
+        }
+        if (ret == -1) return -1;
+        int same = ((existingLength == length) && (memcmp(existing, data, length) == 0));
+        free(existing);
+        if (same) return 1; //Already stored. Deduplicated
+        //Hash collision. Try the next suffix
+    }
+    return -1;
+}
+
+static void generationPath(int generation, char path[], unsigned int pathLength) {
+    snprintf(path, pathLength, "%s/generations/%06d", snapshotStoreDir, generation);
+}
+
+static int readCurrentGeneration() {
+    //Returns the generation the 'current' symlink points at, 0 if there isn't one
+    char linkPath[PATH_MAX], target[PATH_MAX] = {0};
+    snprintf(linkPath, PATH_MAX, "%s/current", snapshotStoreDir);
+    ssize_t ret = readlink(linkPath, target, PATH_MAX - 1);
+    if (ret <= 0) return 0;
+    target[ret] = 0;
+    char *number = strrchr(target, '/');
+    return (number == NULL) ? 0 : (int) strtol(number + 1, NULL, 10);
+}
+
+static int setCurrentGeneration(int generation) {
+    /*
+     * Points the 'current' symlink at generation. A new symlink is created under a temporary name and then
+     * renamed over the old one, so 'current' always exists and always points at a complete generation
+     */
+    char linkPath[PATH_MAX], tempPath[PATH_MAX], target[64];
+    snprintf(linkPath, PATH_MAX, "%s/current", snapshotStoreDir);
+    snprintf(tempPath, PATH_MAX, "%s/.current.tmp", snapshotStoreDir);
+    snprintf(target, sizeof (target), "generations/%06d", generation);
+    unlink(tempPath);
+    if (symlink(target, tempPath) == -1) {
+        perror("configSnapshots:setCurrentGeneration():symlink()");
+        return -1;
+    }
+    if (rename(tempPath, linkPath) == -1) {
+        perror("configSnapshots:setCurrentGeneration():rename()");
+        unlink(tempPath);
+        return -1;
+    }
+    return 0;
+}
+
+static int compareInts(const void *a, const void *b) {
+    return *((const int*) a) - *((const int*) b);
+}
+
+static int listGenerationNumbers(int generations[], int maxEntries) {
+    //Fills generations[] with the generation numbers in the store (oldest first). Returns how many
+    char path[PATH_MAX];
+    snprintf(path, PATH_MAX, "%s/generations", snapshotStoreDir);
+    DIR *dir = opendir(path);
+    if (dir == NULL) return 0;
+    int count = 0;
+    struct dirent *entry;
+    while (((entry = readdir(dir)) != NULL) && (count < maxEntries)) {
+        if (entry->d_name[0] == '.') continue; //Skip . .. and half built generations
+        int generation = strtol(entry->d_name, NULL, 10);
+        if (generation > 0) generations[count++] = generation;
+    }
+    closedir(dir);
+    qsort(generations, count, sizeof (int), compareInts);
+    return count;
+}
+
+static void removeGeneration(int generation) {
+    /*
+     * Deletes a generation directory. Any blob left with a link count of 1 afterwards was only used by that
+     * generation (the objects/ entry is the only link left), so that's deleted too
+     */
+    char genPath[PATH_MAX], entryPath[PATH_MAX];
+    struct stat entryInfo;
+    generationPath(generation, genPath, PATH_MAX);
+    for (int n = 0; n < trackedFileCount; n++) {
+        snprintf(entryPath, PATH_MAX, "%s/%s", genPath, trackedFiles[n].name);
+        if (stat(entryPath, &entryInfo) == -1) continue;
+        unlink(entryPath);
+        if (entryInfo.st_nlink == 2) { //The generation link (now gone) plus the objects/ link
+            DIR *dir;
+            char objectsPath[PATH_MAX];
+            snprintf(objectsPath, PATH_MAX, "%s/objects", snapshotStoreDir);
+            if ((dir = opendir(objectsPath)) != NULL) {
+                struct dirent *object;
+                while ((object = readdir(dir)) != NULL) {
+                    if (object->d_ino == entryInfo.st_ino) {
+                        snprintf(entryPath, PATH_MAX, "%s/%s", objectsPath, object->d_name);
+                        unlink(entryPath);
+                        break;
+                    }
+                }
+                closedir(dir);
+            }
+        }
+    }
+    snprintf(entryPath, PATH_MAX, "%s/.reason", genPath);
+    unlink(entryPath);
+    rmdir(genPath);
+}
+
+int initConfigSnapshots(char wpa_supplicantConfigPath[], char hostapdConfigPath[]) {
+    /*
+     * Sets up the snapshot store next to wpa_supplicant.conf and starts tracking the two config files.
+     * Nothing is written to disk until the first takeConfigSnapshot()
+     *
+     * Returns 0 on success, -1 on failure
+     */
+    char pathCopy[PATH_MAX] = {0};
+    if ((wpa_supplicantConfigPath == NULL) || (strlen(wpa_supplicantConfigPath) == 0)) return -1;
+    strncpy(pathCopy, wpa_supplicantConfigPath, PATH_MAX - 1);
+    pthread_mutex_lock(&snapshotMutex);
+    snprintf(snapshotStoreDir, PATH_MAX, "%s/%s", dirname(pathCopy), SNAPSHOT_STORE_NAME);
+    trackedFileCount = 0;
+    pthread_mutex_unlock(&snapshotMutex);
+    printf("initConfigSnapshots(): Snapshot store: %s\n", snapshotStoreDir);
+
+    if (trackConfigFile("wpa_supplicant.conf", wpa_supplicantConfigPath) == -1) return -1;
+    if ((hostapdConfigPath != NULL) && (strlen(hostapdConfigPath) > 0))
+        if (trackConfigFile("hostapd.conf", hostapdConfigPath) == -1) return -1;
+    return 0;
+}
+
+int trackConfigFile(char name[], char livePath[]) {
+    /*
+     * Adds a file to every future snapshot. name is what it's called inside a generation (so it has to be
+     * unique, and must not start with '.'). Returns 0 on success, -1 if the table's full or name is bad
+     */
+    if ((name == NULL) || (livePath == NULL) || (name[0] == '.') || (strchr(name, '/') != NULL)) return -1;
+    pthread_mutex_lock(&snapshotMutex);
+    if (trackedFileCount >= SNAPSHOT_MAX_FILES) {
+        pthread_mutex_unlock(&snapshotMutex);
+        printf("trackConfigFile(): Can't track %s. Already tracking %d files\n", livePath, SNAPSHOT_MAX_FILES);
+        return -1;
+    }
+    strncpy(trackedFiles[trackedFileCount].name, name, SNAPSHOT_NAME_LENGTH - 1);
+    strncpy(trackedFiles[trackedFileCount].livePath, livePath, PATH_MAX - 1);
+    trackedFileCount++;
+    pthread_mutex_unlock(&snapshotMutex);
+    return 0;
+}
+
+int takeConfigSnapshot(char reason[]) {
+    /*
+     * Stores the current contents of every tracked file. If they all match the current generation
+     * nothing new is created.
+     *
+     * Returns the generation number that matches the live files, or -1 on error
+     */
+    char blobPaths[SNAPSHOT_MAX_FILES][PATH_MAX];
+    char genPath[PATH_MAX], tempGenPath[PATH_MAX], entryPath[PATH_MAX];
+    int n, ret = -1;
+
+    pthread_mutex_lock(&snapshotMutex);
+    if ((strlen(snapshotStoreDir) == 0) || (trackedFileCount == 0)) goto done;
+    if (makeStoreDirs() == -1) goto done;
+
+    //1) Make sure every tracked file's contents are in the blob store
+    for (n = 0; n < trackedFileCount; n++) {
+        unsigned char *data = NULL;
+        size_t length = 0;
+        blobPaths[n][0] = 0;
+        int readRet = readWholeFile(trackedFiles[n].livePath, &data, &length);
+        if (readRet == -1) goto done;
+        if (readRet == 1) continue; //Doesn't exist (e.g hostapd config hasn't been generated yet)
+        int storeRet = storeBlob(data, length, blobPaths[n], PATH_MAX);
+        free(data);
+        if (storeRet == -1) goto done;
+    }
+
+    //2) Same as the current generation? Hard links, so comparing inode numbers is enough
+    int current = readCurrentGeneration();
+    if (current > 0) {
+        int changed = 0;
+        generationPath(current, genPath, PATH_MAX);
+        for (n = 0; (n < trackedFileCount) && (changed == 0); n++) {
+            struct stat blobInfo, genInfo;
+            snprintf(entryPath, PATH_MAX, "%s/%s", genPath, trackedFiles[n].name);
+            int inGeneration = (stat(entryPath, &genInfo) == 0);
+            if (blobPaths[n][0] == 0) {
+                changed = inGeneration; //File's gone, but was there before
+            } else {
+                if ((inGeneration == 0) || (stat(blobPaths[n], &blobInfo) == -1) || (blobInfo.st_ino != genInfo.st_ino))
+                    changed = 1;
+            }
+        }
+        if (changed == 0) {
+            ret = current;
+            goto done;
+        }
+    }
+
+    //3) Build the new generation under a temporary name, then rename it into place
+    int generations[SNAPSHOT_MAX_GENERATIONS * 2];
+    int count = listGenerationNumbers(generations, SNAPSHOT_MAX_GENERATIONS * 2);
+    int newGeneration = (count > 0) ? generations[count - 1] + 1 : 1;
+    if (newGeneration <= current) newGeneration = current + 1;
+    generationPath(newGeneration, genPath, PATH_MAX);
+    snprintf(tempGenPath, PATH_MAX, "%s/generations/.%06d", snapshotStoreDir, newGeneration);
+    if ((mkdir(tempGenPath, 0700) == -1) && (errno != EEXIST)) {
+        perror("takeConfigSnapshot():mkdir()");
+        goto done;
+    }
+    for (n = 0; n < trackedFileCount; n++) {
+        if (blobPaths[n][0] == 0) continue;
+        snprintf(entryPath, PATH_MAX, "%s/%s", tempGenPath, trackedFiles[n].name);
+        unlink(entryPath); //Left over from an interrupted attempt?
+        if (link(blobPaths[n], entryPath) == -1) {
+            perror("takeConfigSnapshot():link()");
+            goto done;
+        }
+    }
+    char reasonLine[256];
+    time_t now = time(NULL);
+    struct tm localNow;
+    localtime_r(&now, &localNow);
+    int reasonLength = strftime(reasonLine, sizeof (reasonLine), "%Y-%m-%d %H:%M:%S ", &localNow);
+    snprintf(reasonLine + reasonLength, sizeof (reasonLine) - reasonLength, "%s\n", (reason != NULL) ? reason : "");
+    snprintf(entryPath, PATH_MAX, "%s/.reason", tempGenPath);
+    writeWholeFile(entryPath, (unsigned char*) reasonLine, strlen(reasonLine), 0600);
+    if (rename(tempGenPath, genPath) == -1) {
+        perror("takeConfigSnapshot():rename()");
+        goto done;
+    }
+    if (setCurrentGeneration(newGeneration) == -1) goto done;
+    printf("takeConfigSnapshot(): Generation %d (%s)\n", newGeneration, (reason != NULL) ? reason : "");
+    ret = newGeneration;
+
+    //4) Prune the oldest generations. Never the current one
+    count = listGenerationNumbers(generations, SNAPSHOT_MAX_GENERATIONS * 2);
+    for (n = 0; (count - n) > SNAPSHOT_MAX_GENERATIONS; n++)
+        if (generations[n] != newGeneration) removeGeneration(generations[n]);
+
+done:
+    pthread_mutex_unlock(&snapshotMutex);
+    return ret;
+}
+
+int getCurrentConfigGeneration() {
+    //Returns the generation that matches the live files (as of the last snapshot or rollback), 0 if none
+    pthread_mutex_lock(&snapshotMutex);
+    int ret = readCurrentGeneration();
+    pthread_mutex_unlock(&snapshotMutex);
+    return ret;
+}
+
+int listConfigSnapshots(configSnapshotInfo list[], int maxEntries) {
+    /*
+     * Fills list[] with the most recent generations (newest first).
+     * Returns the number of entries filled in
+     */
+    int generations[SNAPSHOT_MAX_GENERATIONS * 2];
+    char path[PATH_MAX];
+    pthread_mutex_lock(&snapshotMutex);
+    int count = listGenerationNumbers(generations, SNAPSHOT_MAX_GENERATIONS * 2);
+    int current = readCurrentGeneration();
+    int filled = 0;
+    for (int n = count - 1; (n >= 0) && (filled < maxEntries); n--, filled++) {
+        configSnapshotInfo *info = &list[filled];
+        memset(info, 0, sizeof (*info));
+        info->generation = generations[n];
+        info->current = (generations[n] == current);
+        generationPath(generations[n], path, PATH_MAX);
+        strncat(path, "/.reason", PATH_MAX - strlen(path) - 1);
+        FILE *fp = fopen(path, "r");
+        if (fp != NULL) {
+            if (fgets(info->reason, SNAPSHOT_REASON_LENGTH, fp) != NULL)
+                info->reason[strcspn(info->reason, "\n")] = 0;
+            fclose(fp);
+        }
+    }
+    pthread_mutex_unlock(&snapshotMutex);
+    return filled;
+}
+
+static int loadGenerationFile(int generation, int fileIndex, unsigned char **data, size_t *length) {
+    //Generation 0 is the live file. Returns as readWholeFile() (1 means 'not in that generation')
+    char path[PATH_MAX];
+    if (generation == 0) return readWholeFile(trackedFiles[fileIndex].livePath, data, length);
+    generationPath(generation, path, PATH_MAX);
+    strncat(path, "/", PATH_MAX - strlen(path) - 1);
+    strncat(path, trackedFiles[fileIndex].name, PATH_MAX - strlen(path) - 1);
+    return readWholeFile(path, data, length);
+}
+
+static int splitLines(char *text, char *lines[], int maxLines) {
+    //Splits text in place. Returns the number of lines (capped at maxLines)
+    int count = 0;
+    while ((*text != 0) && (count < maxLines)) {
+        lines[count++] = text;
+        char *end = strchr(text, '\n');
+        if (end == NULL) break;
+        *end = 0;
+        text = end + 1;
+    }
+    return count;
+}
+
+int diffConfigSnapshots(int fromGeneration, int toGeneration, char name[], char output[], unsigned int outputLength) {
+    /*
+     * Line by line diff of tracked file 'name' between two generations (0 = the live file). Lines only in
+     * fromGeneration start with '-', lines only in toGeneration with '+', common lines with ' '.
+     * Uses a longest common subsequence table, fine for files the size of a wpa_supplicant.conf.
+     *
+     * Returns the number of changed lines, or -1 on error
+     */
+    unsigned char *fromData = NULL, *toData = NULL;
+    size_t fromLength = 0, toLength = 0;
+    int fileIndex = -1, ret = -1;
+    memset(output, 0, outputLength);
+
+    pthread_mutex_lock(&snapshotMutex);
+    for (int n = 0; n < trackedFileCount; n++)
+        if (strcmp(trackedFiles[n].name, name) == 0) fileIndex = n;
+    if (fileIndex == -1) goto done;
+    //A file missing from a generation diffs as empty
+    int fromRet = loadGenerationFile(fromGeneration, fileIndex, &fromData, &fromLength);
+    int toRet = loadGenerationFile(toGeneration, fileIndex, &toData, &toLength);
+    if ((fromRet == -1) || (toRet == -1)) goto done;
+    if (fromRet == 1) fromData = (unsigned char*) strdup("");
+    if (toRet == 1) toData = (unsigned char*) strdup("");
+
+    char **fromLines = malloc(SNAPSHOT_DIFF_MAX_LINES * sizeof (char*));
+    char **toLines = malloc(SNAPSHOT_DIFF_MAX_LINES * sizeof (char*));
+    unsigned short *lcs = NULL;
+    if ((fromData == NULL) || (toData == NULL) || (fromLines == NULL) || (toLines == NULL)) goto freeDiff;
+    int fromCount = splitLines((char*) fromData, fromLines, SNAPSHOT_DIFF_MAX_LINES);
+    int toCount = splitLines((char*) toData, toLines, SNAPSHOT_DIFF_MAX_LINES);
+    //lcs[i][j] = length of the longest common subsequence of fromLines[i..] and toLines[j..]
+    lcs = calloc((fromCount + 1) * (toCount + 1), sizeof (unsigned short));
+    if (lcs == NULL) goto freeDiff;
+#define LCS(i, j) lcs[(i) * (toCount + 1) + (j)]
+    for (int i = fromCount - 1; i >= 0; i--)
+        for (int j = toCount - 1; j >= 0; j--)
+            LCS(i, j) = (strcmp(fromLines[i], toLines[j]) == 0) ? LCS(i + 1, j + 1) + 1 :
+                ((LCS(i + 1, j) >= LCS(i, j + 1)) ? LCS(i + 1, j) : LCS(i, j + 1));
+
+    int i = 0, j = 0, changes = 0;
+    unsigned int used = 0;
+    while ((i < fromCount) || (j < toCount)) {
+        char marker;
+        char *line;
+        if ((i < fromCount) && (j < toCount) && (strcmp(fromLines[i], toLines[j]) == 0)) {
+            marker = ' ';
+            line = fromLines[i++];
+            j++;
+        } else if ((j < toCount) && ((i == fromCount) || (LCS(i, j + 1) >= LCS(i + 1, j)))) {
+            marker = '+';
+            line = toLines[j++];
+            changes++;
+        } else {
+            marker = '-';
+            line = fromLines[i++];
+            changes++;
+        }
+        if (used < outputLength) {
+            int written = snprintf(output + used, outputLength - used, "%c%s\n", marker, line);
+            if (written > 0) used += written;
+        }
+    }
+#undef LCS
+    ret = changes;
+freeDiff:
+    free(lcs);
+    free(fromLines);
+    free(toLines);
+done:
+    free(fromData);
+    free(toData);
+    pthread_mutex_unlock(&snapshotMutex);
+    return ret;
+}
+
+int rollbackConfigSnapshot(int generation) {
+    /*
+     * Puts the live config files back to how they were in generation, and makes it the current generation.
+     * Each live file is replaced atomically (temp file + rename()). Files missing from the generation
+     * are left alone. Restart wpa_supplicant afterwards for it to take effect.
+     *
+     * Returns 0 on success, -1 on failure
+     */
+    char genPath[PATH_MAX], tempPath[PATH_MAX], pathCopy[PATH_MAX];
+    struct stat genInfo, liveInfo;
+    int ret = -1;
+
+    pthread_mutex_lock(&snapshotMutex);
+    generationPath(generation, genPath, PATH_MAX);
+    if ((generation < 1) || (stat(genPath, &genInfo) == -1) || !S_ISDIR(genInfo.st_mode)) {
+        printf("rollbackConfigSnapshot(): No such generation %d\n", generation);
+        goto done;
+    }
+    for (int n = 0; n < trackedFileCount; n++) {
+        unsigned char *data = NULL;
+        size_t length = 0;
+        int readRet = loadGenerationFile(generation, n, &data, &length);
+        if (readRet == 1) continue;
+        if (readRet == -1) goto done;
+        mode_t mode = 0600;
+        if (stat(trackedFiles[n].livePath, &liveInfo) == 0) mode = liveInfo.st_mode & 07777; //Keep the live file's permissions
+        strncpy(pathCopy, trackedFiles[n].livePath, PATH_MAX - 1);
+        pathCopy[PATH_MAX - 1] = 0;
+        snprintf(tempPath, PATH_MAX, "%s/.%s.rollback", dirname(pathCopy), trackedFiles[n].name);
+        int writeRet = writeWholeFile(tempPath, data, length, mode);
+        free(data);
+        if (writeRet == -1) goto done;
+        if (rename(tempPath, trackedFiles[n].livePath) == -1) {
+            perror("rollbackConfigSnapshot():rename()");
+            unlink(tempPath);
+            goto done;
+        }
+    }
+    if (setCurrentGeneration(generation) == -1) goto done;
+    printf("rollbackConfigSnapshot(): Rolled back to generation %d\n", generation);
+    ret = 0;
+done:
+    pthread_mutex_unlock(&snapshotMutex);
+    return ret;
+}
@@ -0,0 +1,50 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   configSnapshots.h
+ *
+ * Versioned, deduplicated snapshots of wpa_supplicant.conf and the hostapd config (see configSnapshots.c)
+ */
+
+#ifndef CONFIGSNAPSHOTS_H
+#define CONFIGSNAPSHOTS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "configSnapshots.h" TO THE SOURCE FILE
+
+#define SNAPSHOT_MAX_FILES 4            //Max no. of config files that can be tracked
+#define SNAPSHOT_NAME_LENGTH 64
+#define SNAPSHOT_REASON_LENGTH 128
+
+typedef struct {
+    int generation;
+    int current; //1 if this generation matches the live files
+    char reason[SNAPSHOT_REASON_LENGTH]; //Timestamp and reason the snapshot was taken
+} configSnapshotInfo;
+
+int initConfigSnapshots(char wpa_supplicantConfigPath[], char hostapdConfigPath[]);
+int trackConfigFile(char name[], char livePath[]);
+int takeConfigSnapshot(char reason[]);
+int getCurrentConfigGeneration();
+int listConfigSnapshots(configSnapshotInfo list[], int maxEntries);
+int diffConfigSnapshots(int fromGeneration, int toGeneration, char name[], char output[], unsigned int outputLength);
+int rollbackConfigSnapshot(int generation);
+
+//AND BEFORE HERE
+#endif /* CONFIGSNAPSHOTS_H */
+
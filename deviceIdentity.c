@@ -0,0 +1,155 @@
+/*
+ * Device identity
+ *
+ * The hostname and serial number go into the status page, the access point SSIDs and the SIGUSR2 report.
+ * getSerialNumber() used to run `cat /proc/cpuinfo | grep Serial | cut -d ':' -f 2` (three processes) and
+ * getHostName() ran `hostname`, every time, and gpioHardwareRevision() parsed /proc/cpuinfo again for itself.
+ *
+ * None of it changes while we're running, apart from the hostname, and that only if someone changes it. So:
+ *      -The serial number, revision code and model are read once, the first time anything asks, with open()/read():
+ *       /proc/device-tree/serial-number, /proc/device-tree/model, and one pass over /proc/cpuinfo (which also has
+ *       the serial number on older kernels, and is the only place the revision code and CPU model name are)
+ *      -The hostname comes from gethostname(2), once, and again only when refreshDeviceHostName() is called
+ *       (main() does on SIGHUP)
+ */
+
+#define _GNU_SOURCE //O_CLOEXEC, gethostname()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "deviceIdentity.h"
+
+#define CPUINFO_MAX_LENGTH (1 << 20)
+
+static deviceIdentity identity;
+static pthread_once_t identityOnce = PTHREAD_ONCE_INIT;
+static char hostName[DEVICE_HOSTNAME_LENGTH];
+static int hostNameRead = 0;
+static pthread_mutex_t hostNameMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static char *readProcFile(const char *path, int maxLength, int *length) {
+    /*
+     * Reads a /proc (or /sys) file, which can't be sized with stat(), into a malloc()ed, null terminated buffer.
+     * Returns it (free() it), or NULL if it can't be read
+     */
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    int size = 4096, used = 0;
+    char *buffer = (char *) malloc(size);
+    while (buffer != NULL) {
+        if (used == size - 1) {
+            if (size >= maxLength) break; //Keep what we've got
+            size *= 2;
+            char *bigger = (char *) realloc(buffer, size);
+            if (bigger == NULL) break;
+            buffer = bigger;
+        }
+        ssize_t ret = read(fd, buffer + used, size - 1 - used);
+        if (ret <= 0) break;
+        used += ret;
+    }
+    close(fd);
+    if (buffer == NULL) return NULL;
+    buffer[used] = 0;
+    if (length != NULL) *length = used;
+    return buffer;
+}
+
+static void copyField(char output[], int outputLength, const char *input) {
+    //Copies input up to the end of its line, trimming spaces
+    while ((*input == ' ') || (*input == '\t')) input++;
+    int length = strcspn(input, "\r\n");
+    while ((length > 0) && ((input[length - 1] == ' ') || (input[length - 1] == '\t'))) length--;
+    if (length > outputLength - 1) length = outputLength - 1;
+    memcpy(output, input, length);
+    output[length] = 0;
+}
+
+static void parseCPUInfo(void) {
+    //One pass over /proc/cpuinfo for the revision code, CPU model name and (if the device tree hasn't got them) serial no. and model
+    char *cpuinfo = readProcFile("/proc/cpuinfo", CPUINFO_MAX_LENGTH, NULL);
+    if (cpuinfo == NULL) {
+        perror("parseCPUInfo(): /proc/cpuinfo");
+        return;
+    }
+    char *line = cpuinfo;
+    while ((line != NULL) && (*line != 0)) {
+        char *colon = strchr(line, ':');
+        char *end = strchr(line, '\n');
+        if ((colon != NULL) && ((end == NULL) || (colon < end))) {
+            if (strncasecmp(line, "model name", 10) == 0) { //One per core. Never the board's "Model" line
+                if (identity.cpuModelName[0] == 0) copyField(identity.cpuModelName, DEVICE_MODEL_LENGTH, colon + 1);
+            } else if (strncasecmp(line, "revision", 8) == 0) {
+                /* Old style codes are 4 digits (plus an over-volt prefix). New style (bit 23 set) are 6 digits.
+                   Look at the value rather than counting characters, as there's no model name on a 64 bit OS */
+                char *digitsEnd;
+                unsigned long code = strtoul(colon + 1, &digitsEnd, 16);
+                if ((digitsEnd != colon + 1) && ((*digitsEnd == '\n') || (*digitsEnd == 0)))
+                    identity.revision = (code & 0x800000) ? (code & 0xFFFFFF) : (code & 0xFFFF);
+            } else if ((identity.serial[0] == 0) && (strncasecmp(line, "serial", 6) == 0))
+                copyField(identity.serial, DEVICE_SERIAL_LENGTH, colon + 1);
+            else if ((identity.model[0] == 0) && (strncasecmp(line, "model", 5) == 0) && (strchr(" \t:", line[5]) != NULL))
+                copyField(identity.model, DEVICE_MODEL_LENGTH, colon + 1); //Newer kernels, if there's no device tree one
+        }
+        line = (end != NULL) ? end + 1 : NULL;
+    }
+    free(cpuinfo);
+}
+
+static void readDeviceIdentity(void) {
+    //Once only (pthread_once())
+    memset(&identity, 0, sizeof (identity));
+    //Device tree strings are null terminated, with no newline
+    char *value = readProcFile("/proc/device-tree/serial-number", DEVICE_SERIAL_LENGTH, NULL);
+    if (value != NULL) {
+        copyField(identity.serial, DEVICE_SERIAL_LENGTH, value);
+        free(value);
+    }
+    value = readProcFile("/proc/device-tree/model", DEVICE_MODEL_LENGTH, NULL);
+    if (value != NULL) {
+        copyField(identity.model, DEVICE_MODEL_LENGTH, value);
+        free(value);
+    }
+    parseCPUInfo();
+    identity.serialNumber = (unsigned int) strtoull(identity.serial, NULL, 16); //Low 32 bits
+}
+
+const deviceIdentity *getDeviceIdentity(void) {
+    //The serial no. etc. Read the first time it's called, and the same from then on
+    pthread_once(&identityOnce, readDeviceIdentity);
+    return &identity;
+}
+
+int refreshDeviceHostName(void) {
+    //Re-reads the hostname (e.g after it's been changed). Returns 0 on success, -1 on failure
+    char name[DEVICE_HOSTNAME_LENGTH] = {0};
+    if (gethostname(name, DEVICE_HOSTNAME_LENGTH - 1) < 0) {
+        perror("refreshDeviceHostName(): gethostname()");
+        return -1;
+    }
+    pthread_mutex_lock(&hostNameMutex);
+    strcpy(hostName, name);
+    hostNameRead = 1;
+    pthread_mutex_unlock(&hostNameMutex);
+    return 0;
+}
+
+int getDeviceHostName(char output[], int outputLength) {
+    //Copies the hostname into output[]. Returns its length, or -1 if it's unknown
+    if (outputLength < 1) return -1;
+    pthread_mutex_lock(&hostNameMutex);
+    int known = hostNameRead;
+    pthread_mutex_unlock(&hostNameMutex);
+    if ((!known) && (refreshDeviceHostName() < 0)) {
+        output[0] = 0;
+        return -1;
+    }
+    pthread_mutex_lock(&hostNameMutex);
+    snprintf(output, outputLength, "%s", hostName);
+    pthread_mutex_unlock(&hostNameMutex);
+    return strlen(output);
+}
@@ -0,0 +1,48 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   deviceIdentity.h
+ *
+ * Hostname, serial number and hardware revision, read once (see deviceIdentity.c)
+ */
+
+#ifndef DEVICEIDENTITY_H
+#define DEVICEIDENTITY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "deviceIdentity.h" TO THE SOURCE FILE
+
+#define DEVICE_HOSTNAME_LENGTH 65   //HOST_NAME_MAX + 1
+#define DEVICE_SERIAL_LENGTH 33
+#define DEVICE_MODEL_LENGTH 128
+
+typedef struct {
+    char serial[DEVICE_SERIAL_LENGTH]; //As written, e.g "00000000a1b2c3d4". Empty if unknown
+    unsigned int serialNumber; //Its low 32 bits, as getSerialNumber() has always returned
+    unsigned revision; //Hardware revision code. 16 bits for old style codes, 24 for new style (bit 23 set). 0 if unknown
+    char model[DEVICE_MODEL_LENGTH]; //e.g "Raspberry Pi 4 Model B Rev 1.4" (device tree). Empty if unknown
+    char cpuModelName[DEVICE_MODEL_LENGTH]; //The "model name" line in /proc/cpuinfo, e.g "ARMv7 Processor rev 3 (v7l)"
+} deviceIdentity; //Doesn't change while we're running
+
+const deviceIdentity *getDeviceIdentity(void);
+int getDeviceHostName(char output[], int outputLength);
+int refreshDeviceHostName(void);
+
+//AND BEFORE HERE
+#endif /* DEVICEIDENTITY_H */
+
@@ -0,0 +1,1105 @@
+/*
+ * Built-in DHCP client
+ *
+ * renewDHCPLeases() used to run 'dhclient -v &', 'dhclient wlan0 -r -v &' and 'dhclient wlan0 -v &' and hope.
+ * Nothing found out whether a lease was actually got, and each dhclient went through the whole
+ * DISCOVER/OFFER/REQUEST/ACK exchange, with its own 1-4s retransmit timers, even when it was going back to
+ * the network it had just left (e.g coming out of setup mode).
+ *
+ * This is an RFC 2131 client, one thread per interface, using the message layout and option code the server
+ * uses (dhcpOptions.c). Each thread sleeps in poll() on:
+ *      -An AF_PACKET socket, with a BPF filter that only lets UDP to port 68 through. Until we have an address,
+ *       messages can't go through a UDP socket (no source address, and replies are addressed to an address we
+ *       haven't got yet), so they're sent and received as whole IP/UDP frames here (buildDHCPFrame()/parseDHCPFrame())
+ *      -A UDP socket on port 68, for unicast renewals once we have a lease
+ *      -An rtnetlink socket (RTMGRP_LINK), so the exchange starts the moment the interface has a carrier
+ *       (for wlan0, as soon as wpa_supplicant has associated), rather than on the next retransmit
+ *      -An eventfd, to be told to renew or stop
+ *
+ * Getting an address quickly:
+ *      -Every lease is cached (DHCP_CLIENT_LEASE_FILENAME, and in memory). With a cached lease that hasn't run out,
+ *       the client starts in INIT-REBOOT: one DHCPREQUEST for that address, and a DHCPACK back, i.e one round
+ *       trip. A DHCPNAK (different network) drops it and goes on to DISCOVER straight away. So does no reply
+ *       after two tries
+ *      -The DHCPDISCOVER carries Rapid Commit (RFC 4039, option 80). Our own server, and others that support it,
+ *       answer with a DHCPACK straight away, so that's one round trip too
+ *      -Retransmits start at 1s (doubling up to 16s, +/-25%), rather than RFC 2131's 4s
+ *
+ * Leases are put into effect with rtnetlink, not ifconfig/route: the address with the lease time as its
+ * lifetime (so the kernel removes it if we're not around to renew it), and the default route with a metric of
+ * 200 + ifindex (+100 for wireless interfaces), as dhcpcd does, so each interface keeps its own default
+ * route and eth0 is preferred (see routeTable.c). DNS servers are recorded in the lease but /etc/resolv.conf
+ * is left to the system. T1/T2 renewal and rebinding are as RFC 2131 (4.4.5), and an expired lease takes the
+ * address away again.
+ *
+ * Call startDHCPClient() for each interface (again to renew), getDHCPClientStatus() or printDHCPClientReport()
+ * to see how it went, and stopDHCPClient() to stop (optionally sending a DHCPRELEASE).
+ */
+
+#define _GNU_SOURCE //O_CLOEXEC, SOCK_CLOEXEC
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/ethernet.h>       //ETH_P_IP
+#include <linux/if_packet.h>    //struct sockaddr_ll, PACKET_AUXDATA
+#include <linux/filter.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include "dhcpOptions.h"
+#include "sharedState.h"
+#include "taskScheduler.h"
+#include "deviceIdentity.h"
+#include "dhcpClient.h"
+
+#define DHCP_CLIENT_RETRANSMIT_MIN_MS 1000
+#define DHCP_CLIENT_RETRANSMIT_MAX_MS 16000
+#define DHCP_CLIENT_REBOOT_ATTEMPTS 2   //DHCPREQUESTs for a cached lease before giving up on it
+#define DHCP_CLIENT_REQUEST_ATTEMPTS 4  //DHCPREQUESTs for an offer before starting again
+#define DHCP_CLIENT_RENEW_MIN_MS 5000   //Shortest gap between renewing/rebinding DHCPREQUESTs
+#define DHCP_CLIENT_METRIC 200          //Default route metric is this + ifindex (+100 for wireless)
+#define DHCP_INFINITE_LEASE 0xFFFFFFFF
+
+//Commands to a client thread
+#define DHCP_COMMAND_NONE 0
+#define DHCP_COMMAND_RENEW 1
+#define DHCP_COMMAND_STOP 2
+#define DHCP_COMMAND_RELEASE 3          //Stop, and give the lease back
+
+typedef struct {
+    int inUse;
+    int threadRunning;
+    char interface[IF_NAMESIZE];
+    pthread_t thread;
+    int wakeFd;
+    _Atomic int command;
+    sharedState state; //DHCP_CLIENT_BOUND etc. Can be waited on. Only the client thread changes it once it's going
+    _Atomic uint32_t renewsRequested; //Bumped by startDHCPClient()
+    _Atomic uint32_t renewsAnswered; //renewsRequested as it was when the acquisition that got the lease began
+    uint32_t renewsTaken; //renewsRequested at the last beginAcquisition() (client thread only)
+    pthread_mutex_t mutex; //Guards everything below that getDHCPClientStatus() reads
+    //Interface
+    int ifindex;
+    uint8_t mac[6];
+    int carrier;
+    int metric;
+    //Lease (current, or cached)
+    dhcpClientLease lease;
+    int haveLease;
+    uint64_t leaseStartMs; //CLOCK_MONOTONIC (mS) equivalent of lease.obtained
+    int applied; //lease.address is on the interface
+    struct in_addr appliedRouter;
+    //Exchange in progress
+    uint32_t xid;
+    struct in_addr offered;
+    struct in_addr offerServer;
+    uint64_t exchangeStartMs;
+    uint64_t nextSendMs; //Next retransmit (0 for none)
+    uint32_t retransmitMs;
+    int attempts;
+    //Report
+    uint32_t lastExchangeMs;
+    const char *lastMethod;
+    char lastEvent[DHCP_CLIENT_EVENT_LENGTH];
+    uint32_t leasesObtained;
+    uint32_t naks;
+    //Sockets (client thread only)
+    int packetFd;
+    int udpFd;
+    int netlinkFd;
+} dhcpClient;
+
+static dhcpClient clients[DHCP_CLIENT_MAX_INTERFACES];
+static pthread_mutex_t clientsMutex = PTHREAD_MUTEX_INITIALIZER; //Guards clients[] being added to, and threads being started/stopped
+
+const char *dhcpClientStateToString(int state) {
+    switch (state) {
+        case DHCP_CLIENT_STOPPED: return "stopped";
+        case DHCP_CLIENT_INIT: return "discovering";
+        case DHCP_CLIENT_REQUESTING: return "requesting";
+        case DHCP_CLIENT_REBOOTING: return "rebooting";
+        case DHCP_CLIENT_BOUND: return "bound";
+        case DHCP_CLIENT_RENEWING: return "renewing";
+        case DHCP_CLIENT_REBINDING: return "rebinding";
+        default: return "unknown";
+    }
+}
+
+static int isBound(int state) {
+    return (state == DHCP_CLIENT_BOUND) || (state == DHCP_CLIENT_RENEWING) || (state == DHCP_CLIENT_REBINDING);
+}
+
+static void setEvent(dhcpClient *client, const char *format, const char *detail) {
+    //Records (and prints) what just happened
+    pthread_mutex_lock(&client->mutex);
+    snprintf(client->lastEvent, DHCP_CLIENT_EVENT_LENGTH, format, detail);
+    pthread_mutex_unlock(&client->mutex);
+    printf("dhcpClient(): %s: ", client->interface);
+    printf(format, detail);
+    printf("\n");
+}
+
+static int prefixLength(struct in_addr netmask) {
+    uint32_t mask = ntohl(netmask.s_addr);
+    int length = 0;
+    while (mask & 0x80000000) {
+        length++;
+        mask <<= 1;
+    }
+    return length;
+}
+
+/*
+ * Lease cache
+ */
+static void saveLease(dhcpClient *client) {
+    //Written to a temporary file and renamed, so a half written one is never read
+    char path[128], temporaryPath[140];
+    snprintf(path, sizeof (path), DHCP_CLIENT_LEASE_FILENAME, client->interface);
+    snprintf(temporaryPath, sizeof (temporaryPath), "%s.new", path);
+    FILE *fp = fopen(temporaryPath, "w");
+    if (fp == NULL) {
+        perror("saveLease(): fopen()");
+        return;
+    }
+    char address[INET_ADDRSTRLEN], netmask[INET_ADDRSTRLEN], router[INET_ADDRSTRLEN], server[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &client->lease.address, address, INET_ADDRSTRLEN);
+    inet_ntop(AF_INET, &client->lease.netmask, netmask, INET_ADDRSTRLEN);
+    inet_ntop(AF_INET, &client->lease.router, router, INET_ADDRSTRLEN);
+    inet_ntop(AF_INET, &client->lease.server, server, INET_ADDRSTRLEN);
+    fprintf(fp, "address=%s\nnetmask=%s\nrouter=%s\nserver=%s\nlease=%u\nrenew=%u\nrebind=%u\nobtained=%lld\n",
+            address, netmask, router, server, client->lease.leaseSeconds, client->lease.renewSeconds,
+            client->lease.rebindSeconds, (long long) client->lease.obtained);
+    int n;
+    for (n = 0; n < client->lease.dnsCount; n++) {
+        inet_ntop(AF_INET, &client->lease.dns[n], address, INET_ADDRSTRLEN);
+        fprintf(fp, "dns=%s\n", address);
+    }
+    fclose(fp);
+    if (rename(temporaryPath, path) < 0) perror("saveLease(): rename()");
+}
+
+static void forgetLease(dhcpClient *client) {
+    pthread_mutex_lock(&client->mutex);
+    client->haveLease = 0;
+    pthread_mutex_unlock(&client->mutex);
+    char path[128];
+    snprintf(path, sizeof (path), DHCP_CLIENT_LEASE_FILENAME, client->interface);
+    unlink(path);
+}
+
+static uint32_t leaseRemainingSeconds(dhcpClientLease *lease) {
+    //By the wall clock (a cached lease may be from before we started)
+    if (lease->leaseSeconds == DHCP_INFINITE_LEASE) return DHCP_INFINITE_LEASE;
+    time_t now = time(NULL);
+    if ((now < lease->obtained) || (now - lease->obtained >= lease->leaseSeconds)) return 0;
+    return lease->leaseSeconds - (now - lease->obtained);
+}
+
+static void loadLease(dhcpClient *client) {
+    //Picks up the cached lease, if there is one and it hasn't run out
+    char path[128];
+    snprintf(path, sizeof (path), DHCP_CLIENT_LEASE_FILENAME, client->interface);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) return;
+    dhcpClientLease lease;
+    memset(&lease, 0, sizeof (lease));
+    char line[128], value[64];
+    long long obtained = 0;
+    int fields = 0;
+    while (fgets(line, sizeof (line), fp) != NULL) {
+        if (sscanf(line, "address=%63s", value) == 1) fields += inet_pton(AF_INET, value, &lease.address);
+        else if (sscanf(line, "netmask=%63s", value) == 1) fields += inet_pton(AF_INET, value, &lease.netmask);
+        else if (sscanf(line, "router=%63s", value) == 1) inet_pton(AF_INET, value, &lease.router);
+        else if (sscanf(line, "server=%63s", value) == 1) fields += inet_pton(AF_INET, value, &lease.server);
+        else if (sscanf(line, "lease=%u", &lease.leaseSeconds) == 1) fields++;
+        else if (sscanf(line, "renew=%u", &lease.renewSeconds) == 1) fields++;
+        else if (sscanf(line, "rebind=%u", &lease.rebindSeconds) == 1) fields++;
+        else if (sscanf(line, "obtained=%lld", &obtained) == 1) fields++;
+        else if ((sscanf(line, "dns=%63s", value) == 1) && (lease.dnsCount < DHCP_CLIENT_MAX_DNS))
+            lease.dnsCount += inet_pton(AF_INET, value, &lease.dns[lease.dnsCount]);
+    }
+    fclose(fp);
+    lease.obtained = (time_t) obtained;
+    if ((fields < 7) || (leaseRemainingSeconds(&lease) == 0)) return;
+    pthread_mutex_lock(&client->mutex);
+    client->lease = lease;
+    client->haveLease = 1;
+    uint32_t held = (uint32_t) (time(NULL) - lease.obtained);
+    uint64_t now = getSchedulerTimeMs();
+    client->leaseStartMs = (now > (uint64_t) held * 1000) ? now - (uint64_t) held * 1000 : 0;
+    pthread_mutex_unlock(&client->mutex);
+    char address[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &lease.address, address, INET_ADDRSTRLEN);
+    printf("dhcpClient(): %s: Cached lease for %s, %u s left\n", client->interface, address, leaseRemainingSeconds(&lease));
+}
+
+/*
+ * Putting a lease into effect (rtnetlink)
+ */
+static void addAttribute(struct nlmsghdr *header, int maxLength, int type, const void *data, int length) {
+    struct rtattr *attribute = (struct rtattr *) ((char *) header + NLMSG_ALIGN(header->nlmsg_len));
+    if (NLMSG_ALIGN(header->nlmsg_len) + RTA_LENGTH(length) > (unsigned) maxLength) return;
+    attribute->rta_type = type;
+    attribute->rta_len = RTA_LENGTH(length);
+    memcpy(RTA_DATA(attribute), data, length);
+    header->nlmsg_len = NLMSG_ALIGN(header->nlmsg_len) + RTA_LENGTH(length);
+}
+
+static int sendNetlinkRequest(struct nlmsghdr *request) {
+    //Sends a request and waits for the kernel's answer. Returns 0 on success, otherwise the (negative) errno
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) return -errno;
+    request->nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+    request->nlmsg_seq = 1;
+    int ret = -EIO;
+    if (send(fd, request, request->nlmsg_len, 0) < 0) ret = -errno;
+    else {
+        char buffer[4096];
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, 1000) == 1) {
+            int length = recv(fd, buffer, sizeof (buffer), 0);
+            struct nlmsghdr *header;
+            for (header = (struct nlmsghdr *) buffer; (length > 0) && NLMSG_OK(header, length); header = NLMSG_NEXT(header, length)) {
+                if (header->nlmsg_type == NLMSG_ERROR) {
+                    ret = ((struct nlmsgerr *) NLMSG_DATA(header))->error;
+                    break;
+                }
+            }
+        }
+    }
+    close(fd);
+    return ret;
+}
+
+static int changeAddress(dhcpClient *client, int type, dhcpClientLease *lease) {
+    //RTM_NEWADDR (added, or its lifetime refreshed) or RTM_DELADDR. Returns 0 or -errno
+    struct {
+        struct nlmsghdr header;
+        struct ifaddrmsg message;
+        char attributes[256];
+    } request;
+    memset(&request, 0, sizeof (request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof (struct ifaddrmsg));
+    request.header.nlmsg_type = type;
+    if (type == RTM_NEWADDR) request.header.nlmsg_flags = NLM_F_CREATE | NLM_F_REPLACE;
+    request.message.ifa_family = AF_INET;
+    request.message.ifa_prefixlen = prefixLength(lease->netmask);
+    request.message.ifa_scope = RT_SCOPE_UNIVERSE;
+    request.message.ifa_index = client->ifindex;
+    addAttribute((struct nlmsghdr *) &request, sizeof (request), IFA_LOCAL, &lease->address, 4);
+    addAttribute((struct nlmsghdr *) &request, sizeof (request), IFA_ADDRESS, &lease->address, 4);
+    if (type == RTM_NEWADDR) {
+        struct in_addr broadcast;
+        broadcast.s_addr = lease->address.s_addr | ~lease->netmask.s_addr;
+        addAttribute((struct nlmsghdr *) &request, sizeof (request), IFA_BROADCAST, &broadcast, 4);
+        struct ifa_cacheinfo lifetime;
+        memset(&lifetime, 0, sizeof (lifetime));
+        lifetime.ifa_valid = leaseRemainingSeconds(lease); //Gone when the lease is, even if we aren't around
+        lifetime.ifa_prefered = lifetime.ifa_valid;
+        addAttribute((struct nlmsghdr *) &request, sizeof (request), IFA_CACHEINFO, &lifetime, sizeof (lifetime));
+    }
+    return sendNetlinkRequest(&request.header);
+}
+
+static int changeDefaultRoute(dhcpClient *client, int type, struct in_addr router, struct in_addr source) {
+    //RTM_NEWROUTE or RTM_DELROUTE for our default route via router. Returns 0 or -errno
+    struct {
+        struct nlmsghdr header;
+        struct rtmsg message;
+        char attributes[256];
+    } request;
+    memset(&request, 0, sizeof (request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof (struct rtmsg));
+    request.header.nlmsg_type = type;
+    if (type == RTM_NEWROUTE) request.header.nlmsg_flags = NLM_F_CREATE | NLM_F_REPLACE;
+    request.message.rtm_family = AF_INET;
+    request.message.rtm_dst_len = 0;
+    request.message.rtm_table = RT_TABLE_MAIN;
+    request.message.rtm_protocol = RTPROT_DHCP;
+    request.message.rtm_scope = RT_SCOPE_UNIVERSE;
+    request.message.rtm_type = RTN_UNICAST;
+    uint32_t metric = client->metric;
+    addAttribute((struct nlmsghdr *) &request, sizeof (request), RTA_GATEWAY, &router, 4);
+    addAttribute((struct nlmsghdr *) &request, sizeof (request), RTA_OIF, &client->ifindex, 4);
+    addAttribute((struct nlmsghdr *) &request, sizeof (request), RTA_PRIORITY, &metric, 4);
+    if (type == RTM_NEWROUTE) addAttribute((struct nlmsghdr *) &request, sizeof (request), RTA_PREFSRC, &source, 4);
+    return sendNetlinkRequest(&request.header);
+}
+
+static void removeLease(dhcpClient *client, dhcpClientLease *lease) {
+    //Takes lease's address (and our default route) off the interface. lease is whichever was applied
+    if (!client->applied) return;
+    if (client->appliedRouter.s_addr != 0) changeDefaultRoute(client, RTM_DELROUTE, client->appliedRouter, lease->address);
+    int ret = changeAddress(client, RTM_DELADDR, lease);
+    if ((ret < 0) && (ret != -EADDRNOTAVAIL)) printf("removeLease(): %s: Couldn't remove address: %s\n", client->interface, strerror(-ret));
+    client->applied = 0;
+    client->appliedRouter.s_addr = 0;
+}
+
+static int applyLease(dhcpClient *client, dhcpClientLease *previous) {
+    //Puts the (new or renewed) lease into effect. previous is what was applied before, if anything. Returns 0, or -1 on failure
+    if ((client->applied) && ((previous->address.s_addr != client->lease.address.s_addr) ||
+            (previous->netmask.s_addr != client->lease.netmask.s_addr))) removeLease(client, previous);
+    int ret = changeAddress(client, RTM_NEWADDR, &client->lease);
+    if (ret < 0) {
+        printf("applyLease(): %s: Couldn't set address: %s\n", client->interface, strerror(-ret));
+        return -1;
+    }
+    client->applied = 1;
+    if ((client->appliedRouter.s_addr != 0) && (client->appliedRouter.s_addr != client->lease.router.s_addr))
+        changeDefaultRoute(client, RTM_DELROUTE, client->appliedRouter, client->lease.address);
+    client->appliedRouter.s_addr = 0;
+    if (client->lease.router.s_addr != 0) {
+        ret = changeDefaultRoute(client, RTM_NEWROUTE, client->lease.router, client->lease.address);
+        if (ret < 0) printf("applyLease(): %s: Couldn't add default route: %s\n", client->interface, strerror(-ret));
+        else client->appliedRouter = client->lease.router;
+    }
+    return 0;
+}
+
+/*
+ * Sockets
+ */
+static int openPacketSocket(dhcpClient *client) {
+    //AF_PACKET socket on the interface, only passing UDP datagrams to port 68. Returns 0, or -1 on failure
+    static struct sock_filter filter[] = {//Offsets are from the IP header (SOCK_DGRAM)
+        BPF_STMT(BPF_LD + BPF_B + BPF_ABS, 9), //Protocol
+        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, IPPROTO_UDP, 0, 6),
+        BPF_STMT(BPF_LD + BPF_H + BPF_ABS, 6), //Flags/fragment offset
+        BPF_JUMP(BPF_JMP + BPF_JSET + BPF_K, 0x1FFF, 4, 0), //Not the first fragment
+        BPF_STMT(BPF_LDX + BPF_B + BPF_MSH, 0), //X = IP header length
+        BPF_STMT(BPF_LD + BPF_H + BPF_IND, 2), //UDP destination port
+        BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, IPPORT_DHCPC, 0, 1),
+        BPF_STMT(BPF_RET + BPF_K, 0xFFFF),
+        BPF_STMT(BPF_RET + BPF_K, 0)
+    };
+    struct sock_fprog program = {sizeof (filter) / sizeof (filter[0]), filter};
+    client->packetFd = socket(AF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, htons(ETH_P_IP));
+    if (client->packetFd < 0) {
+        perror("openPacketSocket(): socket()");
+        return -1;
+    }
+    if (setsockopt(client->packetFd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof (program)) < 0)
+        perror("openPacketSocket(): SO_ATTACH_FILTER"); //Works without, just sees more
+    int on = 1; //Say which frames haven't had their UDP checksum filled in yet (see receiveMessages())
+    if (setsockopt(client->packetFd, SOL_PACKET, PACKET_AUXDATA, &on, sizeof (on)) < 0) perror("openPacketSocket(): PACKET_AUXDATA");
+    struct sockaddr_ll address;
+    memset(&address, 0, sizeof (address));
+    address.sll_family = AF_PACKET;
+    address.sll_protocol = htons(ETH_P_IP);
+    address.sll_ifindex = client->ifindex;
+    if (bind(client->packetFd, (struct sockaddr *) &address, sizeof (address)) < 0) {
+        perror("openPacketSocket(): bind()");
+        close(client->packetFd);
+        client->packetFd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static void openUDPSocket(dhcpClient *client) {
+    //Port 68 on the interface, for unicast renewals. If it can't be had (e.g another client has it), renewals are broadcast
+    client->udpFd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (client->udpFd < 0) return;
+    int on = 1;
+    setsockopt(client->udpFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+    setsockopt(client->udpFd, SOL_SOCKET, SO_BROADCAST, &on, sizeof (on));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof (address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(IPPORT_DHCPC);
+    if ((setsockopt(client->udpFd, SOL_SOCKET, SO_BINDTODEVICE, client->interface, strlen(client->interface)) < 0) ||
+            (bind(client->udpFd, (struct sockaddr *) &address, sizeof (address)) < 0)) {
+        printf("openUDPSocket(): %s: Can't have port %d (%s). Renewals will be broadcast\n", client->interface, IPPORT_DHCPC, strerror(errno));
+        close(client->udpFd);
+        client->udpFd = -1;
+    }
+}
+
+static void closeSockets(dhcpClient *client) {
+    if (client->packetFd >= 0) close(client->packetFd);
+    if (client->udpFd >= 0) close(client->udpFd);
+    client->packetFd = -1;
+    client->udpFd = -1;
+}
+
+static int hasCarrier(const char *interface) {
+    //Returns 1 if the interface is up and running (cable in, or associated), 0 if not (or it isn't there)
+    struct ifreq request;
+    memset(&request, 0, sizeof (request));
+    snprintf(request.ifr_name, IF_NAMESIZE, "%s", interface);
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    int flags = 0;
+    if (fd >= 0) {
+        if (ioctl(fd, SIOCGIFFLAGS, &request) == 0) flags = request.ifr_flags;
+        close(fd);
+    }
+    return ((flags & IFF_UP) && (flags & IFF_RUNNING)) ? 1 : 0;
+}
+
+static int refreshInterface(dhcpClient *client) {
+    /*
+     * Looks the interface up (it may not have existed, or come back with a new index, e.g a USB dongle replugged),
+     * and opens the sockets for it. Returns 1 if it's there with a carrier, 0 if not
+     */
+    int ifindex = if_nametoindex(client->interface);
+    if (ifindex == 0) {
+        closeSockets(client);
+        client->ifindex = 0;
+        return 0;
+    }
+    if (ifindex != client->ifindex) {
+        struct ifreq request;
+        memset(&request, 0, sizeof (request));
+        snprintf(request.ifr_name, IF_NAMESIZE, "%s", client->interface);
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0) {
+            if (ioctl(fd, SIOCGIFHWADDR, &request) == 0) memcpy(client->mac, request.ifr_hwaddr.sa_data, 6);
+            close(fd);
+        }
+    }
+    if ((ifindex != client->ifindex) || (client->packetFd < 0)) {
+        closeSockets(client);
+        client->ifindex = ifindex;
+        char path[96];
+        snprintf(path, sizeof (path), "/sys/class/net/%s/wireless", client->interface);
+        client->metric = DHCP_CLIENT_METRIC + ifindex + ((access(path, F_OK) == 0) ? 100 : 0);
+        openPacketSocket(client);
+        openUDPSocket(client);
+    }
+    return hasCarrier(client->interface);
+}
+
+/*
+ * Messages
+ */
+static int sendMessage(dhcpClient *client, uint8_t messageType) {
+    //Builds and sends a DHCPDISCOVER, DHCPREQUEST or DHCPRELEASE for the current state. Returns 0, or -1 on failure
+    DHCP_TYPE message;
+    int state = getSharedState(&client->state);
+    memset(&message, 0, DHCP_HEADER_LENGTH + DHCP_REPLY_OPTIONS_LENGTH);
+    message.dp_op = 1; //Request
+    message.dp_htype = 1; //Ethernet
+    message.dp_hlen = 6;
+    message.dp_xid = client->xid;
+    uint64_t elapsed = (getSchedulerTimeMs() - client->exchangeStartMs) / 1000;
+    message.dp_secs = htons((elapsed > 0xFFFF) ? 0xFFFF : (uint16_t) elapsed);
+    memcpy(message.dp_chaddr, client->mac, 6);
+    memcpy(message.dp_magic, dhcpMagicCookie, 4);
+    int haveAddress = isBound(state) || (messageType == DHCPRELEASE); //RFC 2131 table 5: ciaddr only when renewing/rebinding/releasing
+    if (haveAddress) memcpy(message.dp_ciaddr, &client->lease.address.s_addr, 4);
+
+    dhcpOptionBuilder options;
+    initDHCPOptionBuilder(&options, message.dp_options, DHCP_REPLY_OPTIONS_LENGTH);
+    addDHCPOptionUint8(&options, DHCP_OPTION_MESSAGE_TYPE, messageType);
+    uint8_t clientId[7] = {1}; //Hardware type, then the MAC
+    memcpy(clientId + 1, client->mac, 6);
+    addDHCPOption(&options, DHCP_OPTION_CLIENT_ID, 7, clientId);
+    if (messageType == DHCPDISCOVER) {
+        addDHCPOption(&options, DHCP_OPTION_RAPID_COMMIT, 0, NULL);
+        if (client->haveLease) addDHCPOption(&options, DHCP_OPTION_REQUESTED_ADDRESS, 4, &client->lease.address); //A hint
+    } else if ((messageType == DHCPREQUEST) && (state == DHCP_CLIENT_REQUESTING)) {
+        addDHCPOption(&options, DHCP_OPTION_REQUESTED_ADDRESS, 4, &client->offered);
+        addDHCPOption(&options, DHCP_OPTION_SERVER_ID, 4, &client->offerServer);
+    } else if ((messageType == DHCPREQUEST) && (state == DHCP_CLIENT_REBOOTING)) {
+        addDHCPOption(&options, DHCP_OPTION_REQUESTED_ADDRESS, 4, &client->lease.address);
+    } else if (messageType == DHCPRELEASE) addDHCPOption(&options, DHCP_OPTION_SERVER_ID, 4, &client->lease.server);
+    if (messageType != DHCPRELEASE) {
+        char hostName[DEVICE_HOSTNAME_LENGTH];
+        int length = getDeviceHostName(hostName, DEVICE_HOSTNAME_LENGTH);
+        if (length > 0) addDHCPOption(&options, DHCP_OPTION_HOST_NAME, length, hostName);
+        static const uint8_t parameters[] = {DHCP_OPTION_SUBNET_MASK, DHCP_OPTION_ROUTER, DHCP_OPTION_DNS_SERVER,
+            DHCP_OPTION_LEASE_TIME, DHCP_OPTION_SERVER_ID, DHCP_OPTION_RENEWAL_TIME, DHCP_OPTION_REBINDING_TIME};
+        addDHCPOption(&options, DHCP_OPTION_PARAMETER_LIST, sizeof (parameters), parameters);
+    }
+    int length = DHCP_HEADER_LENGTH + finishDHCPOptions(&options);
+    if (length < DHCP_MIN_REPLY_LENGTH) length = DHCP_MIN_REPLY_LENGTH;
+
+    //Renewals and releases go straight to the server. Everything else is broadcast
+    if (((state == DHCP_CLIENT_RENEWING) || (messageType == DHCPRELEASE)) && (client->udpFd >= 0)) {
+        struct sockaddr_in server;
+        memset(&server, 0, sizeof (server));
+        server.sin_family = AF_INET;
+        server.sin_port = htons(IPPORT_DHCPS);
+        server.sin_addr = client->lease.server;
+        if (sendto(client->udpFd, &message, length, 0, (struct sockaddr *) &server, sizeof (server)) < 0) {
+            printf("sendMessage(): %s: sendto(): %s\n", client->interface, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+    if (client->packetFd < 0) return -1;
+    uint8_t frame[DHCP_FRAME_HEADER_LENGTH + sizeof (DHCP_TYPE)];
+    struct in_addr source, broadcast;
+    source.s_addr = haveAddress ? client->lease.address.s_addr : INADDR_ANY;
+    broadcast.s_addr = INADDR_BROADCAST;
+    int frameLength = buildDHCPFrame(frame, source, broadcast, IPPORT_DHCPC, IPPORT_DHCPS, &message, length);
+    struct sockaddr_ll destination;
+    memset(&destination, 0, sizeof (destination));
+    destination.sll_family = AF_PACKET;
+    destination.sll_protocol = htons(ETH_P_IP);
+    destination.sll_ifindex = client->ifindex;
+    destination.sll_halen = 6;
+    memset(destination.sll_addr, 0xFF, 6);
+    if (sendto(client->packetFd, frame, frameLength, 0, (struct sockaddr *) &destination, sizeof (destination)) < 0) {
+        printf("sendMessage(): %s: sendto(): %s\n", client->interface, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static void scheduleRetransmit(dhcpClient *client, uint64_t now) {
+    //Next try in retransmitMs +/-25%, then doubles it
+    uint32_t jitter = client->retransmitMs / 4;
+    client->nextSendMs = now + client->retransmitMs - jitter + (jitter > 0 ? (uint32_t) (rand() % (2 * jitter + 1)) : 0);
+    client->retransmitMs *= 2;
+    if (client->retransmitMs > DHCP_CLIENT_RETRANSMIT_MAX_MS) client->retransmitMs = DHCP_CLIENT_RETRANSMIT_MAX_MS;
+}
+
+static void startExchange(dhcpClient *client, int state) {
+    //Starts INIT, REBOOTING or REQUESTING with a new xid. The first message goes now (if there's a carrier)
+    uint64_t now = getSchedulerTimeMs();
+    setSharedState(&client->state, state);
+    if (state != DHCP_CLIENT_REQUESTING) { //A DHCPREQUEST for an offer carries on the DHCPDISCOVER's exchange
+        client->xid = (uint32_t) rand() ^ ((uint32_t) now << 16);
+        client->exchangeStartMs = now;
+    }
+    client->attempts = 0;
+    client->retransmitMs = DHCP_CLIENT_RETRANSMIT_MIN_MS;
+    client->nextSendMs = now; //Sent by handleTimers()
+}
+
+static void beginAcquisition(dhcpClient *client) {
+    //INIT-REBOOT with the lease we've got (or had), otherwise DISCOVER
+    if ((client->haveLease) && (leaseRemainingSeconds(&client->lease) == 0)) forgetLease(client);
+    client->renewsTaken = atomic_load(&client->renewsRequested); //Whatever lease this gets answers them
+    startExchange(client, client->haveLease ? DHCP_CLIENT_REBOOTING : DHCP_CLIENT_INIT);
+}
+
+static void leaseLost(dhcpClient *client, const char *why, const char *detail) {
+    //Takes the address away and starts again
+    setEvent(client, why, detail);
+    removeLease(client, &client->lease);
+    forgetLease(client);
+    startExchange(client, DHCP_CLIENT_INIT);
+}
+
+static void leaseBound(dhcpClient *client, DHCP_TYPE *ack, const char *method) {
+    //Takes the lease in the DHCPACK and puts it into effect
+    dhcpClientLease previous = client->lease;
+    dhcpClientLease lease;
+    memset(&lease, 0, sizeof (lease));
+    memcpy(&lease.address.s_addr, ack->dp_yiaddr, 4);
+    lease.netmask.s_addr = htonl(0xFFFFFF00); //If the server doesn't say
+    lease.leaseSeconds = DHCP_INFINITE_LEASE;
+    lease.obtained = time(NULL);
+    dhcpOptionIterator options;
+    dhcpOption option;
+    initDHCPOptionIterator(&options, ack->dp_options, DHCP_OPTIONS_LENGTH);
+    while (nextDHCPOption(&options, &option)) {
+        if (option.length < 4) continue;
+        uint32_t value;
+        memcpy(&value, option.value, 4);
+        switch (option.code) {
+            case DHCP_OPTION_SUBNET_MASK: lease.netmask.s_addr = value;
+                break;
+            case DHCP_OPTION_ROUTER: lease.router.s_addr = value; //The first one
+                break;
+            case DHCP_OPTION_SERVER_ID: lease.server.s_addr = value;
+                break;
+            case DHCP_OPTION_LEASE_TIME: lease.leaseSeconds = ntohl(value);
+                break;
+            case DHCP_OPTION_RENEWAL_TIME: lease.renewSeconds = ntohl(value);
+                break;
+            case DHCP_OPTION_REBINDING_TIME: lease.rebindSeconds = ntohl(value);
+                break;
+            case DHCP_OPTION_DNS_SERVER:
+                for (lease.dnsCount = 0; (lease.dnsCount < DHCP_CLIENT_MAX_DNS) && ((lease.dnsCount + 1) * 4 <= option.length); lease.dnsCount++)
+                    memcpy(&lease.dns[lease.dnsCount].s_addr, option.value + lease.dnsCount * 4, 4);
+                break;
+        }
+    }
+    if (lease.leaseSeconds != DHCP_INFINITE_LEASE) {
+        if ((lease.renewSeconds == 0) || (lease.renewSeconds >= lease.leaseSeconds)) lease.renewSeconds = lease.leaseSeconds / 2;
+        if ((lease.rebindSeconds <= lease.renewSeconds) || (lease.rebindSeconds >= lease.leaseSeconds))
+            lease.rebindSeconds = (uint32_t) ((uint64_t) lease.leaseSeconds * 7 / 8);
+    }
+    if (lease.server.s_addr == 0) lease.server = client->offerServer;
+
+    uint64_t now = getSchedulerTimeMs();
+    pthread_mutex_lock(&client->mutex);
+    client->lease = lease;
+    client->haveLease = 1;
+    client->leaseStartMs = now;
+    client->lastExchangeMs = (uint32_t) (now - client->exchangeStartMs);
+    client->lastMethod = method;
+    client->leasesObtained++;
+    pthread_mutex_unlock(&client->mutex);
+    client->nextSendMs = 0;
+    applyLease(client, &previous);
+    saveLease(client);
+
+    char address[INET_ADDRSTRLEN], router[INET_ADDRSTRLEN], server[INET_ADDRSTRLEN], event[DHCP_CLIENT_EVENT_LENGTH];
+    inet_ntop(AF_INET, &lease.address, address, INET_ADDRSTRLEN);
+    inet_ntop(AF_INET, &lease.router, router, INET_ADDRSTRLEN);
+    inet_ntop(AF_INET, &lease.server, server, INET_ADDRSTRLEN);
+    snprintf(event, DHCP_CLIENT_EVENT_LENGTH, "%s/%d from %s", address, prefixLength(lease.netmask), server);
+    setEvent(client, "%s", event);
+    atomic_store(&client->renewsAnswered, client->renewsTaken);
+    setSharedState(&client->state, DHCP_CLIENT_BOUND); //Last, so waitDHCPClientBound() returns with the address in place
+    printf("dhcpClient(): %s: Router %s, lease %u s. %s in %u mS\n", client->interface,
+            (lease.router.s_addr != 0) ? router : "none", lease.leaseSeconds, method, client->lastExchangeMs);
+}
+
+static void handleMessage(dhcpClient *client, DHCP_TYPE *reply, int length) {
+    //A DHCPOFFER, DHCPACK or DHCPNAK for us
+    if ((length < DHCP_HEADER_LENGTH) || (reply->dp_op != 2) || (reply->dp_xid != client->xid) ||
+            (memcmp(reply->dp_magic, dhcpMagicCookie, 4) != 0) || (memcmp(reply->dp_chaddr, client->mac, 6) != 0)) return;
+    int messageType = 0, rapidCommit = 0;
+    struct in_addr serverId = {0};
+    dhcpOptionIterator options;
+    dhcpOption option;
+    initDHCPOptionIterator(&options, reply->dp_options, length - DHCP_HEADER_LENGTH);
+    while (nextDHCPOption(&options, &option)) {
+        if ((option.code == DHCP_OPTION_MESSAGE_TYPE) && (option.length == 1)) messageType = option.value[0];
+        else if ((option.code == DHCP_OPTION_SERVER_ID) && (option.length == 4)) memcpy(&serverId.s_addr, option.value, 4);
+        else if (option.code == DHCP_OPTION_RAPID_COMMIT) rapidCommit = 1;
+    }
+    char server[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &serverId, server, INET_ADDRSTRLEN);
+    int state = getSharedState(&client->state);
+
+    if (messageType == DHCPNAK) {
+        if ((state == DHCP_CLIENT_INIT) || (state == DHCP_CLIENT_BOUND)) return; //Not waiting for an answer
+        if ((state == DHCP_CLIENT_REQUESTING) && (serverId.s_addr != client->offerServer.s_addr)) return;
+        pthread_mutex_lock(&client->mutex);
+        client->naks++;
+        pthread_mutex_unlock(&client->mutex);
+        leaseLost(client, "NAK from %s", server);
+        return;
+    }
+    switch (state) {
+        case DHCP_CLIENT_INIT:
+            if ((messageType == DHCPACK) && (rapidCommit)) leaseBound(client, reply, "rapid commit");
+            else if ((messageType == DHCPOFFER) && (serverId.s_addr != 0)) {
+                memcpy(&client->offered.s_addr, reply->dp_yiaddr, 4);
+                client->offerServer = serverId;
+                startExchange(client, DHCP_CLIENT_REQUESTING); //Take the first offer
+            }
+            break;
+        case DHCP_CLIENT_REQUESTING:
+            if ((messageType == DHCPACK) && ((serverId.s_addr == 0) || (serverId.s_addr == client->offerServer.s_addr)))
+                leaseBound(client, reply, "DORA");
+            break;
+        case DHCP_CLIENT_REBOOTING:
+            if (messageType == DHCPACK) leaseBound(client, reply, "INIT-REBOOT");
+            break;
+        case DHCP_CLIENT_RENEWING:
+        case DHCP_CLIENT_REBINDING:
+            if (messageType == DHCPACK) leaseBound(client, reply, (state == DHCP_CLIENT_RENEWING) ? "renewal" : "rebinding");
+            break;
+    }
+}
+
+static void receiveMessages(dhcpClient *client) {
+    //Everything waiting on the packet socket
+    uint8_t frame[DHCP_FRAME_HEADER_LENGTH + sizeof (DHCP_TYPE)];
+    char control[CMSG_SPACE(sizeof (struct tpacket_auxdata))];
+    DHCP_TYPE reply;
+    for (;;) {
+        struct sockaddr_ll from;
+        struct iovec buffer = {frame, sizeof (frame)};
+        struct msghdr header;
+        memset(&header, 0, sizeof (header));
+        header.msg_name = &from;
+        header.msg_namelen = sizeof (from);
+        header.msg_iov = &buffer;
+        header.msg_iovlen = 1;
+        header.msg_control = control;
+        header.msg_controllen = sizeof (control);
+        int frameLength = recvmsg(client->packetFd, &header, 0);
+        if (frameLength < 0) return; //EAGAIN: that's all of them
+        if (from.sll_pkttype == PACKET_OUTGOING) continue; //One of ours
+        int checksumReady = 1;
+        struct cmsghdr *message;
+        for (message = CMSG_FIRSTHDR(&header); message != NULL; message = CMSG_NXTHDR(&header, message)) {
+            if ((message->cmsg_level == SOL_PACKET) && (message->cmsg_type == PACKET_AUXDATA)) {
+                struct tpacket_auxdata auxdata;
+                memcpy(&auxdata, CMSG_DATA(message), sizeof (auxdata));
+                if (auxdata.tp_status & TP_STATUS_CSUMNOTREADY) checksumReady = 0;
+            }
+        }
+        const uint8_t *payload;
+        int length = parseDHCPFrame(frame, frameLength, IPPORT_DHCPC, checksumReady, &payload);
+        if (length < DHCP_HEADER_LENGTH) continue;
+        if (length > (int) sizeof (DHCP_TYPE)) length = sizeof (DHCP_TYPE);
+        memset(&reply, 0, sizeof (reply));
+        memcpy(&reply, payload, length);
+        handleMessage(client, &reply, length);
+    }
+}
+
+static void handleTimers(dhcpClient *client) {
+    //Retransmits, and moves through RENEWING/REBINDING/expiry as the lease ages
+    uint64_t now = getSchedulerTimeMs();
+    int state = getSharedState(&client->state);
+    if (isBound(state) && (client->lease.leaseSeconds != DHCP_INFINITE_LEASE)) {
+        uint64_t renewAt = client->leaseStartMs + (uint64_t) client->lease.renewSeconds * 1000;
+        uint64_t rebindAt = client->leaseStartMs + (uint64_t) client->lease.rebindSeconds * 1000;
+        uint64_t expireAt = client->leaseStartMs + (uint64_t) client->lease.leaseSeconds * 1000;
+        if (now >= expireAt) {
+            leaseLost(client, "%s", "lease expired");
+            return;
+        }
+        int due = (now >= rebindAt) ? DHCP_CLIENT_REBINDING : (now >= renewAt) ? DHCP_CLIENT_RENEWING : DHCP_CLIENT_BOUND;
+        if (due != state) { //Start renewing/rebinding, with a new xid
+            setSharedState(&client->state, due);
+            client->xid = (uint32_t) rand() ^ ((uint32_t) now << 16);
+            client->exchangeStartMs = now;
+            client->nextSendMs = now;
+            state = due;
+        }
+        if ((state != DHCP_CLIENT_BOUND) && (client->carrier) && (now >= client->nextSendMs)) {
+            sendMessage(client, DHCPREQUEST);
+            //Half the time left to T2 (or expiry), as RFC 2131 4.4.5
+            uint64_t until = (state == DHCP_CLIENT_RENEWING) ? rebindAt : expireAt;
+            uint64_t wait = (until - now) / 2;
+            client->nextSendMs = now + ((wait < DHCP_CLIENT_RENEW_MIN_MS) ? DHCP_CLIENT_RENEW_MIN_MS : wait);
+        }
+        return;
+    }
+    if ((isBound(state)) || (!client->carrier) || (client->nextSendMs == 0) || (now < client->nextSendMs)) return;
+    if ((state == DHCP_CLIENT_REBOOTING) && (client->attempts >= DHCP_CLIENT_REBOOT_ATTEMPTS)) {
+        setEvent(client, "%s", "no answer for the cached lease");
+        startExchange(client, DHCP_CLIENT_INIT); //Keep the lease as a hint
+        state = DHCP_CLIENT_INIT;
+    } else if ((state == DHCP_CLIENT_REQUESTING) && (client->attempts >= DHCP_CLIENT_REQUEST_ATTEMPTS)) {
+        setEvent(client, "%s", "no answer to DHCPREQUEST");
+        startExchange(client, DHCP_CLIENT_INIT);
+        state = DHCP_CLIENT_INIT;
+    }
+    sendMessage(client, (state == DHCP_CLIENT_INIT) ? DHCPDISCOVER : DHCPREQUEST);
+    client->attempts++;
+    scheduleRetransmit(client, now);
+}
+
+static int nextTimeoutMs(dhcpClient *client) {
+    //How long poll() can sleep for (-1 for as long as it likes)
+    uint64_t now = getSchedulerTimeMs();
+    uint64_t next = 0;
+    int state = getSharedState(&client->state);
+    if (isBound(state) && (client->lease.leaseSeconds != DHCP_INFINITE_LEASE)) {
+        next = client->leaseStartMs + (uint64_t) client->lease.leaseSeconds * 1000; //Expiry
+        uint64_t stateChange = client->leaseStartMs + (uint64_t) ((state == DHCP_CLIENT_BOUND) ? client->lease.renewSeconds : client->lease.rebindSeconds) * 1000;
+        if ((state != DHCP_CLIENT_REBINDING) && (stateChange < next)) next = stateChange;
+        if ((state != DHCP_CLIENT_BOUND) && (client->carrier) && (client->nextSendMs < next)) next = client->nextSendMs;
+    } else if ((!isBound(state)) && (client->carrier)) next = client->nextSendMs;
+    if (next == 0) return -1;
+    if (next <= now) return 0;
+    return (next - now > 60000) ? 60000 : (int) (next - now); //Wall clock changes are picked up within a minute
+}
+
+static void handleLinkMessages(dhcpClient *client) {
+    //Starts again (INIT-REBOOT, if we've a lease) when the carrier comes back, e.g wlan0 associating with a network
+    char buffer[8192];
+    int changed = 0;
+    for (;;) {
+        int length = recv(client->netlinkFd, buffer, sizeof (buffer), MSG_DONTWAIT);
+        if (length <= 0) break;
+        struct nlmsghdr *header;
+        for (header = (struct nlmsghdr *) buffer; NLMSG_OK(header, length); header = NLMSG_NEXT(header, length))
+            if ((header->nlmsg_type == RTM_NEWLINK) || (header->nlmsg_type == RTM_DELLINK)) changed = 1;
+    }
+    if (!changed) return; //Someone else's. Cheaper to look at ours again than to parse them
+    int carrier = refreshInterface(client);
+    if (carrier == client->carrier) return;
+    pthread_mutex_lock(&client->mutex);
+    client->carrier = carrier;
+    pthread_mutex_unlock(&client->mutex);
+    if (!carrier) {
+        printf("dhcpClient(): %s: No carrier\n", client->interface);
+        return;
+    }
+    printf("dhcpClient(): %s: Carrier\n", client->interface);
+    closeSockets(client); //A packet socket whose interface went down fails its next send with ENETDOWN
+    refreshInterface(client);
+    beginAcquisition(client); //Might be a different network. Check the lease's still good
+}
+
+static void *dhcpClientThread(void *arg) {
+    /*
+     * PThread: One per interface. Sleeps in poll() until a reply, a link change, a timer or a command
+     */
+    dhcpClient *client = (dhcpClient *) arg;
+    client->packetFd = -1;
+    client->udpFd = -1;
+    client->ifindex = 0;
+    client->netlinkFd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+    if (client->netlinkFd >= 0) {
+        struct sockaddr_nl address;
+        memset(&address, 0, sizeof (address));
+        address.nl_family = AF_NETLINK;
+        address.nl_groups = RTMGRP_LINK;
+        if (bind(client->netlinkFd, (struct sockaddr *) &address, sizeof (address)) < 0) {
+            perror("dhcpClientThread(): bind(netlink)");
+            close(client->netlinkFd);
+            client->netlinkFd = -1;
+        }
+    }
+    if (client->netlinkFd < 0) printf("dhcpClient(): %s: No link notifications. Carrier changes won't be noticed\n", client->interface);
+    pthread_mutex_lock(&client->mutex);
+    client->carrier = refreshInterface(client);
+    pthread_mutex_unlock(&client->mutex);
+    if (client->ifindex == 0) printf("dhcpClient(): %s: Not there (yet)\n", client->interface);
+    if (!client->haveLease) loadLease(client);
+    beginAcquisition(client);
+
+    for (;;) {
+        int command = atomic_exchange(&client->command, DHCP_COMMAND_NONE);
+        if (command == DHCP_COMMAND_RENEW) beginAcquisition(client);
+        else if ((command == DHCP_COMMAND_STOP) || (command == DHCP_COMMAND_RELEASE)) {
+            if ((command == DHCP_COMMAND_RELEASE) && (isBound(getSharedState(&client->state)))) {
+                sendMessage(client, DHCPRELEASE);
+                removeLease(client, &client->lease);
+                forgetLease(client);
+                setEvent(client, "%s", "released");
+            }
+            break;
+        }
+        handleTimers(client);
+
+        struct pollfd fds[4];
+        int count = 0;
+        fds[count].fd = client->wakeFd;
+        fds[count++].events = POLLIN;
+        if (client->netlinkFd >= 0) {
+            fds[count].fd = client->netlinkFd;
+            fds[count++].events = POLLIN;
+        }
+        int packetIndex = -1, udpIndex = -1;
+        if (client->packetFd >= 0) {
+            packetIndex = count;
+            fds[count].fd = client->packetFd;
+            fds[count++].events = POLLIN;
+        }
+        if (client->udpFd >= 0) {
+            udpIndex = count;
+            fds[count].fd = client->udpFd;
+            fds[count++].events = POLLIN;
+        }
+        int timeoutMs = nextTimeoutMs(client);
+        if ((timeoutMs < 0) && (client->netlinkFd < 0)) timeoutMs = 1000; //Keep checking the carrier ourselves
+        if (poll(fds, count, timeoutMs) < 0) {
+            if (errno != EINTR) perror("dhcpClientThread(): poll()");
+            continue;
+        }
+        if (fds[0].revents & POLLIN) {
+            uint64_t value;
+            if (read(client->wakeFd, &value, sizeof (value)) < 0) perror("dhcpClientThread(): read()");
+        }
+        if ((client->netlinkFd >= 0) && (fds[1].revents & POLLIN)) handleLinkMessages(client);
+        else if (client->netlinkFd < 0) {
+            int carrier = refreshInterface(client);
+            if (carrier != client->carrier) {
+                client->carrier = carrier;
+                if (carrier) beginAcquisition(client);
+            }
+        }
+        if ((packetIndex >= 0) && (fds[packetIndex].revents & POLLIN) && (client->packetFd >= 0)) receiveMessages(client);
+        if ((udpIndex >= 0) && (fds[udpIndex].revents & POLLIN) && (client->udpFd >= 0)) {
+            char discard[DHCP_FRAME_HEADER_LENGTH + sizeof (DHCP_TYPE)];
+            while (recv(client->udpFd, discard, sizeof (discard), 0) > 0); //The packet socket sees these too
+        }
+    }
+    closeSockets(client);
+    if (client->netlinkFd >= 0) close(client->netlinkFd);
+    client->netlinkFd = -1;
+    setSharedState(&client->state, DHCP_CLIENT_STOPPED);
+    return NULL;
+}
+
+static dhcpClient *findClient(const char *interface) {
+    //clientsMutex held
+    int n;
+    for (n = 0; n < DHCP_CLIENT_MAX_INTERFACES; n++)
+        if ((clients[n].inUse) && (strcmp(clients[n].interface, interface) == 0)) return &clients[n];
+    return NULL;
+}
+
+int startDHCPClient(const char *interface) {
+    /*
+     * Starts getting a lease for interface (which needn't exist yet). If its client's already running, it checks
+     * its lease again (INIT-REBOOT), as after reconnecting to a network.
+     * Returns 0 on success, -1 on failure
+     */
+    if ((interface == NULL) || (strlen(interface) == 0) || (strlen(interface) >= IF_NAMESIZE)) return -1;
+    pthread_mutex_lock(&clientsMutex);
+    dhcpClient *client = findClient(interface);
+    int n;
+    for (n = 0; (client == NULL) && (n < DHCP_CLIENT_MAX_INTERFACES); n++) {
+        if (!clients[n].inUse) {
+            client = &clients[n];
+            memset(client, 0, sizeof (dhcpClient));
+            client->inUse = 1;
+            strcpy(client->interface, interface);
+            client->wakeFd = -1;
+            initSharedState(&client->state, DHCP_CLIENT_STOPPED);
+            pthread_mutex_init(&client->mutex, NULL);
+        }
+    }
+    if (client == NULL) {
+        pthread_mutex_unlock(&clientsMutex);
+        printf("startDHCPClient(): No room for %s. Already running %d clients\n", interface, DHCP_CLIENT_MAX_INTERFACES);
+        return -1;
+    }
+    int ret = 0;
+    atomic_fetch_add(&client->renewsRequested, 1); //So waitDHCPClientBound() waits for the new lease, not the old
+    if (client->threadRunning) {
+        atomic_store(&client->command, DHCP_COMMAND_RENEW);
+        uint64_t one = 1;
+        if (write(client->wakeFd, &one, sizeof (one)) < 0) perror("startDHCPClient(): write()");
+    } else {
+        srand(time(NULL) ^ getpid());
+        client->wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        atomic_store(&client->command, DHCP_COMMAND_NONE);
+        setSharedState(&client->state, DHCP_CLIENT_INIT); //So waitDHCPClientBound() waits, even before the thread's going
+        pthread_mutex_lock(&client->mutex);
+        client->carrier = hasCarrier(interface); //Before the thread's first look, for getDHCPClientStatus()
+        pthread_mutex_unlock(&client->mutex);
+        if ((client->wakeFd < 0) || (pthread_create(&client->thread, NULL, dhcpClientThread, client))) {
+            printf("startDHCPClient(): Error creating dhcp client thread for %s.\n", interface);
+            if (client->wakeFd >= 0) close(client->wakeFd);
+            client->wakeFd = -1;
+            setSharedState(&client->state, DHCP_CLIENT_STOPPED);
+            ret = -1;
+        } else client->threadRunning = 1;
+    }
+    pthread_mutex_unlock(&clientsMutex);
+    return ret;
+}
+
+int stopDHCPClient(const char *interface, int release) {
+    /*
+     * Stops the interface's client. With release = 1 the lease is given back (DHCPRELEASE) and the address removed,
+     * otherwise the address stays until the lease runs out, and the lease is kept for next time (INIT-REBOOT).
+     * Returns 0, or -1 if it wasn't running
+     */
+    pthread_mutex_lock(&clientsMutex);
+    dhcpClient *client = findClient(interface);
+    if ((client == NULL) || (!client->threadRunning)) {
+        pthread_mutex_unlock(&clientsMutex);
+        return -1;
+    }
+    atomic_store(&client->command, release ? DHCP_COMMAND_RELEASE : DHCP_COMMAND_STOP);
+    uint64_t one = 1;
+    if (write(client->wakeFd, &one, sizeof (one)) < 0) perror("stopDHCPClient(): write()");
+    pthread_join(client->thread, NULL);
+    close(client->wakeFd);
+    client->wakeFd = -1;
+    client->threadRunning = 0;
+    pthread_mutex_unlock(&clientsMutex);
+    return 0;
+}
+
+int waitDHCPClientBound(const char *interface, int timeoutMs) {
+    /*
+     * Waits (timeoutMs = -1 for as long as it takes) for the interface to have a lease, got since the last
+     * startDHCPClient() (so not the one it had before a renew). Returns 1 once it has, 0 if it timed out
+     * (or the client isn't running)
+     */
+    pthread_mutex_lock(&clientsMutex);
+    dhcpClient *client = findClient(interface);
+    pthread_mutex_unlock(&clientsMutex); //Entries are never removed, so client stays valid
+    if (client == NULL) return 0;
+    uint64_t deadline = getSchedulerTimeMs() + ((timeoutMs > 0) ? timeoutMs : 0);
+    uint32_t requested = atomic_load(&client->renewsRequested);
+    int state = getSharedState(&client->state);
+    while ((!isBound(state)) || ((int32_t) (atomic_load(&client->renewsAnswered) - requested) < 0)) {
+        if (state == DHCP_CLIENT_STOPPED) return 0;
+        int remaining = -1;
+        if (timeoutMs >= 0) {
+            uint64_t now = getSchedulerTimeMs();
+            if (now >= deadline) return 0;
+            remaining = deadline - now;
+        }
+        state = waitSharedStateChange(&client->state, state, remaining);
+    }
+    return 1;
+}
+
+int getDHCPClientStatus(const char *interface, dhcpClientStatus *status) {
+    //Fills in status for the interface's client. Returns 0, or -1 if there's never been one
+    memset(status, 0, sizeof (dhcpClientStatus));
+    pthread_mutex_lock(&clientsMutex);
+    dhcpClient *client = findClient(interface);
+    pthread_mutex_unlock(&clientsMutex);
+    if (client == NULL) return -1;
+    pthread_mutex_lock(&client->mutex);
+    strcpy(status->interface, client->interface);
+    status->state = getSharedState(&client->state);
+    status->carrier = client->carrier;
+    status->haveLease = client->haveLease;
+    status->lease = client->lease;
+    status->remainingSeconds = client->haveLease ? leaseRemainingSeconds(&client->lease) : 0;
+    status->lastExchangeMs = client->lastExchangeMs;
+    status->lastMethod = client->lastMethod;
+    strcpy(status->lastEvent, client->lastEvent);
+    status->leasesObtained = client->leasesObtained;
+    status->naks = client->naks;
+    pthread_mutex_unlock(&client->mutex);
+    return 0;
+}
+
+int printDHCPClientReport(char output[], int outputLength, const char *lineEnd) {
+    /*
+     * Writes one line per interface into output[] (state, address, lease left, how it was got and how long it took),
+     * each ended with lineEnd ("\n", or "<br>" for the status page).
+     * Returns the no. of chars written, 0 if no client has been started
+     */
+    if (outputLength < 1) return 0;
+    output[0] = 0;
+    char names[DHCP_CLIENT_MAX_INTERFACES][IF_NAMESIZE];
+    int count = 0, n;
+    pthread_mutex_lock(&clientsMutex);
+    for (n = 0; n < DHCP_CLIENT_MAX_INTERFACES; n++)
+        if (clients[n].inUse) strcpy(names[count++], clients[n].interface);
+    pthread_mutex_unlock(&clientsMutex);
+    if (count == 0) return 0;
+
+    int length = snprintf(output, outputLength, "DHCP clients:%s", lineEnd);
+    for (n = 0; (n < count) && (length < outputLength); n++) {
+        dhcpClientStatus status;
+        if (getDHCPClientStatus(names[n], &status) < 0) continue;
+        length += snprintf(output + length, outputLength - length, "    %s: %s%s", status.interface,
+                dhcpClientStateToString(status.state), ((status.state != DHCP_CLIENT_STOPPED) && (!status.carrier)) ? " (no carrier)" : "");
+        if ((isBound(status.state)) && (length < outputLength)) {
+            char address[INET_ADDRSTRLEN], router[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &status.lease.address, address, INET_ADDRSTRLEN);
+            inet_ntop(AF_INET, &status.lease.router, router, INET_ADDRSTRLEN);
+            length += snprintf(output + length, outputLength - length, ", %s/%d", address, prefixLength(status.lease.netmask));
+            if ((status.lease.router.s_addr != 0) && (length < outputLength))
+                length += snprintf(output + length, outputLength - length, " via %s", router);
+            if ((status.lease.leaseSeconds == DHCP_INFINITE_LEASE) && (length < outputLength))
+                length += snprintf(output + length, outputLength - length, ", no expiry");
+            else if (length < outputLength) length += snprintf(output + length, outputLength - length, ", %u s left", status.remainingSeconds);
+        }
+        if ((status.lastMethod != NULL) && (length < outputLength))
+            length += snprintf(output + length, outputLength - length, ", last lease: %s in %u mS",
+                status.lastMethod, status.lastExchangeMs);
+        if ((status.lastEvent[0] != 0) && (length < outputLength))
+            length += snprintf(output + length, outputLength - length, " (%s)", status.lastEvent);
+        if (length < outputLength) length += snprintf(output + length, outputLength - length, "%s", lineEnd);
+    }
+    return (length < outputLength) ? length : outputLength - 1;
+}
@@ -0,0 +1,85 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   dhcpClient.h
+ *
+ * Built-in DHCP client, one per interface (see dhcpClient.c)
+ */
+
+#ifndef DHCPCLIENT_H
+#define DHCPCLIENT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "dhcpClient.h" TO THE SOURCE FILE
+
+#include <stdint.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <net/if.h>
+
+#define DHCP_CLIENT_MAX_INTERFACES 4
+#define DHCP_CLIENT_MAX_DNS 3
+#define DHCP_CLIENT_LEASE_FILENAME "/tmp/piconfigserver_dhcpclient_%s.lease" //Cached lease, for INIT-REBOOT
+#define DHCP_CLIENT_EVENT_LENGTH 64
+
+//Client states (RFC 2131 4.4)
+#define DHCP_CLIENT_STOPPED 0
+#define DHCP_CLIENT_INIT 1          //Sending DHCPDISCOVERs
+#define DHCP_CLIENT_REQUESTING 2    //Got an offer, sent a DHCPREQUEST for it
+#define DHCP_CLIENT_REBOOTING 3     //INIT-REBOOT: asking for the cached lease back
+#define DHCP_CLIENT_BOUND 4
+#define DHCP_CLIENT_RENEWING 5      //Past T1, asking the server that gave the lease to extend it
+#define DHCP_CLIENT_REBINDING 6     //Past T2, asking any server
+
+typedef struct {
+    struct in_addr address;
+    struct in_addr netmask;
+    struct in_addr router; //0.0.0.0 if none
+    struct in_addr server; //Server identifier (option 54)
+    struct in_addr dns[DHCP_CLIENT_MAX_DNS];
+    int dnsCount;
+    uint32_t leaseSeconds; //0xFFFFFFFF for infinite
+    uint32_t renewSeconds; //T1
+    uint32_t rebindSeconds; //T2
+    time_t obtained; //Wall clock time of the DHCPACK (so a cached lease can be checked after a restart)
+} dhcpClientLease;
+
+typedef struct {
+    char interface[IF_NAMESIZE];
+    int state;
+    int carrier; //0 while the interface is down/not associated (nothing is sent)
+    int haveLease; //lease is current (bound) or cached, and not expired
+    dhcpClientLease lease;
+    uint32_t remainingSeconds; //Of the lease
+    uint32_t lastExchangeMs; //How long the last lease took to get, from the first message sent
+    const char *lastMethod; //How it was got: "INIT-REBOOT", "rapid commit", "DORA", "renewal", "rebinding"
+    char lastEvent[DHCP_CLIENT_EVENT_LENGTH]; //e.g "NAK from 192.168.3.1", "lease expired"
+    uint32_t leasesObtained;
+    uint32_t naks;
+} dhcpClientStatus;
+
+int startDHCPClient(const char *interface);
+int stopDHCPClient(const char *interface, int release);
+int waitDHCPClientBound(const char *interface, int timeoutMs);
+int getDHCPClientStatus(const char *interface, dhcpClientStatus *status);
+const char *dhcpClientStateToString(int state);
+int printDHCPClientReport(char output[], int outputLength, const char *lineEnd);
+
+//AND BEFORE HERE
+#endif /* DHCPCLIENT_H */
+
@@ -0,0 +1,680 @@
+/*
+ * Address pool and lease table for the DHCP server (dhcpServer2.c)
+ *
+ * The server used to hold three hard-coded leases (192.168.0.16-18) and search them linearly. A pool
+ * is now any range of addresses within the server's subnet (up to DHCP_POOL_MAX_SIZE addresses):-
+ *
+ *      -leases[] has one fixed size record per address, so an address <-> lease no. is just a subtraction
+ *      -freeMap has one bit per address (set = free). freeSummary has one bit per freeMap word
+ *       (set = that word has a free address), so finding a free address is two count-trailing-zeros,
+ *       plus a scan of freeSummary which is only 16 words long for a 64k address pool
+ *      -index is an open addressing (linear probe) hash table from the client's key (hardware type + MAC,
+ *       or a client identifier) to its lease. It's kept at least half empty, and entries are removed
+ *       by shifting the rest of the probe sequence back, so there are no tombstones to build up
+ *
+ * The server's own address, and the subnet's network and broadcast addresses are never handed out,
+ * even if they fall within the range.
+ *
+ * Lease lifecycle:-
+ *
+ *      FREE/EXPIRED --allocate+offer--> OFFERED --bind (DHCPREQUEST)--> BOUND --expiry/DHCPRELEASE--> EXPIRED
+ *      OFFERED --hold time up--> FREE (the client never came back)
+ *      OFFERED/BOUND --DHCPDECLINE--> DECLINED --hold time up--> FREE
+ *
+ * Each lease has a timer in a hierarchical timer wheel (timerWheel.c), ticking once a second, so the
+ * cost of expiring leases is O(1) per tick plus the leases that actually expire, however big the pool.
+ * An EXPIRED lease keeps its key, so a client that comes back gets the same address, unless it's been
+ * given to someone else in the meantime (the old binding is dropped at that point).
+ *
+ * Lease file:-
+ *
+ * attachDHCPLeaseFile() moves leases[] into a file (a dhcpLeaseFileHeader followed by one dhcpLease record
+ * per address), mapped with mmap(MAP_SHARED). Leases are updated in place, so there's no log to write or
+ * replay. Changes are noted as a dirty range of records, and syncDHCPLeaseFile() msync()s just those pages,
+ * at most once every DHCP_LEASE_SYNC_SECONDS however many leases changed in between.
+ * If the file already holds records for the same pool, they're reloaded with a single pass over the
+ * records, rebuilding freeMap, the index and the timers. So restarting the server (or the whole program)
+ * keeps everyone's address.
+ *
+ * benchmarkDHCPLeasePool() times allocation, lookup, release/re-allocation, reclaiming unconfirmed
+ * offers and reloading the lease file for pools of 3 addresses up to maxPoolSize (e.g: piConfigServer -benchdhcppool 65536)
+ */
+
+#define _POSIX_C_SOURCE 200809L //For clock_gettime() with -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include "dhcpLeasePool.h"
+
+#define DHCP_LEASE_FILE_MAGIC "PCSL"
+
+static uint32_t hashKey(uint8_t key[], int keyLength) {
+    //FNV-1a
+    uint32_t hash = 2166136261u;
+    int n;
+    for (n = 0; n < keyLength; n++) {
+        hash ^= key[n];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t monotonicSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) now.tv_sec;
+}
+
+static void markLeaseDirty(dhcpLeasePool *pool, uint32_t lease) {
+    //Notes that a record needs writing back to the lease file
+    if (lease < pool->dirtyFirst) pool->dirtyFirst = lease;
+    if (lease > pool->dirtyLast) pool->dirtyLast = lease;
+}
+
+static int isAddressFree(dhcpLeasePool *pool, uint32_t n) {
+    return (pool->freeMap[n / 64] >> (n % 64)) & 1;
+}
+
+static void markAddressUsed(dhcpLeasePool *pool, uint32_t n) {
+    if (!isAddressFree(pool, n)) return;
+    pool->freeMap[n / 64] &= ~(1ULL << (n % 64));
+    if (pool->freeMap[n / 64] == 0) //Word now full
+        pool->freeSummary[n / 4096] &= ~(1ULL << ((n / 64) % 64));
+    pool->freeCount--;
+}
+
+static void markAddressFree(dhcpLeasePool *pool, uint32_t n) {
+    if (isAddressFree(pool, n)) return;
+    pool->freeMap[n / 64] |= 1ULL << (n % 64);
+    pool->freeSummary[n / 4096] |= 1ULL << ((n / 64) % 64);
+    pool->freeCount++;
+}
+
+static int takeFreeAddress(dhcpLeasePool *pool) {
+    //Returns the lowest free address in the pool (as a lease no.), or -1 if the pool is full
+    uint32_t summaryWords = (pool->freeMapWords + 63) / 64;
+    uint32_t s;
+    for (s = 0; s < summaryWords; s++) {
+        if (pool->freeSummary[s] != 0) {
+            uint32_t word = s * 64 + __builtin_ctzll(pool->freeSummary[s]);
+            return (int) (word * 64 + __builtin_ctzll(pool->freeMap[word]));
+        }
+    }
+    return -1;
+}
+
+static void reserveAddress(dhcpLeasePool *pool, uint32_t address) {
+    //Takes an address (host byte order) out of the pool for good, if it's in the range
+    if ((address >= pool->firstAddress) && (address - pool->firstAddress < pool->size))
+        markAddressUsed(pool, address - pool->firstAddress);
+}
+
+static void resetFreeMap(dhcpLeasePool *pool) {
+    //Every address free, apart from the reserved ones
+    memset(pool->freeMap, 0, pool->freeMapWords * sizeof (uint64_t));
+    memset(pool->freeSummary, 0, ((pool->freeMapWords + 63) / 64) * sizeof (uint64_t));
+    pool->freeCount = 0;
+    uint32_t n;
+    for (n = 0; n < pool->size; n++) markAddressFree(pool, n);
+
+    uint32_t server = ntohl(pool->serverAddress.s_addr);
+    uint32_t mask = ntohl(pool->netmask.s_addr);
+    reserveAddress(pool, server);
+    reserveAddress(pool, server & mask); //Network address
+    reserveAddress(pool, server | ~mask); //Broadcast address
+}
+
+int initDHCPLeasePool(dhcpLeasePool *pool, struct in_addr serverAddress, struct in_addr netmask,
+        struct in_addr firstAddress, struct in_addr lastAddress) {
+    /*
+     * Sets up a pool handing out firstAddress to lastAddress (inclusive). The range has to be
+     * within serverAddress/netmask.
+     * Returns 0 on success, -1 on error
+     *
+     * Sample usage:-
+     *      dhcpLeasePool pool;
+     *      struct in_addr server, mask, first, last;
+     *      inet_aton("192.168.0.11", &server); inet_aton("255.255.255.0", &mask);
+     *      inet_aton("192.168.0.16", &first); inet_aton("192.168.0.254", &last);
+     *      if (initDHCPLeasePool(&pool, server, mask, first, last) == 0) {
+     *          int lease = allocateDHCPLease(&pool, mac, 6, requestedAddress);
+     *          ...
+     *          freeDHCPLeasePool(&pool);
+     *      }
+     */
+    memset(pool, 0, sizeof (dhcpLeasePool));
+    uint32_t first = ntohl(firstAddress.s_addr);
+    uint32_t last = ntohl(lastAddress.s_addr);
+    uint32_t server = ntohl(serverAddress.s_addr);
+    uint32_t mask = ntohl(netmask.s_addr);
+    if (last < first) {
+        printf("initDHCPLeasePool(): Last address comes before the first\n");
+        return -1;
+    }
+    if (((first & mask) != (server & mask)) || ((last & mask) != (server & mask))) {
+        printf("initDHCPLeasePool(): Address range isn't within the server's subnet\n");
+        return -1;
+    }
+    if (last - first >= DHCP_POOL_MAX_SIZE) {
+        printf("initDHCPLeasePool(): Address range too large (max %d addresses)\n", DHCP_POOL_MAX_SIZE);
+        return -1;
+    }
+    pool->serverAddress = serverAddress;
+    pool->netmask = netmask;
+    pool->firstAddress = first;
+    pool->size = last - first + 1;
+    pool->freeMapWords = (pool->size + 63) / 64;
+
+    uint32_t indexSize = 16;
+    while (indexSize < pool->size * 2) indexSize *= 2; //Keep the hash table at most half full
+    pool->indexMask = indexSize - 1;
+
+    pool->freeMap = calloc(pool->freeMapWords, sizeof (uint64_t));
+    pool->freeSummary = calloc((pool->freeMapWords + 63) / 64, sizeof (uint64_t));
+    pool->leases = calloc(pool->size, sizeof (dhcpLease));
+    pool->index = calloc(indexSize, sizeof (uint32_t));
+    if ((pool->freeMap == NULL) || (pool->freeSummary == NULL) || (pool->leases == NULL) || (pool->index == NULL)) {
+        printf("initDHCPLeasePool(): calloc()\n");
+        freeDHCPLeasePool(pool);
+        return -1;
+    }
+    if (initTimerWheel(&pool->timers, pool->size, monotonicSeconds()) == -1) {
+        freeDHCPLeasePool(pool);
+        return -1;
+    }
+    pool->dirtyFirst = UINT32_MAX; //Nothing dirty
+    pool->dirtyLast = 0;
+    resetFreeMap(pool);
+    return 0;
+}
+
+int isDHCPLeasePoolSame(dhcpLeasePool *pool, struct in_addr serverAddress, struct in_addr netmask,
+        struct in_addr firstAddress, struct in_addr lastAddress) {
+    //Returns 1 if the pool has been set up with exactly these settings, otherwise 0
+    return (pool->leases != NULL) && (pool->serverAddress.s_addr == serverAddress.s_addr) &&
+            (pool->netmask.s_addr == netmask.s_addr) && (pool->firstAddress == ntohl(firstAddress.s_addr)) &&
+            (pool->firstAddress + pool->size - 1 == ntohl(lastAddress.s_addr));
+}
+
+void freeDHCPLeasePool(dhcpLeasePool *pool) {
+    free(pool->freeMap);
+    free(pool->freeSummary);
+    if (pool->leaseFileMap != NULL) { //Leases live in the file
+        syncDHCPLeaseFile(pool, 1);
+        munmap(pool->leaseFileMap, pool->leaseFileLength);
+    } else free(pool->leases);
+    free(pool->index);
+    freeTimerWheel(&pool->timers);
+    memset(pool, 0, sizeof (dhcpLeasePool));
+}
+
+void clearDHCPLeasePool(dhcpLeasePool *pool) {
+    //Forgets every lease (the range stays the same)
+    if (pool->leases == NULL) return;
+    memset(pool->leases, 0, pool->size * sizeof (dhcpLease));
+    memset(pool->index, 0, (pool->indexMask + 1) * sizeof (uint32_t));
+    clearTimerWheel(&pool->timers);
+    resetFreeMap(pool);
+    markLeaseDirty(pool, 0);
+    markLeaseDirty(pool, pool->size - 1);
+}
+
+static uint32_t findIndexSlot(dhcpLeasePool *pool, uint8_t key[], int keyLength) {
+    //Returns the slot holding key, or the empty slot where it would go
+    uint32_t slot = hashKey(key, keyLength) & pool->indexMask;
+    while (pool->index[slot] != 0) {
+        dhcpLease *lease = &pool->leases[pool->index[slot] - 1];
+        if ((lease->keyLength == keyLength) && (memcmp(lease->key, key, keyLength) == 0)) break;
+        slot = (slot + 1) & pool->indexMask;
+    }
+    return slot;
+}
+
+static void removeIndexSlot(dhcpLeasePool *pool, uint32_t slot) {
+    /*
+     * Empties slot, then moves back any later entries in the same probe run that can no longer be
+     * reached from their home slot (backward shift deletion)
+     */
+    uint32_t hole = slot, next = slot;
+    while (1) {
+        next = (next + 1) & pool->indexMask;
+        if (pool->index[next] == 0) break;
+        dhcpLease *lease = &pool->leases[pool->index[next] - 1];
+        uint32_t home = hashKey(lease->key, lease->keyLength) & pool->indexMask;
+        //Leave the entry where it is if its home slot is (cyclically) after the hole
+        if ((hole <= next) ? ((hole < home) && (home <= next)) : ((hole < home) || (home <= next))) continue;
+        pool->index[hole] = pool->index[next];
+        hole = next;
+    }
+    pool->index[hole] = 0;
+}
+
+int findDHCPLease(dhcpLeasePool *pool, uint8_t key[], int keyLength) {
+    //Returns the lease no. held by key, or -1 if it doesn't have one
+    if ((pool->leases == NULL) || (keyLength < 1) || (keyLength > DHCP_LEASE_KEY_LENGTH)) return -1;
+    uint32_t slot = findIndexSlot(pool, key, keyLength);
+    return (int) pool->index[slot] - 1;
+}
+
+int findDHCPLeaseByAddress(dhcpLeasePool *pool, struct in_addr address) {
+    //Returns the lease no. for address if it's offered or bound to a client, otherwise -1
+    uint32_t offset = ntohl(address.s_addr) - pool->firstAddress;
+    if ((pool->leases == NULL) || (offset >= pool->size)) return -1;
+    if ((pool->leases[offset].state != DHCP_LEASE_OFFERED) && (pool->leases[offset].state != DHCP_LEASE_BOUND)) return -1;
+    return (int) offset;
+}
+
+int isDHCPPoolAddress(dhcpLeasePool *pool, struct in_addr address) {
+    //Returns 1 if address is within the pool's range, otherwise 0
+    return (pool->leases != NULL) && (ntohl(address.s_addr) - pool->firstAddress < pool->size);
+}
+
+static void forgetLease(dhcpLeasePool *pool, int lease) {
+    //Drops a lease's key (if it has one) from the index, and cancels its timer
+    dhcpLease *record = &pool->leases[lease];
+    if (record->keyLength != 0) removeIndexSlot(pool, findIndexSlot(pool, record->key, record->keyLength));
+    cancelTimer(&pool->timers, lease);
+    memset(record, 0, sizeof (dhcpLease));
+    markLeaseDirty(pool, lease);
+}
+
+int allocateDHCPLease(dhcpLeasePool *pool, uint8_t key[], int keyLength, struct in_addr requestedAddress) {
+    /*
+     * Returns the lease no. for key. If key already has a lease (or had one that's expired, and the
+     * address is still free), that's the one returned. Otherwise requestedAddress (0.0.0.0 for none)
+     * is used if it's free, or else the lowest free address. A new lease starts off OFFERED, with no
+     * timer running (see offerDHCPLease()).
+     * Returns -1 if the pool is full
+     */
+    if ((pool->leases == NULL) || (keyLength < 1) || (keyLength > DHCP_LEASE_KEY_LENGTH)) return -1;
+    uint32_t slot = findIndexSlot(pool, key, keyLength);
+    if (pool->index[slot] != 0) { //Already has one
+        int lease = (int) pool->index[slot] - 1;
+        if (pool->leases[lease].state == DHCP_LEASE_EXPIRED) {
+            markAddressUsed(pool, lease);
+            pool->leases[lease].state = DHCP_LEASE_OFFERED;
+            markLeaseDirty(pool, lease);
+        }
+        return lease;
+    }
+
+    int lease = -1;
+    if (requestedAddress.s_addr != 0) {
+        uint32_t offset = ntohl(requestedAddress.s_addr) - pool->firstAddress;
+        if ((offset < pool->size) && isAddressFree(pool, offset)) lease = (int) offset;
+    }
+    if (lease == -1) lease = takeFreeAddress(pool);
+    if (lease == -1) return -1; //Pool full
+
+    if (pool->leases[lease].keyLength != 0) { //Someone else's expired lease. Forget it
+        forgetLease(pool, lease);
+        slot = findIndexSlot(pool, key, keyLength); //The removal may have moved things about
+    }
+    markAddressUsed(pool, lease);
+    memcpy(pool->leases[lease].key, key, keyLength);
+    pool->leases[lease].keyLength = (uint8_t) keyLength;
+    pool->leases[lease].state = DHCP_LEASE_OFFERED;
+    pool->index[slot] = lease + 1;
+    markLeaseDirty(pool, lease);
+    return lease;
+}
+
+static int isLeaseValid(dhcpLeasePool *pool, int lease) {
+    return (pool->leases != NULL) && (lease >= 0) && ((uint32_t) lease < pool->size);
+}
+
+int releaseDHCPLease(dhcpLeasePool *pool, int lease) {
+    /*
+     * Returns the address to the pool and forgets who had it.
+     * Returns 0 on success, -1 if the lease wasn't in use
+     */
+    if (!isLeaseValid(pool, lease)) return -1;
+    if (pool->leases[lease].state == DHCP_LEASE_FREE) return -1;
+    forgetLease(pool, lease);
+    markAddressFree(pool, lease);
+    return 0;
+}
+
+int offerDHCPLease(dhcpLeasePool *pool, int lease, uint32_t holdSeconds) {
+    /*
+     * Holds an OFFERED lease for holdSeconds, after which it's reclaimed unless bindDHCPLease() has been
+     * called. A BOUND lease is left as it is (a client can DHCPDISCOVER again while its lease is running).
+     * Returns 0 on success, -1 if the lease isn't OFFERED or BOUND
+     */
+    if (!isLeaseValid(pool, lease)) return -1;
+    if (pool->leases[lease].state == DHCP_LEASE_BOUND) return 0;
+    if (pool->leases[lease].state != DHCP_LEASE_OFFERED) return -1;
+    scheduleTimer(&pool->timers, lease, pool->timers.now + holdSeconds);
+    pool->leases[lease].expires = time(NULL) + holdSeconds;
+    markLeaseDirty(pool, lease);
+    return 0;
+}
+
+int bindDHCPLease(dhcpLeasePool *pool, int lease, uint32_t leaseSeconds) {
+    //(Re)starts a lease for leaseSeconds. Returns 0 on success, -1 if the lease isn't OFFERED or BOUND
+    if (!isLeaseValid(pool, lease)) return -1;
+    if ((pool->leases[lease].state != DHCP_LEASE_OFFERED) && (pool->leases[lease].state != DHCP_LEASE_BOUND)) return -1;
+    pool->leases[lease].state = DHCP_LEASE_BOUND;
+    scheduleTimer(&pool->timers, lease, pool->timers.now + leaseSeconds);
+    pool->leases[lease].expires = time(NULL) + leaseSeconds;
+    markLeaseDirty(pool, lease);
+    return 0;
+}
+
+int expireDHCPLease(dhcpLeasePool *pool, int lease) {
+    /*
+     * Ends a lease (it's run out, or the client sent a DHCPRELEASE). The address goes back in the pool,
+     * but the client keeps first call on it.
+     * Returns 0 on success, -1 if the lease isn't OFFERED or BOUND
+     */
+    if (!isLeaseValid(pool, lease)) return -1;
+    if ((pool->leases[lease].state != DHCP_LEASE_OFFERED) && (pool->leases[lease].state != DHCP_LEASE_BOUND)) return -1;
+    cancelTimer(&pool->timers, lease);
+    pool->leases[lease].state = DHCP_LEASE_EXPIRED;
+    markAddressFree(pool, lease);
+    markLeaseDirty(pool, lease);
+    return 0;
+}
+
+int declineDHCPLease(dhcpLeasePool *pool, int lease, uint32_t holdSeconds) {
+    /*
+     * The client found the address already in use (DHCPDECLINE). Forgets the client and keeps the address
+     * out of the pool for holdSeconds.
+     * Returns 0 on success, -1 if the lease isn't OFFERED or BOUND
+     */
+    if (!isLeaseValid(pool, lease)) return -1;
+    if ((pool->leases[lease].state != DHCP_LEASE_OFFERED) && (pool->leases[lease].state != DHCP_LEASE_BOUND)) return -1;
+    forgetLease(pool, lease);
+    pool->leases[lease].state = DHCP_LEASE_DECLINED;
+    scheduleTimer(&pool->timers, lease, pool->timers.now + holdSeconds);
+    pool->leases[lease].expires = time(NULL) + holdSeconds;
+    return 0;
+}
+
+static void leaseTimerExpired(int lease, void *context) {
+    dhcpLeasePool *pool = (dhcpLeasePool *) context;
+    switch (pool->leases[lease].state) {
+        case DHCP_LEASE_OFFERED: //Never confirmed
+        case DHCP_LEASE_DECLINED:
+            releaseDHCPLease(pool, lease);
+            break;
+        case DHCP_LEASE_BOUND:
+            expireDHCPLease(pool, lease);
+            break;
+    }
+}
+
+int advanceDHCPLeasePool(dhcpLeasePool *pool, uint32_t now) {
+    /*
+     * Brings the pool's clock up to 'now' (seconds, from CLOCK_MONOTONIC) and expires or reclaims
+     * any leases whose time is up. Call this before handling each message, and at least once a second
+     * while pool->timers.pending != 0.
+     * Returns the no. of leases that changed state
+     */
+    if (pool->leases == NULL) return 0;
+    return advanceTimerWheel(&pool->timers, now, leaseTimerExpired, pool);
+}
+
+uint32_t getDHCPLeaseRemaining(dhcpLeasePool *pool, int lease) {
+    //Returns the seconds left before a lease (or offer, or decline) runs out, 0 if no timer is running
+    if (!isLeaseValid(pool, lease) || !isTimerScheduled(&pool->timers, lease)) return 0;
+    return pool->timers.entries[lease].expires - pool->timers.now;
+}
+
+const char *dhcpLeaseStateToString(int state) {
+    switch (state) {
+        case DHCP_LEASE_FREE: return "free";
+        case DHCP_LEASE_OFFERED: return "offered";
+        case DHCP_LEASE_BOUND: return "bound";
+        case DHCP_LEASE_EXPIRED: return "expired";
+        case DHCP_LEASE_DECLINED: return "declined";
+    }
+    return "unknown";
+}
+
+struct in_addr getDHCPLeaseAddress(dhcpLeasePool *pool, int lease) {
+    struct in_addr address;
+    address.s_addr = htonl(pool->firstAddress + lease);
+    return address;
+}
+
+static void reloadLeases(dhcpLeasePool *pool, uint32_t maxRemaining) {
+    /*
+     * Rebuilds freeMap, the index and the timers from leases[] (just mapped from the lease file), in one pass.
+     * Records that don't make sense are wiped. Time left is worked out from the wall clock, and capped at
+     * maxRemaining in case the clock has gone backwards since the file was written
+     */
+    memset(pool->index, 0, (pool->indexMask + 1) * sizeof (uint32_t));
+    clearTimerWheel(&pool->timers);
+    resetFreeMap(pool);
+    time_t now = time(NULL);
+    uint32_t n;
+    for (n = 0; n < pool->size; n++) {
+        dhcpLease *record = &pool->leases[n];
+        if ((record->state == DHCP_LEASE_FREE) && (record->keyLength == 0)) continue;
+
+        int valid;
+        if (record->state == DHCP_LEASE_DECLINED) valid = (record->keyLength == 0);
+        else valid = ((record->state == DHCP_LEASE_OFFERED) || (record->state == DHCP_LEASE_BOUND) || (record->state == DHCP_LEASE_EXPIRED)) &&
+                (record->keyLength >= 1) && (record->keyLength <= DHCP_LEASE_KEY_LENGTH);
+        if (valid && (record->state != DHCP_LEASE_EXPIRED)) valid = isAddressFree(pool, n); //Not a reserved address
+        if (valid && (record->keyLength != 0)) {
+            uint32_t slot = findIndexSlot(pool, record->key, record->keyLength);
+            if (pool->index[slot] != 0) valid = 0; //Same client twice
+            else pool->index[slot] = n + 1;
+        }
+        if (!valid) {
+            memset(record, 0, sizeof (dhcpLease));
+            markLeaseDirty(pool, n);
+            continue;
+        }
+        if (record->state == DHCP_LEASE_EXPIRED) continue; //Address stays free
+
+        markAddressUsed(pool, n);
+        int64_t remaining = (int64_t) record->expires - (int64_t) now;
+        if (remaining < 0) remaining = 0; //Ran out while we weren't running. Dealt with on the next tick
+        if (remaining > maxRemaining) remaining = maxRemaining;
+        scheduleTimer(&pool->timers, n, pool->timers.now + (uint32_t) remaining);
+    }
+}
+
+int attachDHCPLeaseFile(dhcpLeasePool *pool, char path[], uint32_t maxRemaining) {
+    /*
+     * Keeps the pool's leases in 'path' from now on. If the file holds leases for the same pool (e.g the
+     * server has been restarted) they're reloaded, otherwise the file is (re)created from the leases held
+     * in memory. maxRemaining is the longest a reloaded lease can have left (the longest lease time).
+     * Returns 1 if leases were reloaded, 0 if the file was created, -1 on error (the leases stay in memory)
+     *
+     * Sample usage:-
+     *      initDHCPLeasePool(&pool, server, mask, first, last);
+     *      attachDHCPLeaseFile(&pool, "/tmp/piconfigserver_dhcp.leases", 600);
+     *      ...
+     *      freeDHCPLeasePool(&pool); //Syncs and unmaps the file
+     */
+    if ((pool->leases == NULL) || (pool->leaseFileMap != NULL)) return -1;
+    size_t length = sizeof (dhcpLeaseFileHeader) + (size_t) pool->size * sizeof (dhcpLease);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        perror("attachDHCPLeaseFile(): open()");
+        return -1;
+    }
+    struct stat fileStatus;
+    int sameSize = (fstat(fd, &fileStatus) == 0) && ((size_t) fileStatus.st_size == length);
+    if (!sameSize && (ftruncate(fd, length) == -1)) {
+        perror("attachDHCPLeaseFile(): ftruncate()");
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); //The mapping keeps the file open
+    if (map == MAP_FAILED) {
+        perror("attachDHCPLeaseFile(): mmap()");
+        return -1;
+    }
+
+    dhcpLeaseFileHeader *header = (dhcpLeaseFileHeader *) map;
+    int reload = sameSize && (memcmp(header->magic, DHCP_LEASE_FILE_MAGIC, 4) == 0) &&
+            (header->version == DHCP_LEASE_FILE_VERSION) && (header->recordSize == sizeof (dhcpLease)) &&
+            (header->serverAddress == pool->serverAddress.s_addr) && (header->netmask == pool->netmask.s_addr) &&
+            (header->firstAddress == htonl(pool->firstAddress)) && (header->size == pool->size);
+    dhcpLease *records = (dhcpLease *) ((char *) map + sizeof (dhcpLeaseFileHeader));
+    if (!reload) { //New file, or one for a different pool
+        memset(header, 0, sizeof (dhcpLeaseFileHeader));
+        memcpy(header->magic, DHCP_LEASE_FILE_MAGIC, 4);
+        header->version = DHCP_LEASE_FILE_VERSION;
+        header->recordSize = sizeof (dhcpLease);
+        header->serverAddress = pool->serverAddress.s_addr;
+        header->netmask = pool->netmask.s_addr;
+        header->firstAddress = htonl(pool->firstAddress);
+        header->size = pool->size;
+        memcpy(records, pool->leases, pool->size * sizeof (dhcpLease));
+    }
+    free(pool->leases);
+    pool->leases = records;
+    pool->leaseFileMap = map;
+    pool->leaseFileLength = length;
+    if (reload) reloadLeases(pool, maxRemaining);
+    else {
+        markLeaseDirty(pool, 0);
+        markLeaseDirty(pool, pool->size - 1);
+        msync(map, sizeof (dhcpLeaseFileHeader), MS_SYNC);
+    }
+    syncDHCPLeaseFile(pool, 1);
+    return reload;
+}
+
+int isDHCPLeaseFileDirty(dhcpLeasePool *pool) {
+    //Returns 1 if there are changes that syncDHCPLeaseFile() hasn't written out yet
+    return (pool->leaseFileMap != NULL) && (pool->dirtyFirst <= pool->dirtyLast);
+}
+
+int syncDHCPLeaseFile(dhcpLeasePool *pool, int force) {
+    /*
+     * Flushes changed records to disk, if it's been DHCP_LEASE_SYNC_SECONDS since the last time (or force is set).
+     * Only the pages holding changed records are written.
+     * Returns 1 if anything was written, 0 if not, -1 on error
+     */
+    if (!isDHCPLeaseFileDirty(pool)) return 0;
+    uint32_t now = monotonicSeconds();
+    if (!force && (now - (uint32_t) pool->lastSync < DHCP_LEASE_SYNC_SECONDS)) return 0;
+    size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    size_t start = sizeof (dhcpLeaseFileHeader) + (size_t) pool->dirtyFirst * sizeof (dhcpLease);
+    size_t end = sizeof (dhcpLeaseFileHeader) + ((size_t) pool->dirtyLast + 1) * sizeof (dhcpLease);
+    start &= ~(pageSize - 1); //msync() needs a page aligned start
+    pool->dirtyFirst = UINT32_MAX;
+    pool->dirtyLast = 0;
+    pool->lastSync = now;
+    if (msync((char *) pool->leaseFileMap + start, end - start, MS_SYNC) == -1) {
+        perror("syncDHCPLeaseFile(): msync()");
+        return -1;
+    }
+    return 1;
+}
+
+static double elapsedNs(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+int benchmarkDHCPLeasePool(int maxPoolSize) {
+    /*
+     * Times allocateDHCPLease() (new clients), findDHCPLease() (known clients), release followed by
+     * re-allocation (churn), reclaiming offers that were never confirmed (the timer wheel) and reloading
+     * a full lease file, for a range of pool sizes. Every pool is filled completely.
+     * Returns 0 on success, -1 on error
+     */
+    int poolSizes[] = {3, 256, 4096, 65536, DHCP_POOL_MAX_SIZE - 2};
+    int noOfSizes = sizeof (poolSizes) / sizeof (poolSizes[0]);
+    struct in_addr server, mask, first, last;
+    struct timespec start, end;
+    dhcpLeasePool pool;
+    int s, n;
+    if (maxPoolSize < 3) maxPoolSize = 3;
+    inet_pton(AF_INET, "10.0.0.1", &server);
+    inet_pton(AF_INET, "255.0.0.0", &mask);
+    inet_pton(AF_INET, "10.0.0.2", &first);
+
+    char leaseFile[] = "/tmp/piconfigserver_benchdhcppool.leases";
+    printf("Pool size\tallocate (ns)\tlookup (ns)\trelease+reallocate (ns)\treclaim offer (ns)\treload file (ms)\n");
+    for (s = 0; s < noOfSizes; s++) {
+        int size = poolSizes[s];
+        if (size > maxPoolSize) size = maxPoolSize;
+        last.s_addr = htonl(ntohl(first.s_addr) + size - 1);
+        if (initDHCPLeasePool(&pool, server, mask, first, last) == -1) return -1;
+
+        uint8_t key[7] = {1, 0x02, 0, 0, 0, 0, 0}; //Hardware type 1 + locally administered MAC
+        struct in_addr noAddress;
+        noAddress.s_addr = 0;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (n = 0; n < size; n++) {
+            memcpy(&key[3], &n, 4);
+            if (allocateDHCPLease(&pool, key, 7, noAddress) == -1) {
+                printf("benchmarkDHCPLeasePool(): pool of %d full after %d leases\n", size, n);
+                freeDHCPLeasePool(&pool);
+                return -1;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double allocateNs = elapsedNs(&start, &end) / size;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (n = 0; n < size; n++) {
+            memcpy(&key[3], &n, 4);
+            if (findDHCPLease(&pool, key, 7) == -1) printf("benchmarkDHCPLeasePool(): lease %d lost\n", n);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double lookupNs = elapsedNs(&start, &end) / size;
+
+        //Churn: a client leaves and a new one takes its place
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (n = 0; n < size; n++) {
+            memcpy(&key[3], &n, 4);
+            releaseDHCPLease(&pool, findDHCPLease(&pool, key, 7));
+            int newClient = n + size;
+            memcpy(&key[3], &newClient, 4);
+            if (allocateDHCPLease(&pool, key, 7, noAddress) == -1) printf("benchmarkDHCPLeasePool(): reallocate failed\n");
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double churnNs = elapsedNs(&start, &end) / size;
+
+        //Every client goes away without confirming its offer. Spread the hold times over 64 seconds
+        for (n = 0; n < size; n++) offerDHCPLease(&pool, n, 30 + n % 64);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int reclaimed = advanceDHCPLeasePool(&pool, pool.timers.now + 30 + 64);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double reclaimNs = elapsedNs(&start, &end) / size;
+        if ((reclaimed != size) || (pool.freeCount != (uint32_t) size))
+            printf("benchmarkDHCPLeasePool(): only %d of %d offers reclaimed\n", reclaimed, size);
+
+        //Fill the pool again, this time in a lease file, then time reading it back in
+        unlink(leaseFile);
+        if (attachDHCPLeaseFile(&pool, leaseFile, 600) == -1) {
+            freeDHCPLeasePool(&pool);
+            return -1;
+        }
+        for (n = 0; n < size; n++) {
+            memcpy(&key[3], &n, 4);
+            bindDHCPLease(&pool, allocateDHCPLease(&pool, key, 7, noAddress), 600);
+        }
+        freeDHCPLeasePool(&pool);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        initDHCPLeasePool(&pool, server, mask, first, last);
+        int reloaded = attachDHCPLeaseFile(&pool, leaseFile, 600);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double reloadMs = elapsedNs(&start, &end) / 1e6;
+        if ((reloaded != 1) || (pool.freeCount != 0) || (pool.timers.pending != size))
+            printf("benchmarkDHCPLeasePool(): lease file reload failed (%u free, %d timers)\n", pool.freeCount, pool.timers.pending);
+
+        printf("%d\t\t%.1f\t\t%.1f\t\t%.1f\t\t\t%.1f\t\t\t%.2f\n", size, allocateNs, lookupNs, churnNs, reclaimNs, reloadMs);
+        freeDHCPLeasePool(&pool);
+        unlink(leaseFile);
+        if (size == maxPoolSize) break;
+    }
+    return 0;
+}
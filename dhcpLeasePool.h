@@ -0,0 +1,113 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   dhcpLeasePool.h
+ *
+ * Address pool and lease table for the DHCP server (see dhcpLeasePool.c)
+ */
+
+#ifndef DHCPLEASEPOOL_H
+#define DHCPLEASEPOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "dhcpLeasePool.h" TO THE SOURCE FILE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+#include "timerWheel.h"
+
+#define DHCP_LEASE_KEY_LENGTH 20        //Hardware type + chaddr, or a client identifier (option 61)
+#define DHCP_POOL_MAX_SIZE (1 << 20)    //Max no. of addresses in a pool
+#define DHCP_LEASE_FILE_VERSION 1
+#define DHCP_LEASE_SYNC_SECONDS 1       //Changes to the lease file are flushed to disk at most this often
+
+//Lease states
+#define DHCP_LEASE_FREE 0       //Address free, nobody has had it
+#define DHCP_LEASE_OFFERED 1    //Address offered, waiting for a DHCPREQUEST
+#define DHCP_LEASE_BOUND 2      //Client has the address
+#define DHCP_LEASE_EXPIRED 3    //Lease expired or released. Address free, but it goes back to the same client if possible
+#define DHCP_LEASE_DECLINED 4   //Client said the address is already in use. Held out of the pool for a while
+
+typedef struct {
+    uint8_t key[DHCP_LEASE_KEY_LENGTH]; //Who the address belongs to
+    uint8_t keyLength; //0 if the address isn't leased
+    uint8_t state; //DHCP_LEASE_FREE etc.
+    uint8_t reserved[2];
+    uint32_t expires; //Wall clock time (time()) the offer/lease/decline runs out. Only used when reloading the lease file
+} dhcpLease; //Fixed size record. One per address in the pool, and the lease file is an array of them
+
+typedef struct {
+    char magic[4]; //"PCSL"
+    uint32_t version; //DHCP_LEASE_FILE_VERSION
+    uint32_t recordSize; //sizeof(dhcpLease)
+    uint32_t serverAddress; //The pool the records belong to (network byte order)
+    uint32_t netmask;
+    uint32_t firstAddress;
+    uint32_t size; //No. of records following the header
+    uint32_t reserved;
+} dhcpLeaseFileHeader;
+
+typedef struct {
+    struct in_addr serverAddress;
+    struct in_addr netmask;
+    uint32_t firstAddress; //Host byte order
+    uint32_t size; //No. of addresses from firstAddress to the end of the range
+    uint32_t freeCount;
+    uint64_t *freeMap; //Bit set = address free
+    uint64_t *freeSummary; //Bit set = that freeMap word has at least one free bit
+    uint32_t freeMapWords;
+    dhcpLease *leases; //leases[n] is for address firstAddress + n
+    uint32_t *index; //Open addressing (linear probe) hash of key -> lease no. + 1. 0 = empty slot
+    uint32_t indexMask;
+    int rapidCommit; //1 to answer a DHCPDISCOVER carrying option 80 straight away with a DHCPACK (RFC 4039)
+    timerWheel timers; //Expiry time of each lease (timer id = lease no.), in seconds
+    //Lease file (see attachDHCPLeaseFile())
+    void *leaseFileMap; //NULL if leases[] is only in memory
+    size_t leaseFileLength;
+    uint32_t dirtyFirst, dirtyLast; //Range of leases changed since the last sync. dirtyFirst > dirtyLast if none
+    uint32_t lastSync; //CLOCK_MONOTONIC seconds
+} dhcpLeasePool;
+
+int initDHCPLeasePool(dhcpLeasePool *pool, struct in_addr serverAddress, struct in_addr netmask,
+        struct in_addr firstAddress, struct in_addr lastAddress);
+void freeDHCPLeasePool(dhcpLeasePool *pool);
+void clearDHCPLeasePool(dhcpLeasePool *pool);
+int isDHCPLeasePoolSame(dhcpLeasePool *pool, struct in_addr serverAddress, struct in_addr netmask,
+        struct in_addr firstAddress, struct in_addr lastAddress);
+int attachDHCPLeaseFile(dhcpLeasePool *pool, char path[], uint32_t maxRemaining);
+int syncDHCPLeaseFile(dhcpLeasePool *pool, int force);
+int isDHCPLeaseFileDirty(dhcpLeasePool *pool);
+int findDHCPLease(dhcpLeasePool *pool, uint8_t key[], int keyLength);
+int findDHCPLeaseByAddress(dhcpLeasePool *pool, struct in_addr address);
+int isDHCPPoolAddress(dhcpLeasePool *pool, struct in_addr address);
+int allocateDHCPLease(dhcpLeasePool *pool, uint8_t key[], int keyLength, struct in_addr requestedAddress);
+int releaseDHCPLease(dhcpLeasePool *pool, int lease);
+int offerDHCPLease(dhcpLeasePool *pool, int lease, uint32_t holdSeconds);
+int bindDHCPLease(dhcpLeasePool *pool, int lease, uint32_t leaseSeconds);
+int expireDHCPLease(dhcpLeasePool *pool, int lease);
+int declineDHCPLease(dhcpLeasePool *pool, int lease, uint32_t holdSeconds);
+int advanceDHCPLeasePool(dhcpLeasePool *pool, uint32_t now);
+uint32_t getDHCPLeaseRemaining(dhcpLeasePool *pool, int lease);
+const char *dhcpLeaseStateToString(int state);
+struct in_addr getDHCPLeaseAddress(dhcpLeasePool *pool, int lease);
+int benchmarkDHCPLeasePool(int maxPoolSize);
+
+//AND BEFORE HERE
+#endif /* DHCPLEASEPOOL_H */
+
@@ -0,0 +1,182 @@
+/*
+ * DHCP option (TLV) iterator and builder
+ *
+ * Options are code, length, value triples (apart from pad (0) and end (255), which are a single byte).
+ *
+ *      -dhcpOptionIterator walks the options of a received packet in place. Every option is checked against
+ *       the end of the packet before it's handed out, so a truncated or malicious packet can't make the
+ *       server read past the buffer (the iterator just stops and sets 'malformed')
+ *      -dhcpOptionBuilder appends options to a reply in place, refusing any that won't fit (leaving room
+ *       for the end option). finishDHCPOptions() returns how many bytes were used, so the reply can be
+ *       sent without the unused part of the buffer
+ *
+ * Sample usage:-
+ *      dhcpOptionIterator options;
+ *      dhcpOption option;
+ *      initDHCPOptionIterator(&options, packet->dp_options, packetLength - DHCP_HEADER_LENGTH);
+ *      while (nextDHCPOption(&options, &option)) {
+ *          if ((option.code == DHCP_OPTION_MESSAGE_TYPE) && (option.length == 1)) messageType = option.value[0];
+ *      }
+ *
+ *      dhcpOptionBuilder builder;
+ *      initDHCPOptionBuilder(&builder, reply->dp_options, sizeof (reply->dp_options));
+ *      addDHCPOptionUint8(&builder, DHCP_OPTION_MESSAGE_TYPE, DHCPOFFER);
+ *      addDHCPOptionUint32(&builder, DHCP_OPTION_LEASE_TIME, 600);
+ *      int length = DHCP_HEADER_LENGTH + finishDHCPOptions(&builder);
+ *
+ * Messages to or from a host with no address yet can't go through a UDP socket, so the server (replying to a
+ * client by its hardware address) and the client (before it has a lease) send and receive them on AF_PACKET
+ * sockets. buildDHCPFrame() puts the IP and UDP headers on a message and parseDHCPFrame() checks and takes
+ * them off (checksums included). DHCP_TYPE, the message layout itself, is in dhcpOptions.h
+ */
+
+#include <string.h>
+#include <arpa/inet.h>
+#include "dhcpOptions.h"
+
+const uint8_t dhcpMagicCookie[4] = {0x63, 0x82, 0x53, 0x63}; //In decimal: 99,130,83,99
+
+void initDHCPOptionIterator(dhcpOptionIterator *iterator, const uint8_t *options, size_t length) {
+    iterator->position = options;
+    iterator->end = options + length;
+    iterator->malformed = 0;
+}
+
+int nextDHCPOption(dhcpOptionIterator *iterator, dhcpOption *option) {
+    //Returns 1 and fills in option, or 0 at the end of the options (or if the rest of them are malformed)
+    while ((iterator->position < iterator->end) && (*iterator->position == DHCP_OPTION_PAD)) iterator->position++;
+    if ((iterator->position >= iterator->end) || (*iterator->position == DHCP_OPTION_END)) return 0;
+    if ((iterator->end - iterator->position < 2) || (iterator->end - iterator->position - 2 < iterator->position[1])) {
+        iterator->malformed = 1; //Length runs past the end of the packet
+        iterator->position = iterator->end;
+        return 0;
+    }
+    option->code = iterator->position[0];
+    option->length = iterator->position[1];
+    option->value = iterator->position + 2;
+    iterator->position += 2 + option->length;
+    return 1;
+}
+
+int findDHCPOption(const uint8_t *options, size_t length, uint8_t code, dhcpOption *option) {
+    //Returns 1 and fills in option if 'code' is present, otherwise 0
+    dhcpOptionIterator iterator;
+    initDHCPOptionIterator(&iterator, options, length);
+    while (nextDHCPOption(&iterator, option)) {
+        if (option->code == code) return 1;
+    }
+    return 0;
+}
+
+int isDHCPOptionRequested(const dhcpOption *parameterList, uint8_t code) {
+    //Returns 1 if code is in the parameter request list (option 55). No list (NULL) means the client takes whatever it's given
+    if (parameterList == NULL) return 1;
+    return memchr(parameterList->value, code, parameterList->length) != NULL;
+}
+
+void initDHCPOptionBuilder(dhcpOptionBuilder *builder, uint8_t *buffer, size_t capacity) {
+    builder->start = buffer;
+    builder->position = buffer;
+    builder->end = buffer + (capacity > 0 ? capacity - 1 : 0);
+    builder->overflow = 0;
+}
+
+int addDHCPOption(dhcpOptionBuilder *builder, uint8_t code, uint8_t length, const void *value) {
+    //Returns 0 on success, -1 if there isn't room
+    if (builder->end - builder->position < 2 + length) {
+        builder->overflow = 1;
+        return -1;
+    }
+    *builder->position++ = code;
+    *builder->position++ = length;
+    if (length > 0) memcpy(builder->position, value, length); //Some options (e.g Rapid Commit) have no value
+    builder->position += length;
+    return 0;
+}
+
+int addDHCPOptionUint8(dhcpOptionBuilder *builder, uint8_t code, uint8_t value) {
+    return addDHCPOption(builder, code, 1, &value);
+}
+
+int addDHCPOptionUint32(dhcpOptionBuilder *builder, uint8_t code, uint32_t value) {
+    //For times (e.g lease time). Sent in network byte order
+    uint32_t networkValue = htonl(value);
+    return addDHCPOption(builder, code, 4, &networkValue);
+}
+
+int finishDHCPOptions(dhcpOptionBuilder *builder) {
+    //Adds the end option. Returns the length of the options, or -1 if any of them didn't fit
+    *builder->position++ = DHCP_OPTION_END;
+    if (builder->overflow) return -1;
+    return (int) (builder->position - builder->start);
+}
+
+static uint16_t ipChecksum(const uint8_t *data, int length, uint32_t sum) {
+    //Internet checksum (RFC 1071). sum carries on from a previous block (e.g the UDP pseudo header)
+    int n;
+    for (n = 0; n + 1 < length; n += 2) sum += (data[n] << 8) | data[n + 1];
+    if (length & 1) sum += data[length - 1] << 8;
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t) ~sum;
+}
+
+static uint32_t pseudoHeaderSum(const uint8_t *ip, int udpLength) {
+    //The UDP checksum covers a pseudo header of the addresses, protocol and length
+    return ((ip[12] << 8) | ip[13]) + ((ip[14] << 8) | ip[15]) + ((ip[16] << 8) | ip[17]) + ((ip[18] << 8) | ip[19]) +
+            IPPROTO_UDP + udpLength;
+}
+
+int buildDHCPFrame(uint8_t frame[], struct in_addr source, struct in_addr destination, uint16_t sourcePort,
+        uint16_t destinationPort, const DHCP_TYPE *message, int length) {
+    /*
+     * Puts IP and UDP headers on the first length bytes of message. frame[] needs DHCP_FRAME_HEADER_LENGTH + length bytes.
+     * Returns the length of the frame
+     */
+    uint8_t *ip = frame, *udp = frame + 20;
+    int udpLength = 8 + length;
+    memset(frame, 0, DHCP_FRAME_HEADER_LENGTH);
+    ip[0] = 0x45; //IPv4, 20 byte header
+    ip[2] = (20 + udpLength) >> 8;
+    ip[3] = (20 + udpLength) & 0xFF;
+    ip[8] = 64; //TTL
+    ip[9] = IPPROTO_UDP;
+    memcpy(&ip[12], &source.s_addr, 4);
+    memcpy(&ip[16], &destination.s_addr, 4);
+    uint16_t checksum = ipChecksum(ip, 20, 0);
+    ip[10] = checksum >> 8;
+    ip[11] = checksum & 0xFF;
+
+    udp[0] = sourcePort >> 8;
+    udp[1] = sourcePort & 0xFF;
+    udp[2] = destinationPort >> 8;
+    udp[3] = destinationPort & 0xFF;
+    udp[4] = udpLength >> 8;
+    udp[5] = udpLength & 0xFF;
+    memcpy(udp + 8, message, length);
+    checksum = ipChecksum(udp, udpLength, pseudoHeaderSum(ip, udpLength));
+    if (checksum == 0) checksum = 0xFFFF; //0 means 'no checksum'
+    udp[6] = checksum >> 8;
+    udp[7] = checksum & 0xFF;
+    return DHCP_FRAME_HEADER_LENGTH + length;
+}
+
+int parseDHCPFrame(const uint8_t frame[], int frameLength, uint16_t destinationPort, int checkUDPChecksum, const uint8_t **message) {
+    /*
+     * Checks a received IPv4 frame is a whole, undamaged UDP datagram to destinationPort, and points message at
+     * its payload. checkUDPChecksum = 0 skips the UDP checksum, for frames the kernel says haven't got one filled
+     * in yet (TP_STATUS_CSUMNOTREADY: sent from this machine with checksum offload, e.g over a veth).
+     * Returns the payload length, or -1 if it isn't one
+     */
+    if ((frameLength < 20) || ((frame[0] >> 4) != 4)) return -1;
+    int headerLength = (frame[0] & 0x0F) * 4;
+    int totalLength = (frame[2] << 8) | frame[3];
+    if ((headerLength < 20) || (totalLength > frameLength) || (totalLength < headerLength + 8)) return -1;
+    if ((frame[9] != IPPROTO_UDP) || (((frame[6] << 8) | frame[7]) & 0x3FFF)) return -1; //Not UDP, or a fragment
+    if (ipChecksum(frame, headerLength, 0) != 0) return -1;
+    const uint8_t *udp = frame + headerLength;
+    int udpLength = (udp[4] << 8) | udp[5];
+    if ((((udp[2] << 8) | udp[3]) != destinationPort) || (udpLength < 8) || (udpLength > totalLength - headerLength)) return -1;
+    if ((checkUDPChecksum) && ((udp[6] | udp[7]) != 0) && (ipChecksum(udp, udpLength, pseudoHeaderSum(frame, udpLength)) != 0)) return -1;
+    *message = udp + 8;
+    return udpLength - 8;
+}
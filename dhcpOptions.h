@@ -0,0 +1,129 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   dhcpOptions.h
+ *
+ * DHCP message layout, option (TLV) iterator and builder, and IP/UDP framing (see dhcpOptions.c)
+ */
+
+#ifndef DHCPOPTIONS_H
+#define DHCPOPTIONS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "dhcpOptions.h" TO THE SOURCE FILE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
+#define IPPORT_DHCPS 67
+#define IPPORT_DHCPC 68
+
+#define DHCP_HEADER_LENGTH 240          //Fixed BOOTP fields + magic cookie. The options follow
+#define DHCP_MIN_REPLY_LENGTH 300       //Shortest BOOTP message (RFC 1542). Some clients drop anything shorter
+#define DHCP_OPTIONS_LENGTH 1232        //Room for the options of anything that fits in a 1500 byte frame
+#define DHCP_REPLY_OPTIONS_LENGTH 312   //Longest options field a client has to accept (RFC 2131)
+#define DHCP_FLAG_BROADCAST 0x8000      //dp_flags (host byte order)
+#define DHCP_FRAME_HEADER_LENGTH 28     //IPv4 (no options) + UDP headers, for messages sent/received on AF_PACKET sockets
+
+//Message types (option 53)
+#define DHCPDISCOVER                    1
+#define DHCPOFFER                       2
+#define DHCPREQUEST                     3
+#define DHCPDECLINE                     4
+#define DHCPACK                         5
+#define DHCPNAK                         6
+#define DHCPRELEASE                     7
+#define DHCPINFORM                      8
+
+//Option codes
+#define DHCP_OPTION_PAD                 0
+#define DHCP_OPTION_SUBNET_MASK         1
+#define DHCP_OPTION_ROUTER              3
+#define DHCP_OPTION_DNS_SERVER          6
+#define DHCP_OPTION_HOST_NAME           12
+#define DHCP_OPTION_REQUESTED_ADDRESS   50
+#define DHCP_OPTION_LEASE_TIME          51
+#define DHCP_OPTION_MESSAGE_TYPE        53
+#define DHCP_OPTION_SERVER_ID           54
+#define DHCP_OPTION_PARAMETER_LIST      55
+#define DHCP_OPTION_MAX_MESSAGE_SIZE    57
+#define DHCP_OPTION_RENEWAL_TIME        58
+#define DHCP_OPTION_REBINDING_TIME      59
+#define DHCP_OPTION_CLIENT_ID           61
+#define DHCP_OPTION_RAPID_COMMIT        80
+#define DHCP_OPTION_END                 255
+
+typedef struct {
+    uint8_t dp_op; /* packet opcode type, 1 for request, 2 for reply */
+    uint8_t dp_htype; /* hardware addr type , 6 for IEEE802 networks*/
+    uint8_t dp_hlen; /* hardware addr length , 6 for normal mac addresses*/
+    uint8_t dp_hops; /* gateway hops */
+    uint32_t dp_xid; /* transaction identifier - A 32-bit identification field 
+                      * generated by the client, to allow it to match up the request with replies received from DHCP servers. */
+    uint16_t dp_secs; /* seconds since boot began */
+    uint16_t dp_flags; /* If client can't receive unicast before it has an address, sets the top bit
+                        (DHCP_FLAG_BROADCAST) to denote that DHCP server should reply using broadcast*/
+    uint8_t dp_ciaddr[4]; /* client IP address - (if already known or set), otherwise zero */
+    uint8_t dp_yiaddr[4]; /* 'your' IP address -  IP address that the server is assigning to the client.*/
+    uint8_t dp_siaddr[4]; /* server IP address */
+    uint8_t dp_giaddr[4]; /* gateway IP address */
+    uint8_t dp_chaddr[16]; /* client hardware address */
+    uint8_t dp_legacy[192];
+    uint8_t dp_magic[4];
+    uint8_t dp_options[DHCP_OPTIONS_LENGTH]; /* options area */
+    /* as of RFC2131 it is variable length. Walk it with dhcpOptionIterator */
+} DHCP_TYPE; //Used by the server (dhcpServer2.c) and the client (dhcpClient.c)
+
+extern const uint8_t dhcpMagicCookie[4]; //99,130,83,99
+
+typedef struct {
+    uint8_t code;
+    uint8_t length;
+    const uint8_t *value; //Points into the packet, nothing is copied
+} dhcpOption;
+
+typedef struct {
+    const uint8_t *position;
+    const uint8_t *end;
+    int malformed; //Set if an option ran off the end of the packet
+} dhcpOptionIterator;
+
+typedef struct {
+    uint8_t *start;
+    uint8_t *position;
+    uint8_t *end; //Keeps one byte back for the end option
+    int overflow; //Set if an option didn't fit
+} dhcpOptionBuilder;
+
+void initDHCPOptionIterator(dhcpOptionIterator *iterator, const uint8_t *options, size_t length);
+int nextDHCPOption(dhcpOptionIterator *iterator, dhcpOption *option);
+int findDHCPOption(const uint8_t *options, size_t length, uint8_t code, dhcpOption *option);
+int isDHCPOptionRequested(const dhcpOption *parameterList, uint8_t code);
+void initDHCPOptionBuilder(dhcpOptionBuilder *builder, uint8_t *buffer, size_t capacity);
+int addDHCPOption(dhcpOptionBuilder *builder, uint8_t code, uint8_t length, const void *value);
+int addDHCPOptionUint8(dhcpOptionBuilder *builder, uint8_t code, uint8_t value);
+int addDHCPOptionUint32(dhcpOptionBuilder *builder, uint8_t code, uint32_t value);
+int finishDHCPOptions(dhcpOptionBuilder *builder);
+int buildDHCPFrame(uint8_t frame[], struct in_addr source, struct in_addr destination, uint16_t sourcePort,
+        uint16_t destinationPort, const DHCP_TYPE *message, int length);
+int parseDHCPFrame(const uint8_t frame[], int frameLength, uint16_t destinationPort, int checkUDPChecksum, const uint8_t **message);
+
+//AND BEFORE HERE
+#endif /* DHCPOPTIONS_H */
+
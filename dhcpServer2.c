@@ -1,10 +1,13 @@
 /*
  * Simple DHCP server. 
- *      -Hardwired to dole out three addresses, 192.168.0.16-18/24
- *      -'Bound' to wlan0 (so will only listen/respond on that interface
- *      -wlan0 must be set to a static ip of 192.168.0.11
- *      -Once it starts, there's no way of stopping it (endless while loop)
- *      -It only gives out an ip address to th client (not dns, gateway etc. parameters)
+ *      -Hands out addresses from a pool (see dhcpLeasePool.c). By default 192.168.0.16-254/24, change
+ *       it with setDHCPServerPool() (takes effect straight away if the server is running)
+ *      -Serves wlan0 (192.168.0.11/24) by default. Other interfaces (wlan1, a USB ethernet gadget...) can be added,
+ *       each with its own pool, lease file and options, with addDHCPInterface(). It only answers on those interfaces,
+ *       and each one must already have its server address set up
+ *      -stopDHCPServer() stops it: it wakes the server thread through dhcpWakeFd, and waitDHCPServerStopped() waits for it to go
+ *      -Replies carry the address, server identifier, lease time, and the subnet mask and T1/T2 times if the client asks
+ *       for them (option 55). No router or DNS servers: in setup mode we're not a way onto any other network
  * 
  * The breakthrough to making it work was to include the message....
  * 
@@ -21,16 +24,49 @@
  * 
  * There is some cleverness here:-
  *  The socket options are set such that:-
- *          -It binds to a particular interface
+ *          -It isn't bound to an interface. Instead IP_PKTINFO tells us which interface each message came in on, which
+ *              picks the pool (messages from interfaces we don't serve, e.g eth0, are ignored), and replies are sent
+ *              back out of the same interface. So one socket and one epoll loop serve every interface. An interface
+ *              doesn't have to exist when the server starts: an rtnetlink socket (RTMGRP_LINK) in the same epoll set
+ *              tells us when interfaces come and go, so e.g a USB gadget is served as soon as it's plugged in
  *          -It is permitted to send broadcast packets
- *          -It is non blocking. (If there is no data recvfrm() will not block as normal, but will error.
- *              By reading the system variable ' errorno'  and testing for EAGAIN or EWOULDBLOCK (i.e 'would block' error),
- *              we can determine whether there is a genuine error or just no data. We can then wait a second or so
- *              and then try polling again. By waiting a second, the polling process won't be 
- *              too processor intensive
+ *          -It is non blocking. The server thread sleeps in epoll_wait() on the socket and on an eventfd (dhcpWakeFd),
+ *              so a DISCOVER/REQUEST is answered as soon as it arrives rather than on the next poll (this used to
+ *              be a recvfrom()/sleep(1) loop, which added up to a second to each step of the DORA exchange).
+ *              The socket is still non blocking so that a spurious wakeup can't wedge the thread in recvfrom()
+ * 
+ * Leases last DHCP_LEASE_SECONDS (unless changed with setDHCPInterfaceOptions()). An offer that isn't followed up with a DHCPREQUEST is reclaimed after
+ * DHCP_OFFER_HOLD_SECONDS (or straight away if the client's DHCPREQUEST names another server), so a small
+ * pool can keep up with phones and laptops that come and go during setup. DHCPRELEASE returns the address
+ * to the pool, and DHCPDECLINE keeps it out of the pool for DHCP_DECLINE_HOLD_SECONDS. While any lease
+ * is running, epoll_wait() times out once a second to let advanceDHCPLeasePool() expire them.
+ * 
+ * Incoming options are walked with a bounds-checked iterator (dhcpOptions.c) rather than assuming the message
+ * type is the first option, and replies are built into a separate buffer and sent at the length actually
+ * used (padded to the 300 byte BOOTP minimum) with only the options the client asked for in option 55.
+ * 
+ * Replies go where RFC 2131 (4.1) says, rather than always being broadcast: to the relay (giaddr), to ciaddr if
+ * the client already has an address, broadcast if the client sets the broadcast flag (or for a DHCPNAK), and
+ * otherwise unicast to the client's hardware address. A client with no address can't answer ARP, so that last
+ * case is sent as a ready-made IP/UDP packet on an AF_PACKET socket, addressed to chaddr. Some dongles (see
+ * main.c) lose broadcast frames in ad-hoc mode, and unicast frames are acknowledged and retried by the radio.
+ * If the AF_PACKET socket can't be opened, those replies are broadcast as before
+ * 
+ * Rapid Commit (RFC 4039): a DHCPDISCOVER carrying option 80 is answered straight away with a DHCPACK, so the
+ * client is on the network after two messages rather than four. It's a per-interface setting (see setDHCPInterfaceOptions()),
+ * on by default. Turn it off with setDHCPRapidCommit(0) (e.g if there could be another DHCP server on the network)
+ * 
+ * Leases are kept in an mmap'd file (DHCP_LEASE_FILENAME for wlan0, change it with setDHCPLeaseFile()), flushed at
+ * most once a second. Stopping and starting the server (e.g toggling setup mode) keeps the pool as it is,
+ * and restarting the program reloads it from the file, so a phone that reconnects gets the same address.
+ * 
+ * benchmarkDHCPServer() (-benchdhcpserver in main.c) runs the server on lo against thousands of synthetic clients
+ * (DORA, renew, release) and reports exchanges per second and latency percentiles for pools of 3 up to 64k addresses.
+ * Set dhcpServerLogging to 0 to stop the line per message being printed (the benchmark does)
  * 
  * start the server with startDHCPServer() (which then invokes the server in a seperate thread);
- * Stop it with stopDHCPServer()
+ * Stop it with stopDHCPServer(). That writes to dhcpWakeFd, which wakes the server thread immediately,
+ * and then waits for the thread to exit
  * 
  * 
  */
@@ -53,158 +89,839 @@
 #include <sys/types.h>
 #include <errno.h>          //Needed to decode error messages
 #include <fcntl.h>          //Needed to set the socket to be non-blocking
-
-const int forever = 1;
-int noOfAttempts = 0; //Counts the number of times the while() loop cycles
-
-#define IPPORT_DHCPS 67
-#define IPPORT_DHCPC 68
-
-#define DHCPDISCOVER                    1
-#define DHCPOFFER                       2
-#define DHCPREQUEST                     3
-#define DHCPACK                         5
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <net/if.h>             //if_nametoindex()
+#include <net/ethernet.h>       //ETH_P_IP
+#include <netpacket/packet.h>   //struct sockaddr_ll
+#include <sys/ioctl.h>          //SIOCGIFFLAGS
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>    //RTMGRP_LINK
+#include <stdarg.h>
+#include <poll.h>
+#include "dhcpLeasePool.h"
+#include "dhcpOptions.h"
+#include "sharedState.h"
+#include "dhcpServer2.h"
+
+int noOfAttempts = 0; //Counts the number of messages received
+static time_t dhcpServerStartTime = 0;
+
+#define DHCP_LEASE_SECONDS 600          //Lease time given to clients (option 51)
+#define DHCP_OFFER_HOLD_SECONDS 30      //How long an offered address is kept for a client that hasn't sent a DHCPREQUEST
+#define DHCP_DECLINE_HOLD_SECONDS 600   //How long an address some other host is using is kept out of the pool
+#define DHCP_LEASE_FILENAME "/tmp/piconfigserver_dhcp.leases" //Survives the server (and program) restarting, but not a reboot
+#define DHCP_INTERFACE_LEASE_FILENAME "/tmp/piconfigserver_dhcp_%s.leases" //Lease file for interfaces other than the default one
+
+#define DHCP_MAX_INTERFACES 8           //Max no. of interfaces served at once
+#define DHCP_DEFAULT_INTERFACE "wlan0"  //Interface served unless removeDHCPInterface() says otherwise
+
+//dhcpServerState
+#define DHCP_SERVER_STOPPED 0
+#define DHCP_SERVER_STARTING 1          //startDHCPServer() is waiting for DHCPServerThread() to get going
+#define DHCP_SERVER_RUNNING 2
+#define DHCP_SERVER_FAILED 3            //DHCPServerThread() couldn't start. stopDHCPServer() tidies up
 
 /* 32-bit structure containing 4-digit ip number */
 struct id_struct {
     uint8_t is_ip_addrs[4]; /* IP address number */
 };
 
+sharedState haltServerFlag; //Used to signal the server to stop
+sharedState dhcpServerState; //DHCP_SERVER_STOPPED etc. Wait on it rather than polling getDhcpServerRunningStatus()
+
+static int32_t DHCPSocket = -1; //Handle for the dhcp server listening socket (one socket for every interface)
+static int dhcpWakeFd = -1; //eventfd. Written by stopDHCPServer() (and when an interface is added) to wake the server thread
+static int dhcpPacketSocket = -1; //AF_PACKET socket for unicast replies to clients without an address yet. -1 to broadcast them
+static int dhcpNetlinkSocket = -1; //rtnetlink socket. Tells the server thread when interfaces come and go. -1 if unavailable
+static pthread_t dhcpServerThreadId;
+static int dhcpServerThreadStarted = 0; //1 between startDHCPServer() and stopDHCPServer()
+static int dhcpServerLogging = 1; //0 to stop the server printing a line for every message (e.g while benchmarking)
+static void (*dhcpActivityCallback)(void) = NULL; //Called for every reply sent (e.g to flash an LED)
+
 typedef struct {
-    uint8_t dp_op; /* packet opcode type, 1 for request, 2 for reply */
-    uint8_t dp_htype; /* hardware addr type , 6 for IEEE802 networks*/
-    uint8_t dp_hlen; /* hardware addr length , 6 for normal mac addresses*/
-    uint8_t dp_hops; /* gateway hops */
-    uint32_t dp_xid; /* transaction identifier - A 32-bit identification field 
-                      * generated by the client, to allow it to match up the request with replies received from DHCP servers. */
-    uint16_t dp_secs; /* seconds since boot began */
-    uint16_t dp_flags; /* If client doesn't yet have an address, set's bit 0 (LSB)
-                        to denote that DHCP server should reply using broadcast*/
-    uint8_t dp_ciaddr[4]; /* client IP address - (if already known or set), otherwise zero */
-    uint8_t dp_yiaddr[4]; /* 'your' IP address -  IP address that the server is assigning to the client.*/
-    uint8_t dp_siaddr[4]; /* server IP address */
-    uint8_t dp_giaddr[4]; /* gateway IP address */
-    uint8_t dp_chaddr[16]; /* client hardware address */
-    uint8_t dp_legacy[192];
-    uint8_t dp_magic[4];
-    uint8_t dp_options[275]; /* options area */
-    /* as of RFC2131 it is variable length */
-} DHCP_TYPE;
-
-volatile int haltServerFlag = 0; //Used to signal the server to stop
-volatile int dhcpServerRunningFlag = 0; //Flags whether server is currently active or not
-
-static int32_t DHCPSocket = -1; //Handle for the dhcp server listening socket
-char magic_cookie[] = {0x63, 0x82, 0x53, 0x63}; //In decimal: 99,130,83,99
-
-char OptionNewSubnet[] = {1, 4, 255, 255, 255, 0};
-char OptionNewOffer[] = {53, 1, DHCPOFFER};
-char OptionNewAck[] = {53, 1, DHCPACK};
-uint8_t OptionEnd[] = {0xFF};
-
-typedef struct { //Maintains a list of ip addresses already handed out
-    uint8_t mac[6];
-    uint8_t ip[4];
-} DHCP_Entry_t;
-
-#define NUM_ENTRIES 3
-DHCP_Entry_t dhcpTable[NUM_ENTRIES] = {
-    {
-        {0, 0, 0, 0, 0, 0}, //Set 6x mac address octets to zero 
-        {192, 168, 0, 16}
-    },
-    {
-        {0, 0, 0, 0, 0, 0}, //Set 6x mac address octets to zero
-        {192, 168, 0, 17}
-    },
-    {
-        {0, 0, 0, 0, 0, 0}, //Set 6x mac address octets to zero
-        {192, 168, 0, 18}
+    char name[IF_NAMESIZE]; //"" if the entry isn't in use
+    unsigned int index; //Interface index, 0 while the interface isn't there
+    int isLoopback; //No hardware address to unicast to, so those replies are broadcast
+    //Pool settings. Applied by setupDHCPInterfacePool()
+    struct in_addr serverAddress;
+    struct in_addr netmask;
+    struct in_addr firstAddress;
+    struct in_addr lastAddress;
+    char leaseFilename[256]; //Empty if the leases are only kept in memory
+    //Options
+    uint32_t leaseSeconds; //Lease time given to clients (option 51)
+    int rapidCommit; //Copied to pool.rapidCommit
+    dhcpLeasePool pool; //Maintains a list of ip addresses already handed out on this interface
+} dhcpInterface;
+
+static dhcpInterface dhcpInterfaces[DHCP_MAX_INTERFACES];
+static int dhcpInterfacesInitialised = 0; //Set once the default interface has been added
+static int dhcpRapidCommit = 1; //Rapid Commit setting for interfaces added from now on
+//Held by the server thread while it's working on dhcpInterfaces[], and by anything that changes them
+static pthread_mutex_t dhcpInterfacesMutex = PTHREAD_MUTEX_INITIALIZER;
+
+DHCP_TYPE DHCP_Buffer; //Received message
+static DHCP_TYPE DHCP_Reply; //Reply being built
+
+static int setDHCPInterfacePool(dhcpInterface *interface, char serverAddress[], char netmask[], char firstAddress[], char lastAddress[]) {
+    //Stores the interface's pool settings. Returns 0, or -1 if any of the addresses are malformed (the settings are left as they were)
+    struct in_addr server, mask, first, last;
+    if ((inet_pton(AF_INET, serverAddress, &server) != 1) || (inet_pton(AF_INET, netmask, &mask) != 1) ||
+            (inet_pton(AF_INET, firstAddress, &first) != 1) || (inet_pton(AF_INET, lastAddress, &last) != 1)) {
+        printf("setDHCPInterfacePool(): Badly formed address supplied\n");
+        return -1;
     }
-};
+    interface->serverAddress = server;
+    interface->netmask = mask;
+    interface->firstAddress = first;
+    interface->lastAddress = last;
+    return 0;
+}
 
-int i;
-DHCP_TYPE DHCP_Buffer;
-uint8_t zeros[6] = {0, 0, 0, 0, 0, 0};
+static dhcpInterface *findDHCPInterface(const char name[]) {
+    //Returns the entry for interface 'name', or NULL if it isn't being served. Call with dhcpInterfacesMutex held
+    int n;
+    for (n = 0; n < DHCP_MAX_INTERFACES; n++)
+        if ((dhcpInterfaces[n].name[0] != '\0') && (strcmp(dhcpInterfaces[n].name, name) == 0)) return &dhcpInterfaces[n];
+    return NULL;
+}
 
-static int InventAddress(uint8_t mac[], uint8_t ip[]) {
-    // search for existing
-    for (i = 0; i < NUM_ENTRIES; i++) {
-        if (memcmp(mac, dhcpTable[i].mac, 6) == 0) { //Use 'compare' to see if MAC table already contains the supplied mac address
-            memcpy(ip, dhcpTable[i].ip, 4); //If it does, re-copy in an ip address
-            return 0; //Return
+static dhcpInterface *findDHCPInterfaceByIndex(unsigned int index) {
+    //As findDHCPInterface(), by interface index
+    int n;
+    if (index == 0) return NULL;
+    for (n = 0; n < DHCP_MAX_INTERFACES; n++)
+        if ((dhcpInterfaces[n].name[0] != '\0') && (dhcpInterfaces[n].index == index)) return &dhcpInterfaces[n];
+    return NULL;
+}
+
+static dhcpInterface *newDHCPInterface(const char name[]) {
+    /*
+     * Returns the entry for interface 'name', adding it if it isn't there. A new entry gets the default options
+     * and lease file (and, for the default interface, the default pool). Returns NULL if the table is full.
+     * Call with dhcpInterfacesMutex held
+     */
+    dhcpInterface *interface = findDHCPInterface(name);
+    if (interface != NULL) return interface;
+    int n;
+    for (n = 0; (n < DHCP_MAX_INTERFACES) && (dhcpInterfaces[n].name[0] != '\0'); n++);
+    if (n == DHCP_MAX_INTERFACES) return NULL;
+    interface = &dhcpInterfaces[n];
+    memset(interface, 0, sizeof (dhcpInterface));
+    snprintf(interface->name, IF_NAMESIZE, "%s", name);
+    interface->leaseSeconds = DHCP_LEASE_SECONDS;
+    interface->rapidCommit = dhcpRapidCommit;
+    if (strcmp(name, DHCP_DEFAULT_INTERFACE) == 0) {
+        setDHCPInterfacePool(interface, "192.168.0.11", "255.255.255.0", "192.168.0.16", "192.168.0.254");
+        strcpy(interface->leaseFilename, DHCP_LEASE_FILENAME);
+    } else snprintf(interface->leaseFilename, sizeof (interface->leaseFilename), DHCP_INTERFACE_LEASE_FILENAME, name);
+    return interface;
+}
+
+static void initDHCPInterfaces() {
+    //The first time through, adds the default interface (wlan0). Call with dhcpInterfacesMutex held
+    if (dhcpInterfacesInitialised) return;
+    dhcpInterfacesInitialised = 1;
+    newDHCPInterface(DHCP_DEFAULT_INTERFACE);
+}
+
+static void refreshDHCPInterface(dhcpInterface *interface) {
+    //Looks the interface up again (it may have appeared, gone, or come back with a different index)
+    unsigned int index = if_nametoindex(interface->name);
+    if (index != interface->index) {
+        if (index == 0) printf("DHCP: %s has gone\n", interface->name);
+        else printf("DHCP: %s is there (index %u), serving it\n", interface->name, index);
+        interface->index = index;
+    }
+    interface->isLoopback = 0;
+    if ((index != 0) && (DHCPSocket != -1)) {
+        struct ifreq request;
+        memset(&request, 0, sizeof (request));
+        snprintf(request.ifr_name, IF_NAMESIZE, "%s", interface->name);
+        if ((ioctl(DHCPSocket, SIOCGIFFLAGS, &request) == 0) && (request.ifr_flags & IFF_LOOPBACK)) interface->isLoopback = 1;
+    }
+}
+
+static int setupDHCPInterfacePool(dhcpInterface *interface) {
+    /*
+     * Rebuilds the interface's pool if its settings have changed (otherwise carries on with the leases it's got).
+     * Call with dhcpInterfacesMutex held. Returns 0 on success, -1 if the pool settings are invalid
+     */
+    if (!isDHCPLeasePoolSame(&interface->pool, interface->serverAddress, interface->netmask, interface->firstAddress,
+            interface->lastAddress)) {
+        freeDHCPLeasePool(&interface->pool);
+        if (initDHCPLeasePool(&interface->pool, interface->serverAddress, interface->netmask, interface->firstAddress,
+                interface->lastAddress) == -1) {
+            printf("setupDHCPInterfacePool(): Invalid address pool for %s\n", interface->name);
+            return -1;
         }
+        //Pick up where the last run left off. If the file can't be used, the leases are just kept in memory
+        uint32_t maxRemaining = (interface->leaseSeconds > DHCP_DECLINE_HOLD_SECONDS) ? interface->leaseSeconds : DHCP_DECLINE_HOLD_SECONDS;
+        if ((interface->leaseFilename[0] != '\0') && (attachDHCPLeaseFile(&interface->pool, interface->leaseFilename, maxRemaining) == 1))
+            printf("setupDHCPInterfacePool(): %s: %u of %u addresses in use from %s\n", interface->name,
+                interface->pool.size - interface->pool.freeCount, interface->pool.size, interface->leaseFilename);
+    }
+    interface->pool.rapidCommit = interface->rapidCommit;
+    return 0;
+}
+
+static void wakeDHCPServer() {
+    //Makes the server thread go round its loop (e.g to pick up new timers, or to see haltServerFlag)
+    uint64_t wake = 1;
+    if ((dhcpWakeFd != -1) && (write(dhcpWakeFd, &wake, sizeof (wake)) == -1)) perror("wakeDHCPServer(): write(dhcpWakeFd)");
+}
+
+static int applyDHCPInterface(dhcpInterface *interface) {
+    //Puts new settings into effect straight away if the server is running. Call with dhcpInterfacesMutex held
+    if (dhcpServerThreadStarted == 0) return 0; //startDHCPServer() will do it
+    refreshDHCPInterface(interface);
+    if (setupDHCPInterfacePool(interface) == -1) return -1;
+    wakeDHCPServer(); //Its timeout may need to change (e.g leases reloaded from the file)
+    return 0;
+}
+
+int addDHCPInterface(char name[], char serverAddress[], char netmask[], char firstAddress[], char lastAddress[]) {
+    /*
+     * Serves interface 'name' as well as the ones already set up, with its own pool, lease file
+     * (/tmp/piconfigserver_dhcp_[name].leases) and options (see setDHCPInterfaceOptions()).
+     * Calling it again for the same interface changes its pool.
+     * The interface doesn't have to exist yet, it's served as soon as it appears (its address has to be
+     * set up by whoever brings it up). If the server is running, the pool is set up straight away, otherwise
+     * when startDHCPServer() is called.
+     * Returns 0 on success, -1 on error (bad name or address, invalid pool, or DHCP_MAX_INTERFACES already served)
+     *
+     * Sample usage:-
+     *      addDHCPInterface("usb0", "192.168.7.1", "255.255.255.0", "192.168.7.16", "192.168.7.254");
+     */
+    if ((strlen(name) == 0) || (strlen(name) >= IF_NAMESIZE)) {
+        printf("addDHCPInterface(): Bad interface name\n");
+        return -1;
+    }
+    pthread_mutex_lock(&dhcpInterfacesMutex);
+    initDHCPInterfaces();
+    int isNew = (findDHCPInterface(name) == NULL);
+    dhcpInterface *interface = newDHCPInterface(name);
+    int status = -1;
+    if (interface == NULL) printf("addDHCPInterface(): Already serving %d interfaces\n", DHCP_MAX_INTERFACES);
+    else if (setDHCPInterfacePool(interface, serverAddress, netmask, firstAddress, lastAddress) == 0)
+        status = applyDHCPInterface(interface);
+    if ((status == -1) && isNew && (interface != NULL)) { //Don't leave a half set up entry behind
+        freeDHCPLeasePool(&interface->pool);
+        memset(interface, 0, sizeof (dhcpInterface));
+    }
+    pthread_mutex_unlock(&dhcpInterfacesMutex);
+    return status;
+}
+
+int removeDHCPInterface(char name[]) {
+    /*
+     * Stops serving interface 'name'. Its leases are written out to its lease file first, so they're
+     * picked up again if it's added back.
+     * Returns 0 on success, -1 if the interface wasn't being served
+     */
+    pthread_mutex_lock(&dhcpInterfacesMutex);
+    initDHCPInterfaces();
+    dhcpInterface *interface = findDHCPInterface(name);
+    if (interface == NULL) {
+        pthread_mutex_unlock(&dhcpInterfacesMutex);
+        printf("removeDHCPInterface(): Not serving %s\n", name);
+        return -1;
+    }
+    freeDHCPLeasePool(&interface->pool); //Syncs the lease file
+    memset(interface, 0, sizeof (dhcpInterface));
+    pthread_mutex_unlock(&dhcpInterfacesMutex);
+    printf("removeDHCPInterface(): No longer serving %s\n", name);
+    return 0;
+}
+
+int setDHCPInterfaceOptions(char name[], uint32_t leaseSeconds, int rapidCommit) {
+    /*
+     * Sets the lease time given to clients on interface 'name' (the renewal and rebinding times follow from it)
+     * and whether it answers Rapid Commit. Takes effect straight away (leases already given out keep their times).
+     * Returns 0 on success, -1 if the interface isn't being served or leaseSeconds is 0
+     */
+    pthread_mutex_lock(&dhcpInterfacesMutex);
+    initDHCPInterfaces();
+    dhcpInterface *interface = findDHCPInterface(name);
+    if ((interface == NULL) || (leaseSeconds == 0)) {
+        pthread_mutex_unlock(&dhcpInterfacesMutex);
+        printf("setDHCPInterfaceOptions(): Not serving %s, or bad lease time\n", name);
+        return -1;
+    }
+    interface->leaseSeconds = leaseSeconds;
+    interface->rapidCommit = (rapidCommit != 0);
+    interface->pool.rapidCommit = interface->rapidCommit;
+    pthread_mutex_unlock(&dhcpInterfacesMutex);
+    return 0;
+}
+
+int setDHCPServerPool(char serverAddress[], char netmask[], char firstAddress[], char lastAddress[]) {
+    /*
+     * Sets the server's own address/netmask and the range of addresses it hands out on the default interface (wlan0).
+     * Same as addDHCPInterface(DHCP_DEFAULT_INTERFACE, ...)
+     * Returns 0 on success, -1 if any of the addresses are malformed (the settings are left as they were)
+     *
+     * Sample usage:-
+     *      setDHCPServerPool("192.168.0.11", "255.255.255.0", "192.168.0.16", "192.168.0.254");
+     */
+    return addDHCPInterface(DHCP_DEFAULT_INTERFACE, serverAddress, netmask, firstAddress, lastAddress);
+}
+
+int setDHCPServerRange(char firstAddress[], char lastAddress[]) {
+    //As setDHCPServerPool(), but keeps the server address and netmask (192.168.0.11/24 unless changed)
+    char server[INET_ADDRSTRLEN], mask[INET_ADDRSTRLEN];
+    pthread_mutex_lock(&dhcpInterfacesMutex);
+    initDHCPInterfaces();
+    dhcpInterface *interface = newDHCPInterface(DHCP_DEFAULT_INTERFACE);
+    if (interface != NULL) {
+        inet_ntop(AF_INET, &interface->serverAddress, server, INET_ADDRSTRLEN);
+        inet_ntop(AF_INET, &interface->netmask, mask, INET_ADDRSTRLEN);
+    }
+    pthread_mutex_unlock(&dhcpInterfacesMutex);
+    if (interface == NULL) {
+        printf("setDHCPServerRange(): Already serving %d interfaces\n", DHCP_MAX_INTERFACES);
+        return -1;
+    }
+    return setDHCPServerPool(server, mask, firstAddress, lastAddress);
+}
+
+void setDHCPRapidCommit(int enabled) {
+    //Turns Rapid Commit (option 80) on or off on every interface, including ones added later
+    int n;
+    pthread_mutex_lock(&dhcpInterfacesMutex);
+    dhcpRapidCommit = (enabled != 0);
+    for (n = 0; n < DHCP_MAX_INTERFACES; n++) {
+        dhcpInterfaces[n].rapidCommit = dhcpRapidCommit;
+        dhcpInterfaces[n].pool.rapidCommit = dhcpRapidCommit;
+    }
+    pthread_mutex_unlock(&dhcpInterfacesMutex);
+}
+
+void setDHCPActivityCallback(void (*callback)(void)) {
+    //callback() is called on the server thread each time a reply is sent, so it must be quick. NULL for none
+    dhcpActivityCallback = callback;
+}
+
+int setDHCPInterfaceLeaseFile(char name[], char path[]) {
+    /*
+     * Sets the file interface 'name's leases are kept in ("" to keep them in memory only).
+     * Takes effect the next time its pool has to be set up.
+     * Returns 0 on success, -1 if the interface isn't being served or the path is too long
+     */
+    if (strlen(path) >= sizeof (dhcpInterfaces[0].leaseFilename)) {
+        printf("setDHCPInterfaceLeaseFile(): Path too long\n");
+        return -1;
     }
-    // create new one
-    for (i = 0; i < NUM_ENTRIES; i++) {
-        if (memcmp(dhcpTable[i].mac, zeros, 6) == 0) { //Or else Use 'compare' to see if MAC table is empty (i.e contains zeros)
-            memcpy(dhcpTable[i].mac, mac, 6); //Copy supplied mac address into table
-            memcpy(ip, dhcpTable[i].ip, 4); //Copy 
-            return 0;
+    pthread_mutex_lock(&dhcpInterfacesMutex);
+    initDHCPInterfaces();
+    //The default interface can be set up before it's been added. Any other has to have a pool first
+    dhcpInterface *interface = (strcmp(name, DHCP_DEFAULT_INTERFACE) == 0) ? newDHCPInterface(name) : findDHCPInterface(name);
+    if (interface != NULL) strcpy(interface->leaseFilename, path);
+    pthread_mutex_unlock(&dhcpInterfacesMutex);
+    if (interface == NULL) printf("setDHCPInterfaceLeaseFile(): Not serving %s\n", name);
+    return (interface != NULL) ? 0 : -1;
+}
+
+int setDHCPLeaseFile(char path[]) {
+    //As setDHCPInterfaceLeaseFile(), for the default interface (wlan0)
+    return setDHCPInterfaceLeaseFile(DHCP_DEFAULT_INTERFACE, path);
+}
+
+static void dhcpLog(const char *format, ...) {
+    //printf() for the per-message chatter, so that it can be turned off with dhcpServerLogging
+    if (dhcpServerLogging == 0) return;
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+static int clientKey(DHCP_TYPE *packet, uint8_t key[]) {
+    //Identifies the client by hardware type + hardware address. Returns the key length
+    int length = packet->dp_hlen;
+    if (length > 16) length = 16;
+    key[0] = packet->dp_htype;
+    memcpy(&key[1], packet->dp_chaddr, length);
+    return length + 1;
+}
+
+static uint32_t monotonicSeconds() {
+    //Clock for lease expiry. Unlike time(), it doesn't jump when NTP sets the clock
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) now.tv_sec;
+}
+
+static int buildReply(dhcpInterface *interface, DHCP_TYPE *request, DHCP_TYPE *reply, uint8_t messageType, uint8_t yiaddr[],
+        dhcpOption *parameterList, int rapidCommit) {
+    /*
+     * Fills in a reply (OFFER, ACK or NAK) to request. Apart from the ones that have to be there, only the
+     * options the client asked for (option 55) are included, or all of them if it didn't send a list.
+     * rapidCommit is set for an ACK sent in answer to a DHCPDISCOVER (it has to carry option 80 as well)
+     * Returns the no. of bytes to send (only what's used, but at least DHCP_MIN_REPLY_LENGTH), or -1 on error
+     */
+    dhcpLeasePool *pool = &interface->pool;
+    memset(reply, 0, DHCP_MIN_REPLY_LENGTH); //Header and padding. Nothing left over from the last reply
+    reply->dp_op = 2; //Reply
+    reply->dp_htype = request->dp_htype;
+    reply->dp_hlen = request->dp_hlen;
+    reply->dp_xid = request->dp_xid;
+    reply->dp_flags = request->dp_flags;
+    memcpy(reply->dp_giaddr, request->dp_giaddr, 4);
+    memcpy(reply->dp_chaddr, request->dp_chaddr, 16);
+    memcpy(reply->dp_magic, dhcpMagicCookie, 4);
+    if (messageType != DHCPNAK) {
+        if (messageType == DHCPACK) memcpy(reply->dp_ciaddr, request->dp_ciaddr, 4);
+        memcpy(reply->dp_yiaddr, yiaddr, 4);
+        memcpy(reply->dp_siaddr, &pool->serverAddress.s_addr, 4); //Set 'server address' field
+    }
+
+    dhcpOptionBuilder options;
+    initDHCPOptionBuilder(&options, reply->dp_options, DHCP_REPLY_OPTIONS_LENGTH);
+    addDHCPOptionUint8(&options, DHCP_OPTION_MESSAGE_TYPE, messageType);
+    addDHCPOption(&options, DHCP_OPTION_SERVER_ID, 4, &pool->serverAddress.s_addr); //Need to include this, otherwise the client ignores you
+    if (messageType != DHCPNAK) {
+        addDHCPOptionUint32(&options, DHCP_OPTION_LEASE_TIME, interface->leaseSeconds); //Has to be in an OFFER or ACK
+        if (rapidCommit) addDHCPOption(&options, DHCP_OPTION_RAPID_COMMIT, 0, NULL);
+        if (isDHCPOptionRequested(parameterList, DHCP_OPTION_SUBNET_MASK))
+            addDHCPOption(&options, DHCP_OPTION_SUBNET_MASK, 4, &pool->netmask.s_addr);
+        if (isDHCPOptionRequested(parameterList, DHCP_OPTION_RENEWAL_TIME)) //500 seconds for a 600 second lease
+            addDHCPOptionUint32(&options, DHCP_OPTION_RENEWAL_TIME, interface->leaseSeconds * 5 / 6);
+        if (isDHCPOptionRequested(parameterList, DHCP_OPTION_REBINDING_TIME)) //550 seconds for a 600 second lease
+            addDHCPOptionUint32(&options, DHCP_OPTION_REBINDING_TIME, interface->leaseSeconds * 11 / 12);
+    }
+    int optionsLength = finishDHCPOptions(&options);
+    if (optionsLength == -1) {
+        printf("buildReply(): Options don't fit\n");
+        return -1;
+    }
+    int length = DHCP_HEADER_LENGTH + optionsLength;
+    return (length < DHCP_MIN_REPLY_LENGTH) ? DHCP_MIN_REPLY_LENGTH : length;
+}
+
+static int InventAddress(dhcpLeasePool *pool, DHCP_TYPE *packet, uint8_t requested[], uint8_t ip[]) {
+    //Finds the client's existing lease, or creates a new one (preferring the requested address, if not 0.0.0.0)
+    //Returns the lease no. and copies the address into ip[], or -1 if the pool is full
+    uint8_t key[DHCP_LEASE_KEY_LENGTH];
+    struct in_addr requestedAddress;
+    memcpy(&requestedAddress.s_addr, requested, 4);
+    int lease = allocateDHCPLease(pool, key, clientKey(packet, key), requestedAddress);
+    if (lease == -1) return -1;
+    struct in_addr address = getDHCPLeaseAddress(pool, lease);
+    memcpy(ip, &address.s_addr, 4);
+    return lease;
+}
+
+static int sendUnicastFrame(dhcpInterface *interface, DHCP_TYPE *reply, int length) {
+    /*
+     * Sends reply to yiaddr:68 at chaddr, without needing an ARP entry for yiaddr (the client can't answer
+     * ARP until it has the address). buildDHCPFrame() adds the IP and UDP headers, the kernel the ethernet header.
+     * Returns the no. of DHCP bytes sent, or -1 on error
+     */
+    uint8_t frame[DHCP_FRAME_HEADER_LENGTH + sizeof (DHCP_TYPE)];
+    struct in_addr destinationAddress;
+    memcpy(&destinationAddress.s_addr, reply->dp_yiaddr, 4);
+    int frameLength = buildDHCPFrame(frame, interface->pool.serverAddress, destinationAddress, IPPORT_DHCPS, IPPORT_DHCPC, reply, length);
+
+    struct sockaddr_ll destination;
+    memset(&destination, 0, sizeof (destination));
+    destination.sll_family = AF_PACKET;
+    destination.sll_protocol = htons(ETH_P_IP);
+    destination.sll_ifindex = interface->index;
+    destination.sll_halen = 6;
+    memcpy(destination.sll_addr, reply->dp_chaddr, 6);
+    if (sendto(dhcpPacketSocket, frame, frameLength, 0, (struct sockaddr *) &destination, sizeof (destination)) == -1) {
+        perror("sendUnicastFrame(): sendto()");
+        return -1;
+    }
+    return length;
+}
+
+static int sendReply(dhcpInterface *interface, DHCP_TYPE *request, DHCP_TYPE *reply, int length) {
+    /*
+     * Sends a reply built by buildReply() to wherever RFC 2131 (4.1) says it should go, out of the interface
+     * the request came in on. Returns the no. of bytes sent, or -1 on error
+     */
+    struct sockaddr_in destination;
+    memset(&destination, 0, sizeof (destination));
+    destination.sin_family = AF_INET;
+    destination.sin_port = htons(IPPORT_DHCPC);
+    destination.sin_addr.s_addr = INADDR_BROADCAST;
+    int isNak = (reply->dp_options[2] == DHCPNAK); //buildReply() always puts the message type first
+    if (dhcpActivityCallback != NULL) dhcpActivityCallback();
+
+    if (memcmp(request->dp_giaddr, "\0\0\0\0", 4) != 0) { //Came through a relay. Send it back there
+        memcpy(&destination.sin_addr.s_addr, request->dp_giaddr, 4);
+        destination.sin_port = htons(IPPORT_DHCPS);
+    } else if (isNak) { //Client's idea of its address is wrong, so broadcast
+    } else if (memcmp(request->dp_ciaddr, "\0\0\0\0", 4) != 0) { //Client has an address (renewing), and can answer ARP
+        memcpy(&destination.sin_addr.s_addr, request->dp_ciaddr, 4);
+    } else if (ntohs(request->dp_flags) & DHCP_FLAG_BROADCAST) { //Client has asked for broadcast
+    } else if ((dhcpPacketSocket != -1) && !interface->isLoopback && (request->dp_htype == 1) && (request->dp_hlen == 6)) { //Ethernet (or WiFi)
+        return sendUnicastFrame(interface, reply, length);
+    }
+
+    //The socket isn't bound to an interface, so say which one (otherwise a broadcast would go out of the default route)
+    struct iovec data = {reply, length};
+    char control[CMSG_SPACE(sizeof (struct in_pktinfo))];
+    struct msghdr message;
+    memset(control, 0, sizeof (control));
+    memset(&message, 0, sizeof (message));
+    message.msg_name = &destination;
+    message.msg_namelen = sizeof (destination);
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof (control);
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = IPPROTO_IP;
+    header->cmsg_type = IP_PKTINFO;
+    header->cmsg_len = CMSG_LEN(sizeof (struct in_pktinfo));
+    struct in_pktinfo packetInfo;
+    memset(&packetInfo, 0, sizeof (packetInfo));
+    packetInfo.ipi_ifindex = interface->index; //Source address is left to the kernel (the interface's own)
+    memcpy(CMSG_DATA(header), &packetInfo, sizeof (packetInfo));
+    int status = sendmsg(DHCPSocket, &message, 0);
+    if (status == -1) perror("sendReply(): sendmsg()");
+    return status;
+}
+
+static int receiveDHCPMessage(unsigned int *interfaceIndex) {
+    /*
+     * Reads the next message into DHCP_Buffer, and finds out which interface it came in on (IP_PKTINFO).
+     * Returns the no. of bytes received, or -1 on error (errno is left as recvmsg() set it)
+     */
+    struct sockaddr_in sourceAddr;
+    struct iovec data = {&DHCP_Buffer, sizeof (DHCP_Buffer)};
+    char control[CMSG_SPACE(sizeof (struct in_pktinfo))];
+    struct msghdr message;
+    memset(&message, 0, sizeof (message));
+    message.msg_name = &sourceAddr;
+    message.msg_namelen = sizeof (sourceAddr);
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof (control);
+    *interfaceIndex = 0;
+    int status = recvmsg(DHCPSocket, &message, 0);
+    if (status == -1) return -1;
+    struct cmsghdr *header;
+    for (header = CMSG_FIRSTHDR(&message); header != NULL; header = CMSG_NXTHDR(&message, header)) {
+        if ((header->cmsg_level == IPPROTO_IP) && (header->cmsg_type == IP_PKTINFO)) {
+            struct in_pktinfo packetInfo;
+            memcpy(&packetInfo, CMSG_DATA(header), sizeof (packetInfo));
+            *interfaceIndex = packetInfo.ipi_ifindex;
         }
     }
-    return -1;
+    return status;
 }
 
 int getDhcpServerRunningStatus() {
     /*
-     * Returns the current status of dhcpServerRunningFlag
+     * Returns 1 if the server is running, otherwise 0
      */
-    return dhcpServerRunningFlag;
+    return getSharedState(&dhcpServerState) == DHCP_SERVER_RUNNING;
+}
+
+int waitDHCPServerStopped(int timeoutMs) {
+    //Waits (without polling) until the server has stopped. Returns 0 once it has, -1 if timeoutMs (-1 for no limit) ran out
+    return waitSharedState(&dhcpServerState, DHCP_SERVER_STOPPED, timeoutMs);
 }
 
 void stopDHCPServer() {
     /*
      *  Inis sets a flag (monitored by the main dhcp server while loop) to schedule
-     * a shutdown oof the server. It will block until the flag is acknwoledhed and 
-     * cleared.
-     * 
-     * It also modifies the dhcpServerRunningFlag (the only other function that 
-     * should modify this global is DHCPServerThread()
+     * a shutdown oof the server, and wakes the server thread through dhcpWakeFd.
+     * It will block until the server thread has exited (normally well under a millisecond)
+     *
+     * It also sets dhcpServerState to DHCP_SERVER_STOPPED, waking anything waiting in waitDHCPServerStopped()
+     * (the only other functions that should modify it are startDHCPServer() and DHCPServerThread())
      */
-    if (DHCPSocket != -1) //Check socket has actually been initialised, otherwise ignore
-        haltServerFlag = 1; //Set flag
-    while (haltServerFlag != 0); //Now wait until main dhcp loop in DHCPServerThread() acts on and resets the flag
-    dhcpServerRunningFlag = 0; //Clear flag
-    //Now clear the lease table
-    int i;
-    for (i = 0; i < NUM_ENTRIES; i++)
-        memcpy(dhcpTable[i].mac, zeros, 6);
-    printf("haltServerFlag value: %d\n", haltServerFlag);
+    if (dhcpServerThreadStarted == 1) { //Check server has actually been started, otherwise ignore
+        setSharedState(&haltServerFlag, 1); //Set flag
+        wakeDHCPServer();
+        pthread_join(dhcpServerThreadId, NULL); //Now wait until DHCPServerThread() acts on the flag and exits
+        pthread_mutex_lock(&dhcpInterfacesMutex); //Nothing else is writing to dhcpWakeFd while we've got this
+        close(dhcpWakeFd);
+        dhcpWakeFd = -1;
+        dhcpServerThreadStarted = 0;
+        pthread_mutex_unlock(&dhcpInterfacesMutex);
+        setSharedState(&haltServerFlag, 0); //Clear flag
+    }
+    //The lease tables are kept (clients will want the same addresses next time). Just make sure they're on disk
+    int n;
+    pthread_mutex_lock(&dhcpInterfacesMutex);
+    for (n = 0; n < DHCP_MAX_INTERFACES; n++) syncDHCPLeaseFile(&dhcpInterfaces[n].pool, 1);
+    pthread_mutex_unlock(&dhcpInterfacesMutex);
+    setSharedState(&dhcpServerState, DHCP_SERVER_STOPPED); //Leases are on disk, so now it's stopped
+    printf("haltServerFlag value: %d\n", getSharedState(&haltServerFlag));
 }
 
 void printDHCPLeaseTable() {
     /*
-     *  Prints the current lease table (MAC addresses and corresponding ip addresses)
+     *  Prints the current lease table of each interface (MAC addresses and corresponding ip addresses)
      */
     //Display server status
-    if (getDhcpServerRunningStatus() == 1) printf("DHCP Server running for %d seconds...\n", noOfAttempts);
+    if (getDhcpServerRunningStatus() == 1) printf("DHCP Server running for %d seconds, %d messages received...\n",
+            (int) (time(NULL) - dhcpServerStartTime), noOfAttempts);
     else printf("DHCP Server not running\n");
 
-    //Display actual lease table
-    int i, j;
-    printf("Hardware addresss \tIP address\n");
-    printf("-----------------------------------\n");
-    for (i = 0; i < NUM_ENTRIES; i++) { //Iterate through table
-        for (j = 0; j < 5; j++) //Display mac address of table line i
-            printf("%02X:", dhcpTable[i].mac[j]); //Display mac address element j
-        printf("%02X\t", dhcpTable[i].mac[5]); //Don't want colon after last octet
+    //Display actual lease tables (leases in use only)
+    uint32_t i;
+    int j, n;
+    pthread_mutex_lock(&dhcpInterfacesMutex);
+    for (n = 0; n < DHCP_MAX_INTERFACES; n++) {
+        dhcpInterface *interface = &dhcpInterfaces[n];
+        dhcpLeasePool *pool = &interface->pool;
+        if (interface->name[0] == '\0') continue;
+        char server[INET_ADDRSTRLEN];
+        printf("\n%s (%s, %s): %u of %u addresses free\n", interface->name,
+                inet_ntop(AF_INET, &interface->serverAddress, server, INET_ADDRSTRLEN),
+                (interface->index != 0) ? "present" : "not present", pool->freeCount, pool->size);
+        printf("Hardware addresss \tIP address\tState\t\tExpires in (s)\n");
+        printf("---------------------------------------------------------------\n");
+        for (i = 0; i < pool->size; i++) { //Iterate through table
+            dhcpLease *lease = &pool->leases[i];
+            if (lease->state == DHCP_LEASE_FREE) continue;
+            if (lease->keyLength == 0) printf("-\t\t\t"); //Declined, nobody owns it
+            else {
+                for (j = 1; j < lease->keyLength - 1; j++) //Display mac address of table line i (key[0] is the hardware type)
+                    printf("%02X:", lease->key[j]); //Display mac address element j
+                printf("%02X\t", lease->key[lease->keyLength - 1]); //Don't want colon after last octet
+            }
+
+            //Now print corresponding ip address, state and time left
+            char address[INET_ADDRSTRLEN];
+            struct in_addr leaseAddress = getDHCPLeaseAddress(pool, i);
+            printf("%s\t%-8s\t%u\n", inet_ntop(AF_INET, &leaseAddress, address, INET_ADDRSTRLEN),
+                    dhcpLeaseStateToString(lease->state), getDHCPLeaseRemaining(pool, i));
+        }
+    }
+    pthread_mutex_unlock(&dhcpInterfacesMutex);
+
+}
+
+static void reportDHCPServerStartup(int failed) {
+    //Lets startDHCPServer() know whether DHCPServerThread() got as far as its main loop
+    setSharedState(&dhcpServerState, failed ? DHCP_SERVER_FAILED : DHCP_SERVER_RUNNING);
+}
 
-        //Now print corresponding ip address.
-        printf("%d.%d.%d.%d\n",
-                (int) dhcpTable[i].ip[0], (int) dhcpTable[i].ip[1], (int) dhcpTable[i].ip[2], (int) dhcpTable[i].ip[3]);
+static int isDHCPTickNeeded() {
+    //Returns 1 if any interface has leases to expire or changes to write out. Call with dhcpInterfacesMutex held
+    int n;
+    for (n = 0; n < DHCP_MAX_INTERFACES; n++) {
+        if ((dhcpInterfaces[n].pool.timers.pending != 0) || isDHCPLeaseFileDirty(&dhcpInterfaces[n].pool)) return 1;
     }
+    return 0;
+}
 
+static void tickDHCPInterfaces() {
+    //Expires leases and writes out the lease files on every interface. Call with dhcpInterfacesMutex held
+    uint32_t now = monotonicSeconds();
+    int n;
+    for (n = 0; n < DHCP_MAX_INTERFACES; n++) {
+        dhcpInterface *interface = &dhcpInterfaces[n];
+        if ((interface->name[0] == '\0') || (interface->pool.leases == NULL)) continue;
+        int expired = advanceDHCPLeasePool(&interface->pool, now);
+        if (expired > 0) dhcpLog("DHCPServerThread(): %s: %d lease(s) expired or reclaimed\n", interface->name, expired);
+        syncDHCPLeaseFile(&interface->pool, 0); //Batches up the changes from the last second
+    }
+}
+
+static void handleNetlinkMessages() {
+    //Drains dhcpNetlinkSocket. If an interface has appeared, gone or changed, looks them all up again
+    char buffer[8192];
+    int length, changed = 0;
+    while ((length = recv(dhcpNetlinkSocket, buffer, sizeof (buffer), 0)) > 0) {
+        struct nlmsghdr *message;
+        for (message = (struct nlmsghdr *) buffer; NLMSG_OK(message, length); message = NLMSG_NEXT(message, length)) {
+            if ((message->nlmsg_type == RTM_NEWLINK) || (message->nlmsg_type == RTM_DELLINK)) changed = 1;
+        }
+    }
+    if ((length == -1) && (errno == ENOBUFS)) changed = 1; //Some were lost, so look anyway
+    if (changed) {
+        int n;
+        for (n = 0; n < DHCP_MAX_INTERFACES; n++)
+            if (dhcpInterfaces[n].name[0] != '\0') refreshDHCPInterface(&dhcpInterfaces[n]);
+    }
+}
+
+static void handleDHCPMessage() {
+    //Reads a message from DHCPSocket and answers it. Call with dhcpInterfacesMutex held
+    unsigned int interfaceIndex;
+    int status = receiveDHCPMessage(&interfaceIndex);
+    if (status == -1) {
+        int errsv = errno; //Capture error number
+        if (errsv != EAGAIN && errsv != EWOULDBLOCK) { //EAGAIN just means the wakeup was spurious
+            printf("DHCPServerThread():recvmsg(): 'Unexpected' Error %d\n", errsv);
+            perror("recvmsg()");
+        }
+        return; //Nothing to reply to
+    }
+    dhcpInterface *interface = findDHCPInterfaceByIndex(interfaceIndex);
+    if ((interface == NULL) || (interface->pool.leases == NULL)) return; //Came in on an interface we're not serving (e.g eth0)
+    dhcpLeasePool *pool = &interface->pool;
+    noOfAttempts++; //Increment no. of messages received
+    int packetLength = status;
+    if ((packetLength < DHCP_HEADER_LENGTH) || (DHCP_Buffer.dp_op != 1) || (memcmp(DHCP_Buffer.dp_magic, dhcpMagicCookie, 4) != 0)) {
+        dhcpLog("DHCPServerThread(): Not a DHCP request (%d bytes), ignored\n", packetLength);
+        return;
+    }
+
+    //Walk the options once, picking out the ones we need. They point into DHCP_Buffer, nothing is copied
+    dhcpOptionIterator options;
+    dhcpOption option, parameterList;
+    dhcpOption *requestedParameters = NULL; //NULL if the client didn't send a parameter request list
+    int messageType = 0;
+    const uint8_t *requestedAddress = NULL; //Option 50
+    const uint8_t *serverIdentifier = NULL; //Option 54
+    int rapidCommitRequested = 0; //Option 80
+    initDHCPOptionIterator(&options, DHCP_Buffer.dp_options, packetLength - DHCP_HEADER_LENGTH);
+    while (nextDHCPOption(&options, &option)) {
+        switch (option.code) {
+            case DHCP_OPTION_MESSAGE_TYPE:
+                if (option.length == 1) messageType = option.value[0];
+                break;
+            case DHCP_OPTION_REQUESTED_ADDRESS:
+                if (option.length == 4) requestedAddress = option.value;
+                break;
+            case DHCP_OPTION_SERVER_ID:
+                if (option.length == 4) serverIdentifier = option.value;
+                break;
+            case DHCP_OPTION_PARAMETER_LIST:
+                parameterList = option;
+                requestedParameters = &parameterList;
+                break;
+            case DHCP_OPTION_RAPID_COMMIT:
+                if (option.length == 0) rapidCommitRequested = 1;
+                break;
+        }
+    }
+    if (options.malformed) {
+        dhcpLog("DHCPServerThread(): Malformed options, ignored\n");
+        return;
+    }
+
+    int lease;
+    int replyLength;
+    uint8_t yiaddr[4];
+    uint8_t requested[4];
+    uint8_t clientKeyBuffer[DHCP_LEASE_KEY_LENGTH];
+    struct in_addr leaseAddress;
+
+    //Test the incoming message type
+    switch (messageType) {
+        case 0:
+            //No message type, so a plain BOOTP request (or rubbish). Not supported
+            dhcpLog("DHCPServerThread(): No message type, ignored\n");
+            break;
+
+        case DHCPDISCOVER:
+            dhcpLog("DHCP DISCOVER on %s\n", interface->name);
+            //Offer the client's old address if it's asked for one (option 50) and it's free
+            memcpy(requested, (requestedAddress != NULL) ? requestedAddress : DHCP_Buffer.dp_ciaddr, 4);
+            lease = InventAddress(pool, &DHCP_Buffer, requested, yiaddr);
+            if (lease != -1) { //Supply InventAddress() with received client mac address and requested
+                //IP address (if it exists?) to see whether a lease for this
+                //mac address has been offered before (if not, InventAddress() will
+                // allocate one of the remaining addresses)
+                int rapidCommit = rapidCommitRequested && pool->rapidCommit;
+                if (rapidCommit) bindDHCPLease(pool, lease, interface->leaseSeconds); //Skip the OFFER/REQUEST
+                else offerDHCPLease(pool, lease, DHCP_OFFER_HOLD_SECONDS); //Reclaimed unless a DHCPREQUEST follows
+                replyLength = buildReply(interface, &DHCP_Buffer, &DHCP_Reply, rapidCommit ? DHCPACK : DHCPOFFER, yiaddr,
+                        requestedParameters, rapidCommit);
+                if (replyLength == -1) break;
+                status = sendReply(interface, &DHCP_Buffer, &DHCP_Reply, replyLength);
+                dhcpLog("DHCPS: %s %02X:%02X:%02X:%02X:%02X:%02X -> %d.%d.%d.%d (%d bytes)\n", rapidCommit ? "rapid commit ack" : "offer",
+                        DHCP_Reply.dp_chaddr[0], DHCP_Reply.dp_chaddr[1], DHCP_Reply.dp_chaddr[2],
+                        DHCP_Reply.dp_chaddr[3], DHCP_Reply.dp_chaddr[4], DHCP_Reply.dp_chaddr[5],
+                        yiaddr[0], yiaddr[1], yiaddr[2], yiaddr[3], status);
+            } else {
+                dhcpLog("DHCPS: rejected discover, table full\n");
+            }
+            break;
+
+        case DHCPREQUEST:
+            dhcpLog("DHCP REQUEST on %s\n", interface->name);
+            //Requested address: option 50 when answering an offer or rebooting, ciaddr when renewing
+            memcpy(requested, (requestedAddress != NULL) ? requestedAddress : DHCP_Buffer.dp_ciaddr, 4);
+
+            //If the client has picked another server's offer, take ours back now rather than waiting for it to time out
+            if ((serverIdentifier != NULL) && (memcmp(serverIdentifier, &pool->serverAddress.s_addr, 4) != 0)) {
+                lease = findDHCPLease(pool, clientKeyBuffer, clientKey(&DHCP_Buffer, clientKeyBuffer));
+                if ((lease != -1) && (pool->leases[lease].state == DHCP_LEASE_OFFERED)) releaseDHCPLease(pool, lease);
+                dhcpLog("DHCPS: client chose another server\n");
+                break;
+            }
+
+            int anyAddress = (memcmp(requested, "\0\0\0\0", 4) == 0);
+            memcpy(&leaseAddress.s_addr, requested, 4);
+            int inPool = anyAddress || isDHCPPoolAddress(pool, leaseAddress);
+            lease = inPool ? InventAddress(pool, &DHCP_Buffer, requested, yiaddr) : -1;
+            if (!inPool || ((lease != -1) && !anyAddress && (memcmp(requested, yiaddr, 4) != 0))) {
+                //Asking for an address it can't have (from another network, or someone else's). Tell it to start again
+                dhcpLog("DHCPS: nak %d.%d.%d.%d\n", requested[0], requested[1], requested[2], requested[3]);
+                if ((lease != -1) && (pool->leases[lease].state == DHCP_LEASE_OFFERED))
+                    offerDHCPLease(pool, lease, DHCP_OFFER_HOLD_SECONDS); //Reclaimed if it doesn't start again
+                replyLength = buildReply(interface, &DHCP_Buffer, &DHCP_Reply, DHCPNAK, NULL, NULL, 0);
+                if (replyLength != -1) sendReply(interface, &DHCP_Buffer, &DHCP_Reply, replyLength);
+                break;
+            }
+            if (lease != -1) {
+                bindDHCPLease(pool, lease, interface->leaseSeconds);
+                replyLength = buildReply(interface, &DHCP_Buffer, &DHCP_Reply, DHCPACK, yiaddr, requestedParameters, 0);
+                if (replyLength == -1) break;
+                status = sendReply(interface, &DHCP_Buffer, &DHCP_Reply, replyLength);
+                dhcpLog("DHCPS: ack %02x:%02x:%02x:%02x:%02x:%02x -> %d.%d.%d.%d (%d bytes)\n",
+                        DHCP_Reply.dp_chaddr[0], DHCP_Reply.dp_chaddr[1], DHCP_Reply.dp_chaddr[2],
+                        DHCP_Reply.dp_chaddr[3], DHCP_Reply.dp_chaddr[4], DHCP_Reply.dp_chaddr[5],
+                        yiaddr[0], yiaddr[1], yiaddr[2], yiaddr[3], status);
+            } else {
+                dhcpLog("DHCPS: rejected Request, table full\n");
+            }
+            break;
+
+        case DHCPOFFER:
+        case DHCPACK:
+        case DHCPNAK:
+            dhcpLog("DHCP message type %d from another server, ignored\n", messageType);
+            break;
+
+        case DHCPRELEASE:
+            //Client is giving its address back (ciaddr). No reply
+            lease = findDHCPLease(pool, clientKeyBuffer, clientKey(&DHCP_Buffer, clientKeyBuffer));
+            if (lease != -1) leaseAddress = getDHCPLeaseAddress(pool, lease);
+            if ((lease != -1) && (memcmp(DHCP_Buffer.dp_ciaddr, &leaseAddress.s_addr, 4) == 0)) {
+                expireDHCPLease(pool, lease);
+                dhcpLog("DHCPS: release %d.%d.%d.%d\n", DHCP_Buffer.dp_ciaddr[0], DHCP_Buffer.dp_ciaddr[1],
+                        DHCP_Buffer.dp_ciaddr[2], DHCP_Buffer.dp_ciaddr[3]);
+            } else dhcpLog("DHCPS: release for an address the client doesn't hold, ignored\n");
+            break;
+
+        case DHCPDECLINE:
+            //Client found its address (option 50) already in use. Keep it out of the pool for a while. No reply
+            lease = findDHCPLease(pool, clientKeyBuffer, clientKey(&DHCP_Buffer, clientKeyBuffer));
+            if (lease != -1) leaseAddress = getDHCPLeaseAddress(pool, lease);
+            if ((lease != -1) && (requestedAddress != NULL) && (memcmp(requestedAddress, &leaseAddress.s_addr, 4) == 0)) {
+                declineDHCPLease(pool, lease, DHCP_DECLINE_HOLD_SECONDS);
+                dhcpLog("DHCPS: decline %d.%d.%d.%d\n", requestedAddress[0], requestedAddress[1], requestedAddress[2], requestedAddress[3]);
+            } else dhcpLog("DHCPS: decline for an address the client wasn't given, ignored\n");
+            break;
+
+        default:
+            dhcpLog("DHCP unknown message type %d\n", messageType);
+            break;
+    }
 }
 
 void *DHCPServerThread(void *arg) {
     struct sockaddr_in myAddr;
-    struct sockaddr_in sourceAddr;
-    struct sockaddr_in destinationAddr;
 
-    noOfAttempts = 0; //Counts the number of times the while() loop cycles
+    noOfAttempts = 0; //Counts the number of messages received
     int status;
-    char * option_ptr;
 
     myAddr.sin_family = AF_INET;
     myAddr.sin_port = htons(IPPORT_DHCPS);
@@ -213,9 +930,13 @@ void *DHCPServerThread(void *arg) {
 
     //DHCPSocket = socket(AF_INET, SOCK_DGRAM, 0);
     DHCPSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP); //Mod by JT 6/11/16
-    if (DHCPSocket < 0) printf("dhcpServer2(): socket()");
-    fcntl(DHCPSocket, F_SETFL, O_NONBLOCK); //Set socket to be non-blocking (we don't want recvfrom()
-    //to block, otherwise we won't be able to act on the haltServerFlag)
+    if (DHCPSocket < 0) {
+        perror("DHCPServerThread(): socket()");
+        reportDHCPServerStartup(1);
+        return NULL;
+    }
+    fcntl(DHCPSocket, F_SETFL, O_NONBLOCK); //Set socket to be non-blocking (epoll_wait() does the waiting.
+    //recvmsg() must never block, otherwise we won't be able to act on the haltServerFlag)
 
     //Now set socket options to allow UDP broadcast
     printf("DHCPSocket: %d\n", (int) DHCPSocket);
@@ -226,348 +947,417 @@ void *DHCPServerThread(void *arg) {
 
     }
 
-    int sockOptRetValue = 0;
-    char *devname = "wlan0";
-    //char *devname = "eth0";
-    
-    //Now force the socket to bind to wlan0 (otherwise reply might be sent out on eth0)
-    if (setsockopt(DHCPSocket, SOL_SOCKET, SO_BINDTODEVICE, devname, strlen(devname)) == -1) {
-        do {
-            //if (setsockopt(DHCPSocket, SOL_SOCKET, SO_BINDTODEVICE, "wlan0", 4) == -1) {
-            perror("setsockopt - SOL_SOCKET, SO_BINDTODEVICE ");
-            sleep(1);
-            sockOptRetValue = setsockopt(DHCPSocket, SOL_SOCKET, SO_BINDTODEVICE, devname, strlen(devname));
-
-        } while (sockOptRetValue == -1);
-    }
-    
-    status = bind(DHCPSocket, (struct sockaddr *) &myAddr, sizeof (myAddr));
-    if (status < 0) {
-        printf("DHCPServerThread(): bind");
-        sleep(1);
+    //The socket isn't bound to an interface (it serves all of them), so have each message say which one it came in on
+    int packetInfo = 1;
+    status = setsockopt(DHCPSocket, IPPROTO_IP, IP_PKTINFO, &packetInfo, sizeof (packetInfo));
+    if (status == 0) {
         status = bind(DHCPSocket, (struct sockaddr *) &myAddr, sizeof (myAddr));
+        if (status < 0) perror("DHCPServerThread(): bind()");
+    } else perror("setsockopt - IPPROTO_IP, IP_PKTINFO");
+    if (status < 0) {
+        close(DHCPSocket);
+        DHCPSocket = -1;
+        reportDHCPServerStartup(1);
+        return NULL;
     }
-    printf("DHCPServerThread():DHCP Server started\n");
 
-    ///This block of code polls the socket for data every second (and also monitors haltServerFlag)
-    while (forever == 1) {
-        status = recvfrom(DHCPSocket, (char *) &DHCP_Buffer, sizeof ( DHCP_Buffer), 0, (struct sockaddr *) &sourceAddr, 0);
-        //'\33[2K\r'   //Erase existing line, move cursor to start of line
-        noOfAttempts++; //Increment no. of iterarions around while loop
-        //printf("Attempts: %d\n", noOfAttempts); //Display no of while{} iterations
-        //printDHCPLeaseTable();
-
-        if (status == -1) {
-            int errsv = errno; //Capture error number
-            //perror("recvfrom()");
-            if (errsv == EAGAIN || errsv == EWOULDBLOCK) {
-                //printf("recvfrom() error: EAGAIN or EWOULDBLOCK. Wait 1 second.. \n");
-                sleep(1); //If recvfrom() would block, wait a second before carrying on)
-            } else {
-                printf("DHCPServerThread():recvfrom(): 'Unexpected' Error %d\n", errsv);
-                perror("recvfrom()");
-                sleep(1);
-            }
+    //Socket for unicasting replies to clients that don't have an address yet. Only ever sent on
+    dhcpPacketSocket = socket(AF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC, 0); //Protocol 0, so nothing is received on it
+    if (dhcpPacketSocket == -1) perror("DHCPServerThread(): AF_PACKET socket(). Replies will be broadcast");
+
+    //Listen for interfaces coming and going (e.g a USB gadget being plugged in)
+    dhcpNetlinkSocket = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (dhcpNetlinkSocket != -1) {
+        struct sockaddr_nl local;
+        memset(&local, 0, sizeof (local));
+        local.nl_family = AF_NETLINK;
+        local.nl_groups = RTMGRP_LINK;
+        if (bind(dhcpNetlinkSocket, (struct sockaddr *) &local, sizeof (local)) == -1) {
+            close(dhcpNetlinkSocket);
+            dhcpNetlinkSocket = -1;
+        }
+    }
+    if (dhcpNetlinkSocket == -1) perror("DHCPServerThread(): netlink socket(). Interfaces that appear later won't be served");
+
+    int n;
+    pthread_mutex_lock(&dhcpInterfacesMutex);
+    for (n = 0; n < DHCP_MAX_INTERFACES; n++) {
+        dhcpInterface *interface = &dhcpInterfaces[n];
+        if (interface->name[0] == '\0') continue;
+        interface->index = 0;
+        refreshDHCPInterface(interface);
+        if (interface->index == 0) printf("DHCPServerThread(): %s isn't there yet. It'll be served when it appears\n", interface->name);
+    }
+    pthread_mutex_unlock(&dhcpInterfacesMutex);
+
+    //Wait on the socket, dhcpWakeFd (stopDHCPServer()) and the netlink socket together
+    int epollFd = epoll_create1(0);
+    if (epollFd == -1) {
+        perror("DHCPServerThread(): epoll_create1()");
+        close(DHCPSocket);
+        DHCPSocket = -1;
+        if (dhcpPacketSocket != -1) close(dhcpPacketSocket);
+        dhcpPacketSocket = -1;
+        if (dhcpNetlinkSocket != -1) close(dhcpNetlinkSocket);
+        dhcpNetlinkSocket = -1;
+        reportDHCPServerStartup(1);
+        return NULL;
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof (event));
+    event.events = EPOLLIN;
+    event.data.fd = DHCPSocket;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, DHCPSocket, &event) == -1) perror("DHCPServerThread(): epoll_ctl(DHCPSocket)");
+    event.data.fd = dhcpWakeFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, dhcpWakeFd, &event) == -1) perror("DHCPServerThread(): epoll_ctl(dhcpWakeFd)");
+    event.data.fd = dhcpNetlinkSocket;
+    if ((dhcpNetlinkSocket != -1) && (epoll_ctl(epollFd, EPOLL_CTL_ADD, dhcpNetlinkSocket, &event) == -1))
+        perror("DHCPServerThread(): epoll_ctl(dhcpNetlinkSocket)");
 
+    printf("DHCPServerThread():DHCP Server started\n");
+    dhcpServerStartTime = time(NULL);
+    reportDHCPServerStartup(0);
+
+    ///This block of code sleeps until there's a message on one of the sockets (or haltServerFlag is set)
+    while (1) {
+        struct epoll_event readyEvents[3];
+        //No timeout unless there are leases to expire or write out. Then wake up once a second
+        pthread_mutex_lock(&dhcpInterfacesMutex);
+        int timeout = isDHCPTickNeeded() ? 1000 : -1;
+        pthread_mutex_unlock(&dhcpInterfacesMutex);
+        int noOfEvents = epoll_wait(epollFd, readyEvents, 3, timeout);
+        if (noOfEvents == -1) {
+            if (errno == EINTR) continue; //Interrupted by a signal, go back to sleep
+            perror("DHCPServerThread(): epoll_wait()");
+            break;
         }
 
-        if (haltServerFlag == 1) { //Has the server been signalled to stop?
+        if (getSharedState(&haltServerFlag) == 1) { //Has the server been signalled to stop?
             printf("haltServerFlag acknowledged\n");
+            break; //Break out of while loop
+        }
 
-            if (close(DHCPSocket) == -1) {
-                perror("close(DHCPSocket)");
-            } else { //close() successfully executed
-                printf("socket %d successfully closed\n", DHCPSocket);
-                DHCPSocket == -1; //Reset socket back to default value
-                haltServerFlag = 0; //Clear flag
-                break; //Break out of while loop
+        pthread_mutex_lock(&dhcpInterfacesMutex);
+        tickDHCPInterfaces();
+        for (n = 0; n < noOfEvents; n++) {
+            if (readyEvents[n].data.fd == DHCPSocket) handleDHCPMessage();
+            else if (readyEvents[n].data.fd == dhcpNetlinkSocket) handleNetlinkMessages();
+            else if (readyEvents[n].data.fd == dhcpWakeFd) {
+                uint64_t wake;
+                if (read(dhcpWakeFd, &wake, sizeof (wake)) == -1) perror("DHCPServerThread(): read(dhcpWakeFd)");
             }
-        } else dhcpServerRunningFlag = 1; //Set flag
-
-        //Test the incoming message type                 
-        switch (DHCP_Buffer.dp_options[2]) {
-            case 0:
-                //Invalid value (only values 1-8 permissable according to the spec)
-                break;
+        }
+        pthread_mutex_unlock(&dhcpInterfacesMutex);
+    }
+    close(epollFd);
+    if (dhcpPacketSocket != -1) close(dhcpPacketSocket);
+    dhcpPacketSocket = -1;
+    if (dhcpNetlinkSocket != -1) close(dhcpNetlinkSocket);
+    dhcpNetlinkSocket = -1;
+    if (close(DHCPSocket) == -1) {
+        perror("close(DHCPSocket)");
+    } else { //close() successfully executed
+        printf("socket %d successfully closed\n", DHCPSocket);
+    }
+    DHCPSocket = -1; //Reset socket back to default value
+    printf("DHCP Server stopping\n");
+    return NULL;
+}
 
-            case DHCPDISCOVER:
-                printf("DHCP DISCOVER\n");
-                printf("recvfrom:  %02X:%02X:%02X:%02X:%02X:%02X -> %d.%d.%d.%d\n",
-                        DHCP_Buffer.dp_chaddr[0], DHCP_Buffer.dp_chaddr[1], DHCP_Buffer.dp_chaddr[2],
-                        DHCP_Buffer.dp_chaddr[3], DHCP_Buffer.dp_chaddr[4], DHCP_Buffer.dp_chaddr[5],
-                        DHCP_Buffer.dp_yiaddr[0], DHCP_Buffer.dp_yiaddr[1], DHCP_Buffer.dp_yiaddr[2], DHCP_Buffer.dp_yiaddr[3]);
-                printf("DHCP_Buffer.dp_options[2]: %d\n", (int) DHCP_Buffer.dp_options[2]);
-                printf("DHCP_Buffer.dp_flags: %d\n", (int) DHCP_Buffer.dp_flags);
-                if (InventAddress(DHCP_Buffer.dp_chaddr, DHCP_Buffer.dp_yiaddr) == 0) { //Supply InventAddress() with received client mac address and client
-                    //IP address (if it exists?) to see whether a lease for this 
-                    //mac address has been offered before (if not, InventAddress() will
-                    // allocate one of the remaining addresses)
-                    DHCP_Buffer.dp_op = 2; // DHCP Offer has Opcode 0x02 because it's a reply         
-                    DHCP_Buffer.dp_secs = 0;
-                    DHCP_Buffer.dp_flags = 0;
-
-
-                    //Set 'server address' field
-                    DHCP_Buffer.dp_siaddr[0] = 192;
-                    DHCP_Buffer.dp_siaddr[1] = 168;
-                    DHCP_Buffer.dp_siaddr[2] = 0;
-                    DHCP_Buffer.dp_siaddr[3] = 11;
-
-                    memset(&DHCP_Buffer.dp_options, 0, sizeof ( DHCP_Buffer.dp_options)); //Clear memory used for options fields
-                    memcpy(DHCP_Buffer.dp_magic, magic_cookie, 4); //Copy in "magic cookie"
-
-                    char *optionsStartAddr = NULL;
-                    int optionsLength = 0;
-                    option_ptr = (char *) &DHCP_Buffer.dp_options; //Get pointer to 'options' block of struct
-                    optionsStartAddr = option_ptr; //Capture start of options block
-
-                    memcpy(option_ptr, OptionNewOffer, sizeof (OptionNewOffer)); //Identify message as a DHCPOFFER 
-                    option_ptr += sizeof (OptionNewOffer);
-
-                    // dhcp server identifier       //Need to include this, otherwise the client ignores you
-                    *option_ptr++ = 54;
-                    *option_ptr++ = 4;
-                    *option_ptr++ = 192;
-                    *option_ptr++ = 168;
-                    *option_ptr++ = 0;
-                    *option_ptr++ = 11;
-
-                    memcpy(option_ptr, OptionNewSubnet, sizeof (OptionNewSubnet)); //
-                    option_ptr += sizeof (OptionNewSubnet);
-
-                    memcpy(option_ptr, OptionEnd, sizeof (OptionEnd));
-                    option_ptr += sizeof (OptionEnd);
-
-                    optionsLength = option_ptr - optionsStartAddr; //Calculate length of options block
-                    printf("Option Block length: %d\n", optionsLength);
-                    int n;
-                    for (n = 0; n < optionsLength; n++) {
-                        printf("%d ", ((int) *(optionsStartAddr + n))); //Print option block
-                    }
-                    printf("\n");
-
-                    destinationAddr.sin_port = htons(IPPORT_DHCPC);
-                    destinationAddr.sin_family = AF_INET;
-                    destinationAddr.sin_addr.s_addr = INADDR_BROADCAST;
-
-                    //Printf full DHCP/BOOTP Message
-                    printf("dp_op:%d, ", DHCP_Buffer.dp_op);
-                    printf("dp_htype:%d, ", DHCP_Buffer.dp_htype);
-                    printf("dp_hlen:%d, ", DHCP_Buffer.dp_hlen);
-                    printf("dp_hops:%d, \n", DHCP_Buffer.dp_hops);
-
-                    printf("dp_xid:%d, ", DHCP_Buffer.dp_xid);
-                    printf("dp_secs:%d, ", DHCP_Buffer.dp_secs);
-                    printf("dp_flags:%d, \n", DHCP_Buffer.dp_flags);
-
-                    printf("Client IP dp_ciaddr: %d:%d:%d:%d,  ", DHCP_Buffer.dp_ciaddr[0], DHCP_Buffer.dp_ciaddr[1], DHCP_Buffer.dp_ciaddr[2], DHCP_Buffer.dp_ciaddr[3]);
-                    printf("Your IP dp_yiaddr: %d:%d:%d:%d,  ", DHCP_Buffer.dp_yiaddr[0], DHCP_Buffer.dp_yiaddr[1], DHCP_Buffer.dp_yiaddr[2], DHCP_Buffer.dp_yiaddr[3]);
-                    printf("Server IP dp_siaddr: %d:%d:%d:%d,  ", DHCP_Buffer.dp_siaddr[0], DHCP_Buffer.dp_siaddr[1], DHCP_Buffer.dp_siaddr[2], DHCP_Buffer.dp_siaddr[3]);
-                    printf("Gateway IP dp_giaddr: %d:%d:%d:%d\n", DHCP_Buffer.dp_giaddr[0], DHCP_Buffer.dp_giaddr[1], DHCP_Buffer.dp_giaddr[2], DHCP_Buffer.dp_giaddr[3]);
-                    printf("Client hardware address dp_chaddr: %02X:%02X:%02X:%02X:%02X:%02X\n",
-                            DHCP_Buffer.dp_chaddr[0], DHCP_Buffer.dp_chaddr[1], DHCP_Buffer.dp_chaddr[2],
-                            DHCP_Buffer.dp_chaddr[3], DHCP_Buffer.dp_chaddr[4], DHCP_Buffer.dp_chaddr[5]);
-                    printf("Magic cookie dp_magic: %02X:%02X:%02X:%02X\n", DHCP_Buffer.dp_magic[0], DHCP_Buffer.dp_magic[1], DHCP_Buffer.dp_magic[2], DHCP_Buffer.dp_magic[3]);
-
-                    status = sendto(DHCPSocket, (char *) &DHCP_Buffer, sizeof ( DHCP_Buffer), 0, (struct sockaddr *) &destinationAddr, sizeof ( destinationAddr));
-                    if (status == -1) perror("sendto()");
-                    printf("sendto() bytes sent: %d\n", status);
-                    printf("DHCPS: offer %02X:%02X:%02X:%02X:%02X:%02X -> %d.%d.%d.%d\n",
-                            DHCP_Buffer.dp_chaddr[0], DHCP_Buffer.dp_chaddr[1], DHCP_Buffer.dp_chaddr[2],
-                            DHCP_Buffer.dp_chaddr[3], DHCP_Buffer.dp_chaddr[4], DHCP_Buffer.dp_chaddr[5],
-                            DHCP_Buffer.dp_yiaddr[0], DHCP_Buffer.dp_yiaddr[1], DHCP_Buffer.dp_yiaddr[2], DHCP_Buffer.dp_yiaddr[3]);
-
-
-                } else {
-                    printf("DHCPS: rejected discover, table full\n");
-                }
-                //DHCP_Buffer.dp_options[2]=0;        //Clear option message type field
-                break;
+int startDHCPServer() {
+    //Start dhcp server as a thread
+    if (dhcpServerThreadStarted == 1) {
+        printf("startDHCPServer(): DHCP Server already running\n");
+        return 1;
+    }
+    dhcpWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC); //Created here so that stopDHCPServer() can always write to it
+    if (dhcpWakeFd == -1) {
+        perror("startDHCPServer(): eventfd()");
+        return -1;
+    }
+    //Rebuild the pools whose settings have changed (the others carry on with the leases they've got).
+    //The mutex is held until the thread has been created, so an interface added meanwhile is set up either here or by addDHCPInterface()
+    int n, failed = 0;
+    pthread_mutex_lock(&dhcpInterfacesMutex);
+    initDHCPInterfaces();
+    for (n = 0; n < DHCP_MAX_INTERFACES; n++) {
+        if ((dhcpInterfaces[n].name[0] != '\0') && (setupDHCPInterfacePool(&dhcpInterfaces[n]) == -1)) failed = 1;
+    }
+    setSharedState(&dhcpServerState, DHCP_SERVER_STARTING);
+    setSharedState(&haltServerFlag, 0);
+    if (failed) printf("startDHCPServer(): Invalid address pool\n");
+    else if (pthread_create(&dhcpServerThreadId, NULL, DHCPServerThread, NULL)) {
+        printf("Error creating dhcp server thread.\n");
+        failed = 1;
+    } else dhcpServerThreadStarted = 1;
+    pthread_mutex_unlock(&dhcpInterfacesMutex);
+    if (failed) {
+        setSharedState(&dhcpServerState, DHCP_SERVER_STOPPED);
+        close(dhcpWakeFd);
+        dhcpWakeFd = -1;
+        return -1;
+    }
+    printf("startDHCPServer(): Waiting for confirmation that DHCP server has started\n");
+    //Blocking call. Wakes as soon as DHCPServerThread() reports back
+    if (waitSharedStateChange(&dhcpServerState, DHCP_SERVER_STARTING, -1) == DHCP_SERVER_FAILED) {
+        printf("startDHCPServer(): DHCP Server failed to start\n");
+        stopDHCPServer(); //Thread has already exited, this just tidies up
+        return -1;
+    }
+    printf("startDHCPServer(): DHCP Server has started\n");
+    return 1; //Will only return once server has started
+}
 
+//Load generator for benchmarkDHCPServer(). Each synthetic client goes DISCOVER/OFFER, REQUEST/ACK, renew (REQUEST/ACK), RELEASE
+#define DHCP_BENCH_WAIT_OFFER 1
+#define DHCP_BENCH_WAIT_ACK 2
+#define DHCP_BENCH_WAIT_RENEW 3
+#define DHCP_BENCH_MAX_IN_FLIGHT 64     //Clients part way through at once (never more than the pool size)
+#define DHCP_BENCH_TIMEOUT_NS 1000000000ULL //A reply that hasn't come after this is lost. The client starts again
 
-            case DHCPOFFER:
-                printf("DHCPOFFER. Resending offer\n");
-                status = sendto(DHCPSocket, (char *) &DHCP_Buffer, sizeof ( DHCP_Buffer), 0, (struct sockaddr *) &destinationAddr, sizeof ( destinationAddr));
-                if (status == -1) perror("sendto()");
-                printf("sendto() bytes sent: %d\n", status);
-                break;
+typedef struct {
+    int client; //Client no. (its xid and MAC address are made from this). -1 if the slot has finished
+    int state; //Which reply it's waiting for (DHCP_BENCH_WAIT_OFFER etc.)
+    uint8_t address[4]; //yiaddr from the offer
+    uint8_t server[4]; //Server identifier from the offer
+    uint64_t startNs; //When the DISCOVER went
+    uint64_t sentNs; //When the last message went
+} dhcpBenchClient;
+
+static uint64_t monotonicNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
 
-            case DHCPREQUEST:
-                printf("DHCP REQUEST\n");
-                uint8_t temp[4];
-                if (InventAddress(DHCP_Buffer.dp_chaddr, temp) == 0) {
-                    DHCP_Buffer.dp_op = 2; // reply
-                    DHCP_Buffer.dp_secs = 0;
-                    DHCP_Buffer.dp_flags = 0;
-                    option_ptr = (char *) &DHCP_Buffer.dp_options;
-                    while (*option_ptr != 255) {
-                        int len = option_ptr[1];
-                        switch (*option_ptr) {
-                            case 50:
-                                // requested IP
-                                if (len == 4) {
-                                    memcpy(DHCP_Buffer.dp_yiaddr, option_ptr + 2, 4);
-                                }
-                                break;
-                            default:
-                                break;
-                        }
-                        option_ptr += (len + 2);
-                    }
-                    if (memcmp(DHCP_Buffer.dp_yiaddr, temp, 4) != 0) {
-                        printf("ohoh, DHCP request did not match offer\n");
-                    }
-                    memcpy(DHCP_Buffer.dp_magic, magic_cookie, 4);
-                    // erase and create new options
-                    memset(&DHCP_Buffer.dp_options, 0, sizeof ( DHCP_Buffer.dp_options));
-                    option_ptr = (char *) &DHCP_Buffer.dp_options;
-
-                    // ACK message typ
-                    *option_ptr++ = 53;
-                    *option_ptr++ = 1;
-                    *option_ptr++ = 5;
-
-                    // renewal time     
-                    *option_ptr++ = 58;
-                    *option_ptr++ = 4;
-                    *option_ptr++ = 0;
-                    *option_ptr++ = 0;
-                    /*
-                    *option_ptr++ = 0x38;
-                    *option_ptr++ = 0x40;
-                    */
-                    *option_ptr++ = 0x01;       //500 seconds high byte
-                    *option_ptr++ = 0xF4;       //500 seconds low byte
-
-                    // rebinding time
-                    *option_ptr++ = 59;
-                    *option_ptr++ = 4;
-                    *option_ptr++ = 0;
-                    *option_ptr++ = 0;
-                    /*
-                    *option_ptr++ = 0x62;
-                    *option_ptr++ = 0x70;
-                    */
-                    *option_ptr++ = 0x02;       //550 seconds high byte
-                    *option_ptr++ = 0x26;       //550 seconds low byte
-
-                    // lease time (in seconds) (10 minutes=600 secs. =0x0258)
-                    *option_ptr++ = 51;
-                    *option_ptr++ = 4;
-                    *option_ptr++ = 0;
-                    *option_ptr++ = 0;
-                    *option_ptr++ = 0x02;       //600 seconds high byte
-                    *option_ptr++ = 0x58;       //600 seconds low byte
-
-                    // dhcp server identifier
-                    *option_ptr++ = 54;
-                    *option_ptr++ = 4;
-                    *option_ptr++ = 192;
-                    *option_ptr++ = 168;
-                    *option_ptr++ = 0;
-                    *option_ptr++ = 11;
-
-                    // subnet mask
-                    *option_ptr++ = 1;
-                    *option_ptr++ = 4;
-                    *option_ptr++ = 0xFF;
-                    *option_ptr++ = 0xFF;
-                    *option_ptr++ = 0xFF;
-                    *option_ptr++ = 0x00;
-
-                    /*                       
-                     *option_ptr++ = 15; //Option message type 15 (set domain)
-                                           int len = sprintf((char*) option_ptr + 1, "polecat.internal");
-                     *option_ptr = (len + 1);        //Set length field
-                                           option_ptr += (len + 2);
-                     */
-                    /*
-                    // router
-                     *option_ptr++ = 3;      //Option message type 03 (set default route)
-                     *option_ptr++ = 4;
-                     *option_ptr++ = 192;
-                     *option_ptr++ = 168;
-                     *option_ptr++ = 0;
-                     *option_ptr++ = 11;
-                     */
-                    /*
-                    // domain name server (DNS) //Option message type 04 (set dns)
-                     *option_ptr++ = 6;
-                     *option_ptr++ = 4;
-                     */
-                    /*
-                    if (ppp_addr.dns1.addr != 0) {
-                        printf("Using DNS from ppp\n");
-                        uint8_t* addr = (uint8_t*) &ppp_addr.dns1.addr;
-                     *option_ptr++ = addr[0];
-                     *option_ptr++ = addr[1];
-                     *option_ptr++ = addr[2];
-                     *option_ptr++ = addr[3];
-                    } else {
-                     *option_ptr++ = 192;
-                     *option_ptr++ = 168;
-                     *option_ptr++ = 0;
-                     *option_ptr++ = 11;
-                    }
-                     */
-                    /*
-                    ///////Mod by JT
-                     *option_ptr++ = 192;
-                     *option_ptr++ = 168;
-                     *option_ptr++ = 0;
-                     *option_ptr++ = 11;
-                     */
-
-                    //End of JT mod
-
-
-                    // end
-                    *option_ptr++ = 255;
-
-
-                    destinationAddr.sin_port = htons(IPPORT_DHCPC);
-                    destinationAddr.sin_family = AF_INET;
-                    destinationAddr.sin_addr.s_addr = INADDR_BROADCAST;
-                    sendto(DHCPSocket, (char *) &DHCP_Buffer, sizeof ( DHCP_Buffer), 0, (struct sockaddr *) &destinationAddr, sizeof ( destinationAddr));
-
-                    printf("DHCPS: ack %02x:%02x:%02x:%02x:%02x:%02x -> %d.%d.%d.%d\n",
-                            DHCP_Buffer.dp_chaddr[0], DHCP_Buffer.dp_chaddr[1], DHCP_Buffer.dp_chaddr[2],
-                            DHCP_Buffer.dp_chaddr[3], DHCP_Buffer.dp_chaddr[4], DHCP_Buffer.dp_chaddr[5],
-                            DHCP_Buffer.dp_yiaddr[0], DHCP_Buffer.dp_yiaddr[1], DHCP_Buffer.dp_yiaddr[2], DHCP_Buffer.dp_yiaddr[3]);
-                } else {
-                    printf("DHCPS: rejected Request, table full\n");
-                    DHCP_Buffer.dp_options[2] = 0; //Clear option message type field
-                }
+static int compareUint32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
 
-                break;
+static double percentileUs(uint32_t samples[], int count, double fraction) {
+    //samples[] must be sorted. Returns the sample 'fraction' of the way up, in microseconds
+    if (count == 0) return 0;
+    int n = (int) (fraction * count);
+    if (n >= count) n = count - 1;
+    return samples[n] / 1000.0;
+}
 
-            case DHCPACK:
-                printf("DHCPACK received\n");
-                DHCP_Buffer.dp_options[2] = 0; //Clear option message type field
-                break;
+static int sendBenchmarkMessage(int sock, dhcpBenchClient *client, uint8_t messageType) {
+    //Builds and sends one message from a synthetic client to the server on 127.0.0.1. Returns 0, or -1 on error
+    DHCP_TYPE message;
+    uint32_t clientNo = htonl(client->client);
+    memset(&message, 0, DHCP_MIN_REPLY_LENGTH);
+    message.dp_op = 1; //Request
+    message.dp_htype = 1; //Ethernet
+    message.dp_hlen = 6;
+    message.dp_xid = htonl(client->client + 1);
+    message.dp_chaddr[0] = 0x02; //Locally administered MAC
+    memcpy(&message.dp_chaddr[2], &clientNo, 4);
+    memcpy(message.dp_magic, dhcpMagicCookie, 4);
+    int renewing = (messageType == DHCPRELEASE) || (client->state == DHCP_BENCH_WAIT_RENEW);
+    if (renewing) memcpy(message.dp_ciaddr, client->address, 4);
+
+    dhcpOptionBuilder options;
+    initDHCPOptionBuilder(&options, message.dp_options, DHCP_REPLY_OPTIONS_LENGTH);
+    addDHCPOptionUint8(&options, DHCP_OPTION_MESSAGE_TYPE, messageType);
+    if ((messageType == DHCPREQUEST) && !renewing) addDHCPOption(&options, DHCP_OPTION_REQUESTED_ADDRESS, 4, client->address);
+    if ((messageType == DHCPRELEASE) || ((messageType == DHCPREQUEST) && !renewing))
+        addDHCPOption(&options, DHCP_OPTION_SERVER_ID, 4, client->server);
+    int length = DHCP_HEADER_LENGTH + finishDHCPOptions(&options);
+    if (length < DHCP_MIN_REPLY_LENGTH) length = DHCP_MIN_REPLY_LENGTH;
+
+    struct sockaddr_in server;
+    memset(&server, 0, sizeof (server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(IPPORT_DHCPS);
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    client->sentNs = monotonicNs();
+    if (sendto(sock, &message, length, 0, (struct sockaddr *) &server, sizeof (server)) == -1) {
+        perror("sendBenchmarkMessage(): sendto()");
+        return -1;
+    }
+    return 0;
+}
 
-            default:
-                printf("DHCP unknown option %d\n", (int) DHCP_Buffer.dp_options[2]);
-                //DHCP_Buffer.dp_options[2]=0;        //Clear option message type field
-                break;
+static int runDHCPBenchmarkClients(int sock, int noOfClients, int inFlight, uint32_t doraNs[], uint32_t renewNs[], int *lost) {
+    /*
+     * Puts noOfClients synthetic clients through the whole lease lifecycle, inFlight at a time. Client c always uses
+     * slot c % inFlight, so a reply's xid (client no. + 1) leads straight to its slot.
+     * Fills in doraNs[] (DISCOVER to ACK) and renewNs[] (REQUEST to ACK) for every client.
+     * Returns 0 on success, -1 if the server stopped answering
+     */
+    dhcpBenchClient clients[DHCP_BENCH_MAX_IN_FLIGHT];
+    DHCP_TYPE reply;
+    int n, finished = 0;
+    *lost = 0;
+    for (n = 0; n < inFlight; n++) {
+        clients[n].client = (n < noOfClients) ? n : -1;
+        clients[n].state = DHCP_BENCH_WAIT_OFFER;
+        if (clients[n].client != -1) {
+            clients[n].startNs = monotonicNs();
+            if (sendBenchmarkMessage(sock, &clients[n], DHCPDISCOVER) == -1) return -1;
+        }
+    }
+    uint64_t lastTimeoutCheck = monotonicNs();
+    while (finished < noOfClients) {
+        struct pollfd readable = {sock, POLLIN, 0};
+        if (poll(&readable, 1, 100) == -1) {
+            if (errno == EINTR) continue;
+            perror("runDHCPBenchmarkClients(): poll()");
+            return -1;
+        }
+        int length;
+        while ((length = recv(sock, &reply, sizeof (reply), MSG_DONTWAIT)) > 0) {
+            uint64_t now = monotonicNs();
+            if ((length < DHCP_HEADER_LENGTH) || (reply.dp_op != 2) || (memcmp(reply.dp_magic, dhcpMagicCookie, 4) != 0)) continue;
+            int clientNo = (int) ntohl(reply.dp_xid) - 1;
+            if ((clientNo < 0) || (clientNo >= noOfClients)) continue;
+            dhcpBenchClient *client = &clients[clientNo % inFlight];
+            if (client->client != clientNo) continue; //Late reply to a client that's started again, or finished
+            dhcpOption messageType, serverIdentifier;
+            if (!findDHCPOption(reply.dp_options, length - DHCP_HEADER_LENGTH, DHCP_OPTION_MESSAGE_TYPE, &messageType) ||
+                    (messageType.length != 1)) continue;
+
+            if ((messageType.value[0] == DHCPOFFER) && (client->state == DHCP_BENCH_WAIT_OFFER)) {
+                memcpy(client->address, reply.dp_yiaddr, 4);
+                if (findDHCPOption(reply.dp_options, length - DHCP_HEADER_LENGTH, DHCP_OPTION_SERVER_ID, &serverIdentifier) &&
+                        (serverIdentifier.length == 4)) memcpy(client->server, serverIdentifier.value, 4);
+                client->state = DHCP_BENCH_WAIT_ACK;
+                if (sendBenchmarkMessage(sock, client, DHCPREQUEST) == -1) return -1;
+            } else if ((messageType.value[0] == DHCPACK) && (client->state == DHCP_BENCH_WAIT_ACK)) {
+                doraNs[clientNo] = (uint32_t) (now - client->startNs);
+                client->state = DHCP_BENCH_WAIT_RENEW;
+                if (sendBenchmarkMessage(sock, client, DHCPREQUEST) == -1) return -1;
+            } else if ((messageType.value[0] == DHCPACK) && (client->state == DHCP_BENCH_WAIT_RENEW)) {
+                renewNs[clientNo] = (uint32_t) (now - client->sentNs);
+                if (sendBenchmarkMessage(sock, client, DHCPRELEASE) == -1) return -1;
+                finished++;
+                //Next client into this slot. Its DISCOVER comes after the RELEASE, so a full pool has an address for it
+                client->client = (clientNo + inFlight < noOfClients) ? clientNo + inFlight : -1;
+                client->state = DHCP_BENCH_WAIT_OFFER;
+                if (client->client != -1) {
+                    client->startNs = monotonicNs();
+                    if (sendBenchmarkMessage(sock, client, DHCPDISCOVER) == -1) return -1;
+                }
+            } else if (messageType.value[0] == DHCPNAK) { //Shouldn't happen. Start again
+                (*lost)++;
+                client->state = DHCP_BENCH_WAIT_OFFER;
+                client->startNs = monotonicNs();
+                if (sendBenchmarkMessage(sock, client, DHCPDISCOVER) == -1) return -1;
+            }
         }
 
+        //Anything that's waited too long for a reply starts again from DISCOVER
+        uint64_t now = monotonicNs();
+        if (now - lastTimeoutCheck < DHCP_BENCH_TIMEOUT_NS / 10) continue;
+        lastTimeoutCheck = now;
+        for (n = 0; n < inFlight; n++) {
+            if ((clients[n].client == -1) || (now - clients[n].sentNs < DHCP_BENCH_TIMEOUT_NS)) continue;
+            if (++(*lost) > noOfClients) {
+                printf("runDHCPBenchmarkClients(): Server has stopped answering\n");
+                return -1;
+            }
+            clients[n].state = DHCP_BENCH_WAIT_OFFER;
+            clients[n].startNs = now;
+            if (sendBenchmarkMessage(sock, &clients[n], DHCPDISCOVER) == -1) return -1;
+        }
     }
-    printf("DHCP Server stopping\n");
+    return 0;
 }
 
-int startDHCPServer() {
-    //Start dhcp server as a thread
-    pthread_t _dhcpServerThread;
-    if (pthread_create(&_dhcpServerThread, NULL, DHCPServerThread, NULL)) {
-        printf("Error creating dhcp server thread.\n");
+int benchmarkDHCPServer(int maxPoolSize, int noOfClients) {
+    /*
+     * Runs the server on the loopback interface (lo, 127.0.0.1/8, handing out 127.1.x.x) and drives noOfClients
+     * synthetic clients through DISCOVER/OFFER, REQUEST/ACK, a renewal (REQUEST/ACK from ciaddr) and a RELEASE,
+     * up to DHCP_BENCH_MAX_IN_FLIGHT at a time, for pools from 3 up to maxPoolSize addresses. When the pool is
+     * smaller than the no. of clients, released addresses are handed on to new clients.
+     * Reports request/reply exchanges per second (three per client) and DORA and renewal latency percentiles.
+     * Needs ports 67 and 68 (run it as root, with no other DHCP server or client running). wlan0 isn't served
+     * while it runs, so it's for benchmarking only (main.c exits afterwards).
+     * Returns 0 on success, -1 on error
+     */
+    int poolSizes[] = {3, 256, 4096, 65536};
+    int noOfSizes = sizeof (poolSizes) / sizeof (poolSizes[0]);
+    char leaseFile[] = "/tmp/piconfigserver_benchdhcpserver.leases";
+    char first[] = "127.1.0.0";
+    char last[INET_ADDRSTRLEN];
+    struct in_addr lastAddress;
+    int s, status = 0;
+    if (maxPoolSize < 3) maxPoolSize = 3;
+    if (maxPoolSize > 65536) maxPoolSize = 65536; //All within 127.1.x.x
+    if (noOfClients < 1) noOfClients = 1;
+
+    //The synthetic clients share one socket on port 68. Replies come back broadcast (lo has no hardware address
+    //to unicast to) or, for renewals, to ciaddr, which is local as it's in 127/8
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+    if (sock == -1) {
+        perror("benchmarkDHCPServer(): socket()");
         return -1;
     }
-    while (getDhcpServerRunningStatus() == 0) { //Blocking call
-        printf("startDHCPServer(): Waiting for confirmation that DHCP server has started\n");
-        sleep(1);
+    int bufferSize = 4 * 1024 * 1024;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof (bufferSize));
+    struct sockaddr_in clientAddr;
+    memset(&clientAddr, 0, sizeof (clientAddr));
+    clientAddr.sin_family = AF_INET;
+    clientAddr.sin_port = htons(IPPORT_DHCPC);
+    clientAddr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(sock, (struct sockaddr *) &clientAddr, sizeof (clientAddr)) == -1) {
+        perror("benchmarkDHCPServer(): bind() to port 68");
+        close(sock);
+        return -1;
     }
-    printf("startDHCPServer(): DHCP Server has started\n");
-    return 1; //Will only return once server has started
-}
 
+    uint32_t *doraNs = malloc(noOfClients * sizeof (uint32_t));
+    uint32_t *renewNs = malloc(noOfClients * sizeof (uint32_t));
+    if ((doraNs == NULL) || (renewNs == NULL)) {
+        printf("benchmarkDHCPServer(): malloc()\n");
+        free(doraNs);
+        free(renewNs);
+        close(sock);
+        return -1;
+    }
+
+    dhcpServerLogging = 0;
+    removeDHCPInterface(DHCP_DEFAULT_INTERFACE);
+    printf("Pool size\tClients\tExchanges/s\tDORA p50/p99/p999 (us)\t\tRenew p50/p99/p999 (us)\t\tLost\n");
+    for (s = 0; s < noOfSizes; s++) {
+        int size = poolSizes[s];
+        if (size > maxPoolSize) size = maxPoolSize;
+        inet_pton(AF_INET, first, &lastAddress);
+        lastAddress.s_addr = htonl(ntohl(lastAddress.s_addr) + size - 1);
+        inet_ntop(AF_INET, &lastAddress, last, INET_ADDRSTRLEN);
+        //A fresh pool (and lease file) for each size. Set up straight away if the server's already running
+        unlink(leaseFile);
+        if ((addDHCPInterface("lo", "127.0.0.1", "255.0.0.0", first, last) == -1) ||
+                (setDHCPInterfaceLeaseFile("lo", leaseFile) == -1) ||
+                ((s == 0) && (startDHCPServer() == -1))) {
+            status = -1;
+            break;
+        }
+
+        int inFlight = (size < DHCP_BENCH_MAX_IN_FLIGHT) ? size : DHCP_BENCH_MAX_IN_FLIGHT;
+        int lost;
+        uint64_t start = monotonicNs();
+        if (runDHCPBenchmarkClients(sock, noOfClients, inFlight, doraNs, renewNs, &lost) == -1) {
+            status = -1;
+            break;
+        }
+        double seconds = (monotonicNs() - start) / 1e9;
+        qsort(doraNs, noOfClients, sizeof (uint32_t), compareUint32);
+        qsort(renewNs, noOfClients, sizeof (uint32_t), compareUint32);
+        printf("%d\t\t%d\t%.0f\t\t%.1f/%.1f/%.1f\t\t%.1f/%.1f/%.1f\t\t%d\n", size, noOfClients, 3 * noOfClients / seconds,
+                percentileUs(doraNs, noOfClients, 0.5), percentileUs(doraNs, noOfClients, 0.99), percentileUs(doraNs, noOfClients, 0.999),
+                percentileUs(renewNs, noOfClients, 0.5), percentileUs(renewNs, noOfClients, 0.99), percentileUs(renewNs, noOfClients, 0.999),
+                lost);
+        if (size == maxPoolSize) break;
+    }
+    stopDHCPServer();
+    removeDHCPInterface("lo");
+    unlink(leaseFile);
+    dhcpServerLogging = 1;
+    free(doraNs);
+    free(renewNs);
+    close(sock);
+    return status;
+}
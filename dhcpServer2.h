@@ -0,0 +1,50 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   dhcpServer2.h
+ *
+ * DHCP server for setup mode (see dhcpServer2.c)
+ */
+
+#ifndef DHCPSERVER2_H
+#define DHCPSERVER2_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "dhcpServer2.h" TO THE SOURCE FILE
+
+#include <stdint.h>
+
+int addDHCPInterface(char name[], char serverAddress[], char netmask[], char firstAddress[], char lastAddress[]);
+int removeDHCPInterface(char name[]);
+int setDHCPInterfaceOptions(char name[], uint32_t leaseSeconds, int rapidCommit);
+int setDHCPServerPool(char serverAddress[], char netmask[], char firstAddress[], char lastAddress[]);
+int setDHCPServerRange(char firstAddress[], char lastAddress[]);
+void setDHCPRapidCommit(int enabled);
+void setDHCPActivityCallback(void (*callback)(void));
+int setDHCPInterfaceLeaseFile(char name[], char path[]);
+int setDHCPLeaseFile(char path[]);
+int startDHCPServer();
+void stopDHCPServer();
+int waitDHCPServerStopped(int timeoutMs);
+int getDhcpServerRunningStatus();
+void printDHCPLeaseTable();
+int benchmarkDHCPServer(int maxPoolSize, int noOfClients);
+
+//AND BEFORE HERE
+#endif /* DHCPSERVER2_H */
+
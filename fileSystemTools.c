@@ -0,0 +1,532 @@
+/*
+ * File system helpers for the read-only Raspian setup described here:-
+ * http://petr.io/en/blog/2015/11/09/read-only-raspberry-pi-with-jessie/
+ *
+ * isFileSystemWriteable()
+ * -----------------------
+ * Used to create (and then delete) a test file in /etc (and then the home directory) every time
+ * an SSID was added or removed. That's a real write to an SD card that we are deliberately trying
+ * to keep read-only. It now asks the kernel instead:-
+ *      -statvfs() on the target directory tells us whether the file system is mounted read-only (ST_RDONLY)
+ *      -faccessat(W_OK) on the target directory tells us whether we have the rights to write there
+ * Neither call touches the disk.
+ *
+ * The answer is cached. The cache is thrown away whenever the mount table changes. The kernel
+ * flags /proc/self/mountinfo with POLLPRI|POLLERR every time something is mounted, unmounted or
+ * remounted, so mountWatcherThread() simply sits in poll() on that file and invalidates the cache
+ * when it fires.
+ *
+ * Start the watcher with startMountWatcher() (the target path can be a file or a directory. If it's
+ * a file, the directory containing it is checked)
+ *
+ * Read-write sessions
+ * -------------------
+ * Every config change used to be wrapped in its own 'mount -o remount,rw /' ... 'mount -o remount,ro /'
+ * pair, each of which forks a shell and mount(8), and each ro remount forces the file system to be
+ * synced. beginReadWriteSession() / endReadWriteSession() replace that:-
+ *      -Sessions are reference counted. The first one remounts rw (only if it has to), the rest piggy-back
+ *      -When the last session ends, readWriteLingerThread() waits for the linger time (default
+ *       READ_WRITE_LINGER_MS). If another session starts in the meantime it shares the existing rw mount
+ *      -Once the linger time has passed with no sessions open, the file system is put back to ro
+ *      -If the file system was already rw when the first session started, it's left alone afterwards
+ * Remounting is done with the mount(2) syscall directly (see remountFileSystem()), not via a shell.
+ *
+ * benchmarkReadWriteSessions() compares the two approaches (run it against a loop-mounted image,
+ * e.g: piConfigServer -benchremount /mnt/test)
+ */
+
+#define _GNU_SOURCE     //For the ST_NODEV etc statvfs() flags
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <limits.h>
+#include <pthread.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/mount.h>
+#include <time.h>
+#include "fileSystemTools.h"
+
+#define MOUNTINFO_PATH "/proc/self/mountinfo"
+#define READ_WRITE_LINGER_MS 5000 //How long the fs stays rw after the last session has ended
+
+static char writeableTargetDir[PATH_MAX] = "/etc"; //Directory that has to be writeable (by default, /etc)
+static pthread_mutex_t writeableCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static int writeableCacheValid = 0; //Set once a value has been calculated, cleared by a mount table change
+static int writeableCacheValue = -1; //Last value returned by probeFileSystemWriteable()
+static int mountWatcherRunning = 0; //Guarded by writeableCacheMutex
+
+static int isPathWriteable(char path[]) {
+    /*
+     * Returns 1 if the file system holding path is mounted read-write and we have the rights to
+     * write to path, 0 if not, -1 if the path can't be examined
+     */
+    struct statvfs fsInfo;
+    if (statvfs(path, &fsInfo) == -1) {
+        perror("fileSystemTools:isPathWriteable():statvfs()");
+        return -1;
+    }
+    if (fsInfo.f_flag & ST_RDONLY) return 0; //Mounted read-only. No point going any further
+    //AT_EACCESS so that the effective uid is checked (we might have been started via sudo/setuid)
+    if (faccessat(AT_FDCWD, path, W_OK, AT_EACCESS) == 0) return 1;
+    return 0;
+}
+
+static int probeFileSystemWriteable() {
+    /*
+     * Does the actual work for isFileSystemWriteable(). Keeps the return values of the original
+     * 'create a test file' version:-
+     *
+     * Returns '2' if the target directory (normally /etc) is writeable,
+     * returns 1 if the file system is writeable but we can only write to the working directory,
+     * 0 if read-only, or -1 if an error
+     */
+    struct statvfs fsInfo;
+    if (statvfs(writeableTargetDir, &fsInfo) == -1) {
+        perror("isFileSystemWriteable():statvfs()");
+        return -1;
+    }
+    if (fsInfo.f_flag & ST_RDONLY) return 0; //Read-only file system. Needs remounting before we can write
+    if (faccessat(AT_FDCWD, writeableTargetDir, W_OK, AT_EACCESS) == 0) return 2;
+
+    //File system is read-write, but we're not allowed to write to the target directory (could be a sudo issue)
+    //Fall back to testing the working directory (this is what the original test file version did)
+    if (isPathWriteable(".") == 1) return 1;
+    return 0;
+}
+
+int isFileSystemWriteable() {
+    /**
+     * Returns '2' if OS fully writeable (i.e the program has sudo rights) ,
+     * returns 1 if can write to home folder, 0 if read-only, or -1 if an error
+     *
+     * The result is cached until mountWatcherThread() sees the mount table change
+     * (or invalidateFileSystemWriteableCache() is called). If the watcher isn't running
+     * the cache can't be trusted so the kernel is asked every time (it's still cheap and
+     * still doesn't write anything)
+     *
+     * @return
+     */
+    int ret;
+    pthread_mutex_lock(&writeableCacheMutex);
+    if ((writeableCacheValid == 1) && (mountWatcherRunning == 1)) {
+        ret = writeableCacheValue;
+    } else {
+        ret = probeFileSystemWriteable();
+        writeableCacheValue = ret;
+        writeableCacheValid = (ret == -1) ? 0 : 1; //Don't cache errors
+        printf("isFileSystemWriteable(): %s: %d\n", writeableTargetDir, ret);
+    }
+    pthread_mutex_unlock(&writeableCacheMutex);
+    return ret;
+}
+
+void invalidateFileSystemWriteableCache() {
+    /*
+     * Forces the next isFileSystemWriteable() call to ask the kernel again.
+     * Call this after remounting the file system ourselves, so we don't have to wait
+     * for mountWatcherThread() to notice
+     */
+    pthread_mutex_lock(&writeableCacheMutex);
+    writeableCacheValid = 0;
+    pthread_mutex_unlock(&writeableCacheMutex);
+}
+
+void *mountWatcherThread(void *arg) {
+    /*
+     * Pthread: Blocks in poll() on /proc/self/mountinfo. The kernel raises POLLPRI|POLLERR on that
+     * file whenever the mount table changes (e.g mount -o remount,ro /). When that happens
+     * the cached isFileSystemWriteable() value is thrown away.
+     *
+     * There's no need to re-read the file to re-arm it, the kernel records that we've seen the
+     * event inside poll() itself
+     */
+    int fd = *((int*) arg); //Take local copy of arg
+    free(arg); //Free up memory requested by malloc
+    struct pollfd mountInfo;
+    mountInfo.fd = fd;
+    mountInfo.events = POLLPRI;
+
+    while (1) {
+        mountInfo.revents = 0;
+        int ret = poll(&mountInfo, 1, -1); //Blocking call. No timeout
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            perror("mountWatcherThread():poll()");
+            break;
+        }
+        if (mountInfo.revents & (POLLPRI | POLLERR)) {
+            printf("mountWatcherThread(): Mount table changed\n");
+            invalidateFileSystemWriteableCache();
+        }
+    }
+    //Can't trust the cache any more, so stop using it
+    pthread_mutex_lock(&writeableCacheMutex);
+    mountWatcherRunning = 0;
+    writeableCacheValid = 0;
+    pthread_mutex_unlock(&writeableCacheMutex);
+    close(fd);
+    return NULL;
+}
+
+int startMountWatcher(char targetPath[]) {
+    /*
+     * Sets the directory checked by isFileSystemWriteable() and starts mountWatcherThread()
+     *
+     * targetPath can be the file we want to modify (e.g /etc/wpa_supplicant/wpa_supplicant.conf), in which
+     * case the directory it lives in is used, or the directory itself.
+     *
+     * Returns 1 on success, -1 on failure (isFileSystemWriteable() will still work, it just won't cache)
+     */
+    struct stat targetInfo;
+    char pathCopy[PATH_MAX] = {0};
+
+    if ((targetPath != NULL) && (strlen(targetPath) > 0)) {
+        strncpy(pathCopy, targetPath, PATH_MAX - 1);
+        pthread_mutex_lock(&writeableCacheMutex);
+        if ((stat(pathCopy, &targetInfo) == 0) && S_ISDIR(targetInfo.st_mode))
+            strncpy(writeableTargetDir, pathCopy, PATH_MAX - 1);
+        else
+            strncpy(writeableTargetDir, dirname(pathCopy), PATH_MAX - 1); //dirname() modifies pathCopy, hence the copy
+        writeableCacheValid = 0;
+        pthread_mutex_unlock(&writeableCacheMutex);
+    }
+    printf("startMountWatcher(): Checking writeability of %s\n", writeableTargetDir);
+
+    pthread_mutex_lock(&writeableCacheMutex);
+    int alreadyRunning = mountWatcherRunning;
+    mountWatcherRunning = 1; //Claimed here, so two callers can't both start one
+    pthread_mutex_unlock(&writeableCacheMutex);
+    if (alreadyRunning == 1) return 1;
+
+    int *fdPtr = malloc(sizeof (*fdPtr));
+    if (fdPtr == NULL) goto notStarted;
+    *fdPtr = open(MOUNTINFO_PATH, O_RDONLY | O_CLOEXEC);
+    if (*fdPtr < 0) {
+        perror("startMountWatcher():open() " MOUNTINFO_PATH);
+        free(fdPtr);
+        goto notStarted;
+    }
+    pthread_t _mountWatcherThread;
+    if (pthread_create(&_mountWatcherThread, NULL, mountWatcherThread, (void*) fdPtr)) {
+        printf("Error creating mountWatcherThread thread.\n");
+        close(*fdPtr);
+        free(fdPtr);
+        goto notStarted;
+    }
+    pthread_detach(_mountWatcherThread); //Don't care what happens to thread afterwards
+    return 1;
+
+notStarted:
+    pthread_mutex_lock(&writeableCacheMutex);
+    mountWatcherRunning = 0;
+    pthread_mutex_unlock(&writeableCacheMutex);
+    return -1;
+}
+
+/*
+ * Read-write session state. All protected by sessionMutex
+ */
+static char sessionMountPoint[PATH_MAX] = "/"; //File system that gets remounted
+static pthread_mutex_t sessionMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sessionCond; //Initialised (with CLOCK_MONOTONIC) by initSessionCond()
+static pthread_once_t sessionCondOnce = PTHREAD_ONCE_INIT;
+static int sessionRefCount = 0; //Number of open sessions
+static int sessionRemounted = 0; //Set if we remounted rw (so it's up to us to put it back to ro)
+static int sessionLingerMs = READ_WRITE_LINGER_MS;
+static struct timespec sessionIdleSince; //When sessionRefCount last dropped to zero
+static int lingerThreadRunning = 0;
+static int sessionRemountCount = 0; //Number of remounts actually performed (rw and ro). For diagnostics
+
+int remountFileSystem(char mountPoint[], int readWrite) {
+    /*
+     * Remounts mountPoint read-write (readWrite>0) or read-only (readWrite==0) using the mount(2)
+     * syscall. Equivalent to 'mount -o remount,rw|ro mountPoint' but without forking a shell.
+     *
+     * A plain MS_REMOUNT replaces the per-mount flags (nosuid, nodev etc) with whatever's passed in,
+     * so the current ones are read back with statvfs() and passed through unchanged.
+     *
+     * Returns 0 on success, -1 on failure (errno set by mount())
+     */
+    struct statvfs fsInfo;
+    unsigned long flags = MS_REMOUNT;
+    if (statvfs(mountPoint, &fsInfo) == -1) {
+        perror("remountFileSystem():statvfs()");
+        return -1;
+    }
+    if (fsInfo.f_flag & ST_NOSUID) flags |= MS_NOSUID;
+    if (fsInfo.f_flag & ST_NODEV) flags |= MS_NODEV;
+    if (fsInfo.f_flag & ST_NOEXEC) flags |= MS_NOEXEC;
+    if (fsInfo.f_flag & ST_SYNCHRONOUS) flags |= MS_SYNCHRONOUS;
+    if (fsInfo.f_flag & ST_NOATIME) flags |= MS_NOATIME;
+    if (fsInfo.f_flag & ST_NODIRATIME) flags |= MS_NODIRATIME;
+    if (fsInfo.f_flag & ST_RELATIME) flags |= MS_RELATIME;
+    if (readWrite == 0) flags |= MS_RDONLY;
+
+    int ret = mount(NULL, mountPoint, NULL, flags, NULL);
+    int savedErrno = errno;
+    invalidateFileSystemWriteableCache(); //Don't wait for the mount watcher to notice
+    if (ret == -1) {
+        errno = savedErrno;
+        perror("remountFileSystem():mount()");
+        return -1;
+    }
+    return 0;
+}
+
+void setReadWriteFileSystemMode(int mode) {
+    /**
+     * Remounts the root file system as read-write, or read only, immediately.
+     *
+     * These remounts are only intended to be used if the os has been modded according to this tutorial:-
+     * http://petr.io/en/blog/2015/11/09/read-only-raspberry-pi-with-jessie/ which modifies Raspian to be readonly
+     * (to protect the SD card from corruption) but permits writes, by remounting, where necessary.
+     *
+     * Doesn't know about read-write sessions, so for config changes use beginReadWriteSession() and
+     * endReadWriteSession() instead.
+     *
+     * if mode>0, will invoke read-write mode, if mode==0, will invoke readonly mode
+     *
+     * @param mode
+     */
+    remountFileSystem("/", mode);
+}
+
+static void initSessionCond() {
+    //The linger deadline is measured against CLOCK_MONOTONIC, so the condvar has to use it too
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sessionCond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static int closeIdleSession() {
+    /*
+     * Puts the file system back to read-only, if we were the ones who made it read-write
+     * and there are no sessions open. Must be called with sessionMutex held.
+     *
+     * Returns 1 if remounted, 0 if there was nothing to do, -1 if the remount failed
+     * (e.g EBUSY because a file is still open for writing)
+     */
+    if ((sessionRefCount > 0) || (sessionRemounted == 0)) return 0;
+    printf("closeIdleSession(): Reverting %s to read-only mode\n", sessionMountPoint);
+    if (remountFileSystem(sessionMountPoint, 0) == -1) return -1;
+    sessionRemounted = 0;
+    sessionRemountCount++;
+    return 1;
+}
+
+void *readWriteLingerThread(void *arg) {
+    /*
+     * Pthread: Waits for the last read-write session to end, then waits for the linger time
+     * to pass. If no new session has started by then, the file system is remounted read-only.
+     * If the remount fails, the linger period starts again and it'll be retried.
+     */
+    pthread_mutex_lock(&sessionMutex);
+    while (1) {
+        if ((sessionRefCount > 0) || (sessionRemounted == 0)) {
+            pthread_cond_wait(&sessionCond, &sessionMutex); //Nothing to do until a session ends
+            continue;
+        }
+        struct timespec deadline = sessionIdleSince;
+        deadline.tv_sec += sessionLingerMs / 1000;
+        deadline.tv_nsec += (sessionLingerMs % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec > deadline.tv_sec) || ((now.tv_sec == deadline.tv_sec) && (now.tv_nsec >= deadline.tv_nsec))) {
+            if (closeIdleSession() == -1)
+                sessionIdleSince = now; //Try again after another linger period
+            continue;
+        }
+        //Wakes early if a session starts or ends (which may move sessionIdleSince on), so loop round and re-check
+        pthread_cond_timedwait(&sessionCond, &sessionMutex, &deadline);
+    }
+    pthread_mutex_unlock(&sessionMutex);
+    return NULL;
+}
+
+int beginReadWriteSession() {
+    /*
+     * Opens a read-write session. If the file system is read-only it's remounted read-write
+     * (unless another session already did that). Every call must be matched with endReadWriteSession(),
+     * whatever this returns.
+     *
+     * Returns the isFileSystemWriteable() value once the remount (if any) has been done, i.e
+     * 2 if the target directory can now be written to, 1 if only the working directory can,
+     * 0 if the file system is still read-only, -1 on error
+     */
+    pthread_once(&sessionCondOnce, initSessionCond);
+    pthread_mutex_lock(&sessionMutex);
+    sessionRefCount++;
+    if (lingerThreadRunning == 0) {
+        pthread_t _readWriteLingerThread;
+        if (pthread_create(&_readWriteLingerThread, NULL, readWriteLingerThread, NULL)) {
+            printf("Error creating readWriteLingerThread thread.\n");
+        } else {
+            pthread_detach(_readWriteLingerThread); //Don't care what happens to thread afterwards
+            lingerThreadRunning = 1;
+        }
+    }
+    int status = isFileSystemWriteable();
+    if (status == 0) {
+        printf("beginReadWriteSession(): File system is readonly. Remounting %s read-write\n", sessionMountPoint);
+        if (remountFileSystem(sessionMountPoint, 1) == 0) {
+            sessionRemounted = 1;
+            sessionRemountCount++;
+        }
+        status = isFileSystemWriteable();
+    }
+    pthread_mutex_unlock(&sessionMutex);
+    return status;
+}
+
+void endReadWriteSession() {
+    /*
+     * Closes a session opened by beginReadWriteSession(). When the last one closes, the linger
+     * timer starts. If no new session is opened before it expires, the file system goes back to read-only.
+     */
+    pthread_mutex_lock(&sessionMutex);
+    if (sessionRefCount > 0) sessionRefCount--;
+    if (sessionRefCount == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &sessionIdleSince);
+        if (sessionLingerMs <= 0) closeIdleSession(); //No linger, revert straight away
+        pthread_cond_signal(&sessionCond);
+    }
+    pthread_mutex_unlock(&sessionMutex);
+}
+
+int flushReadWriteSession() {
+    /*
+     * Don't wait for the linger time. If no sessions are open and we remounted the file system
+     * read-write, put it back to read-only now (e.g because we're about to exit)
+     *
+     * Returns 1 if remounted, 0 if there was nothing to do, -1 on failure
+     */
+    pthread_mutex_lock(&sessionMutex);
+    int ret = closeIdleSession();
+    pthread_mutex_unlock(&sessionMutex);
+    return ret;
+}
+
+void setReadWriteSessionOptions(char mountPoint[], int lingerMs) {
+    /*
+     * Sets the file system remounted by beginReadWriteSession() (default "/") and how long it stays
+     * read-write after the last session has ended (default READ_WRITE_LINGER_MS). A lingerMs of 0 reverts
+     * as soon as the last session ends (i.e the old behaviour). Pass NULL or -1 to leave a setting alone.
+     */
+    pthread_mutex_lock(&sessionMutex);
+    if ((mountPoint != NULL) && (strlen(mountPoint) > 0)) strncpy(sessionMountPoint, mountPoint, PATH_MAX - 1);
+    if (lingerMs >= 0) sessionLingerMs = lingerMs;
+    pthread_mutex_unlock(&sessionMutex);
+}
+
+int getReadWriteSessionRemountCount() {
+    //Returns the number of remounts performed by the session manager so far
+    pthread_mutex_lock(&sessionMutex);
+    int ret = sessionRemountCount;
+    pthread_mutex_unlock(&sessionMutex);
+    return ret;
+}
+
+static double elapsedMs(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1000.0 + (end->tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static int benchmarkWrite(char filePath[], int iteration) {
+    //A small config-sized write, like createWPASupplicantConfig() does
+    FILE *fp = fopen(filePath, "w");
+    if (fp == NULL) return -1;
+    fprintf(fp, "network={\n\tssid=\"benchmark%d\"\n\tpsk=\"benchmarkpassphrase\"\n}\n", iteration);
+    fclose(fp);
+    return 0;
+}
+
+int benchmarkReadWriteSessions(char mountPoint[], int iterations) {
+    /*
+     * Compares remount-per-write (the old AddSSID/removeSSID behaviour) against read-write sessions.
+     * mountPoint should be a scratch file system that's currently mounted read-only, e.g a
+     * loop-mounted image:-
+     *      dd if=/dev/zero of=/tmp/fs.img bs=1M count=16 && mkfs.ext4 /tmp/fs.img
+     *      mkdir /mnt/test && mount -o loop,ro /tmp/fs.img /mnt/test
+     *
+     * Writes (and finally removes) a small file in mountPoint, so needs root.
+     * Returns 0 on success, -1 on failure
+     */
+    char filePath[PATH_MAX] = {0};
+    struct timespec start, end;
+    struct statvfs fsInfo;
+    if (iterations < 1) iterations = 1;
+    snprintf(filePath, PATH_MAX, "%s/piConfigServerBenchmark.tmp", mountPoint);
+
+    if (statvfs(mountPoint, &fsInfo) == -1) {
+        perror("benchmarkReadWriteSessions():statvfs()");
+        return -1;
+    }
+    if (!(fsInfo.f_flag & ST_RDONLY)) {
+        printf("benchmarkReadWriteSessions(): %s should be mounted read-only to start with\n", mountPoint);
+        return -1;
+    }
+    printf("benchmarkReadWriteSessions(): %d writes to %s\n", iterations, filePath);
+
+    //Old way: rw remount, write, ro remount for every write
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int n = 0; n < iterations; n++) {
+        if (remountFileSystem(mountPoint, 1) == -1) return -1;
+        if (benchmarkWrite(filePath, n) == -1) perror("benchmarkReadWriteSessions():fopen()");
+        if (remountFileSystem(mountPoint, 0) == -1) return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double perWriteMs = elapsedMs(&start, &end);
+    printf("Remount per write:  %8.3f ms total, %8.3f ms/write, %d remounts\n",
+            perWriteMs, perWriteMs / iterations, iterations * 2);
+
+    //New way: back-to-back sessions share one remount, reverted once on flush
+    char savedMountPoint[PATH_MAX];
+    int savedLingerMs;
+    pthread_mutex_lock(&sessionMutex);
+    strncpy(savedMountPoint, sessionMountPoint, PATH_MAX);
+    savedLingerMs = sessionLingerMs;
+    pthread_mutex_unlock(&sessionMutex);
+    //isFileSystemWriteable() looks at the target dir, so point that at the test mount too
+    pthread_mutex_lock(&writeableCacheMutex);
+    char savedTargetDir[PATH_MAX];
+    strncpy(savedTargetDir, writeableTargetDir, PATH_MAX);
+    strncpy(writeableTargetDir, mountPoint, PATH_MAX - 1);
+    writeableCacheValid = 0;
+    pthread_mutex_unlock(&writeableCacheMutex);
+    setReadWriteSessionOptions(mountPoint, READ_WRITE_LINGER_MS);
+    int startCount = getReadWriteSessionRemountCount();
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int n = 0; n < iterations; n++) {
+        if (beginReadWriteSession() == 2) {
+            if (benchmarkWrite(filePath, n) == -1) perror("benchmarkReadWriteSessions():fopen()");
+        }
+        endReadWriteSession();
+    }
+    if (beginReadWriteSession() == 2) unlink(filePath); //Tidy up before reverting
+    endReadWriteSession();
+    flushReadWriteSession();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double sessionMs = elapsedMs(&start, &end);
+    printf("Read-write session: %8.3f ms total, %8.3f ms/write, %d remounts\n",
+            sessionMs, sessionMs / iterations, getReadWriteSessionRemountCount() - startCount);
+
+    //Put everything back how it was
+    setReadWriteSessionOptions(savedMountPoint, savedLingerMs);
+    pthread_mutex_lock(&writeableCacheMutex);
+    strncpy(writeableTargetDir, savedTargetDir, PATH_MAX);
+    writeableCacheValid = 0;
+    pthread_mutex_unlock(&writeableCacheMutex);
+    return 0;
+}
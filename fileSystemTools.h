@@ -0,0 +1,44 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   fileSystemTools.h
+ *
+ * Helpers for living with a read-only root file system (see fileSystemTools.c)
+ */
+
+#ifndef FILESYSTEMTOOLS_H
+#define FILESYSTEMTOOLS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "fileSystemTools.h" TO THE SOURCE FILE
+
+int startMountWatcher(char targetPath[]);
+int isFileSystemWriteable();
+void invalidateFileSystemWriteableCache();
+int remountFileSystem(char mountPoint[], int readWrite);
+void setReadWriteFileSystemMode(int mode);
+int beginReadWriteSession();
+void endReadWriteSession();
+int flushReadWriteSession();
+void setReadWriteSessionOptions(char mountPoint[], int lingerMs);
+int getReadWriteSessionRemountCount();
+int benchmarkReadWriteSessions(char mountPoint[], int iterations);
+
+//AND BEFORE HERE
+#endif /* FILESYSTEMTOOLS_H */
+
@@ -0,0 +1,138 @@
+/*
+ * GPIO backends
+ *
+ * Everything that touches a pin (the status LED, the setup button) goes through here, and here passes it on to
+ * one of:
+ *      -gpioChipBackend (gpioChip.c): The kernel's GPIO character device. Works on any Pi (including the Pi 5,
+ *       whose GPIOs aren't on the SoC at all) without root, and can wait for edges rather than polling
+ *      -gpioMemBackend (minimal_gpio.c): The SoC's registers, mmap()ed through /dev/mem. Needs root, and only
+ *       works on BCM283x/BCM2711 based Pis. Can't wait for edges
+ *      -gpioSimBackend (gpioSim.c): A simulator. Inputs are driven by a script or setGPIOSimInput(), and writes
+ *       are recorded. So the button and LED logic, and the whole server, can run on any Linux box
+ *
+ * With GPIO_BACKEND_AUTO (the default) they're tried in that order, so a box without GPIO hardware ends up
+ * with the simulator rather than the server refusing to start.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "gpioBackend.h"
+#include "gpioChip.h"
+#include "gpioSim.h"
+
+static void memWriteBank(uint64_t setMask, uint64_t clearMask) {
+    //One write to GPSET0/GPCLR0 (and GPSET1/GPCLR1 for GPIO 32-53, if any are involved) however many pins change
+    if ((uint32_t) setMask) gpioSetBank1((uint32_t) setMask);
+    if ((uint32_t) clearMask) gpioClearBank1((uint32_t) clearMask);
+    if (setMask >> 32) gpioSetBank2((uint32_t) (setMask >> 32));
+    if (clearMask >> 32) gpioClearBank2((uint32_t) (clearMask >> 32));
+}
+
+static gpioBackend gpioMemBackend = {
+    "/dev/mem", gpioInitialise, gpioSetMode, gpioSetPullUpDown, gpioRead, gpioWrite, memWriteBank, NULL, NULL
+};
+
+static int requestedGPIOBackend = GPIO_BACKEND_AUTO;
+static gpioBackend *activeGPIOBackend = NULL;
+
+void setGPIOBackend(int backend) {
+    //Call before initialiseGPIO()
+    requestedGPIOBackend = backend;
+}
+
+static gpioBackend *getGPIOBackend(int backend) {
+    switch (backend) {
+        case GPIO_BACKEND_CHIP: return &gpioChipBackend;
+        case GPIO_BACKEND_MEM: return &gpioMemBackend;
+        case GPIO_BACKEND_SIM: return &gpioSimBackend;
+        default: return NULL;
+    }
+}
+
+int initialiseGPIO(void) {
+    /*
+     * Initialises the requested backend (see setGPIOBackend()), or the first that works.
+     * Returns 0 on success, -1 if the requested backend can't be used
+     */
+    if (activeGPIOBackend != NULL) return 0;
+    if (requestedGPIOBackend != GPIO_BACKEND_AUTO) {
+        gpioBackend *backend = getGPIOBackend(requestedGPIOBackend);
+        if ((backend == NULL) || (backend->initialise() < 0)) {
+            printf("initialiseGPIO(): Can't use GPIO backend %s\n", backend != NULL ? backend->name : "?");
+            return -1;
+        }
+        activeGPIOBackend = backend;
+    } else {
+        int backends[] = {GPIO_BACKEND_CHIP, GPIO_BACKEND_MEM, GPIO_BACKEND_SIM};
+        int n;
+        for (n = 0; n < (int) (sizeof (backends) / sizeof (backends[0])); n++) {
+            gpioBackend *backend = getGPIOBackend(backends[n]);
+            if (backend->initialise() == 0) {
+                activeGPIOBackend = backend;
+                break;
+            }
+        }
+        if (activeGPIOBackend == NULL) return -1;
+        if (activeGPIOBackend == &gpioSimBackend) printf("initialiseGPIO(): No GPIO hardware found, pins are simulated\n");
+    }
+    printf("initialiseGPIO(): Using %s for GPIO\n", activeGPIOBackend->name);
+    return 0;
+}
+
+const char *getGPIOBackendName(void) {
+    return (activeGPIOBackend != NULL) ? activeGPIOBackend->name : "none";
+}
+
+void setGPIOMode(unsigned gpio, unsigned mode) {
+    if ((activeGPIOBackend == NULL) || (gpio >= GPIO_MAX_PINS)) return;
+    activeGPIOBackend->setMode(gpio, mode);
+}
+
+void setGPIOPullUpDown(unsigned gpio, unsigned pud) {
+    if ((activeGPIOBackend == NULL) || (gpio >= GPIO_MAX_PINS)) return;
+    activeGPIOBackend->setPullUpDown(gpio, pud);
+}
+
+int readGPIO(unsigned gpio) {
+    //Returns the pin's level (0 or 1), or -1 if it can't be read
+    if ((activeGPIOBackend == NULL) || (gpio >= GPIO_MAX_PINS)) return -1;
+    return activeGPIOBackend->read(gpio);
+}
+
+void writeGPIO(unsigned gpio, unsigned level) {
+    if ((activeGPIOBackend == NULL) || (gpio >= GPIO_MAX_PINS)) return;
+    activeGPIOBackend->write(gpio, level);
+}
+
+void writeGPIOBank(uint64_t setMask, uint64_t clearMask) {
+    //Sets the pins in setMask high and those in clearMask low (bit n = GPIO n), all at once if the backend can
+    if (activeGPIOBackend == NULL) return;
+    if (activeGPIOBackend->writeBank != NULL) {
+        activeGPIOBackend->writeBank(setMask, clearMask & ~setMask);
+        return;
+    }
+    unsigned gpio;
+    for (gpio = 0; gpio < GPIO_MAX_PINS; gpio++) {
+        if (setMask & (1ull << gpio)) activeGPIOBackend->write(gpio, HIGH);
+        else if (clearMask & (1ull << gpio)) activeGPIOBackend->write(gpio, LOW);
+    }
+}
+
+int watchGPIOEdges(unsigned gpio, unsigned pud, unsigned debounceUs) {
+    /*
+     * Sets gpio up as an input and asks for its edges. debounceUs is a hint: the backend may not debounce.
+     * Returns an fd to poll() for POLLIN, then readGPIOEdge() from. -1 if the backend can't report edges (so the
+     * pin has to be polled with readGPIO() instead). The fd belongs to the backend: don't close it
+     */
+    if ((activeGPIOBackend == NULL) || (gpio >= GPIO_MAX_PINS) || (activeGPIOBackend->watchEdges == NULL)) return -1;
+    return activeGPIOBackend->watchEdges(gpio, pud, debounceUs);
+}
+
+int readGPIOEdge(int fd, int *level, uint64_t *timestampNs) {
+    /*
+     * Reads the next edge from a watchGPIOEdges() fd: the level the pin went to, and when (CLOCK_MONOTONIC nS).
+     * Returns 1 if there was one, 0 if there are no more for now, -1 on error
+     */
+    if ((activeGPIOBackend == NULL) || (activeGPIOBackend->readEdge == NULL)) return -1;
+    return activeGPIOBackend->readEdge(fd, level, timestampNs);
+}
@@ -0,0 +1,69 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   gpioBackend.h
+ *
+ * GPIO access through whichever backend is available: gpiochip, /dev/mem or a simulator (see gpioBackend.c)
+ */
+
+#ifndef GPIOBACKEND_H
+#define GPIOBACKEND_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "gpioBackend.h" TO THE SOURCE FILE
+
+#include <stdint.h>
+#include "minimal_gpio.h" //PI_INPUT, PI_PUD_UP, HIGH etc. are used by all the backends
+
+#define GPIO_MAX_PINS 64
+
+//Backends
+#define GPIO_BACKEND_AUTO 0     //gpiochip if there is one, else /dev/mem, else the simulator
+#define GPIO_BACKEND_CHIP 1     //GPIO character device, /dev/gpiochipN (gpioChip.c)
+#define GPIO_BACKEND_MEM 2      //BCM283x/BCM2711 registers mmap()ed through /dev/mem (minimal_gpio.c)
+#define GPIO_BACKEND_SIM 3      //In-process simulator (gpioSim.c)
+
+typedef struct {
+    const char *name;
+    int (*initialise)(void); //Returns 0 if the backend can be used, -1 if not
+    void (*setMode)(unsigned gpio, unsigned mode); //PI_INPUT or PI_OUTPUT
+    void (*setPullUpDown)(unsigned gpio, unsigned pud); //PI_PUD_OFF etc.
+    int (*read)(unsigned gpio);
+    void (*write)(unsigned gpio, unsigned level);
+    //Optional: sets every pin in setMask high and every pin in clearMask low (bit n = GPIO n) in one go.
+    //If NULL, writeGPIOBank() writes the pins one at a time
+    void (*writeBank)(uint64_t setMask, uint64_t clearMask);
+    //Optional (NULL if the backend can't): edge events. watchEdges() returns an fd that polls readable when
+    //there's an edge to read with readEdge() (1 = got one, 0 = no more, -1 = error)
+    int (*watchEdges)(unsigned gpio, unsigned pud, unsigned debounceUs);
+    int (*readEdge)(int fd, int *level, uint64_t *timestampNs);
+} gpioBackend;
+
+void setGPIOBackend(int backend);
+int initialiseGPIO(void);
+const char *getGPIOBackendName(void);
+void setGPIOMode(unsigned gpio, unsigned mode);
+void setGPIOPullUpDown(unsigned gpio, unsigned pud);
+int readGPIO(unsigned gpio);
+void writeGPIO(unsigned gpio, unsigned level);
+void writeGPIOBank(uint64_t setMask, uint64_t clearMask);
+int watchGPIOEdges(unsigned gpio, unsigned pud, unsigned debounceUs);
+int readGPIOEdge(int fd, int *level, uint64_t *timestampNs);
+
+//AND BEFORE HERE
+#endif /* GPIOBACKEND_H */
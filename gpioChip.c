@@ -0,0 +1,327 @@
+/*
+ * GPIO character device (/dev/gpiochipN), uAPI v2
+ *
+ * minimal_gpio.c drives the pins by mmap()ing the SoC's registers through /dev/mem. That's fine for setting an
+ * LED, but the only way to see an input change is to keep reading it. Through the character device the kernel
+ * watches the pin for us: a line requested with edge detection gives a file descriptor that becomes readable
+ * on each edge, and each event carries a CLOCK_MONOTONIC timestamp taken in the interrupt handler, so how long
+ * a button was held doesn't depend on when we got round to reading it. The kernel can debounce the line too.
+ *
+ * Each pin we use is requested as a line of its own and held for as long as we use it. Changing its mode,
+ * bias or edge detection re-requests it. Line offsets on the SoC's own gpiochip are the BCM GPIO nos., the same
+ * as minimal_gpio.c uses.
+ *
+ * The exception is pins written with writeGPIOBank() (the LEDs, see ledPatterns.c). They're held together as one
+ * multi-line output request, the bank, so each tick is a single GPIO_V2_LINE_SET_VALUES_IOCTL (mask + bits) however
+ * many LEDs change. The bank is only re-requested when a write includes a pin that isn't in it yet, or when
+ * one of its pins is wanted for something else.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include "gpioChip.h"
+
+//How a line's requested
+#define CHIP_LINE_NONE 0
+#define CHIP_LINE_INPUT 1
+#define CHIP_LINE_OUTPUT 2
+#define CHIP_LINE_EDGES 3 //Input, with edge events
+#define CHIP_LINE_BANK 4 //Output, one of the lines of the bank request
+
+typedef struct {
+    int fd; //-1 if not requested
+    int use; //CHIP_LINE_INPUT etc.
+    int pud; //PI_PUD_OFF etc., -1 to leave the bias as it is
+    unsigned debounceUs;
+    unsigned level; //Last level written
+    int bankLine; //Its line no. within the bank request, if use is CHIP_LINE_BANK
+} chipLine;
+
+static int gpioChipFd = -1;
+static chipLine chipLines[GPIO_MAX_PINS];
+static pthread_mutex_t chipLinesMutex = PTHREAD_MUTEX_INITIALIZER;
+static int bankFd = -1; //The bank request (see chipWriteBank()). -1 if there isn't one
+static uint64_t bankPins = 0; //Bit n set if GPIO n is in it
+
+static int isSoCGPIOChip(const char label[]) {
+    //The SoC's own GPIOs: pinctrl-bcm2835 (Pi 1-3), pinctrl-bcm2711 (Pi 4), pinctrl-rp1 (Pi 5)
+    return (strncmp(label, "pinctrl-bcm", 11) == 0) || (strncmp(label, "pinctrl-rp1", 11) == 0);
+}
+
+static int openGPIOChip(void) {
+    /*
+     * Opens the gpiochip the SoC's GPIOs are on. That's gpiochip0 on most Pis, but not all (and not on a Pi 5),
+     * so the chips' labels are checked. If none looks like the SoC's, the first chip found is used.
+     * Returns the chip's fd, or -1 if there isn't a GPIO character device
+     */
+    int firstFd = -1;
+    int n;
+    for (n = 0; n < GPIO_CHIP_MAX; n++) {
+        char path[32];
+        snprintf(path, sizeof (path), "/dev/gpiochip%d", n);
+        int fd = open(path, O_RDWR | O_CLOEXEC);
+        if (fd < 0) continue;
+        struct gpiochip_info info;
+        memset(&info, 0, sizeof (info));
+        if ((ioctl(fd, GPIO_GET_CHIPINFO_IOCTL, &info) == 0) && isSoCGPIOChip(info.label)) {
+            if (firstFd != -1) close(firstFd);
+            return fd;
+        }
+        if (firstFd == -1) firstFd = fd;
+        else close(fd);
+    }
+    return firstFd;
+}
+
+static int requestBank(uint64_t pins) {
+    /*
+     * (Re)requests the bank as outputs: every GPIO in pins, as one request, each line starting at its last level
+     * written. Any of them held as lines of their own are released first. Call with chipLinesMutex held.
+     * Returns 0, or -1 on failure (the pins are left unrequested, and get written one at a time)
+     */
+    unsigned gpio;
+    if (bankFd != -1) {
+        close(bankFd);
+        bankFd = -1;
+    }
+    for (gpio = 0; gpio < GPIO_MAX_PINS; gpio++)
+        if (bankPins & (1ull << gpio)) chipLines[gpio].use = CHIP_LINE_NONE;
+    bankPins = 0;
+    if (pins == 0) return 0;
+
+    struct gpio_v2_line_request request;
+    memset(&request, 0, sizeof (request));
+    strncpy(request.consumer, GPIO_CHIP_CONSUMER, sizeof (request.consumer) - 1);
+    request.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+    request.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    request.config.num_attrs = 1;
+    for (gpio = 0; (gpio < GPIO_MAX_PINS) && (request.num_lines < GPIO_V2_LINES_MAX); gpio++) {
+        if (!(pins & (1ull << gpio))) continue;
+        chipLine *line = &chipLines[gpio];
+        if (line->fd != -1) {
+            close(line->fd);
+            line->fd = -1;
+            line->use = CHIP_LINE_NONE;
+        }
+        request.config.attrs[0].mask |= 1ull << request.num_lines;
+        if (line->level) request.config.attrs[0].attr.values |= 1ull << request.num_lines; //Don't glitch
+        request.offsets[request.num_lines++] = gpio;
+    }
+    if (ioctl(gpioChipFd, GPIO_V2_GET_LINE_IOCTL, &request) < 0) {
+        perror("requestBank(): GPIO_V2_GET_LINE_IOCTL");
+        return -1;
+    }
+    unsigned n;
+    for (n = 0; n < request.num_lines; n++) {
+        chipLines[request.offsets[n]].use = CHIP_LINE_BANK;
+        chipLines[request.offsets[n]].bankLine = n;
+        bankPins |= 1ull << request.offsets[n];
+    }
+    bankFd = request.fd;
+    return 0;
+}
+
+static int requestChipLine(unsigned gpio, int use, unsigned debounceUs) {
+    /*
+     * (Re)requests a line for 'use', with the bias in chipLines[gpio].pud. Call with chipLinesMutex held.
+     * Returns the line's fd, or -1 on failure
+     */
+    chipLine *line = &chipLines[gpio];
+    if (line->use == CHIP_LINE_BANK) requestBank(bankPins & ~(1ull << gpio)); //Take it out of the bank first
+    if (line->fd != -1) {
+        close(line->fd);
+        line->fd = -1;
+        line->use = CHIP_LINE_NONE;
+    }
+
+    struct gpio_v2_line_request request;
+    memset(&request, 0, sizeof (request));
+    request.offsets[0] = gpio;
+    request.num_lines = 1;
+    strncpy(request.consumer, GPIO_CHIP_CONSUMER, sizeof (request.consumer) - 1);
+    if (use == CHIP_LINE_OUTPUT) {
+        request.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+        request.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+        request.config.attrs[0].attr.values = line->level ? 1 : 0; //Don't glitch: start at the last level written
+        request.config.attrs[0].mask = 1; //Applies to the first (only) line
+        request.config.num_attrs = 1;
+    } else {
+        request.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+        if (line->pud == PI_PUD_UP) request.config.flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+        else if (line->pud == PI_PUD_DOWN) request.config.flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN;
+        else if (line->pud == PI_PUD_OFF) request.config.flags |= GPIO_V2_LINE_FLAG_BIAS_DISABLED;
+        if (use == CHIP_LINE_EDGES) {
+            request.config.flags |= GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+            request.event_buffer_size = 16;
+            if (debounceUs > 0) {
+                request.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_DEBOUNCE;
+                request.config.attrs[0].attr.debounce_period_us = debounceUs;
+                request.config.attrs[0].mask = 1;
+                request.config.num_attrs = 1;
+            }
+        }
+    }
+    if (ioctl(gpioChipFd, GPIO_V2_GET_LINE_IOCTL, &request) < 0) {
+        perror("requestChipLine(): GPIO_V2_GET_LINE_IOCTL");
+        return -1;
+    }
+    if (use == CHIP_LINE_EDGES) {
+        int flags = fcntl(request.fd, F_GETFL);
+        fcntl(request.fd, F_SETFL, flags | O_NONBLOCK);
+    }
+    line->fd = request.fd;
+    line->use = use;
+    line->debounceUs = debounceUs;
+    return line->fd;
+}
+
+static int chipInitialise(void) {
+    if (gpioChipFd != -1) return 0;
+    gpioChipFd = openGPIOChip();
+    if (gpioChipFd < 0) return -1;
+    int n;
+    for (n = 0; n < GPIO_MAX_PINS; n++) {
+        chipLines[n].fd = -1;
+        chipLines[n].use = CHIP_LINE_NONE;
+        chipLines[n].pud = -1;
+        chipLines[n].level = 0;
+        chipLines[n].bankLine = -1;
+    }
+    return 0;
+}
+
+static void chipSetMode(unsigned gpio, unsigned mode) {
+    //Only PI_INPUT and PI_OUTPUT mean anything here: the alt functions belong to the kernel's drivers
+    pthread_mutex_lock(&chipLinesMutex);
+    if ((mode == PI_OUTPUT) && (chipLines[gpio].use != CHIP_LINE_OUTPUT) && (chipLines[gpio].use != CHIP_LINE_BANK))
+        requestChipLine(gpio, CHIP_LINE_OUTPUT, 0);
+    else if ((mode == PI_INPUT) && (chipLines[gpio].use != CHIP_LINE_INPUT) && (chipLines[gpio].use != CHIP_LINE_EDGES))
+        requestChipLine(gpio, CHIP_LINE_INPUT, 0);
+    pthread_mutex_unlock(&chipLinesMutex);
+}
+
+static void chipSetPullUpDown(unsigned gpio, unsigned pud) {
+    pthread_mutex_lock(&chipLinesMutex);
+    chipLine *line = &chipLines[gpio];
+    int changed = (line->pud != (int) pud);
+    line->pud = pud;
+    if (changed && ((line->use == CHIP_LINE_INPUT) || (line->use == CHIP_LINE_EDGES)))
+        requestChipLine(gpio, line->use, line->debounceUs);
+    pthread_mutex_unlock(&chipLinesMutex);
+}
+
+static int chipRead(unsigned gpio) {
+    struct gpio_v2_line_values values;
+    memset(&values, 0, sizeof (values));
+    pthread_mutex_lock(&chipLinesMutex);
+    if (chipLines[gpio].use == CHIP_LINE_BANK) { //An output, but it can still be read
+        values.mask = 1ull << chipLines[gpio].bankLine;
+        int ret = ioctl(bankFd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values);
+        pthread_mutex_unlock(&chipLinesMutex);
+        if (ret < 0) {
+            perror("chipRead(): GPIO_V2_LINE_GET_VALUES_IOCTL");
+            return -1;
+        }
+        return (values.bits & values.mask) ? 1 : 0;
+    }
+    int fd = chipLines[gpio].fd;
+    if (fd == -1) fd = requestChipLine(gpio, CHIP_LINE_INPUT, 0);
+    pthread_mutex_unlock(&chipLinesMutex);
+    if (fd == -1) return -1;
+
+    values.mask = 1;
+    if (ioctl(fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) {
+        perror("chipRead(): GPIO_V2_LINE_GET_VALUES_IOCTL");
+        return -1;
+    }
+    return (values.bits & 1) ? 1 : 0;
+}
+
+static void writeChipLine(unsigned gpio) {
+    //Drives the line to chipLines[gpio].level, requesting it as an output if it isn't one. Call with chipLinesMutex held
+    chipLine *line = &chipLines[gpio];
+    struct gpio_v2_line_values values;
+    memset(&values, 0, sizeof (values));
+    if (line->use == CHIP_LINE_BANK) {
+        values.mask = 1ull << line->bankLine;
+        values.bits = line->level ? values.mask : 0;
+        if (ioctl(bankFd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0)
+            perror("writeChipLine(): GPIO_V2_LINE_SET_VALUES_IOCTL");
+    } else if (line->use != CHIP_LINE_OUTPUT) requestChipLine(gpio, CHIP_LINE_OUTPUT, 0); //Requested at the new level
+    else {
+        values.mask = 1;
+        values.bits = line->level;
+        if (ioctl(line->fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0)
+            perror("writeChipLine(): GPIO_V2_LINE_SET_VALUES_IOCTL");
+    }
+}
+
+static void chipWrite(unsigned gpio, unsigned level) {
+    pthread_mutex_lock(&chipLinesMutex);
+    chipLines[gpio].level = level ? 1 : 0;
+    writeChipLine(gpio);
+    pthread_mutex_unlock(&chipLinesMutex);
+}
+
+static void chipWriteBank(uint64_t setMask, uint64_t clearMask) {
+    /*
+     * Sets the pins in setMask high and those in clearMask low with one GPIO_V2_LINE_SET_VALUES_IOCTL on the bank.
+     * A pin that isn't in the bank yet is added to it (the bank's re-requested, at the levels last written)
+     */
+    uint64_t pins = setMask | clearMask;
+    unsigned gpio;
+    pthread_mutex_lock(&chipLinesMutex);
+    for (gpio = 0; gpio < GPIO_MAX_PINS; gpio++)
+        if (pins & (1ull << gpio)) chipLines[gpio].level = (setMask & (1ull << gpio)) ? 1 : 0;
+    if (((pins & ~bankPins) != 0) && (requestBank(bankPins | pins) == 0)) {
+        pthread_mutex_unlock(&chipLinesMutex);
+        return; //Requested at the new levels
+    }
+    struct gpio_v2_line_values values;
+    memset(&values, 0, sizeof (values));
+    for (gpio = 0; gpio < GPIO_MAX_PINS; gpio++) {
+        if (!(pins & (1ull << gpio))) continue;
+        if (chipLines[gpio].use != CHIP_LINE_BANK) {
+            writeChipLine(gpio); //Couldn't get the bank
+            continue;
+        }
+        values.mask |= 1ull << chipLines[gpio].bankLine;
+        if (chipLines[gpio].level) values.bits |= 1ull << chipLines[gpio].bankLine;
+    }
+    if ((values.mask != 0) && (ioctl(bankFd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0))
+        perror("chipWriteBank(): GPIO_V2_LINE_SET_VALUES_IOCTL");
+    pthread_mutex_unlock(&chipLinesMutex);
+}
+
+static int chipWatchEdges(unsigned gpio, unsigned pud, unsigned debounceUs) {
+    pthread_mutex_lock(&chipLinesMutex);
+    chipLines[gpio].pud = pud;
+    int fd = requestChipLine(gpio, CHIP_LINE_EDGES, debounceUs);
+    if ((fd < 0) && (debounceUs > 0)) fd = requestChipLine(gpio, CHIP_LINE_EDGES, 0); //Kernel without debounce support
+    pthread_mutex_unlock(&chipLinesMutex);
+    return fd;
+}
+
+static int chipReadEdge(int fd, int *level, uint64_t *timestampNs) {
+    struct gpio_v2_line_event event;
+    ssize_t length = read(fd, &event, sizeof (event));
+    if (length < 0) {
+        if ((errno == EAGAIN) || (errno == EINTR)) return 0;
+        perror("chipReadEdge(): read()");
+        return -1;
+    }
+    if (length != sizeof (event)) return 0;
+    *level = (event.id == GPIO_V2_LINE_EVENT_RISING_EDGE) ? 1 : 0;
+    *timestampNs = event.timestamp_ns; //CLOCK_MONOTONIC, unless asked for otherwise
+    return 1;
+}
+
+gpioBackend gpioChipBackend = {
+    "gpiochip", chipInitialise, chipSetMode, chipSetPullUpDown, chipRead, chipWrite, chipWriteBank, chipWatchEdges, chipReadEdge
+};
@@ -0,0 +1,38 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   gpioChip.h
+ *
+ * GPIO backend using the kernel's GPIO character device (/dev/gpiochipN, uAPI v2) (see gpioChip.c)
+ */
+
+#ifndef GPIOCHIP_H
+#define GPIOCHIP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "gpioChip.h" TO THE SOURCE FILE
+
+#include "gpioBackend.h"
+
+#define GPIO_CHIP_MAX 16 //Looks at /dev/gpiochip0 to /dev/gpiochip15
+#define GPIO_CHIP_CONSUMER "piconfigserver" //Shows up in gpioinfo against the lines we hold
+
+extern gpioBackend gpioChipBackend;
+
+//AND BEFORE HERE
+#endif /* GPIOCHIP_H */
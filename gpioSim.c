@@ -0,0 +1,266 @@
+/*
+ * Simulated GPIO
+ *
+ * A GPIO backend (see gpioBackend.c) with no hardware behind it, so the server can run on a build box:
+ *      -Inputs are driven with setGPIOSimInput(), either directly (e.g from a test harness) or by a script
+ *       (runGPIOSimScript()), and read back through the pull-up/down when nothing's driving them, as a real
+ *       pin would
+ *      -Every write is recorded with its timestamp, so what the status LEDs did can be checked afterwards. Bank
+ *       writes (writeGPIOBank()) are counted as well
+ *      -Edges are reported like the gpiochip backend's: each watched pin has a pipe, and a change of level
+ *       writes an event (level + CLOCK_MONOTONIC timestamp) into it
+ *
+ * Script syntax: steps separated by commas or spaces, run in order on a thread of their own:
+ *      23=0    Drive GPIO 23 low (e.g press a button to ground)
+ *      23=1    Drive it high
+ *      23=x    Stop driving it (it floats to its pull-up/down)
+ *      +3500   Wait 3500mS
+ * e.g "+5000,23=0,+3500,23=x" holds a button on GPIO 23 for 3.5 seconds, 5 seconds after start up
+ */
+
+#define _GNU_SOURCE //pipe2()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "gpioSim.h"
+
+typedef struct {
+    uint64_t timestampNs;
+    int level;
+} gpioSimEdge; //What goes down a watched pin's pipe
+
+typedef struct {
+    int mode; //PI_INPUT or PI_OUTPUT
+    int pud;
+    int driven; //Level something outside is driving the pin to, -1 for none
+    int output; //Level last written
+    int edgeFds[2]; //Pipe for watchEdges(), -1 if not watched
+} gpioSimPin;
+
+static gpioSimPin simPins[GPIO_MAX_PINS];
+static gpioSimWrite simWrites[GPIO_SIM_LOG_SIZE]; //Ring buffer
+static uint64_t simWriteCount = 0;
+static uint64_t simBankWriteCount = 0;
+static pthread_mutex_t simMutex = PTHREAD_MUTEX_INITIALIZER;
+static int simInitialised = 0;
+
+static uint64_t simNowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static int simLevel(gpioSimPin *pin) {
+    //What the pin reads. Call with simMutex held
+    if (pin->mode == PI_OUTPUT) return pin->output;
+    if (pin->driven != -1) return pin->driven;
+    return (pin->pud == PI_PUD_UP) ? 1 : 0;
+}
+
+static void simLevelChanged(gpioSimPin *pin, int before) {
+    //Queues an edge on a watched pin, if its level has changed. Call with simMutex held
+    int after = simLevel(pin);
+    if ((after == before) || (pin->edgeFds[1] == -1)) return;
+    gpioSimEdge edge = {simNowNs(), after};
+    if (write(pin->edgeFds[1], &edge, sizeof (edge)) != sizeof (edge))
+        printf("gpioSim: edge queue full, edge lost\n");
+}
+
+static int simInitialise(void) {
+    pthread_mutex_lock(&simMutex);
+    if (!simInitialised) {
+        int n;
+        for (n = 0; n < GPIO_MAX_PINS; n++) {
+            simPins[n].mode = PI_INPUT;
+            simPins[n].pud = PI_PUD_OFF;
+            simPins[n].driven = -1;
+            simPins[n].output = 0;
+            simPins[n].edgeFds[0] = simPins[n].edgeFds[1] = -1;
+        }
+        simInitialised = 1;
+    }
+    pthread_mutex_unlock(&simMutex);
+    return 0;
+}
+
+static void simSetMode(unsigned gpio, unsigned mode) {
+    pthread_mutex_lock(&simMutex);
+    int before = simLevel(&simPins[gpio]);
+    simPins[gpio].mode = (mode == PI_OUTPUT) ? PI_OUTPUT : PI_INPUT;
+    simLevelChanged(&simPins[gpio], before);
+    pthread_mutex_unlock(&simMutex);
+}
+
+static void simSetPullUpDown(unsigned gpio, unsigned pud) {
+    pthread_mutex_lock(&simMutex);
+    int before = simLevel(&simPins[gpio]);
+    simPins[gpio].pud = pud;
+    simLevelChanged(&simPins[gpio], before);
+    pthread_mutex_unlock(&simMutex);
+}
+
+static int simRead(unsigned gpio) {
+    pthread_mutex_lock(&simMutex);
+    int level = simLevel(&simPins[gpio]);
+    pthread_mutex_unlock(&simMutex);
+    return level;
+}
+
+static void simWriteLocked(unsigned gpio, unsigned level) {
+    //Call with simMutex held
+    int before = simLevel(&simPins[gpio]);
+    simPins[gpio].output = level ? 1 : 0;
+    gpioSimWrite *record = &simWrites[simWriteCount % GPIO_SIM_LOG_SIZE];
+    record->timestampNs = simNowNs();
+    record->gpio = gpio;
+    record->level = level ? 1 : 0;
+    simWriteCount++;
+    simLevelChanged(&simPins[gpio], before);
+}
+
+static void simWrite(unsigned gpio, unsigned level) {
+    pthread_mutex_lock(&simMutex);
+    simWriteLocked(gpio, level);
+    pthread_mutex_unlock(&simMutex);
+}
+
+static void simWriteBank(uint64_t setMask, uint64_t clearMask) {
+    //Every pin changes at once (nothing can see a half done bank write), but each is recorded as a write of its own
+    pthread_mutex_lock(&simMutex);
+    unsigned gpio;
+    for (gpio = 0; gpio < GPIO_MAX_PINS; gpio++) {
+        if (setMask & (1ull << gpio)) simWriteLocked(gpio, HIGH);
+        else if (clearMask & (1ull << gpio)) simWriteLocked(gpio, LOW);
+    }
+    simBankWriteCount++;
+    pthread_mutex_unlock(&simMutex);
+}
+
+static int simWatchEdges(unsigned gpio, unsigned pud, unsigned debounceUs) {
+    //Simulated inputs don't bounce, so debounceUs is ignored
+    pthread_mutex_lock(&simMutex);
+    gpioSimPin *pin = &simPins[gpio];
+    if ((pin->edgeFds[0] == -1) && (pipe2(pin->edgeFds, O_NONBLOCK | O_CLOEXEC) < 0)) {
+        perror("simWatchEdges(): pipe2()");
+        pin->edgeFds[0] = pin->edgeFds[1] = -1;
+        pthread_mutex_unlock(&simMutex);
+        return -1;
+    }
+    pin->mode = PI_INPUT;
+    pin->pud = pud;
+    int fd = pin->edgeFds[0];
+    pthread_mutex_unlock(&simMutex);
+    return fd;
+}
+
+static int simReadEdge(int fd, int *level, uint64_t *timestampNs) {
+    gpioSimEdge edge;
+    ssize_t length = read(fd, &edge, sizeof (edge));
+    if (length < 0) {
+        if ((errno == EAGAIN) || (errno == EINTR)) return 0;
+        perror("simReadEdge(): read()");
+        return -1;
+    }
+    if (length != sizeof (edge)) return 0;
+    *level = edge.level;
+    *timestampNs = edge.timestampNs;
+    return 1;
+}
+
+gpioBackend gpioSimBackend = {
+    "simulator", simInitialise, simSetMode, simSetPullUpDown, simRead, simWrite, simWriteBank, simWatchEdges, simReadEdge
+};
+
+void setGPIOSimInput(unsigned gpio, int level) {
+    //Drives an input to level (0 or 1), or stops driving it (-1). Edges are reported if it changes what the pin reads
+    if (gpio >= GPIO_MAX_PINS) return;
+    simInitialise();
+    pthread_mutex_lock(&simMutex);
+    int before = simLevel(&simPins[gpio]);
+    simPins[gpio].driven = (level < 0) ? -1 : (level ? 1 : 0);
+    simLevelChanged(&simPins[gpio], before);
+    pthread_mutex_unlock(&simMutex);
+}
+
+int getGPIOSimOutput(unsigned gpio) {
+    //Returns the level last written to gpio
+    if (gpio >= GPIO_MAX_PINS) return -1;
+    pthread_mutex_lock(&simMutex);
+    int level = simPins[gpio].output;
+    pthread_mutex_unlock(&simMutex);
+    return level;
+}
+
+int getGPIOSimWrites(gpioSimWrite writes[], int maxWrites) {
+    /*
+     * Copies the most recent writes (up to maxWrites, and up to GPIO_SIM_LOG_SIZE back), oldest first.
+     * Returns the no. copied
+     */
+    pthread_mutex_lock(&simMutex);
+    uint64_t available = (simWriteCount < GPIO_SIM_LOG_SIZE) ? simWriteCount : GPIO_SIM_LOG_SIZE;
+    if (available > (uint64_t) maxWrites) available = maxWrites;
+    uint64_t first = simWriteCount - available;
+    uint64_t n;
+    for (n = 0; n < available; n++) writes[n] = simWrites[(first + n) % GPIO_SIM_LOG_SIZE];
+    pthread_mutex_unlock(&simMutex);
+    return (int) available;
+}
+
+uint64_t getGPIOSimWriteCount(void) {
+    pthread_mutex_lock(&simMutex);
+    uint64_t count = simWriteCount;
+    pthread_mutex_unlock(&simMutex);
+    return count;
+}
+
+uint64_t getGPIOSimBankWriteCount(void) {
+    pthread_mutex_lock(&simMutex);
+    uint64_t count = simBankWriteCount;
+    pthread_mutex_unlock(&simMutex);
+    return count;
+}
+
+static void *gpioSimScriptThread(void *arg) {
+    /*
+     * PThread: Runs a script (see the top of this file). arg is a malloc()ed copy of it
+     */
+    char *script = (char *) arg;
+    char *saveptr = NULL;
+    char *step;
+    for (step = strtok_r(script, ", \t", &saveptr); step != NULL; step = strtok_r(NULL, ", \t", &saveptr)) {
+        if (step[0] == '+') {
+            long ms = strtol(step + 1, NULL, 10);
+            if (ms > 0) usleep(ms * 1000);
+        } else if (isdigit((unsigned char) step[0]) && (strchr(step, '=') != NULL)) {
+            unsigned gpio = strtoul(step, NULL, 10);
+            char *value = strchr(step, '=') + 1;
+            int level = ((*value == 'x') || (*value == 'X')) ? -1 : (strtol(value, NULL, 10) ? 1 : 0);
+            printf("gpioSim: GPIO %u %s\n", gpio, level == -1 ? "released" : (level ? "driven high" : "driven low"));
+            setGPIOSimInput(gpio, level);
+        } else printf("gpioSim: Don't understand script step '%s'\n", step);
+    }
+    free(script);
+    return NULL;
+}
+
+int runGPIOSimScript(const char script[]) {
+    /*
+     * Starts running a script of simulated inputs in the background. Returns 0, or -1 on failure
+     */
+    char *copy = strndup(script, GPIO_SIM_SCRIPT_LENGTH);
+    if (copy == NULL) return -1;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, gpioSimScriptThread, copy)) {
+        printf("runGPIOSimScript(): Error creating script thread.\n");
+        free(copy);
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   gpioSim.h
+ *
+ * Simulated GPIO backend: scriptable inputs, recorded outputs (see gpioSim.c)
+ */
+
+#ifndef GPIOSIM_H
+#define GPIOSIM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "gpioSim.h" TO THE SOURCE FILE
+
+#include <stdint.h>
+#include "gpioBackend.h"
+
+#define GPIO_SIM_LOG_SIZE 1024 //No. of writes remembered
+#define GPIO_SIM_SCRIPT_LENGTH 1024
+
+typedef struct {
+    uint64_t timestampNs; //CLOCK_MONOTONIC
+    uint8_t gpio;
+    uint8_t level;
+} gpioSimWrite;
+
+extern gpioBackend gpioSimBackend;
+
+void setGPIOSimInput(unsigned gpio, int level);
+int getGPIOSimOutput(unsigned gpio);
+int getGPIOSimWrites(gpioSimWrite writes[], int maxWrites);
+uint64_t getGPIOSimWriteCount(void);
+uint64_t getGPIOSimBankWriteCount(void);
+int runGPIOSimScript(const char script[]);
+
+//AND BEFORE HERE
+#endif /* GPIOSIM_H */
@@ -13,15 +13,34 @@
 #include <strings.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <net/route.h> //RTF_GATEWAY
 #include <pthread.h> //Remember to add -lpthread to linker options
 #include "iptools2.3.h"
 #include <signal.h>             //For the signal() line)
-#include "minimal_gpio.h"
+#include "gpioBackend.h"
+#include "fileSystemTools.h"
+#include "configSnapshots.h"
+#include "knownNetworks.h"
+#include "sharedState.h"
+#include "taskScheduler.h"
+#include "buttonGestures.h"
+#include "ledPatterns.h"
+#include "wlanTransition.h"
+#include "modeCommandQueue.h"
+#include "deviceIdentity.h"
+#include "routeTable.h"
+#include "processSupervisor.h"
+#include "dhcpClient.h"
+#include "dhcpServer2.h"
+#include "httpConfigServer.h"
 
 #define _POSIX_C_SOURCE 200809L  //This line required for OSX otherwise popen() fails)
 //#define _POSIX_SOURCE
 #define  FIELD          1024     //used for user entry field buffers
 #define  SECTION        4096    //Used for buffers containing sections of the html page
+#define HOSTAPD_CONFIG_FILENAME "/tmp/httpConfigServer_hostapd.conf" //Generated by setHostAPWlanMode()
+#define DHCP_ACTIVITY_LED_MS 500 //The dhcp LED flickers until there's been no DHCP traffic for this long
+#define DHCP_RENEW_WAIT_MS 4000 //How long the Renew DHCP button waits for the leases (see waitDHCPLeasesRenewed())
 
 //#define WPA_CONFIG_FILENAME "/etc/wpa_supplicant/wpa_supplicant.conf"
 
@@ -43,19 +62,26 @@ typedef struct GPIOPin{
 } gpioPin;
  */
 //Global variables
-volatile int twoSecSq, oneSecSq, halfSecSq, quartSecSq; //'Square wave' signal rails used to flash LEDs
-volatile int setupMode = 0; //0= normal mode, 1=adhoc AP, 2= hostAP
-volatile int wifiConnectedStatus;
+//Shared between threads, so they're sharedStates (C11 atomics) rather than volatile ints. See sharedState.c
+sharedState setupMode = SHARED_STATE_INITIALIZER(0); //0= normal mode, 1=adhoc AP, 2= hostAP
+sharedState wifiConnectedStatus;
+//LEDs (see ledPatterns.c). -1 if not fitted
+int statusLED = -1, linkLED = -1, modeLED = -1, dhcpLED = -1, errorLED = -1;
+int linkLEDPin = -1, modeLEDPin = -1, dhcpLEDPin = -1, errorLEDPin = -1; //Set by setStatusLEDPins()
+sharedState dhcpLEDActive = SHARED_STATE_INITIALIZER(0); //1 while the dhcp LED is flickering
+sharedState lastDHCPActivity; //getSchedulerTimeMs() (truncated) of the last DHCP reply
 int sockfd = -1; //file descriptor for 'passive' or 'master'  http listening socket
 int web_sockfd = -1; //file descriptor for 'passive' or 'master'  http listening socket for web socket thread
 int httpListeningPort = 0; //This is the 'actual' port no that was successfully bound to, in simpleHTTPServerThread;
 char ap_ssid[FIELD] = {0}; //Stores the name of the SSID
 char wpa_supplicantConfigPath[FIELD] = {0}; //Holds the path/name of the target wpa_supplicant file (supplied at runtime)
 char hostapdPath[FIELD] = {0}; //Holds the path/filename of the external hostapd (wpa access point) executable
-volatile int unsavedChangesFlag = 0; //Signifies whether there are any unsaved/non backed up config changes made via the website
+sharedState unsavedChangesFlag = SHARED_STATE_INITIALIZER(0); //Signifies whether there are any unsaved/non backed up config changes made via the website
+char dhcpRenewResult[FIELD] = {0}; //What the last Renew DHCP button press got, shown under Status
+pthread_mutex_t dhcpRenewResultMutex = PTHREAD_MUTEX_INITIALIZER;
 
 enum DHCPClient { //Used to signal which dhcp client to use
-    nodhcpclient, dhclient, udhcpc
+    nodhcpclient, dhclient, udhcpc, builtindhcpclient
 };
 enum DHCPClient installedDHCPClient;
 
@@ -123,26 +149,26 @@ int scanForNetworks(char htmlNetworksFound[], unsigned int outputBufferLength) {
     //Create WiFiNetwork struct to contain results of network scan
     printf("scanForNetworks() called\n");
     int k;
-    wifiNetwork networkList[50]; //Allow up to 50 networks to be displayed
-    for (k = 0; k < 50; k++)
-        initWiFiNetworkStruct(&networkList[k]);
-    int noOfNetworksFound = iwscanWrapper(networkList, 50, "wlan0");
+    wifiNetworkList networkList; //Grows to however many networks are found
+    initWiFiNetworkList(&networkList);
+    int noOfNetworksFound = iwscanWrapper(&networkList, "wlan0");
 
-    if (k > 0) {
+    if (noOfNetworksFound > 0) {
         memset(htmlNetworksFound, 0, outputBufferLength); //Clear htmlNetworksFound array
         char buffer[FIELD] = {0}; //Temporary output buffer
         stringBuilder(htmlNetworksFound, outputBufferLength, "<br><br><form><fieldset><legend>The following wireless networks found</legend>");
         for (k = 0; k < noOfNetworksFound; k++) {
-            //printf("%d: %s\n", k, networkList[k].essid);
+            wifiNetwork *network = &networkList.networks[k];
             memset(buffer, 0, FIELD);
-            snprintf(buffer, FIELD, "%d: %s,           encryption: %s<br>", k,
-                    networkList[k].essid, networkList[k].encryption); //Create formatted string
+            snprintf(buffer, FIELD, "%d: %.*s,           encryption: %s<br>", k,
+                    network->essid.length, network->essid.octets, network->encrypted ? "on" : "off"); //Create formatted string
             int ret = stringBuilder(htmlNetworksFound, outputBufferLength, buffer);
             if (ret == -1) printf("htmlNetworksFound char array not large enough\n");
         }
         int ret = stringBuilder(htmlNetworksFound, outputBufferLength, "</fieldset></form>");
         if (ret == -1) printf("htmlNetworksFound char array not large enough\n");
     }
+    freeWiFiNetworkList(&networkList);
     return 0;
 }
 
@@ -183,7 +209,7 @@ int updateStatus(char htmlStatus[], unsigned int outputBufferLength) {
 
         //Now copy info returned by getLocalIPadd() into nicList
         for (k = 0; k < noOfInterfaces; k++) {
-            strlcpy(nicList[k].name, interfaceList[k][0], ARG_LENGTH); //copy name
+            strlcpy(nicList[k].name, interfaceList[k][0], NIC_NAME_LENGTH); //copy name
             //strlcpy(nicList[k].address,interfaceList[k][1],ARG_LENGTH); //copy ip address. Don't need this yet, get this info at the next step
             //printf("nicList: %d: Name: %s, Addr: %s\n", k, nicList[k].name, nicList[k].address);
         }
@@ -200,22 +226,40 @@ int updateStatus(char htmlStatus[], unsigned int outputBufferLength) {
         stringBuilder(htmlStatus, outputBufferLength, "Interface        Address        Netmask<br>");
         for (k = 1; k < noOfInterfaces; k++) { //Start at interface '1' because '0' is the loopback device. Not interested in that
             //Create list of interface parameters in html
+            char address[INET_ADDRSTRLEN], netmask[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &nicList[k].address, address, INET_ADDRSTRLEN);
+            inet_ntop(AF_INET, &nicList[k].netmask, netmask, INET_ADDRSTRLEN);
             memset(buffer, 0, FIELD);
-            snprintf(buffer, FIELD, "%s,  %s,       %s<br>", nicList[k].name, nicList[k].address, nicList[k].netmask);
+            snprintf(buffer, FIELD, "%s,  %s,       %s<br>", nicList[k].name, address, netmask);
             stringBuilder(htmlStatus, outputBufferLength, buffer);
         }
 
         //Add a <br> to the html
         stringBuilder(htmlStatus, outputBufferLength, "<br>");
 
-        //Get the default gateway
-        memset(buffer, 0, FIELD); //Clear buffer
-
-        if (getGateway(buffer, FIELD) > 0) {
-            stringBuilder(htmlStatus, outputBufferLength, "Current default gateway: ");
-            stringBuilder(htmlStatus, outputBufferLength, buffer);
-            stringBuilder(htmlStatus, outputBufferLength, "<br>");
+        //Get the default gateway, and every interface's default route (there's one per interface with a DHCP lease)
+        routeTable routes;
+        initRouteTable(&routes);
+        if (readRouteTable(&routes) >= 0) {
+            const routeEntry *best = getBestDefaultRoute(&routes);
+            if ((best != NULL) && (best->flags & RTF_GATEWAY)) {
+                char gateway[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &best->gateway, gateway, INET_ADDRSTRLEN);
+                memset(buffer, 0, FIELD);
+                snprintf(buffer, FIELD, "Current default gateway: %s (%s)<br>", gateway, best->interface);
+                stringBuilder(htmlStatus, outputBufferLength, buffer);
+            }
+            int r;
+            for (r = 0; r < routes.count; r++) {
+                if ((routes.routes[r].prefixLength != 0) || (getDefaultRoute(&routes, routes.routes[r].ifindex) != &routes.routes[r])) continue;
+                char route[FIELD];
+                formatRouteEntry(&routes.routes[r], route, FIELD);
+                memset(buffer, 0, FIELD);
+                snprintf(buffer, FIELD, "&nbsp;&nbsp;%s%s<br>", route, (&routes.routes[r] == best) ? " (in use)" : "");
+                stringBuilder(htmlStatus, outputBufferLength, buffer);
+            }
         }
+        freeRouteTable(&routes);
 
 
         //Get Wifi connection status for wlan0
@@ -223,7 +267,8 @@ int updateStatus(char htmlStatus[], unsigned int outputBufferLength) {
         initWiFiNetworkStruct(&wifiStatus);
         if (getWiFiConnStatus(&wifiStatus, "wlan0") > 0) { //If currently associated
             memset(buffer, 0, FIELD);
-            snprintf(buffer, FIELD, "Interface wlan0 Connected to network: %s, signal strength: %ddBm<br>", wifiStatus.essid, wifiStatus.sigLevel);
+            snprintf(buffer, FIELD, "Interface wlan0 Connected to network: %.*s, signal strength: %ddBm<br>",
+                    wifiStatus.essid.length, wifiStatus.essid.octets, wifiStatus.sigLevel);
             stringBuilder(htmlStatus, outputBufferLength, buffer);
         }
         //And also WiFi Connection status for wlan1 (if it is installed))
@@ -231,7 +276,8 @@ int updateStatus(char htmlStatus[], unsigned int outputBufferLength) {
             initWiFiNetworkStruct(&wifiStatus);
             if (getWiFiConnStatus(&wifiStatus, "wlan1") > 0) { //If currently associated
                 memset(buffer, 0, FIELD);
-                snprintf(buffer, FIELD, "Interface wlan1 Connected to network: %s, signal strength: %ddBm<br>", wifiStatus.essid, wifiStatus.sigLevel);
+                snprintf(buffer, FIELD, "Interface wlan1 Connected to network: %.*s, signal strength: %ddBm<br>",
+                        wifiStatus.essid.length, wifiStatus.essid.octets, wifiStatus.sigLevel);
                 stringBuilder(htmlStatus, outputBufferLength, buffer);
             }
         }
@@ -243,9 +289,34 @@ int updateStatus(char htmlStatus[], unsigned int outputBufferLength) {
             stringBuilder(htmlStatus, outputBufferLength, "**HostAP Access Point mode enabled:**<br>");
             stringBuilder(htmlStatus, outputBufferLength, ap_ssid);
         }
+        //How long the last change to/from setup mode took, step by step
+        memset(buffer, 0, FIELD);
+        if (printWlanTransitionReport(buffer, FIELD, "<br>") > 0) {
+            stringBuilder(htmlStatus, outputBufferLength, "<br>");
+            stringBuilder(htmlStatus, outputBufferLength, buffer);
+        }
+        //wpa_supplicant, hostapd (and udhcpc): state, uptime, restarts
+        memset(buffer, 0, FIELD);
+        if (printProcessSupervisorReport(buffer, FIELD, "<br>") > 0) {
+            stringBuilder(htmlStatus, outputBufferLength, "<br>");
+            stringBuilder(htmlStatus, outputBufferLength, buffer);
+        }
+        //Each interface's lease, and how long it took to get
+        memset(buffer, 0, FIELD);
+        if (printDHCPClientReport(buffer, FIELD, "<br>") > 0) {
+            stringBuilder(htmlStatus, outputBufferLength, "<br>");
+            stringBuilder(htmlStatus, outputBufferLength, buffer);
+        }
 
     }
 
+    pthread_mutex_lock(&dhcpRenewResultMutex);
+    if (strlen(dhcpRenewResult) > 0) {
+        snprintf(buffer, FIELD, "<br>Renew DHCP: %s<br>", dhcpRenewResult);
+        stringBuilder(htmlStatus, outputBufferLength, buffer);
+    }
+    pthread_mutex_unlock(&dhcpRenewResultMutex);
+
     if (getUnsavedChangesFlag() == 1) {
         stringBuilder(htmlStatus, outputBufferLength, "<font color=\"red\">**Warning: Unsaved changes. Backup config to make permanent **</font><br>");
     }
@@ -257,34 +328,68 @@ int updateStatus(char htmlStatus[], unsigned int outputBufferLength) {
 
 int updateKnownNetworks(char htmlKnownNetworks[], unsigned int outputBufferLength) {
     /*
-     *Parses the wpa configuration file specified in the global array wpa_supplicantConfigPath[]
-     * line  and creates a formatted html string based on the contents
+     * Creates a formatted html string listing the networks in the wpa configuration file specified in the
+     * global array wpa_supplicantConfigPath[]
+     *
+     * The list comes from the in-memory index kept up to date by knownNetworksWatcherThread(), so the file
+     * isn't touched. The html is only rebuilt when the index has changed since last time
      */
-    memset(htmlKnownNetworks, 0, outputBufferLength); //Clear output buffer 
-    wifiNetwork knownNetworksList[50]; //Create a list of network structs
-    int n;
-    for (n = 0; n < 50; n++) //Initialise the array of structs
-        initWiFiNetworkStruct(&knownNetworksList[n]);
-
-    int ret = parseWPASupplicantConfig2(knownNetworksList, 50, wpa_supplicantConfigPath); //Parse the WPA config file
-    if (ret == -1)
-        printf("Error parsing file %s, or file doesn't exist\n", wpa_supplicantConfigPath);
+    static char cachedHtml[SECTION] = {0};
+    static int cachedGeneration = -1;
+    int generation = getKnownNetworksGeneration();
+    if (generation != cachedGeneration) {
+        memset(cachedHtml, 0, SECTION);
+        int ret = getKnownNetworkCount();
+        if (ret > 0) {
+            char buffer[FIELD]; //Temporary output buffer
+            char essid[FIELD];
+            stringBuilder(cachedHtml, SECTION,
+                    "<br><form name=\"AddSSID\"  method=\"post\" action=\"AddSSID\">"
+                    "<fieldset>"
+                    "<legend>Known WiFi networks:</legend>");
+            int n;
+            for (n = 0; n < ret; n++) { //Iterate through network list, formatting as html
+                if (getKnownNetworkESSID(n, essid, FIELD) < 0) break; //Index changed underneath us. Next time
+                memset(buffer, 0, FIELD);
+                snprintf(buffer, FIELD, "%s<br>\n", essid);
+                stringBuilder(cachedHtml, SECTION, buffer);
+            }
+            stringBuilder(cachedHtml, SECTION, "</fieldset></form>");
+        }
+        cachedGeneration = generation;
+    }
+    memset(htmlKnownNetworks, 0, outputBufferLength); //Clear output buffer
+    strlcpy(htmlKnownNetworks, cachedHtml, outputBufferLength);
+    return 0;
+}
+
+int updateConfigSnapshots(char htmlSnapshots[], unsigned int outputBufferLength) {
+    /*
+     * Lists the most recent config snapshots (see configSnapshots.c) as an html string, with a form
+     * to roll back to any of them
+     */
+    memset(htmlSnapshots, 0, outputBufferLength); //Clear output buffer
+    configSnapshotInfo snapshots[10];
+    int ret = listConfigSnapshots(snapshots, 10);
     if (ret > 0) {
         char buffer[FIELD]; //Temporary output buffer
-        stringBuilder(htmlKnownNetworks, outputBufferLength,
-                "<br><form name=\"AddSSID\"  method=\"post\" action=\"AddSSID\">"
+        stringBuilder(htmlSnapshots, outputBufferLength,
+                "<br><form name=\"RollbackConfig\"  method=\"post\" action=\"rollbackConfig\">"
                 "<fieldset>"
-                "<legend>Known WiFi networks:</legend>");
-
-        for (n = 0; n < ret; n++) { //Iterate through network list, formatting as html
+                "<legend>Config snapshots:</legend>");
+        int n;
+        for (n = 0; n < ret; n++) { //Iterate through snapshot list, formatting as html
             memset(buffer, 0, FIELD);
-            snprintf(buffer, FIELD, "%s<br>\n", knownNetworksList[n].essid);
-            stringBuilder(htmlKnownNetworks, outputBufferLength, buffer);
+            snprintf(buffer, FIELD, "%d: %s%s<br>\n", snapshots[n].generation, snapshots[n].reason,
+                    snapshots[n].current ? " (current)" : "");
+            stringBuilder(htmlSnapshots, outputBufferLength, buffer);
         }
-        stringBuilder(htmlKnownNetworks, outputBufferLength, "</fieldset></form>");
-
+        stringBuilder(htmlSnapshots, outputBufferLength,
+                "Generation:<br>"
+                "<input type=\"text\" name=\"rollbackGeneration\" value=\"\"><br><br>"
+                "<input type=\"submit\" value=\"Roll back wpa supplicant config\">"
+                "</fieldset></form>");
     }
-
     return 0;
 }
 
@@ -336,157 +441,327 @@ int reformatHTMLString(char input[], unsigned int length) {
         }
 }
 
-void *twoSecSqThread(void *arg) {
+int applySetupMode(int mode) {
     /*
-     *  PThread: GEnerates 2 second toggle on global variable int twoSecSq
+     *  Called on the mode command thread (see modeCommandQueue.c) to change mode. That's the only thread that
+     *  calls setSetupMode(), so only one mode change can be in progress.
+     *  MODE_SETUP tries (preferred) hostAP mode first, then falls back to ad-hoc.
+     *  Returns 1 on success, -1 on failure
      */
-    while (1) {
-        twoSecSq = 1;
-        //printf("halfSecSq: %d\n",halfSecSq);
-        usleep(1000 * 1000);
-        twoSecSq = 0;
-        //printf("halfSecSq: %d\n",halfSecSq);
-        usleep(1000 * 1000); //Gives a 2 sec period
+    int ret;
+    if (mode == MODE_SETUP) {
+        printf("Entering setup mode\n");
+        printf("Configuring wlan0 in Host-AP mode\n");
+        ret = setSetupMode(2); //Try to start (preferred) AP Host mode first
+        if (ret < 1) {
+            printf("Couldn't start Host-AP setupMode\n"); //Couldn't start Host-AP mode
+            ret = setSetupMode(1); //so try the adhoc AP mode instead
+            if (ret < 1) printf("Couldn't start Adhoc-AP setupMode\n");
+        }
+    } else {
+        if (mode == MODE_NORMAL) printf("Leaving setup mode\n");
+        ret = setSetupMode(mode);
+        if (ret < 1) printf("Couldn't change setupMode to %d\n", mode);
     }
+    setLEDPattern(errorLED, (ret < 1) ? LED_PATTERN_ERROR : LED_PATTERN_OFF); //Until the next attempt
+    return (ret < 1) ? -1 : 1;
 }
 
-void *oneSecSqThread(void *arg) {
+void setupButtonGesture(int gesture) {
     /*
-     *  PThread: GEnerates 1 second toggle on global variable int oneSecSq
+     *  Called (on the button monitor thread, see buttonGestures.c) for each gesture on the AP Enable (setup) button.
+     *  Holding it down for 3 seconds toggles setupMode. Other gestures aren't used (yet)
+     *  The change is queued (see modeCommandQueue.c), so the button thread is free again straight away
      */
-    while (1) {
-        oneSecSq = 1;
-        //printf("halfSecSq: %d\n",halfSecSq);
-        usleep(500 * 1000);
-        oneSecSq = 0;
-        //printf("halfSecSq: %d\n",halfSecSq);
-        usleep(500 * 1000); //Gives a 1 sec period
-    }
+    if (gesture != BUTTON_LONG_PRESS) return;
+    printf("Setup button: toggling setup mode\n");
+    if (postModeCommand(MODE_TOGGLE) < 0) printf("setupButtonGesture(): Couldn't queue mode change\n");
 }
 
-void *halfSecSqThread(void *arg) {
+void updateStatusLEDs(void) {
     /*
-     *  PThread: GEnerates half second toggle on global variable int halfSecSq
+     * Sets the LEDs' patterns to match the global variables setupMode and wifiConnectedStatus
+     *      status: Slow (2 sec period): wlan0 not associated with any network
+     *              Medium (half sec): wlan0 asssociated with a network
+     *              fast (quart sec): program in setup mode
+     *      link:   on while wlan0 is associated with a network
+     *      mode:   on in setup mode
+     * Patterns that haven't changed are left alone, so call it whenever either variable changes
      */
-    while (1) {
-        halfSecSq = 1;
-        usleep(250 * 1000);
-        halfSecSq = 0;
-        usleep(250 * 1000); //Gives a 0.5 sec period
-    }
+    int setup = (getSetupMode() > 0);
+    int connected = (getSharedState(&wifiConnectedStatus) == 1);
+    setLEDPattern(statusLED, setup ? LED_PATTERN_FAST : (connected ? LED_PATTERN_MEDIUM : LED_PATTERN_SLOW));
+    setLEDPattern(linkLED, connected ? LED_PATTERN_ON : LED_PATTERN_OFF);
+    setLEDPattern(modeLED, setup ? LED_PATTERN_ON : LED_PATTERN_OFF);
 }
 
-void *quartSecSqThread(void *arg) {
+uint32_t dhcpLEDOffTask(void *context) {
     /*
-     *  PThread: GEnerates quarter second toggle on global variable int quartSecSq
+     * Scheduled task: Turns the dhcp LED off once there's been no DHCP traffic for DHCP_ACTIVITY_LED_MS
      */
-    while (1) {
-        quartSecSq = 1;
-        usleep(125 * 1000);
-        quartSecSq = 0;
-        usleep(125 * 1000); //Gives a 0.25 sec period
+    uint32_t idle = (uint32_t) getSchedulerTimeMs() - (uint32_t) getSharedState(&lastDHCPActivity);
+    if (idle < DHCP_ACTIVITY_LED_MS) return DHCP_ACTIVITY_LED_MS - idle;
+    setLEDPattern(dhcpLED, LED_PATTERN_OFF); //Before the flag's cleared, so it can't undo a dhcpActivity() that's just set FAST
+    setSharedState(&dhcpLEDActive, 0);
+    //A reply sent since the check above only noted the time (the flag was still set). Don't leave it unshown
+    idle = (uint32_t) getSchedulerTimeMs() - (uint32_t) getSharedState(&lastDHCPActivity);
+    if ((idle < DHCP_ACTIVITY_LED_MS) && (compareAndSetSharedState(&dhcpLEDActive, 0, 1))) {
+        setLEDPattern(dhcpLED, LED_PATTERN_FAST);
+        return DHCP_ACTIVITY_LED_MS - idle;
     }
+    return TASK_DONE;
 }
 
-void *monitorButtonThread(void *arg) {
+void dhcpActivity(void) {
     /*
-     *  Pthread: Monitors the AP Enable (setup) button (GPI gpioPin).
-     *  Updates global setupMode variable accordingly
+     * Called by the DHCP server for every reply it sends (see setDHCPActivityCallback()). Flickers the dhcp LED.
+     * While it's already flickering, all this does is note the time
      */
-    //Set pin directions
-    //    gpioSetMode(23, PI_OUTPUT); //GPIO 23 as output
-    //    gpioSetMode(24, PI_OUTPUT); //GPIO 24 as output
-    int gpioPin = *((int*) arg); //Tale local copy of arg
-    free(arg); //Free up memory requested by malloc 
-    printf("monitorButtonThread(): supplied pin no.: %d\n", gpioPin);
-
-    gpioSetMode(gpioPin, PI_INPUT); //GPIO gpioPin as input
-    //gpioSetMode(22, PI_INPUT); //GPIO 22 as input
-
-    //Set internal pull-ups on GPIO gpioPin and 22
-    gpioSetPullUpDown(gpioPin, PI_PUD_UP);
-    //gpioSetPullUpDown(22, PI_PUD_UP);
-
-    int buttonTimer = 0;
-    int n;
-    while (1) {
-        if (!gpioRead(gpioPin)) {
-            //If pin low, start sampling
-            //pin has to be held low for 3 seconds to trigger
-            buttonTimer += (20 * 1000);
-            if (buttonTimer == (3 * 1000 * 1000)) { //3 seconds elapsed
-                if (getSetupMode() == 0) {//Put prog into setup mode
-                    printf("Entering setup mode\n");
-                    printf("Configuring wlan0 in Host-AP mode\n");
-                    if (setSetupMode(2) < 1) { //Try to start (preferred) AP Host mode first
-                        printf("Couldn't start Host-AP setupMode\n"); //Couldn't start Host-AP mode
-                        if (setSetupMode(1) < 1) { //so try the adhoc AP mode instead
-                            printf("Couldn't start Adhoc-AP setupMode\n");
-                        }
-                    }
-
-                } else {//Or else, take it out of setup mode
-                    printf("Leaving setup mode\n");
-                    //printf("Reverting wlan0 in managed mode\n");
-                    if (setSetupMode(0) < 1) {
-                        printf("Couldn't stop setupMode\n");
-                    }
-                }
-                buttonTimer = 0; //Reset Timer 
-
-            }
-        } else buttonTimer = 0; //Reset Timer 
-        usleep(20 * 1000); //Gives a 20 mS button sampling period
+    setSharedState(&lastDHCPActivity, (int) getSchedulerTimeMs());
+    if (compareAndSetSharedState(&dhcpLEDActive, 0, 1)) {
+        setLEDPattern(dhcpLED, LED_PATTERN_FAST);
+        addScheduledTask("dhcpLEDOff", dhcpLEDOffTask, NULL, DHCP_ACTIVITY_LED_MS);
     }
 }
 
-void *statusLEDThread(void *arg) {
+int setStatusLEDPins(char spec[]) {
     /*
-     * Controls the flashing of status LED based on the status of 
-     * the global variable setupMode and wifiConnectedStatus
-     *      Slow (1 sec period): wlan0 not associated with any network
-     *      Medium (half sec): wlan0 asssociated with a network
-     *      fast (quart sec): program in setup mode
+     * Sets the pins of the LEDs other than the status LED, from a list like "link=24,mode=25,dhcp=26,error=27"
+     * (any of them can be left out). Call before startHttpConfigServer().
+     * Returns 0, or -1 if spec can't be understood
      */
-    int gpioPin = *((int*) arg); //Tale local copy of arg
-    free(arg); //Free up memory requested by malloc 
-    printf("statusLEDThread(): supplied pin no.: %d\n", gpioPin);
-
-    //Set pin directions
-    gpioSetMode(gpioPin, PI_OUTPUT); //GPIO gpioPin as output
-    //gpioSetMode(24, PI_OUTPUT); //GPIO 24 as output
-    while (1) {
-        if (getSetupMode() > 0)
-            gpioWrite(gpioPin, (HIGH & quartSecSq)); //Cause LED on GPIOgpioPin to blink fast
-        else if (wifiConnectedStatus == 1)
-            gpioWrite(gpioPin, (HIGH & halfSecSq));
-        else
-            gpioWrite(gpioPin, (HIGH & twoSecSq)); //Cause LED on GPIOgpioPin to blink slowly (like a watchdog)
-        usleep(20 * 1000); //Gives a 20 mS button sampling period
+    char copy[FIELD] = {0};
+    strlcpy(copy, spec, FIELD);
+    char *saveptr = NULL;
+    char *item;
+    for (item = strtok_r(copy, ",", &saveptr); item != NULL; item = strtok_r(NULL, ",", &saveptr)) {
+        char *equals = strchr(item, '=');
+        if (equals == NULL) return -1;
+        *equals = 0;
+        int pin = strtol(equals + 1, NULL, 10);
+        if ((pin < 0) || (pin >= GPIO_MAX_PINS)) return -1;
+        if (strcmp(item, "link") == 0) linkLEDPin = pin;
+        else if (strcmp(item, "mode") == 0) modeLEDPin = pin;
+        else if (strcmp(item, "dhcp") == 0) dhcpLEDPin = pin;
+        else if (strcmp(item, "error") == 0) errorLEDPin = pin;
+        else return -1;
     }
+    return 0;
 }
 
-void *wiFiConnectedThread(void *arg) {
+uint32_t wiFiConnectedTask(void *context) {
     /*
-     *      sets global variable wifiConnectedStatus if valid WiFi connection on wlan0
+     *      Scheduled task: sets global variable wifiConnectedStatus if valid WiFi connection on wlan0. Runs every 2 seconds
      *      //Note doesn't test other wlan interfaces, just wlan0
+     *      Runs on the scheduler thread with the LEDs and buttons, so it asks the driver (isWlanAssociated()) rather
+     *      than forking iwconfig (getWiFiConnStatus())
      */
-    //gpioSetMode(24, PI_OUTPUT); //GPIO 24 as output
-    wifiNetwork nic;
-    initWiFiNetworkStruct(&nic); //Init the struct
+    int status = isWlanAssociated("wlan0");
+    if (setSharedState(&wifiConnectedStatus, status) != status)
+        updateStatusLEDs(); //Show the change straight away
+    return 2000; //2 second delay
+}
 
-    while (1) {
-        if (getWiFiConnStatus(&nic, "wlan0") == 1)
-            //gpioWrite(24, HIGH); //Cause LED on GPIO24 to go high
-            wifiConnectedStatus = 1;
-        else
-            //gpioWrite(24, LOW); //Cause LED on GPIO24 to be off
-            wifiConnectedStatus = 0;
-        sleep(2); //2 second delay
+typedef struct {
+    char essid[FIELD];
+    char key[FIELD];
+    char ipAddress[INET_ADDRSTRLEN];
+    char subnetMask[INET_ADDRSTRLEN];
+    char configFile[FIELD]; //hostapd config
+} wlanModeSettings; //Context for the setup mode transition steps below (see wlanTransition.c)
+
+int getDaemonPid(char name[], char program[], char interface[]) {
+    /*
+     * Returns the pid of the running daemon 'name' (e.g "wpa_supplicant.wlan0") if we started it
+     * (see processSupervisor.c), otherwise of a 'program' someone else started (with interface on its command line,
+     * if that isn't NULL), or 0 if there isn't one
+     */
+    int pid = getSupervisedPid(name);
+    if (pid > 0) return pid;
+    return findProcessPid(program, interface);
+}
+
+int stopDaemon(char name[], char program[], char interface[], uint32_t killAfterMs) {
+    /*
+     * Stops the daemon 'name' if we started it: SIGTERM, then SIGKILL killAfterMs later (straight away if 0).
+     * Otherwise kills the one someone else started. Doesn't wait for it to go.
+     * Returns its pid, or 0 if it wasn't running
+     */
+    int pid = stopSupervisedProcess(name, killAfterMs);
+    if (pid > 0) return pid;
+    pid = findProcessPid(program, interface);
+    if ((pid > 0) && (kill(pid, (killAfterMs == 0) ? SIGKILL : SIGTERM) < 0)) perror("stopDaemon(): kill()");
+    return pid;
+}
+
+int startWPASupplicant(char interface[]) {
+    //Starts (or restarts) wpa_supplicant for interface, in the foreground so it can be supervised. Returns its pid, or -1
+    char name[SUPERVISOR_NAME_LENGTH] = {0};
+    snprintf(name, SUPERVISOR_NAME_LENGTH, "wpa_supplicant.%s", interface);
+    char *argv[] = {"wpa_supplicant", "-i", interface, "-D", "nl80211,wext", "-c", wpa_supplicantConfigPath, NULL};
+    printf("startWPASupplicant(): wpa_supplicant -i %s -D nl80211,wext -c %s\n", interface, wpa_supplicantConfigPath);
+    return superviseProcess(name, argv, PROCESS_RESTART_ALWAYS);
+}
+
+int stopWPASupplicantStep(wlanTransitionRun *run) {
+    //Kills the wpa_supplicant running on the interface, and waits for it to go
+    char name[SUPERVISOR_NAME_LENGTH] = {0};
+    snprintf(name, SUPERVISOR_NAME_LENGTH, "wpa_supplicant.%s", run->interface);
+    int pid = stopDaemon(name, "wpa_supp", run->interface, 0);
+    if (pid == 0) return 0; //Not running
+    printf("stopWPASupplicantStep(): %s wpa_supplicant pid. Killed process: %d\n", run->interface, pid);
+    run->waitPid = pid;
+    return 1;
+}
+
+int startWPASupplicantStep(wlanTransitionRun *run) {
+    //Association is picked up by wiFiConnectedTask()
+    return (startWPASupplicant(run->interface) > 0) ? 1 : -1;
+}
+
+int interfaceDownStep(wlanTransitionRun *run) {
+    char commandString[FIELD] = {0};
+    char commandResponse[FIELD] = {0};
+    snprintf(commandString, FIELD, "ifconfig %s down", run->interface);
+    printf("interfaceDownStep(): commandString: %s\n", commandString);
+    sysCmd2(commandString, commandResponse, FIELD);
+    return 1;
+}
+
+int interfaceUpStep(wlanTransitionRun *run) {
+    char commandString[FIELD] = {0};
+    char commandResponse[FIELD] = {0};
+    snprintf(commandString, FIELD, "ifconfig %s up", run->interface);
+    printf("interfaceUpStep(): commandString: %s\n", commandString);
+    sysCmd2(commandString, commandResponse, FIELD);
+    return 1;
+}
+
+int interfaceAddressStep(wlanTransitionRun *run) {
+    //Sets the static ip address/mask and brings the interface up
+    wlanModeSettings *settings = (wlanModeSettings *) run->context;
+    char commandString[FIELD] = {0};
+    char commandResponse[FIELD] = {0};
+    snprintf(commandString, FIELD, "ifconfig %s %s netmask %s up", run->interface, settings->ipAddress, settings->subnetMask);
+    printf("interfaceAddressStep(): commandString: %s\n", commandString);
+    sysCmd2(commandString, commandResponse, FIELD);
+    return 1;
+}
+
+int adhocModeStep(wlanTransitionRun *run) {
+    char commandString[FIELD] = {0};
+    char commandResponse[FIELD] = {0};
+    snprintf(commandString, FIELD, "iwconfig %s mode ad-hoc", run->interface);
+    printf("adhocModeStep(): commandString: %s. Attempt %d\n", commandString, run->attempt);
+    sysCmd2(commandString, commandResponse, FIELD);
+    return 1;
+}
+
+int adhocNetworkStep(wlanTransitionRun *run) {
+    //Sets the WEP key, channel and essid
+    wlanModeSettings *settings = (wlanModeSettings *) run->context;
+    char commandString[FIELD] = {0};
+    char commandResponse[FIELD] = {0};
+    snprintf(commandString, FIELD, "iwconfig %s key %s", run->interface, settings->key);
+    printf("adhocNetworkStep(): commandString: %s\n", commandString);
+    sysCmd2(commandString, commandResponse, FIELD);
+
+    memset(commandString, 0, FIELD);
+    snprintf(commandString, FIELD, "iwconfig %s channel 1 essid %s", run->interface, settings->essid);
+    printf("adhocNetworkStep(): commandString: %s\n", commandString);
+    sysCmd2(commandString, commandResponse, FIELD);
+    return 1;
+}
+
+int managedModeStep(wlanTransitionRun *run) {
+    //Puts the interface back into managed mode. Drivers don't always take it first time, so this step is retried
+    if (getWlanInterfaceType(run->interface) == WLAN_IFTYPE_STATION) return 0; //Already is (hostapd puts it back as it exits)
+    char commandString[FIELD] = {0};
+    char commandResponse[FIELD] = {0};
+    snprintf(commandString, FIELD, "iwconfig %s mode managed", run->interface);
+    printf("managedModeStep(): commandString: %s. Attempt %d\n", commandString, run->attempt);
+    sysCmd2(commandString, commandResponse, FIELD);
+    return 1;
+}
+
+int stopDHCPClientStep(wlanTransitionRun *run) {
+    //So it doesn't renew (or lose) a lease over the static address. The lease is kept, to ask for back (INIT-REBOOT) afterwards
+    if (installedDHCPClient == udhcpc) {
+        char name[SUPERVISOR_NAME_LENGTH] = {0};
+        snprintf(name, SUPERVISOR_NAME_LENGTH, "dhcpclient.%s", run->interface);
+        run->waitPid = stopSupervisedProcess(name, 1000);
+        return (run->waitPid > 0) ? 1 : 0;
     }
+    if (stopDHCPClient(run->interface, 0) < 0) return 0; //Not running
+    printf("stopDHCPClientStep(): dhcp client for %s stopped\n", run->interface);
+    return 1;
+}
 
+int interfaceClearAddressStep(wlanTransitionRun *run) {
+    //Removes the static address, so the dhcp client starts from a clean interface (dhclient-script used to flush it)
+    char commandString[FIELD] = {0};
+    char commandResponse[FIELD] = {0};
+    snprintf(commandString, FIELD, "ifconfig %s 0.0.0.0", run->interface);
+    printf("interfaceClearAddressStep(): commandString: %s\n", commandString);
+    sysCmd2(commandString, commandResponse, FIELD);
+    return 1;
 }
 
+int stopHostapdStep(wlanTransitionRun *run) {
+    //Stops hostapd, so it can tidy the interface up. If it hasn't gone by the time the step's retried, it's killed
+    int pid = stopDaemon("hostapd", "hostapd", NULL, (run->attempt == 1) ? 2000 : 0);
+    if (pid == 0) return 0; //Not running
+    printf("stopHostapdStep(): hostapd pid. process to be stopped: %d. Attempt %d\n", pid, run->attempt);
+    run->waitPid = pid;
+    return 1;
+}
+
+int startHostapdStep(wlanTransitionRun *run) {
+    //Restarted if it dies while we're in setup mode
+    wlanModeSettings *settings = (wlanModeSettings *) run->context;
+    char *argv[] = {hostapdPath, settings->configFile, NULL};
+    printf("startHostapdStep(): %s %s\n", hostapdPath, settings->configFile);
+    return (superviseProcess("hostapd", argv, PROCESS_RESTART_ALWAYS) > 0) ? 1 : -1;
+}
+
+/*
+ * The setup mode transitions (see wlanTransition.c). Each step: name, action, what it waits for,
+ * wait argument, timeout (mS), retry interval (mS)
+ */
+static const wlanStep enterAdhocSteps[] = {
+    {"stop dhcp client", stopDHCPClientStep, WLAN_WAIT_PROCESS_EXIT, 0, 2000, 0},
+    {"stop wpa_supplicant", stopWPASupplicantStep, WLAN_WAIT_PROCESS_EXIT, 0, 2000, 0},
+    {"interface down", interfaceDownStep, WLAN_WAIT_LINK_DOWN, 0, 2000, 0},
+    {"ad-hoc mode", adhocModeStep, WLAN_WAIT_IFTYPE, WLAN_IFTYPE_ADHOC, 5000, 1000},
+    {"ad-hoc network", adhocNetworkStep, WLAN_WAIT_NONE, 0, 0, 0},
+    {"address, interface up", interfaceAddressStep, WLAN_WAIT_LINK_UP, 0, 2000, 0},
+    {"check ad-hoc mode", NULL, WLAN_WAIT_IFTYPE, WLAN_IFTYPE_ADHOC, 1000, 0}
+};
+static const wlanStep leaveAdhocSteps[] = {
+    {"interface down", interfaceDownStep, WLAN_WAIT_LINK_DOWN, 0, 2000, 0},
+    {"clear address", interfaceClearAddressStep, WLAN_WAIT_NONE, 0, 0, 0},
+    {"managed mode", managedModeStep, WLAN_WAIT_IFTYPE, WLAN_IFTYPE_STATION, 10000, 1000},
+    {"interface up", interfaceUpStep, WLAN_WAIT_LINK_UP, 0, 2000, 0},
+    {"start wpa_supplicant", startWPASupplicantStep, WLAN_WAIT_NONE, 0, 0, 0}
+};
+static const wlanStep enterHostAPSteps[] = {
+    {"stop dhcp client", stopDHCPClientStep, WLAN_WAIT_PROCESS_EXIT, 0, 2000, 0},
+    {"stop wpa_supplicant", stopWPASupplicantStep, WLAN_WAIT_PROCESS_EXIT, 0, 2000, 0},
+    {"interface down", interfaceDownStep, WLAN_WAIT_LINK_DOWN, 0, 2000, 0},
+    {"address, interface up", interfaceAddressStep, WLAN_WAIT_LINK_UP, 0, 2000, 0},
+    {"stop old hostapd", stopHostapdStep, WLAN_WAIT_PROCESS_EXIT, 0, 3000, 1000},
+    {"start hostapd", startHostapdStep, WLAN_WAIT_HOSTAPD, 0, 10000, 0} //Allows for the 20/40MHz coexistence scan
+};
+static const wlanStep leaveHostAPSteps[] = {
+    {"stop hostapd", stopHostapdStep, WLAN_WAIT_PROCESS_EXIT, 0, 5000, 2000},
+    {"interface down", interfaceDownStep, WLAN_WAIT_LINK_DOWN, 0, 2000, 0},
+    {"clear address", interfaceClearAddressStep, WLAN_WAIT_NONE, 0, 0, 0},
+    {"managed mode", managedModeStep, WLAN_WAIT_IFTYPE, WLAN_IFTYPE_STATION, 10000, 1000},
+    {"interface up", interfaceUpStep, WLAN_WAIT_LINK_UP, 0, 2000, 0},
+    {"start wpa_supplicant", startWPASupplicantStep, WLAN_WAIT_NONE, 0, 0, 0}
+};
+#define WLAN_STEP_COUNT(steps) ((int) (sizeof (steps) / sizeof (steps[0])))
+
 int setAdhocWlanMode(int mode) {
     /*
      *      Puts the wlan0 interface into adhoc mode if mode=1, else disable access point mode.
@@ -497,22 +772,18 @@ int setAdhocWlanMode(int mode) {
      *      a WPA password, which obviously won't work. Repeated clicking on the SSID on the WiFi
      *      menu sometimes works and eventually OSX 'get's it'
      * 
-     *      It parses the return string from iwconfig, to verify that the correct mode has been set
-     *      (i.e it looks for the string "managed" or "Ad-Hoc")
+     *      Each step waits for the interface to report the change (mode, up/down) before the next
+     *      (see wlanTransition.c)
      * 
      */
 
-    char commandString[FIELD] = {0}; //Char array to hold command string
-    char commandResponse[FIELD] = {0}; //Char array to hold command response
-
     //WiFi Network parameters
-    //char ipAddress[] = "192.168.42.1";
     char interface[] = "wlan0";
-    char ipAddress[] = "192.168.0.11";
-    char subnetMask[] = "255.255.255.0";
-    //char essid[] = "RPi";
-    char essid[FIELD] = {0};
-    char wepKey[] = "0123456789";
+    wlanModeSettings settings;
+    memset(&settings, 0, sizeof (settings));
+    strlcpy(settings.ipAddress, "192.168.0.11", INET_ADDRSTRLEN);
+    strlcpy(settings.subnetMask, "255.255.255.0", INET_ADDRSTRLEN);
+    strlcpy(settings.key, "0123456789", FIELD);
 
     if (mode == 1) {
         //construct SSID based on host and serial no. of Pi and a random element
@@ -523,149 +794,23 @@ int setAdhocWlanMode(int mode) {
         int serialNo = getSerialNumber(); //Get serial number
         srand(time(NULL));
         int r = rand() % 100; //Get random number between 0 and 100
-        snprintf(essid, FIELD, "%d%s%X", r, buffer, serialNo); //Construct SSID from random no+hostname+serialNo
-        printf("setAdhocWlanMode():essid: %s\n", essid);
-
-        char commandResponse[FIELD] = {0};
-        char commandString[FIELD] = {0};
-
-        //Kill existing wpa_supplicant process relating to wlan0
-        //Get pid of wpa_supplicant related to wlan0
-        snprintf(commandString, FIELD, "ps x | grep wpa_supp | grep %s | grep -v grep | awk '{print $1}' ", interface);
-        //sysCmd2("ps x | grep wpa_supp | grep wlan0 | awk '{print $1}' ", commandResponse, FIELD);
-        sysCmd2(commandString, commandResponse, FIELD);
-        char *ptr;
-        int wlan0Pid = strtol(commandResponse, &ptr, 10);
-
-        if (wlan0Pid > 0) { //If process running
-            printf("setAdhocWlanMode(): wlan0 wpa_supplicant pid. Killing process: %d\n", wlan0Pid);
-            //Kill wpa_supplicant for wlan0
-            memset(commandResponse, 0, FIELD);
-            snprintf(commandString, FIELD, "kill -9 %d", wlan0Pid); //Create command string to kill wpa_supplicant by process id
-            sysCmd2(commandString, commandResponse, FIELD); //Kill the process
-        }
-
-        //Take interface down
-        memset(commandString, 0, FIELD);
-        snprintf(commandString, FIELD, "ifconfig %s down", interface);
-        printf("setAdhocWlanMode(): commandString: %s\n", commandString);
-        sysCmd2(commandString, commandResponse, FIELD);
-
-        sleep(2);
-        //Put interface into adhoc mode
-        memset(commandString, 0, FIELD);
-        snprintf(commandString, FIELD, "iwconfig %s mode ad-hoc", interface);
-        printf("setAdhocWlanMode(): commandString: %s\n", commandString);
-        sysCmd2(commandString, commandResponse, FIELD);
-
-        //Set WEP key
-        memset(commandString, 0, FIELD);
-        snprintf(commandString, FIELD, "iwconfig %s key %s", interface, wepKey);
-        printf("setAdhocWlanMode(): commandString: %s\n", commandString);
-        sysCmd2(commandString, commandResponse, FIELD);
-
-        sleep(1);
-        memset(commandString, 0, FIELD);
-        snprintf(commandString, FIELD, "iwconfig %s channel 1 essid %s", interface, essid);
-        printf("setAdhocWlanMode(): commandString: %s\n", commandString);
-        sysCmd2(commandString, commandResponse, FIELD);
+        snprintf(settings.essid, FIELD, "%d%s%X", r, buffer, serialNo); //Construct SSID from random no+hostname+serialNo
+        printf("setAdhocWlanMode():essid: %s\n", settings.essid);
 
-        sleep(1);
-        //Set static ip address/mask
-        memset(commandString, 0, FIELD);
-        snprintf(commandString, FIELD, "ifconfig %s %s netmask %s up", interface, ipAddress, subnetMask);
-        printf("setAdhocWlanMode(): commandString: %s\n", commandString);
-        sysCmd2(commandString, commandResponse, FIELD);
-
-        //Now need to check whether interface is actually in adHoc mode
-        memset(commandString, 0, FIELD);
-        memset(commandResponse, 0, FIELD);
-        snprintf(commandString, FIELD, "iwconfig %s", interface);
-        sysCmd2(commandString, commandResponse, FIELD);
-        //Parse iwconfig response for the term 'Ad-Hoc'. If not present, Ad-Hoc mode has not been set
-        //printf("setAdhocWlanMode: Gets here:\n");
-        if (strstr(commandResponse, "Ad-Hoc") == NULL) {
+        if (runWlanTransition("enter ad-hoc mode", interface, enterAdhocSteps, WLAN_STEP_COUNT(enterAdhocSteps), &settings) < 0) {
             printf("Couldn't put %s into Ad-Hoc mode\n", interface);
             return -1;
         }
-        strlcpy(ap_ssid, essid, FIELD); //Copy to global 
+        strlcpy(ap_ssid, settings.essid, FIELD); //Copy to global 
         return 1;
     } else {
         //Turn off Adhoc AP mode
         //First check to see if adhoc mode is actually set. If so, revert to Managed mode, else do nothing.
-        //Now need to check whether interface is actually in adHoc mode
-        memset(commandString, 0, FIELD);
-        memset(commandResponse, 0, FIELD);
-
-        //Interrogate interface
-        snprintf(commandString, FIELD, "iwconfig %s", interface);
-        sysCmd2(commandString, commandResponse, FIELD);
-
-        //Parse iwconfig response for the term 'Ad-Hoc'. If not present, Ad-Hoc mode has not been set
-        if (strstr(commandResponse, "Ad-Hoc") != NULL) { //'Ad-Hoc' is present in the response        
-            /*
-                        //Release the existing dhcp lease for that interface
-                        memset(commandString, 0, FIELD);
-                        snprintf(commandString, FIELD, "dhclient %s -r -v", interface);
-                        printf("setAdhocWlanMode(): commandString: %s\n", commandString);
-                        sysCmd2(commandString, commandResponse, FIELD); //Release old lease
-             */
-            //Take interface down
-            memset(commandString, 0, FIELD);
-            snprintf(commandString, FIELD, "ifconfig %s down", interface);
-            printf("setAdhocWlanMode(): commandString: %s\n", commandString);
-            sysCmd2(commandString, commandResponse, FIELD);
-
-            sleep(2);
-
-            //Take interface up
-            snprintf(commandString, FIELD, "ifconfig %s up", interface);
-            printf("setAdhocWlanMode(): commandString: %s\n", commandString);
-            sysCmd2(commandString, commandResponse, FIELD);
-
-            sleep(1);
-            /*
-            //Set interface to 'managed' mode
-            memset(commandString, 0, FIELD);
-            memset(commandResponse, 0, FIELD);
-            snprintf(commandString, FIELD, "iwconfig %s mode managed", interface);
-            printf("setAdhocWlanMode(): commandString: %s\n", commandString);
-            sysCmd2(commandString, commandResponse, FIELD);
-             */
-            int attempts = 1; //Counts how many attempts it takes to successfully set wlan0 back to Managed mode
-            int maxNoOfAttemptsAllowed = 10;
-            do {
-                //Set interface back to 'managed' mode  -This seemingly takes several goes before it takes
-                memset(commandString, 0, FIELD);
-                memset(commandResponse, 0, FIELD);
-                snprintf(commandString, FIELD, "iwconfig %s mode managed", interface);
-                printf("setAdhocWlanMode(): commandString: %s. Attempt %d of %d\n", commandString, attempts, maxNoOfAttemptsAllowed);
-                sysCmd2(commandString, commandResponse, FIELD);
-
-                //Now need to check whether interface is actually in managed mode
-                memset(commandString, 0, FIELD);
-                memset(commandResponse, 0, FIELD);
-                snprintf(commandString, FIELD, "iwconfig %s", interface);
-                sysCmd2(commandString, commandResponse, FIELD);
-                //Parse iwconfig response for the term 'Mode:Managed'. If not present, Mode:Managed mode has not been set
-                //printf("setAdhocWlanMode: Gets here:\n");
-                if (strstr(commandResponse, "Mode:Managed") == NULL) {
-                    printf("setAdhocWlanMode(): Couldn't put %s into Managed mode\n", interface);
-                } else break; //Else interface mode successfully set. Break out of do-while loop
-                attempts++;
-                sleep(1);
-            } while (attempts < (maxNoOfAttemptsAllowed + 1));
-
-            sleep(2);
-            //Now restart wpa-supplicant for wlan0
-            memset(commandString, 0, FIELD);
-            snprintf(commandString, FIELD, "wpa_supplicant -B -P /run/wpa_supplicant.%s.pid -i %s -D nl80211,wext -c %s", interface, interface, wpa_supplicantConfigPath);
-            printf("setAdhocWlanMode(): %s\n", commandString);
-            sysCmd2(commandString, commandResponse, FIELD);
-
+        if (getWlanInterfaceType(interface) == WLAN_IFTYPE_ADHOC) {
+            int ret = runWlanTransition("leave ad-hoc mode", interface, leaveAdhocSteps, WLAN_STEP_COUNT(leaveAdhocSteps), &settings);
+            if (ret < 0) printf("setAdhocWlanMode(): Couldn't put %s back into Managed mode\n", interface);
             memset(ap_ssid, 0, FIELD); //Clear global ssid field
-            sleep(2);
-            return 1;
+            return 1; //As before, setup mode's over either way
 
         } else { //Ad-hoc mode not set, so don't need to make any changes to the interface
             return 1;
@@ -688,6 +833,8 @@ int setHostAPWlanMode(int mode) {
      * 
      * hostapd requires it's own config file.
      * Therefore this function will create a config file for hostapd on the fly:- /etc/httpConfigServer_hostapd.conf
+     * The config turns on hostapd's control interface, which is how we know the AP is actually up
+     * (see waitHostapdEnabled())
      * 
      * It works with V2.3
      * hostapd v2.3
@@ -697,26 +844,23 @@ int setHostAPWlanMode(int mode) {
      * 
      */
     char interface[] = "wlan0";
-    char ipAddress[] = "192.168.0.11";
-    char subnetMask[] = "255.255.255.0";
-    char essid[FIELD] = {0};
     char wpaKey[] = "raspberry";
-    //char hostapdPath[] = "/usr/sbin/hostapd";
-    //char *fileNameToWrite = "/etc/httpConfigServer_hostapd.conf";
-    char *fileNameToWrite = "/tmp/httpConfigServer_hostapd.conf";
+    wlanModeSettings settings;
+    memset(&settings, 0, sizeof (settings));
+    strlcpy(settings.ipAddress, "192.168.0.11", INET_ADDRSTRLEN);
+    strlcpy(settings.subnetMask, "255.255.255.0", INET_ADDRSTRLEN);
+    strlcpy(settings.configFile, HOSTAPD_CONFIG_FILENAME, FIELD);
+    char *fileNameToWrite = settings.configFile;
 
     //construct SSID based on host and serial no. of Pi and a random element
     char buffer[FIELD] = {0}; //Temp buffer to hold hostname
     getHostName(buffer, FIELD); //Get hostname
     int serialNo = getSerialNumber(); //Get serial number
-    snprintf(essid, FIELD, "%s%X", buffer, serialNo); //Construct SSID from random no+hostname+serialNo
-    printf("APHostWlanMode():essid: %s, wpaKey: %s\n", essid, wpaKey);
-
-    char commandResponse[FIELD] = {0};
-    char commandString[FIELD] = {0};
+    snprintf(settings.essid, FIELD, "%s%X", buffer, serialNo); //Construct SSID from random no+hostname+serialNo
+    printf("APHostWlanMode():essid: %s, wpaKey: %s\n", settings.essid, wpaKey);
 
     char hostapdConfigFile[SECTION] = {0};
-    snprintf(hostapdConfigFile, FIELD,
+    snprintf(hostapdConfigFile, SECTION,
             "#hostapd config file auto generated by httpConfigServer. To suit hostapd V2.3"
             "\n"
             "\n"
@@ -726,6 +870,9 @@ int setHostAPWlanMode(int mode) {
             "# Use the nl80211 driver with the brcmfmac driver\n"
             "driver=nl80211\n"
             "\n"
+            "# Control interface, so httpConfigServer can see when the AP is up\n"
+            "ctrl_interface=" HOSTAPD_CTRL_DIR "\n"
+            "\n"
             "# This is the name of the network\n"
             "ssid=%s\n"
             "\n"
@@ -763,7 +910,7 @@ int setHostAPWlanMode(int mode) {
             "wpa_passphrase=%s\n"
             "\n"
             "# Use AES, instead of TKIP\n"
-            "rsn_pairwise=CCMP\n", essid, wpaKey);
+            "rsn_pairwise=CCMP\n", settings.essid, wpaKey);
 
     if (mode == 1) { //Requested mode = 1
         //Create a config file for hostapd
@@ -777,110 +924,25 @@ int setHostAPWlanMode(int mode) {
         printf("Writing %s\n", fileNameToWrite);
         fprintf(fp, hostapdConfigFile); //Write string to disk
         fclose(fp); //Close file
+        if (isFileSystemWriteable() == 2) //Only if it's already writeable. Not worth a remount
+            takeConfigSnapshot("Generated hostapd config");
 
-        //Kill existing wpa_supplicant process relating to wlan0
-        //Get pid of wpa_supplicant related to wlan0
-        snprintf(commandString, FIELD, "ps x | grep wpa_supp | grep %s | grep -v grep | awk '{print $1}' ", interface);
-        //sysCmd2("ps x | grep wpa_supp | grep wlan0 | awk '{print $1}' ", commandResponse, FIELD);
-        sysCmd2(commandString, commandResponse, FIELD);
-        char *ptr;
-        int wlan0Pid = strtol(commandResponse, &ptr, 10);
-
-        if (wlan0Pid > 0) { //Is process actually running?
-            //Kill wpa_supplicant for wlan0
-            printf("setHostAPWlanMode(): wlan0 wpa_supplicant pid. Killing process: %d\n", wlan0Pid);
-            memset(commandResponse, 0, FIELD);
-            snprintf(commandString, FIELD, "kill -9 %d", wlan0Pid); //Create command string to kill wpa_supplicant by process id
-            sysCmd2(commandString, commandResponse, FIELD); //Kill the process
-        }
-
-        //Take interface down
-        memset(commandString, 0, FIELD);
-        snprintf(commandString, FIELD, "ifconfig %s down", interface);
-        printf("setHostAPWlanMode(): commandString: %s\n", commandString);
-        sysCmd2(commandString, commandResponse, FIELD);
-
-        sleep(1);
-        //Set static ip address/mask
-        memset(commandString, 0, FIELD);
-        snprintf(commandString, FIELD, "ifconfig %s %s netmask %s up", interface, ipAddress, subnetMask);
-        printf("setHostAPWlanMode(): commandString: %s\n", commandString);
-        sysCmd2(commandString, commandResponse, FIELD);
-
-        //start hostapd
-        memset(commandString, 0, FIELD);
-        sysCmd2("killall -9 hostapd", commandResponse, FIELD); //Kill all existing instances that might be running
-        snprintf(commandString, FIELD, "%s %s &", hostapdPath, fileNameToWrite);
-        printf("setHostAPWlanMode(): commandString: %s\n", commandString);
-        system(commandString);
-        sleep(1);
-        //check hostapd is actually running 
-        //Get pid of hostapd
-        memset(commandString, 0, FIELD);
-        memset(commandResponse, 0, FIELD);
-        snprintf(commandString, FIELD, "ps x | grep hostapd | grep -v grep | awk '{print $1}'");
-        sysCmd2(commandString, commandResponse, FIELD);
-
-        int hostapdPid = 0;
-        hostapdPid = strtol(commandResponse, &ptr, 10); //Convert returned string to an int
-
-        if (hostapdPid > 0) {
-            printf("setHostAPWlanMode(): hostapd pid.: %d\n", hostapdPid);
-            strlcpy(ap_ssid, essid, FIELD); //Copy to global
-            return 1;
-        } else {
+        //Stops wpa_supplicant, sets the address, then starts hostapd and waits for it to say the AP is up
+        if (runWlanTransition("enter hostAP mode", interface, enterHostAPSteps, WLAN_STEP_COUNT(enterHostAPSteps), &settings) < 0) {
             printf("setHostAPWlanMode(): Couldn't start hostapd\n");
+            stopDaemon("hostapd", "hostapd", NULL, 0); //Don't leave a half started one running (or restarting)
             return -1;
         }
+        strlcpy(ap_ssid, settings.essid, FIELD); //Copy to global
+        return 1;
 
     } else { //Requested mode 0 disable hostAP mode
 
-        //Check to see if hostapd is running (by grepping ps x)
-        memset(commandString, 0, FIELD);
-        memset(commandResponse, 0, FIELD);
-
-        snprintf(commandString, FIELD, "ps x | grep hostapd | grep -v grep | awk '{print $1}' &");
-        sysCmd2(commandString, commandResponse, FIELD);
-        char *ptr;
-        int hostapdPid = 0;
-        hostapdPid = strtol(commandResponse, &ptr, 10); //Convert returned string to an int
-        if (hostapdPid > 0) {
-            //hostapd running, so kill it
-            printf("setHostAPWlanMode(): hostapd pid. process to be killed: %d\n", hostapdPid);
-            sysCmd2("killall -9 hostapd", commandResponse, FIELD);
-            sleep(1);
-
-            int attempts = 1; //Counts how many attempts it takes to successfully set wlan0 back to Managed mode
-            int maxNoOfAttemptsAllowed = 10;
-            do {
-                //Set interface back to 'managed' mode  -This seemingly takes several goes before it takes
-                memset(commandString, 0, FIELD);
-                memset(commandResponse, 0, FIELD);
-                snprintf(commandString, FIELD, "iwconfig %s mode managed", interface);
-                printf("setHostAPWlanMode(): commandString: %s. Attempt %d of %d\n", commandString, attempts, maxNoOfAttemptsAllowed);
-                sysCmd2(commandString, commandResponse, FIELD);
-
-                //Now need to check whether interface is actually in managed mode
-                memset(commandString, 0, FIELD);
-                memset(commandResponse, 0, FIELD);
-                snprintf(commandString, FIELD, "iwconfig %s", interface);
-                sysCmd2(commandString, commandResponse, FIELD);
-                //Parse iwconfig response for the term 'Mode:Managed'. If not present, Mode:Managed mode has not been set
-                //printf("setAdhocWlanMode: Gets here:\n");
-                if (strstr(commandResponse, "Mode:Managed") == NULL) {
-                    printf("setHostAPWlanMode(): Couldn't put %s into Managed mode\n", interface);
-                } else break; //Else interface mode successfully set. Break out of do-while loop
-                attempts++;
-                sleep(1);
-            } while (attempts < (maxNoOfAttemptsAllowed + 1));
-
-            sleep(2);
-            //Now restart wpa-supplicant for wlan0
-            memset(commandString, 0, FIELD);
-            snprintf(commandString, FIELD, "wpa_supplicant -B -P /run/wpa_supplicant.%s.pid -i %s -D nl80211,wext -c %s", interface, interface, wpa_supplicantConfigPath);
-            printf("setHostAPWlanMode(): %s\n", commandString);
-            sysCmd2(commandString, commandResponse, FIELD);
-            sleep(2);
+        //Check to see if hostapd is running
+        if (getDaemonPid("hostapd", "hostapd", NULL) > 0) {
+            //hostapd running, so stop it and put the interface back to managed mode
+            if (runWlanTransition("leave hostAP mode", interface, leaveHostAPSteps, WLAN_STEP_COUNT(leaveHostAPSteps), &settings) < 0)
+                printf("setHostAPWlanMode(): Couldn't put %s back into Managed mode\n", interface);
             memset(ap_ssid, 0, FIELD); //Clear global ssid field
             return 1;
         } else { //If it's not running, do nothing
@@ -897,14 +959,14 @@ int getSetupMode() {
     /*
      * Retrieves the status of the global variable setupMode
      */
-    return setupMode;
+    return getSharedState(&setupMode);
 }
 
 int getUnsavedChangesFlag() {
     /*
      *      Returns the status of the global var unsavedChangesFlag.
      */
-    return unsavedChangesFlag;
+    return getSharedState(&unsavedChangesFlag);
 }
 
 void setUnsavedChangesFlag(int var) {
@@ -912,8 +974,7 @@ void setUnsavedChangesFlag(int var) {
      * Sets the global var unsavedChanges.
      * @param var
      */
-    if (var > 0) unsavedChangesFlag = 1;
-    else unsavedChangesFlag = 0;
+    setSharedState(&unsavedChangesFlag, (var > 0) ? 1 : 0);
 }
 
 int getHTTPListeningPort() {
@@ -938,59 +999,46 @@ int restartWPASupplicant() {
      * Kills all existing instances of the wpa supplicant and restarts wpa_supplicant for wlan0 
      * (and also wlan1 if it exists).
      * 
-     * 
+     * The ones we start are supervised (see processSupervisor.c): restarted if they die, and starting one
+     * stops the last, so there's never two on an interface. Any we didn't start are killed first
      * 
      */
     if (getSetupMode() == 0) { //Not  in setup mode so restart wpa_supplicant for wlan0 (and wlan1 if installed)
         char commandResponse[FIELD] = {0};
-        char commandString[FIELD] = {0};
-        printf("restartWPASupplicant(): Killing all running wpa_supplicant processes\n");
-        sysCmd2("killall -9 wpa_supplicant", commandResponse, FIELD); //kill all running wpa_supplicant processes
-        sleep(1);
+        printf("restartWPASupplicant(): Stopping all running wpa_supplicant processes\n");
+        stopSupervisedProcess("wpa_supplicant.wlan0", 0); //So they're not restarted
+        stopSupervisedProcess("wpa_supplicant.wlan1", 0);
+        sysCmd2("killall -9 wpa_supplicant", commandResponse, FIELD); //And any we didn't start (e.g at boot)
+        int pid, n;
+        for (n = 0; (n < 5) && ((pid = findProcessPid("wpa_supp", NULL)) > 0); n++) waitProcessExit(pid, 1000);
+        waitSupervisedProcess("wpa_supplicant.wlan0", 1000);
+        waitSupervisedProcess("wpa_supplicant.wlan1", 1000);
         //Now force wlan0 into Managed mode (it might be stuck in 'adhoc' or 'master' mode from an
         //aborted setup mode session)
         sysCmd2("iwconfig wlan0 mode managed", commandResponse, FIELD);
 
         //Restart wlan0 wpa_supplicant
         printf("restartWPASupplicant(): Restarting wpa_supplicant for wlan0\n");
-        snprintf(commandString, FIELD, "wpa_supplicant -B -P /run/wpa_supplicant.wlan0.pid -i wlan0 -D nl80211,wext -c %s", wpa_supplicantConfigPath);
-        printf("restartWPASupplicant():commandString: %s\n", commandString);
-        sysCmd2(commandString, commandResponse, FIELD);
+        startWPASupplicant("wlan0");
 
         //Restart wlan1 wpa_supplicant (if wlan1 installed)
         if (isWlan1Present() == 1) {
             printf("restartWPASupplicant(): wlan1 present. Restarting wpa_supplicant for wlan1\n");
-            memset(commandString, 0, FIELD);
-            snprintf(commandString, FIELD, "wpa_supplicant -B -P /run/wpa_supplicant.wlan1.pid -i wlan1 -D nl80211,wext -c %s", wpa_supplicantConfigPath);
-            printf("restartWPASupplicant():commandString: %s\n", commandString);
-            sysCmd2(commandString, commandResponse, FIELD);
+            startWPASupplicant("wlan1");
         }
 
     } else { //Must be in setup mode. Therefore wlan0 is busy so only want to restart wlan1
         if (isWlan1Present() == 1) {
-            char commandResponse[FIELD] = {0};
-            char commandString[FIELD] = {0};
-            //Get pid of wpa_supplicant related to wlan1
-            sysCmd2("ps x | grep wpa_supp | grep wlan1 | grep -v grep | awk '{print $1}' ", commandResponse, FIELD);
-            char *ptr;
-            int wlan1Pid = strtol(commandResponse, &ptr, 10);
-            if (wlan1Pid > 0) { //Check process is actually running (before we try to kill it)
+            //Stop one we didn't start (starting ours stops our old one)
+            int wlan1Pid = findProcessPid("wpa_supp", "wlan1");
+            if ((getSupervisedPid("wpa_supplicant.wlan1") == 0) && (wlan1Pid > 0)) {
                 printf("restartWPASupplicant(): Current wlan1 wpa_supplicant pid: %d\n", wlan1Pid);
-                snprintf(commandString, FIELD, "kill -9 %d", wlan1Pid); //Create command string to kill wpa_supplicant by process id
-                printf("restartWPASupplicant(): commandString: %s\n", commandString);
-                sysCmd2(commandString, commandResponse, FIELD); //Kill wpa_supplicant   
+                stopDaemon("wpa_supplicant.wlan1", "wpa_supp", "wlan1", 0);
+                waitProcessExit(wlan1Pid, 1000);
             }
 
             //Now restart wpa_supplicant
-            memset(commandString, 0, FIELD);
-            snprintf(commandString, FIELD, "wpa_supplicant -B -P /run/wpa_supplicant.wlan1.pid -i wlan1 -D nl80211,wext -c %s", wpa_supplicantConfigPath);
-            printf("restartWPASupplicant(): commandString: %s\n", commandString);
-            sysCmd2(commandString, commandResponse, FIELD);
-
-            //Get new pid of wpa_supplicant
-            memset(commandResponse, 0, FIELD);
-            sysCmd2("ps x | grep wpa_supp | grep wlan1 | awk '{print $1}' ", commandResponse, FIELD);
-            wlan1Pid = strtol(commandResponse, &ptr, 10);
+            wlan1Pid = startWPASupplicant("wlan1");
             printf("restartWPASupplicant(): New wlan1 wpa_supplicant pid: %d\n", wlan1Pid);
         }
 
@@ -999,28 +1047,37 @@ int restartWPASupplicant() {
 
 int getSerialNumber() {
     /*
-     * Retrieves the serial number string from /cat/proc
+     * Retrieves the serial number (see deviceIdentity.c. It's read once, not looked up each time)
      * Note: serial number on the Pi is expressed as a Hex number
      * Sample code:-
      *          int serialNo=getSerialNumber();
      *          printf("Serial number: %X\n",serialNo);
      */
-    char output[FIELD];
-    memset(output, 0, FIELD);
-    //sysCmd2("grep -Po '^Serial\\s*:\\s*\\K[[:xdigit:]]{16}' /proc/cpuinfo", output, FIELD);
-    sysCmd2("cat /proc/cpuinfo | grep Serial | cut -d ':' -f 2", output, FIELD);
-    char *ptr;
-    unsigned int serialNumber = (int) strtol(output, &ptr, 16); //Serial number is written in 
-    //printf("getSerialNumber(): raw: %s, integer:%d, as Hex: %x\n", output, serialNumber, serialNumber);
-    return serialNumber;
+    return getDeviceIdentity()->serialNumber;
 }
 
 int getHostName(char output[], int outputLength) {
+    //Copies the hostname to output[]. Returns its length (see deviceIdentity.c)
     memset(output, 0, outputLength);
-    int ret = sysCmd2("hostname", output, FIELD); //Run 'hostname' in terminal, Copy response to output[]]
-    output[ret - 1] = 0; //Removes a wierd carriage return character appended by 'hostname'
+    return getDeviceHostName(output, outputLength);
+}
 
-    return ret - 1; //Return length of returned name (not including null char)                      
+int renewDHCPLease(char interface[]) {
+    /*
+     * Starts (or, if it's running, renews) the dhcp client for interface: the built-in one (see dhcpClient.c),
+     * or udhcpc with -udhcpc, in the foreground (udhcpc -f) and supervised so it's restarted if it dies
+     * (see processSupervisor.c). Returns 0 on success, -1 on failure
+     */
+    if (installedDHCPClient == udhcpc) {
+        char name[SUPERVISOR_NAME_LENGTH] = {0};
+        snprintf(name, SUPERVISOR_NAME_LENGTH, "dhcpclient.%s", interface);
+        printf("renewDHCPLease(): udhcpc -f -i %s\n", interface);
+        char *argv[] = {"udhcpc", "-f", "-i", interface, NULL};
+        return (superviseProcess(name, argv, PROCESS_RESTART_ALWAYS) > 0) ? 0 : -1;
+    }
+    if (installedDHCPClient != builtindhcpclient) return -1;
+    printf("renewDHCPLease(): %s\n", interface);
+    return startDHCPClient(interface);
 }
 
 /*
@@ -1032,7 +1089,7 @@ void *dhcpServerThread(void *arg) {
 int renewDHCPLeases() {
     /*
      * Checks the status of setupmode.
-     * If setupMode=0, executes dhcclient for all interfaces
+     * If setupMode=0, (re)starts the dhcp client for all interfaces
      * If setupMode=1, only renews for eth0 and wlan1 (if wlan1 is installed)
      * 
      * Checks to see which dhclient is installed on the system
@@ -1077,45 +1134,63 @@ int renewDHCPLeases() {
 
     if (getSetupMode() == 0) { //In normal mode, so renew all interfaces
         printf("renewDHCPLeases(): SetupMode=0, renewing ALL interfaces\n");
-        char commandResponse[FIELD] = {0};
-
-        //Use built in system command, otherwise we're left waiting (no backgrounding with my sysCmd2() function)
-        if (installedDHCPClient == dhclient) {
-            printf("renewDHCPLeases(): Using dhclient\n");
-            system("dhclient -v &"); //Request new lease, in theory, for all interfaces
-            system("dhclient wlan0 -r -v &"); //Release wlan0 (seem to have to be explicit here,
-            system("dhclient wlan0 -v &"); //Request new lease (seem to have to be explicit here,
-            //otherwise wlan0 gets left off the list)
-        } else if (installedDHCPClient == udhcpc) {
-            printf("renewDHCPLeases(): Using udhcpc\n");
-            system("udhcpc -b"); //Request new lease, in theory, for all interfaces
-            //system("udhcpc -b -i wlan0 -R"); //Release wlan0 (seem to have to be explicit here,
-            system("udhcpc -b -i wlan0"); //Request new lease (seem to have to be explicit here,
-            //otherwise wlan0 gets left off the list)  
-        }
+        renewDHCPLease("eth0");
+        //wlan0 asks for its last lease back (INIT-REBOOT) as soon as wpa_supplicant has associated
+        renewDHCPLease("wlan0");
+        if (isWlan1Present() == 1) renewDHCPLease("wlan1");
     } else {
         // In setup mode, so only renew eth0 (and wlan1, if it exists)
         printf("renewDHCPLeases(): SetupMode=1, renewing dhcp for eth0\n");
-        if (installedDHCPClient == dhclient) {
-            printf("renewDHCPLeases(): Using dhclient\n");
-            system("dhclient eth0 -v &"); //Request new lease
-            if (isWlan1Present() == 1) {
-                printf("renewDHCPLeases(): SetupMode=1, renewing dhcp for wlan1\n");
-                system("dhclient wlan1 -v &");
-            }
-        } else if (installedDHCPClient == udhcpc) {
-            printf("renewDHCPLeases(): Using udhcpc\n");
-            system("udhcpc -i eth0"); //Request new lease
-
-            if (isWlan1Present() == 1) {
-                printf("renewDHCPLeases(): SetupMode=1, renewing dhcp for wlan1\n");
-                system("udhcpc -i");
-            }
+        renewDHCPLease("eth0");
+        if (isWlan1Present() == 1) {
+            printf("renewDHCPLeases(): SetupMode=1, renewing dhcp for wlan1\n");
+            renewDHCPLease("wlan1");
         }
     }
     return 1;
 }
 
+static void waitDHCPLeaseRenewed(char interface[], uint64_t deadline, char result[], int resultLength) {
+    //Waits until deadline (getSchedulerTimeMs()) for interface to be bound, and appends how it went to result
+    char line[FIELD] = {0};
+    dhcpClientStatus status;
+    uint64_t now = getSchedulerTimeMs();
+    int timeoutMs = (deadline > now) ? (int) (deadline - now) : 0;
+    if ((waitDHCPClientBound(interface, timeoutMs) == 1) && (getDHCPClientStatus(interface, &status) == 0)) {
+        char address[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &status.lease.address, address, INET_ADDRSTRLEN);
+        snprintf(line, FIELD, "%s: %s (%s, %u mS). ", interface, address, (status.lastMethod != NULL) ? status.lastMethod : "bound", status.lastExchangeMs);
+    } else if ((getDHCPClientStatus(interface, &status) == 0) && (!status.carrier))
+        snprintf(line, FIELD, "%s: no link. ", interface); //Not plugged in/associated (yet), so no lease expected
+    else snprintf(line, FIELD, "%s: <font color=\"red\">no lease after %d s</font>. ", interface, DHCP_RENEW_WAIT_MS / 1000);
+    strncat(result, line, resultLength - strlen(result) - 1);
+}
+
+int waitDHCPLeasesRenewed() {
+    /*
+     * Called after renewDHCPLeases() (by the Renew DHCP button). Waits, for up to DHCP_RENEW_WAIT_MS altogether,
+     * for the interfaces it renewed to get their leases, and records what happened in dhcpRenewResult for
+     * the status section of the page. udhcpc can't be asked, so then it only says it was asked.
+     * Returns 1 if every interface with a link got a lease, 0 if not, -1 if there's no dhcp client to ask
+     */
+    char result[FIELD] = {0};
+    int ret = -1;
+    if (installedDHCPClient == udhcpc) snprintf(result, FIELD, "requested from udhcpc (it doesn't say when it's done)");
+    else if (installedDHCPClient != builtindhcpclient) snprintf(result, FIELD, "<font color=\"red\">no dhcp client</font>");
+    else {
+        uint64_t deadline = getSchedulerTimeMs() + DHCP_RENEW_WAIT_MS; //One deadline, so the waits overlap
+        waitDHCPLeaseRenewed("eth0", deadline, result, FIELD);
+        if (getSetupMode() == 0) waitDHCPLeaseRenewed("wlan0", deadline, result, FIELD);
+        if (isWlan1Present() == 1) waitDHCPLeaseRenewed("wlan1", deadline, result, FIELD);
+        ret = (strstr(result, "no lease") == NULL) ? 1 : 0;
+    }
+    printf("waitDHCPLeasesRenewed(): %s\n", result);
+    pthread_mutex_lock(&dhcpRenewResultMutex);
+    strlcpy(dhcpRenewResult, result, FIELD);
+    pthread_mutex_unlock(&dhcpRenewResultMutex);
+    return ret;
+}
+
 int setSetupMode(int mode) {
     /*
      * if mode=2, sets the global state variable setupMode to '2' and starts hostapd Access Point mode
@@ -1124,6 +1199,7 @@ int setSetupMode(int mode) {
      * 
      * 
      * This is the only function that should modify the global setupMode;
+     * and it's only called on the mode command thread (see applySetupMode()), or before that's started
      * 
      * Returns '1' on a successful change, else -1
      *      
@@ -1134,7 +1210,8 @@ int setSetupMode(int mode) {
             int ret = setAdhocWlanMode(1);
             if (ret>-1) {
                 printf("Setting setupMode to '1'\n");
-                setupMode = 1;
+                setSharedState(&setupMode, 1);
+                updateStatusLEDs(); //Change the LED flash rate straight away
                 //Now start dhcp server thread
                 /*
                 pthread_t _dhcpServerThread;
@@ -1151,7 +1228,8 @@ int setSetupMode(int mode) {
             int ret = setHostAPWlanMode(1);
             if (ret>-1) {
                 printf("Setting setupMode to '2'\n");
-                setupMode = 2;
+                setSharedState(&setupMode, 2);
+                updateStatusLEDs(); //Change the LED flash rate straight away
                 //Now start dhcp server thread
                 /*
                 pthread_t _dhcpServerThread;
@@ -1167,15 +1245,14 @@ int setSetupMode(int mode) {
         } else { //Deactivate setup mode
             printf("setSetupMode():Attempting to stop Wlan AP mode\n");
             stopDHCPServer(); //Stop DHCP server
-            while (getDhcpServerRunningStatus() == 1) {
-                printf("setSetupMode():Waiting for DHCPServer to stop..\n");
-                sleep(1);
-            }
+            if (waitDHCPServerStopped(5000) == -1) //Wakes as soon as it has (it normally already has)
+                printf("setSetupMode(): DHCPServer hasn't stopped\n");
 
             if (getSetupMode() == 2) { //Are we in APHost AP mode?
                 if (setHostAPWlanMode(0)>-1) { //Signal APHost mode to stop
                     printf("setSetupMode(): Successfully stopped APHost AP mode, renewing leases\n");
-                    setupMode = 0;
+                    setSharedState(&setupMode, 0);
+                    updateStatusLEDs(); //Change the LED flash rate straight away
                     renewDHCPLeases();
                     return 1;
                 } else {
@@ -1186,7 +1263,8 @@ int setSetupMode(int mode) {
             if (getSetupMode() == 1) { //Are we in Adhoc AP mode?
                 if (setAdhocWlanMode(0)>-1) {
                     printf("setSetupMode(): Successfully stopped Ad-Hoc AP mode, renewing leases\n");
-                    setupMode = 0;
+                    setSharedState(&setupMode, 0);
+                    updateStatusLEDs(); //Change the LED flash rate straight away
                     renewDHCPLeases();
                     return 1;
                 } else {
@@ -1202,97 +1280,6 @@ int setSetupMode(int mode) {
     }
 }
 
-void setReadWriteFileSystemMode(int mode) {
-    /**
-     * Very crude function that remounts the file system as read-write, or read only, by
-     * running a system command:-
-     * 
-     * It's very crude, because it doesn't currently check to see whether this is an appropriate course of action
-     * (i.e whether the os currently supports this method of switching mode -see below)
-     * 
-     * You should really run isFileSystemWriteable() first, so you know...
-     * 
-     * system("mount -o remount,ro /"); for readonly
-     * 
-     * or
-     * 
-     * system ("mount -o remount,rw /"); for readwrite
-     * 
-     * These commands are only intended to be run if the os has been modded according to this tutorial:-
-     * http://petr.io/en/blog/2015/11/09/read-only-raspberry-pi-with-jessie/ which modifies Raspian to be readonly
-     * (to protect the SD card from corruption) but permits writes, by remounting, where necessary.
-     * 
-     * Write access is necessary by this program for certain actions like editing the 
-     * /etc/wpa/wpa_supplicant.conf file if you add or remove an ssid/key pair for WiFi
-     * 
-     * if mode>1, will invoke read-write mode, if mode==0, will invoke readonly mode
-     * 
-     * system
-     * @param mode
-     */
-    if (mode > 0)
-        system("mount -o remount,rw /"); //Set read-write mode
-    else
-        system("mount -o remount,ro /"); //Set readonly mode
-}
-
-int isFileSystemWriteable() {
-    /**
-     * Simple function that attempts to write a file to the file system (to the home directory)
-     * and /etc. If this is possible, it is safe to assume that os is writeable.
-     * 
-     * Returns '2' if OS fully writeable (i.e the program has sudo rights) , 
-     * returns 1 if can write to home folder, 0 if read-only, or -1 if an error
-     * 
-     * @return 
-     */
-    //Create a file with a random name
-
-    FILE *fp; //Create pointer to a file
-    char fileNameToWrite[100] = {0}; //Array to hold path
-
-    srand(time(NULL)); //Initialise random number generator
-    int r = rand() % 1000; //Get random number between 0 and 1000
-
-    //See if file can be created and opened in/etc
-    snprintf(fileNameToWrite, 100, "/etc/testfile%d", r); //Construct filename from random no
-    printf("isFileSystemWriteable(): Attempting to open test file: %s\n", fileNameToWrite);
-    fp = fopen(fileNameToWrite, "w+"); //Open file for reading and writing. Truncate to zero first
-    if (fp == NULL) {
-        //File can't be opened for writing in /etc. Could be a permissions issue
-        perror("isFileSystemWriteable(): file can't be open/written in /etc). Error creating file");
-
-        //Writing to /etc not possible, now try writing to the home directory. Could be a sudo issue
-        snprintf(fileNameToWrite, 100, "testfile%d", r); //Construct filename from random no (no /etc/ path this time))
-        printf("isFileSystemWriteable(): Second attempt to to open test file: %s\n", fileNameToWrite);
-        fp = fopen(fileNameToWrite, "w+"); //Open file for reading and writing. Truncate to zero first
-        if (fp == NULL) {
-            //Still can't create/open a file, not even in home dir. Assume a readonly file system
-            return 0;
-        }
-        //File successfuly created in home directory
-        //First, close the file
-        fclose(fp);
-        printf("isFileSystemWriteable(): testfile %s created successfully. Now attempting to delete.\n", fileNameToWrite);
-        if (remove(fileNameToWrite) != 0) { //Attempt to remove file
-            printf("isFileSystemWriteable(): Unable to delete %s.\n", fileNameToWrite);
-            return -1; //Can't delete the file we created, return an error condition
-        }
-        return 1; //Weren't able to write to /etc but were able to write to home dir, so fs is writable
-    } else {
-        //File successfully created in /etc.
-        //First, close the file
-        fclose(fp);
-        printf("isFileSystemWriteable(): testfile %s created successfully. Now attempting to delete.\n", fileNameToWrite);
-        if (remove(fileNameToWrite) != 0) { //Attempt to remove file
-            printf("isFileSystemWriteable(): Unable to delete %s.\n", fileNameToWrite);
-            return -1; //Can't delete the file we created, return an error condition
-        }
-        return 2;
-    }
-
-}
-
 int isWlan1Present() {
     /*
      *  This function determines whether wlan1 interface is installed.
@@ -1410,6 +1397,8 @@ void *simpleHTTPServerThread(void *arg) {
 
     char htmlSetNetworkCard[SECTION] = {0};
 
+    char htmlSnapshots[SECTION] = {0};
+
     char *htmlAddSSIDField = "<br><form name=\"AddSSID\"  method=\"post\" action=\"AddSSID\">"
             "<fieldset>"
             "<legend>Connect to network:</legend>"
@@ -1646,7 +1635,7 @@ void *simpleHTTPServerThread(void *arg) {
                         printf("dhclient response: %s\n", output);
              */
             renewDHCPLeases();
-            sleep(2);
+            waitDHCPLeasesRenewed(); //The result's shown under Status on the page we redirect to
             forceRedirect = 1; //Force redirection to clear POST data on next web refresh
         }
 
@@ -1718,36 +1707,34 @@ void *simpleHTTPServerThread(void *arg) {
                     printf("After: SSID: %s, Passphrase: %s\n", ssid, passPhrase);
 
                     //Now modify WPA config file
-                    //First, check whether the file system is writeable (or readonly)
-                    int fileSystemReadWriteStatus = isFileSystemWriteable();
+                    //Open a read-write session. Remounts the fs read-write if it's currently readonly (or shares
+                    //the remount made by a recent session). It goes back to read-only once the session has gone idle
+                    int fileSystemReadWriteStatus = beginReadWriteSession();
                     switch (fileSystemReadWriteStatus) {
-                            //If isFileSystemWriteable() returns a 2, it's easy, we have access to write /etc)
+                            //If beginReadWriteSession() returns a 2, it's easy, we have access to write /etc)
                         case 2://Easy, file system is writable (and prog has rights to modify /etc folder)
+                            takeConfigSnapshot("Before AddSSID"); //Catches any changes made behind our back. No-op if none
                             if (createWPASupplicantConfig(ssid, passPhrase, wpa_supplicantConfigPath) == -1) //Write new config file
                                 printf(KRED"Couldn't modify file: %s\n"KNRM, wpa_supplicantConfigPath);
+                            else {
+                                refreshKnownNetworks(); //Don't wait for the watcher, the page is about to be redrawn
+                                char reason[FIELD] = {0};
+                                snprintf(reason, FIELD, "AddSSID %.64s", ssid);
+                                takeConfigSnapshot(reason);
+                            }
                             break;
 
                         case 1: //File system is writeable but we don't have rights to modify /etc
                             printf(KRED"Insufficient rights to modify %s. Running as sudo?\n"KNRM, wpa_supplicantConfigPath);
                             break;
 
-                        case 0: //File system is readonly. Try to see if we can force it into read-write mode
-                            printf("File system is readonly. Attempting to put fs into read-write mode with: mount -o remount,rw /\n");
-                            system("mount -o remount,rw /");
-                            //Now check once again to see if we can write to /etc
-                            if (isFileSystemWriteable() == 2) {
-                                //Yes, we can, now modify wpa_supplicant conf file
-                                if (createWPASupplicantConfig(ssid, passPhrase, wpa_supplicantConfigPath) == -1)
-                                    printf("Couldn't modify file: %s\n", wpa_supplicantConfigPath);
-                            } else {
-                                printf(KRED"Still can't write to %s.\n"KNRM, wpa_supplicantConfigPath);
-                            }
-                            printf("Reverting fs to read-only mode with: mount -o remount,ro /\n");
-                            system("mount -o remount,ro /");
+                        case 0: //File system is still readonly, couldn't remount it
+                            printf(KRED"Still can't write to %s.\n"KNRM, wpa_supplicantConfigPath);
                             break;
 
                         default: break;
                     }
+                    endReadWriteSession();
                     forceRedirect = 1; //Force redirection to clear POST data on next web refresh
                 }
             }
@@ -1766,34 +1753,36 @@ void *simpleHTTPServerThread(void *arg) {
                 //Now remove SSID (and associated network block) from WPA config file
 
                 //////
-                int fileSystemReadWriteStatus = isFileSystemWriteable();
-                switch (fileSystemReadWriteStatus) {
-                        //If isFileSystemWriteable() returns a 2, it's easy, we have access to write /etc)
-                    case 2://Easy, file system is writable (and prog has rights to modify /etc folder)
-                        if (deleteESSIDfromConfigFileByName(wpa_supplicantConfigPath, ssid) == -1)
-                            printf(KGRN"Couldn't modify file: %s\n"KNRM, wpa_supplicantConfigPath);
-                        break;
-
-                    case 1: //File system is writeable but we don't have rights to modify /etc
-                        printf(KRED"Insufficient rights to modify %s. Running as sudo?\n"KNRM, wpa_supplicantConfigPath);
-                        break;
-
-                    case 0: //File system is readonly. Try to see if we can force it into read-write mode
-                        printf("File system is readonly. Attempting to put fs into read-write mode with: mount -o remount,rw /\n");
-                        system("mount -o remount,rw /");
-                        //Now check once again to see if we can write to /etc
-                        if (isFileSystemWriteable() == 2) {
-                            //Yes, we can, now modify wpa_supplicant conf file
+                refreshKnownNetworks(); //The watcher may not have caught up with an edit in the last KNOWN_NETWORKS_SETTLE_MS
+                if (findKnownNetwork(ssid) == -1) { //Not in the file, so no need to remount and rewrite it
+                    printf("removeSSID: %s not a known network\n", ssid);
+                } else {
+                    int fileSystemReadWriteStatus = beginReadWriteSession(); //Remounts read-write if necessary
+                    switch (fileSystemReadWriteStatus) {
+                            //If beginReadWriteSession() returns a 2, it's easy, we have access to write /etc)
+                        case 2://Easy, file system is writable (and prog has rights to modify /etc folder)
+                            takeConfigSnapshot("Before removeSSID"); //Replaces the old wpa_supplicant.conf.backup
                             if (deleteESSIDfromConfigFileByName(wpa_supplicantConfigPath, ssid) == -1)
                                 printf(KGRN"Couldn't modify file: %s\n"KNRM, wpa_supplicantConfigPath);
-                        } else {
+                            else {
+                                refreshKnownNetworks();
+                                char reason[FIELD] = {0};
+                                snprintf(reason, FIELD, "removeSSID %.64s", ssid);
+                                takeConfigSnapshot(reason);
+                            }
+                            break;
+
+                        case 1: //File system is writeable but we don't have rights to modify /etc
+                            printf(KRED"Insufficient rights to modify %s. Running as sudo?\n"KNRM, wpa_supplicantConfigPath);
+                            break;
+
+                        case 0: //File system is still readonly, couldn't remount it
                             printf(KRED"Still can't write to %s.\n"KNRM, wpa_supplicantConfigPath);
-                        }
-                        printf("Reverting fs to read-only mode with: mount -o remount,ro /\n");
-                        system("mount -o remount,ro /");
-                        break;
+                            break;
 
-                    default: break;
+                        default: break;
+                    }
+                    endReadWriteSession(); //Back to read-only once idle
                 }
                 //////
                 forceRedirect = 1; //Force redirection to clear POST data on next web refresh
@@ -1802,6 +1791,23 @@ void *simpleHTTPServerThread(void *arg) {
         }
         //////////New code ends
 
+        ////////////Roll back to an earlier config snapshot
+        if (strstr(buffer, "POST /rollbackConfig") != NULL) {
+            printf("\x1B[31mPOST /rollbackConfig\x1B[0m\n");
+            char generationString[FIELD] = {0};
+            if (extractString(buffer, "POST /rollbackConfig", "rollbackGeneration=", "\0", generationString, FIELD) > 0) {
+                int generation = strtol(generationString, NULL, 10);
+                if (beginReadWriteSession() == 2) {
+                    if (rollbackConfigSnapshot(generation) == 0) {
+                        refreshKnownNetworks();
+                        restartWPASupplicant(); //So that wpa_supplicant picks up the restored file
+                    }
+                } else
+                    printf(KRED"Can't write to %s. Not rolling back\n"KNRM, wpa_supplicantConfigPath);
+                endReadWriteSession();
+            }
+            forceRedirect = 1; //Force redirection to clear POST data on next web refresh
+        }
 
         ////////////Manually Set ip address
         if (strstr(buffer, "POST /setInterface") != NULL) {
@@ -1874,6 +1880,7 @@ void *simpleHTTPServerThread(void *arg) {
         updateTime(timeAsString, FIELD); //Update timestamp
         updateStatus(htmlStatus, SECTION);
         updateKnownNetworks(htmlKnownNetworks, SECTION);
+        updateConfigSnapshots(htmlSnapshots, SECTION);
 
         /* Write a response to the client */
         if (forceRedirect == 1) {
@@ -1983,6 +1990,11 @@ void *simpleHTTPServerThread(void *arg) {
             if (n < 0) {
                 perror("ERROR writing to socket:09");
             }
+            n = write(newsockfd, htmlSnapshots, strlen(htmlSnapshots));
+            charsWritten += n;
+            if (n < 0) {
+                perror("ERROR writing to socket:09a");
+            }
             n = write(newsockfd, htmlFooter, strlen(htmlFooter));
             charsWritten += n;
             printf("%d chars written\n", charsWritten);
@@ -2002,18 +2014,19 @@ void *simpleHTTPServerThread(void *arg) {
         }
 
         //Now act on 'schedule flags' set by earlier web button presses
+        //Queued, not run here, so the server isn't held up for the length of the mode change (see modeCommandQueue.c)
         if (scheduleEnterSetupMode > 0) {
             int temp = scheduleEnterSetupMode; //Take a local copy
             scheduleEnterSetupMode = 0; //Clear global flag
-            //Pass value of scheduleEnterSetupMode (1 for Adhoc, 2, for hostAP to setSetupMode)
-            if (setSetupMode(temp) < 1) { //Invoke setup mode
+            //Pass value of scheduleEnterSetupMode (1 for Adhoc, 2, for hostAP)
+            if (postModeCommand(temp) < 0) { //Invoke setup mode
                 printf("Couldn't start setupMode\n");
             }
         }
 
         if (scheduleExitSetupMode == 1) {
             scheduleExitSetupMode = 0; //Clear flag
-            if (setSetupMode(0) < 1) { //Invoke normal (i.e non-setup mode)
+            if (postModeCommand(MODE_NORMAL) < 0) { //Invoke normal (i.e non-setup mode)
 
                 printf("Couldn't exit setupMode\n");
             }
@@ -2036,7 +2049,10 @@ int stopHttpConfigServer() {
      */
 
 
-    setSetupMode(0); //Stops Access Point mode (if enabled) and the dhcp server (if enabled)
+    //Stops Access Point mode (if enabled) and the dhcp server (if enabled). Waits for any change in progress first
+    if (isModeCommandQueueRunning()) runModeCommand(MODE_NORMAL, -1);
+    else setSetupMode(0);
+    flushReadWriteSession(); //Don't leave the fs read-write just because the linger time hasn't passed
     if (close(sockfd) == -1) { //Close http listening socket
         perror("httpConfigServer:stopHttpConfigServer(): close()");
         printf("Couldn't close http listening socket file descriptor sockfd: %d\n", sockfd);
@@ -2047,8 +2063,8 @@ int stopHttpConfigServer() {
         printf("Couldn't close http listening socket file descriptor newsockfd: %d\n", sockfd);
     }
      */
-    gpioWrite(23, LOW); //Set GPO23 low
-    gpioSetMode(23, PI_INPUT); //GPIO 23 as input (so it can't be shorted out)
+    writeGPIO(23, LOW); //Set GPO23 low
+    setGPIOMode(23, PI_INPUT); //GPIO 23 as input (so it can't be shorted out)
     //gpioWrite(24, LOW); //Set GPO24 low
     //gpioSetMode(24, PI_INPUT); //GPIO 24 as input (so it can't be shorted out)
     exit(1);
@@ -2063,7 +2079,7 @@ int startHttpConfigServer(unsigned int _port, char _wpa_supplicantConfigPath[],
      * _port -The http listening port
      * _wpa_supplicantConfigPath[] - Path/filename to wpa_supplicant file (moves around depending upon os type)
      * _hostapdPath[]       - Path to hostapd binary (used to for hostap (wpa) access point mode
-     * useAlternativeDHCPClient: If 0, dhcpclient set to dhclient, otherwise udhcpc
+     * useAlternativeDHCPClient: If 0, the built-in dhcp client is used (see dhcpClient.c), otherwise udhcpc
      * 
      *  Returns -1 on failure
      */
@@ -2076,80 +2092,68 @@ int startHttpConfigServer(unsigned int _port, char _wpa_supplicantConfigPath[],
 
     if (useAlternativeDHCPClient == 1) //Determine which dhcp client to use
         installedDHCPClient = udhcpc;
-    else installedDHCPClient = dhclient;
-
-    if (gpioInitialise() < 0) { //Set up memory mapped access or exit if fail
+    else installedDHCPClient = builtindhcpclient;
+
+    //Watch the mount table so that isFileSystemWriteable() can cache its answer
+    if (startMountWatcher(wpa_supplicantConfigPath) < 0)
+        printf("startHttpConfigServer(): Can't start mount watcher. isFileSystemWriteable() won't be cached\n");
+    //Keep versions of the config files we modify. Nothing's written until the first change
+    if (initConfigSnapshots(wpa_supplicantConfigPath, HOSTAPD_CONFIG_FILENAME) < 0)
+        printf("startHttpConfigServer(): Config snapshots disabled\n");
+    //Parse wpa_supplicant.conf once, then only again when it changes
+    if (startKnownNetworksWatcher(wpa_supplicantConfigPath) < 0)
+        printf("startHttpConfigServer(): Can't watch %s. Known networks will be checked on every lookup\n", wpa_supplicantConfigPath);
+
+    if (initialiseGPIO() < 0) { //gpiochip, memory mapped or simulated access (see gpioBackend.c), or exit if fail
         printf("startHttpConfigServer(): Can't initialise gpio pins.\n");
         return -1;
     }
 
-    //Create 'square-wave' signal threads
-
-    pthread_t _twoSecSqThread;
-    if (pthread_create(&_twoSecSqThread, NULL, twoSecSqThread, NULL)) {
-        printf("Error creating twoSecSq thread.\n");
-        return -1;
-    }
-    pthread_detach(_twoSecSqThread); //Don't care what happens to thread afterwards
-
-
-
-    pthread_t _oneSecSqThread;
-    if (pthread_create(&_oneSecSqThread, NULL, oneSecSqThread, NULL)) {
-        printf("Error creating oneSecSq thread.\n");
-        return -1;
-    }
-    pthread_detach(_oneSecSqThread); //Don't care what happens to thread afterwards
-
-    pthread_t _halfSecSqThread;
-    if (pthread_create(&_halfSecSqThread, NULL, halfSecSqThread, NULL)) {
-        printf("Error creating halfSecSq thread.\n");
+    //Periodic jobs (status LED, WiFi polling) all run from the one scheduler thread
+    if (startTaskScheduler() < 0) {
+        printf("startHttpConfigServer(): Can't start task scheduler.\n");
         return -1;
     }
-    pthread_detach(_halfSecSqThread); //Don't care what happens to thread afterwards
 
-    pthread_t _quartSecSqThread;
-    if (pthread_create(&_quartSecSqThread, NULL, quartSecSqThread, NULL)) {
-        printf("Error creating halfSecSq thread.\n");
+    //Every change of setup mode (button, SIGUSR1, web page) is queued to the one thread
+    if (startModeCommandQueue(applySetupMode, getSetupMode) < 0) {
+        printf("startHttpConfigServer(): Can't start mode command queue.\n");
         return -1;
     }
-    pthread_detach(_quartSecSqThread); //Don't care what happens to thread afterwards
 
-    //Create button-monitoring thread, but only if supplied pin value !=-1 
+    //Start watching the setup button, but only if supplied pin value !=-1
     if (setupModeGPIPin != -1) {
-        //Create pointer from supplied statusGPIPin parameter to pass to monitorButtonThread
-        int *setupModeGPIPinPtr = malloc(sizeof (*setupModeGPIPinPtr));
-        *setupModeGPIPinPtr = setupModeGPIPin;
-        pthread_t _monitorButtonThread;
-        if (pthread_create(&_monitorButtonThread, NULL, monitorButtonThread, (void*) setupModeGPIPinPtr)) {
-            printf("Error creating monitorButtonThread thread.\n");
+        printf("startHttpConfigServer(): setup button pin no.: %d\n", setupModeGPIPin);
+        if (startButtonMonitor(setupModeGPIPin, setupButtonGesture) < 0) {
+            printf("Error starting setup button monitor.\n");
             return -1;
         }
-        pthread_detach(_monitorButtonThread); //Don't care what happens to thread afterwards
     }
 
 
-    //Create status LED thread, , but only if supplied pin value !=-1 
+    //Add the LEDs, but only those with a pin (status LED pin value !=-1). They're driven together (see ledPatterns.c)
     if (ledGPOPin != -1) {
-        //Create pointer from supplied ledGPOPin parameter to pass to statusLEDThread
-        //printf("pthread_create()Status_LED: ledGPOPin: %d\n", ledGPOPin);
-        int *ledGPOPinPtr = malloc(sizeof (*ledGPOPinPtr));
-        *ledGPOPinPtr = ledGPOPin;
-        pthread_t _statusLEDThread;
-        if (pthread_create(&_statusLEDThread, NULL, statusLEDThread, (void*) ledGPOPinPtr)) {
-            printf("Error creating statusLEDThread thread.\n");
+        printf("startHttpConfigServer(): status LED pin no.: %d\n", ledGPOPin);
+        statusLED = addLED("status", ledGPOPin);
+        if (statusLED < 0) {
+            printf("Error adding status LED.\n");
             return -1;
         }
-        pthread_detach(_statusLEDThread); //Don't care what happens to thread afterwards
     }
+    if (linkLEDPin != -1) linkLED = addLED("link", linkLEDPin);
+    if (modeLEDPin != -1) modeLED = addLED("mode", modeLEDPin);
+    if (errorLEDPin != -1) errorLED = addLED("error", errorLEDPin);
+    if (dhcpLEDPin != -1) {
+        dhcpLED = addLED("dhcp", dhcpLEDPin);
+        setDHCPActivityCallback(dhcpActivity);
+    }
+    updateStatusLEDs();
 
-    //*wiFiConnectedThread
-    pthread_t _wiFiConnectedThread;
-    if (pthread_create(&_wiFiConnectedThread, NULL, wiFiConnectedThread, NULL)) {
-        printf("Error creating wiFiConnectedThread thread.\n");
+    //WiFi connection polling task
+    if (addScheduledTask("wiFiConnected", wiFiConnectedTask, NULL, 0) < 0) {
+        printf("Error adding wiFiConnected task.\n");
         return -1;
     }
-    pthread_detach(_wiFiConnectedThread); //Don't care what happens to thread afterwards
     //exit(1);
     //Create webserver thread
     int *portNo = malloc(sizeof (*portNo)); //Create space for an integer pointer
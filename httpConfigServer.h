@@ -0,0 +1,34 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   httpConfigServer.h
+ *
+ * Web config server, setup mode and status LEDs (see httpConfigServer.c)
+ */
+
+#ifndef HTTPCONFIGSERVER_H
+#define HTTPCONFIGSERVER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "httpConfigServer.h" TO THE SOURCE FILE
+
+int setStatusLEDPins(char spec[]);
+
+//AND BEFORE HERE
+#endif /* HTTPCONFIGSERVER_H */
+
@@ -38,7 +38,9 @@
 #include <fcntl.h>
 #include <arpa/inet.h>
 #include <ifaddrs.h>
+#include <net/route.h>
 #include "iptools2.3.h"
+#include "routeTable.h"
 
 size_t nullTermStrlCpy(char* dst, const char* src, size_t bufsize) {
     /*
@@ -419,33 +421,136 @@ int receiveUDP(char *rxBuffer, int rxBufferSize, int udpPort, char *srcIP, int s
 int initWiFiNetworkStruct(wifiNetwork *_wifiNetwork) {
     if (_wifiNetwork == NULL) return -1;
     memset(_wifiNetwork, 0, sizeof (wifiNetwork)); //Initialise struct memory to zero
-    nullTermStrlCpy(_wifiNetwork->desc, " ",ARG_LENGTH);
-    nullTermStrlCpy(_wifiNetwork->essid, " ",ARG_LENGTH);
-    nullTermStrlCpy(_wifiNetwork->key, " ",ARG_LENGTH);
-    nullTermStrlCpy(_wifiNetwork->passPhrase, " ",ARG_LENGTH);
-    nullTermStrlCpy(_wifiNetwork->encryption, " ",ARG_LENGTH);
-    _wifiNetwork->priority = 0;
-    _wifiNetwork->sigLevel = 0;
-    _wifiNetwork->sigQuality = 0;
+    _wifiNetwork->secret = -1; //No passphrase
     return 1;
 }
 
 int initNicStruct(nic *_nic) {
     if (_nic == NULL) return -1;
     //Initialises a nic (network interface) struct
-    //Clears memory ready for use.
-    memset(_nic, 1, sizeof (nic)); //Initialise struct memory to zero
-    nullTermStrlCpy(_nic->name, " ",ARG_LENGTH);
-    nullTermStrlCpy(_nic->address, "0.0.0.0",ARG_LENGTH);
-    nullTermStrlCpy(_nic->netmask, "0.0.0.0",ARG_LENGTH);
-    nullTermStrlCpy(_nic->broadcastAddress, "0.0.0.0",ARG_LENGTH);
-    nullTermStrlCpy(_nic->gateway, "0.0.0.0",ARG_LENGTH);
-    _nic->priority = 0;
-    _nic->status = 0;
-    _nic->configured = 0;
+    //Clears memory ready for use. All addresses become 0.0.0.0 / ::
+    memset(_nic, 0, sizeof (nic)); //Initialise struct memory to zero
     return 1;
 }
 
+int setSSID(ssid80211 *ssid, char text[]) {
+    /*
+     * Copies a C string into an ssid80211. Returns the no. of octets stored, or -1
+     * if the text is longer than the 32 octets 802.11 allows (nothing is stored)
+     */
+    size_t length = strlen(text);
+    if (length > SSID_MAX_LENGTH) {
+        printf("setSSID(): '%s' is longer than %d octets\n", text, SSID_MAX_LENGTH);
+        return -1;
+    }
+    memset(ssid, 0, sizeof (ssid80211));
+    memcpy(ssid->octets, text, length);
+    ssid->length = (uint8_t) length;
+    return (int) length;
+}
+
+char *ssidToString(ssid80211 *ssid, char output[], unsigned int outputLength) {
+    /*
+     * Copies an ssid80211 into a null terminated char array (truncating if
+     * output is too short). Returns output so it can be used inline with printf()
+     */
+    if (outputLength == 0) return output;
+    unsigned int length = ssid->length;
+    if (length > outputLength - 1) length = outputLength - 1;
+    memcpy(output, ssid->octets, length);
+    output[length] = 0;
+    return output;
+}
+
+int ssidMatches(ssid80211 *ssid, char text[]) {
+    //Returns 1 if the SSID is exactly the same as the supplied C string
+    size_t length = strlen(text);
+    return (length == ssid->length) && !memcmp(ssid->octets, text, length);
+}
+
+void initWiFiNetworkList(wifiNetworkList *list) {
+    memset(list, 0, sizeof (wifiNetworkList));
+}
+
+void freeWiFiNetworkList(wifiNetworkList *list) {
+    //Passphrases are wiped before the memory is handed back
+    if (list->secrets != NULL) {
+        memset(list->secrets, 0, list->secretsCapacity);
+        free(list->secrets);
+    }
+    free(list->networks);
+    initWiFiNetworkList(list);
+}
+
+int appendWiFiNetwork(wifiNetworkList *list) {
+    /*
+     * Adds an initialised record to the end of the list, growing it if needed.
+     * Returns the index of the new record, or -1 if memory couldn't be allocated
+     * 
+     * Sample usage:-
+     *      wifiNetworkList list;
+     *      initWiFiNetworkList(&list);
+     *      int n = appendWiFiNetwork(&list);
+     *      if (n > -1) setSSID(&list.networks[n].essid, "MyNetwork");
+     *      ...
+     *      freeWiFiNetworkList(&list);
+     */
+    if (list->count == list->capacity) {
+        int newCapacity = (list->capacity == 0) ? 16 : list->capacity * 2;
+        wifiNetwork *grown = realloc(list->networks, newCapacity * sizeof (wifiNetwork));
+        if (grown == NULL) {
+            printf("appendWiFiNetwork(): realloc()\n");
+            return -1;
+        }
+        list->networks = grown;
+        list->capacity = newCapacity;
+    }
+    initWiFiNetworkStruct(&list->networks[list->count]);
+    return list->count++;
+}
+
+int setWiFiNetworkSecret(wifiNetworkList *list, int index, char secret[], unsigned int length) {
+    /*
+     * Stores 'length' chars of secret as the passphrase of list->networks[index].
+     * The store only grows; a replaced passphrase is wiped in place.
+     * Returns 0 on success, -1 on error
+     */
+    if ((index < 0) || (index >= list->count)) return -1;
+    wifiNetwork *network = &list->networks[index];
+    if (network->secret > -1) { //Wipe the old one
+        char *old = list->secrets + network->secret;
+        memset(old, 0, strlen(old));
+    }
+    if (list->secretsUsed + length + 1 > list->secretsCapacity) {
+        size_t newCapacity = (list->secretsCapacity == 0) ? 1024 : list->secretsCapacity;
+        while (newCapacity < list->secretsUsed + length + 1) newCapacity *= 2;
+        //Not realloc(), which could leave a copy of the old secrets behind
+        char *grown = malloc(newCapacity);
+        if (grown == NULL) {
+            printf("setWiFiNetworkSecret(): malloc()\n");
+            return -1;
+        }
+        if (list->secrets != NULL) {
+            memcpy(grown, list->secrets, list->secretsUsed);
+            memset(list->secrets, 0, list->secretsCapacity);
+            free(list->secrets);
+        }
+        list->secrets = grown;
+        list->secretsCapacity = newCapacity;
+    }
+    memcpy(list->secrets + list->secretsUsed, secret, length);
+    list->secrets[list->secretsUsed + length] = 0;
+    network->secret = (int) list->secretsUsed;
+    list->secretsUsed += length + 1;
+    return 0;
+}
+
+char *getWiFiNetworkSecret(wifiNetworkList *list, int index) {
+    //Returns the passphrase of list->networks[index], or "" for an open network
+    if ((index < 0) || (index >= list->count) || (list->networks[index].secret < 0)) return "";
+    return list->secrets + list->networks[index].secret;
+}
+
 int sysCmd2(char cmdString[], char output[], int outputLength) {
     /*
      * Executes a system command supplied in cmdString places the output
@@ -592,7 +697,7 @@ int getWiFiConnStatus(wifiNetwork *_wifiNetwork, char interface[]) {
         if (length < ARG_LENGTH) //Don't run off the end of the array
             strncpy(line, startPos, length); //Copy value to line
         //printf("getWiFiConnStatus():ESSID: %s\n",line);
-        nullTermStrlCpy(_wifiNetwork->essid, line,ARG_LENGTH); //Copy value to struct
+        setSSID(&_wifiNetwork->essid, line); //Copy value to struct
         free(line); //deallocate memory
     } else {
         printf("getWiFiConnStatus(): malloc()-'ESSID'\n");
@@ -668,22 +773,20 @@ int getWiFiConnStatus(wifiNetwork *_wifiNetwork, char interface[]) {
 
 }
 
-int iwscanWrapper(wifiNetwork _wifiNetwork[], int sizeOfwiFiStruct, char interface[]) {
+int iwscanWrapper(wifiNetworkList *list, char interface[]) {
     /*
      * Executes the system iwlist command on the supplied interface (eg "wlan0")
-     * Returns the no. of wireless networks founds and populates 
-     * the supplied wifiNetwork strct with the SSIDs of those 
-     * networks
+     * Returns the no. of wireless networks founds (or -1 on error) and appends
+     * those networks to the supplied list
      * 
      * Sample usage:-
      *      int k;
-     *      wifiNetwork networkList[50];
-     *      for (k = 0; k < 50; k++)
-     *          initWiFiNetworkStruct(&networkList[k]);
-     *          int noOfNetworksFound = iwscanWrapper(networkList, 50, "wlan0");
-     *      if (k > 0)
-     *          for (k = 0; k < noOfNetworksFound; k++)    
-     *              printf("%d: %s\n", k, networkList[k].essid);
+     *      wifiNetworkList networkList;
+     *      initWiFiNetworkList(&networkList);
+     *      int noOfNetworksFound = iwscanWrapper(&networkList, "wlan0");
+     *      for (k = 0; k < noOfNetworksFound; k++)    
+     *          printf("%d: %.*s\n", k, networkList.networks[k].essid.length, networkList.networks[k].essid.octets);
+     *      freeWiFiNetworkList(&networkList);
      */
     char cmdString[100] = {0};
     snprintf(cmdString, 100,"sudo iwlist %s scan", interface); //Construct command string
@@ -696,7 +799,9 @@ int iwscanWrapper(wifiNetwork _wifiNetwork[], int sizeOfwiFiStruct, char interfa
 
 
     //Now try parsing the output string
-    int n = 0; //Used to index through the _wifiNetworks parameter array
+    int n = 0; //No. of networks found
+    int first = list->count; //Networks are appended after anything already in the list
+    wifiNetwork *network; //Record being filled in. Re-fetched after each append as the list may move
     char *line, *startPos, *endPos, *ptr, *startOfCell;
 
     unsigned int length;
@@ -705,6 +810,9 @@ int iwscanWrapper(wifiNetwork _wifiNetwork[], int sizeOfwiFiStruct, char interfa
     if (startOfCell != NULL) {
 
         do {
+            int index = appendWiFiNetwork(list);
+            if (index == -1) return -1;
+            network = &list->networks[index];
             startPos = startOfCell; //Want to start from each 'cell' instance each time
             //Because depending upon which version of wifitools
             //is installed determines the order in which
@@ -729,7 +837,7 @@ int iwscanWrapper(wifiNetwork _wifiNetwork[], int sizeOfwiFiStruct, char interfa
                     strncpy(line, startPos, length); //Copy value to line
                 int intValue = (int) strtol(line, &ptr, 10); //Copy numeric string to an int
                 //printf("Quality: %d,%s,%d\n", n, line, intValue);
-                _wifiNetwork[n].sigQuality = (int) strtol(line, &ptr, 10); //Copy numeric string to an int
+                network->sigQuality = (int16_t) strtol(line, &ptr, 10); //Copy numeric string to an int
                 free(line); //deallocate memory
             } else {
                 printf("iwscanWrapper(): malloc()-'Quality'\n");
@@ -757,7 +865,7 @@ int iwscanWrapper(wifiNetwork _wifiNetwork[], int sizeOfwiFiStruct, char interfa
                     strncpy(line, startPos, length); //Copy value to line
                 //int intValue = (int) strtol(line, &ptr, 10); //Copy numeric string to an int
                 //printf("Strength: %d,%s,%d\n", n, line, intValue);
-                _wifiNetwork[n].sigLevel = (int) strtol(line, &ptr, 10); //Copy numeric string to an int
+                network->sigLevel = (int16_t) strtol(line, &ptr, 10); //Copy numeric string to an int
                 free(line); //deallocate memory
             } else {
                 printf("iwscanWrapper(): malloc()-'Strength'\n");
@@ -780,7 +888,7 @@ int iwscanWrapper(wifiNetwork _wifiNetwork[], int sizeOfwiFiStruct, char interfa
                 if (length < ARG_LENGTH) //Don't run off the end of the array
                     strncpy(line, startPos, length); //Copy value to line
                 //printf("Encryption: %d,%s\n", n, line);
-                nullTermStrlCpy(_wifiNetwork[n].encryption, line,ARG_LENGTH); //Copy retrieved value to supplied struct
+                network->encrypted = (strstr(line, "on") != NULL); //'on' or 'off'
                 free(line); //deallocate memory
             } else {
                 printf("iwscanWrapper(): malloc()-'Encryption'\n");
@@ -809,7 +917,7 @@ int iwscanWrapper(wifiNetwork _wifiNetwork[], int sizeOfwiFiStruct, char interfa
                 if (length < ARG_LENGTH) //Don't run off the end of the array
                     strncpy(line, startPos, (length - 1)); //Copy value to line (but strip off trailing ' " '  
                 //printf("ESSID: %d,%s\n", n, line);
-                nullTermStrlCpy(_wifiNetwork[n].essid, line,ARG_LENGTH); //Copy retrieved value to supplied struct
+                if (setSSID(&network->essid, line) == -1) network->essid.length = 0; //Not valid 802.11. Show it as hidden
                 free(line); //deallocate memory
             } else {
                 printf("iwscanWrapper(): malloc()-'ESSID'\n");
@@ -820,7 +928,8 @@ int iwscanWrapper(wifiNetwork _wifiNetwork[], int sizeOfwiFiStruct, char interfa
             //All done
             startOfCell = strstr((startOfCell + 1), "Cell"); //Get next start point, ready for next time round the loop
             n++; //Increment counter
-        } while ((startOfCell != NULL) && (n < sizeOfwiFiStruct));
+        } while (startOfCell != NULL);
+        if (list->count > first + n) list->count--; //Drop the record for a cell that couldn't be parsed
     } else return 0;
     //return noOfNetworksFound;
     return n; // return noOfNetworksFound
@@ -855,25 +964,25 @@ int ifConfigSetNic(nic *_nic) {
      * Wrapper for system command 'ifconfig eth0 172.16.25.125 netmask 255.255.255.224 2>&1'
      */
 
-    //First, parse the supplied addresses to check that they're sane
-    //Now actually parse supplied address to make sure it makes sense
-    struct sockaddr_in IPAddr;
-    IPAddr.sin_family = AF_INET;
-    if (inet_aton(_nic->address, &IPAddr.sin_addr.s_addr) == 0) { //Extract ip address
-        printf("ifConfigSetNic(): Invalid IP address supplied.\n");
+    //The addresses are already binary so can't be malformed, but make sure there's something to set
+    if (_nic->address.s_addr == 0) {
+        printf("ifConfigSetNic(): No IP address supplied.\n");
         return -1;
     }
-    if (inet_aton(_nic->address, &IPAddr.sin_addr.s_addr) == 0) { //Extract ip address
-        printf("ifConfigSetNic(): Invalid subnet mask supplied.\n");
+    if (_nic->netmask.s_addr == 0) {
+        printf("ifConfigSetNic(): No subnet mask supplied.\n");
         return -1;
     }
-    if (strlen(_nic->name) > 20) {
-        printf("ifConfigSetNic(): Suspiciously named interface. >20 chars in length.\n");
+    if (strnlen(_nic->name, NIC_NAME_LENGTH) == NIC_NAME_LENGTH) {
+        printf("ifConfigSetNic(): Suspiciously named interface. Not null terminated.\n");
         return -1;
     }
 
+    char address[INET_ADDRSTRLEN], netmask[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &_nic->address, address, INET_ADDRSTRLEN);
+    inet_ntop(AF_INET, &_nic->netmask, netmask, INET_ADDRSTRLEN);
     char cmdString[1024] = {0};
-    snprintf(cmdString, 1024,"ifconfig %s %s netmask %s 2>&1", _nic->name, _nic->address, _nic->netmask); //Construct command string
+    snprintf(cmdString, 1024,"ifconfig %s %s netmask %s 2>&1", _nic->name, address, netmask); //Construct command string
     printf("cmdString: %s\n", cmdString);
     int cmdResponseSize; //Holds the length of the response from sysCmd
     char cmdResponse[10000] = " "; //Large buffer for returned data (just in case))
@@ -914,76 +1023,32 @@ int addGateway(char gatewayAddress[]) {
 
 int getGateway(char gatewayAddress[], int arraySize) {
     /*
-     * Wrapper for the system command 'route -n'
-     * 
-     * Returns the current default gateway (the first listed) as an an array of chars by populating the supplied array.
-     * 
-     * Executes the system 'route -n' command and searches the first line starting with '0.0.0.0'
-     * (which implies the gateway). It then retrieves the subsequent gateway ip address
-     * 
-     * Sample output of 'route -n' looks like this:-
+     * Returns the current default gateway as an array of chars by populating the supplied array.
      * 
-     * Kernel IP routing table
-     * Destination     Gateway         Genmask         Flags Metric Ref    Use Iface
-     * 0.0.0.0         192.168.3.1     0.0.0.0         UG    0      0        0 wlan0      ***Only this first line will be parsed***
-     * 0.0.0.0         192.168.3.1     0.0.0.0         UG    0      0        0 eth0
-     * 127.0.0.1       0.0.0.0         255.255.255.255 UH    0      0        0 lo
-     * 192.168.3.0     0.0.0.0         255.255.255.0   U     0      0        0 eth0
-     * 192.168.3.0     0.0.0.0         255.255.255.0   U     0      0        0 wlan0
+     * This used to run 'route -n' and parse the first line starting '0.0.0.0', which was simply whichever
+     * default route the kernel happened to list first. The routing table is now read with one rtnetlink dump
+     * (see routeTable.c) and this is the gateway of the default route actually in use, i.e the one with the
+     * lowest metric. With the usual dhcpcd metrics (eth0 202, wlan0 303...) that's eth0 if it's up.
      * 
-     * strstr() is used for the main searching within the output string. However, we don't know how long
-     * the gateway address will be (i.e the no of actual digits) and what those numbers will be. Since C 
-     * doesn't have a wildcard search, the easiest way is to scrobble along the (unknown length) whitespace
-     * before the gateway address, and then search a delimiting whitespace character after the address.
-     * 
-     * strstr() returns a memory location. However, we need an array location hence the line:- 
-     * 
-     * unsigned int arrayPosition=startPos-cmdResponse; 
-     * 
-     * Once we've found the start of the actual address we convert the array position back to a pointer with 
-     * startPos=&cmdResponse[arrayPosition]; so that we can once again use strstr()
+     * Returns 1 on success, -1 if there's no default route (or it has no gateway) or the array's too small
      */
-
-    char cmdString[100] = {0};
-    snprintf(cmdString, 100,"route -n"); //Construct command string
-    int cmdResponseSize; //Holds the length of the response from sysCmd
-    char cmdResponse[10000] = " "; //Large buffer for returned data (just in case))
-    //printf("getGateway():cmdString: %s\n", cmdString);
-    cmdResponseSize = sysCmd2(cmdString, cmdResponse, 10000); //Execute the command
-    //printf("getGateway(): %d:%s\n", cmdResponseSize, cmdResponse);
-    //Now try parsing the output string
-    char *line, *startPos, *endPos, *endOfLineOfInterest;
-    unsigned int length;
-
-    startPos = strstr(cmdResponse, "\n0.0.0.0"); //Get initial start point - search for \n0.0.0.0 is EXACTLY what we need
-    if (startPos == NULL) return -1; //If not found, can't trust the output of this command
-
-    startPos = strstr(startPos, " "); //Get initial whitespace delimiter
-    if (startPos == NULL) return -1; //If not found, can't trust the output of this command
-
-    //Only interested in the top line, otherwise get false positives,
-
-    unsigned int arrayPosition = startPos - cmdResponse; //Convert strstr() mem pointer to an aray position)
-
-    while ((cmdResponse[arrayPosition] == ' ')&&(arrayPosition < 10000)) { //Scroll through white-space
-        //printf("Value at %u:%c\n", arrayPosition, cmdResponse[arrayPosition]);
-        arrayPosition++;
-    }
-
-    startPos = &cmdResponse[arrayPosition]; //convert array position back to mem position
-    endPos = strstr(startPos, " "); //gateway delimited by a proceeding space
-    if (endPos == NULL) return -1;
-    length = endPos - startPos;
-    if (length > (arraySize - 1)) {
-        printf("getGateway(): Supplied char array not large enough to hold gateway address string)\n");
-        return -1;
+    routeTable table;
+    initRouteTable(&table);
+    if (readRouteTable(&table) < 0) return -1;
+    const routeEntry *route = getBestDefaultRoute(&table);
+    int ret = -1;
+    if ((route != NULL) && (route->flags & RTF_GATEWAY)) {
+        char address[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &route->gateway, address, INET_ADDRSTRLEN);
+        if (strlen(address) > (arraySize - 1))
+            printf("getGateway(): Supplied char array not large enough to hold gateway address string)\n");
+        else {
+            strcpy(gatewayAddress, address);
+            ret = 1;
+        }
     }
-
-    if (length < (arraySize - 1)) strncpy(gatewayAddress, startPos, length); //Safely Copy gateway addr to supplied char array
-    else return -1;
-    gatewayAddress[length] = 0;
-    //printf("getGateway(): %u: %s\n", length, gatewayAddress);
-    return 1;
+    freeRouteTable(&table);
+    return ret;
 }
 
 int removeAllGateways() {
@@ -1050,6 +1115,21 @@ int ifconfigGetNicStatus(nic *_nic) {
     startPos = strstr(cmdResponse, _nic->name); //Get initial start point - search for name of interface
     if (startPos == NULL) return -1; //Can't trust output of ifconfig (perhaps no interface with that name?)
 
+    //MAC address is on the first line (not all interfaces have one)
+    endPos = strstr(startPos, "\n");
+    ptr = strstr(startPos, "HWaddr");
+    if ((ptr != NULL) && ((endPos == NULL) || (ptr < endPos)))
+        sscanf(ptr, "HWaddr %hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &_nic->mac[0], &_nic->mac[1], &_nic->mac[2],
+            &_nic->mac[3], &_nic->mac[4], &_nic->mac[5]);
+
+    //IPv6 address (optional) e.g. 'inet6 addr: fe80::ba27:ebff:fe12:3456/64 Scope:Link'
+    ptr = strstr(startPos, "inet6 addr:");
+    if (ptr != NULL) {
+        char field[INET6_ADDRSTRLEN] = {0};
+        if (sscanf(ptr, "inet6 addr: %45[0-9a-fA-F:.]", field) == 1)
+            inet_pton(AF_INET6, field, &_nic->address6);
+    }
+
     startPos = strstr(startPos, "UP"); //Search for 'UP' string
     if (startPos == NULL) {
         _nic->status = 0; //If not found, assume interface exists, but it's DOWN
@@ -1060,42 +1140,19 @@ int ifconfigGetNicStatus(nic *_nic) {
     startPos = strstr(cmdResponse, _nic->name); //Get initial start point (based on name of iface we're interested in)
     if (startPos == NULL) return -1; //Interface with that name not found. Shouldn't happen!
 
-    startPos = strstr(startPos, "inet addr"); //Search for 'inet addr
+    //Each address is parsed straight into binary. inet_aton() accepts an address
+    //followed by whitespace, so no need to delimit the fields
+    startPos = strstr(startPos, "inet addr:"); //Search for 'inet addr
     if (startPos == NULL) return 0; //Interface exists, but inet address not set
+    if (inet_aton(startPos + strlen("inet addr:"), &_nic->address) == 0) return -1;
 
-    startPos = strstr(startPos, ":"); //Start delimited by a colon
-    if (startPos == NULL) return 0;
-    startPos += 1;
-    endPos = strstr(startPos, "  Bcast"); //End delimited by two spaces
-    if (endPos == NULL) return 0; //If no sensible delimit detected
-    length = endPos - startPos; //Get length of string to extract
-    if (length < (ARG_LENGTH - 1)) strncpy(_nic->address, startPos, length); //Safely Extract interface address
-    else return -1;
-    _nic->address[length] = 0; //Need to re 'null terminate the string' (because we chopped it up)
-
-    startPos = strstr(startPos, "  Bcast"); //Search for broadcast address
+    startPos = strstr(startPos, "Bcast:"); //Search for broadcast address
     if (startPos == NULL) return 0; //Interface exists, but bcast address not set
-    startPos = strstr(startPos, ":"); //Colon delimiter
-    if (startPos == NULL) return 0;
-    startPos += 1;
-    endPos = strstr(startPos, "  Mask"); //End delimited by two spaces
-    if (endPos == NULL) return 0;
-    length = endPos - startPos; //Get length of string to extract
-    if (length < (ARG_LENGTH - 1)) strncpy(_nic->broadcastAddress, startPos, length);
-    else return -1;
-    _nic->broadcastAddress[length] = 0; //Need to re 'null terminate the string' (because we chopped it up)
+    if (inet_aton(startPos + strlen("Bcast:"), &_nic->broadcastAddress) == 0) return -1;
 
-    startPos = strstr(startPos, "  Mask"); //Search for broadcast address
+    startPos = strstr(startPos, "Mask:"); //Search for subnet mask
     if (startPos == NULL) return 0; //Interface exists, but mask address not set
-    startPos = strstr(startPos, ":"); //Colon delimiter   
-    if (startPos == NULL) return 0;
-    startPos += 1;
-    endPos = strstr(startPos, "\n"); //End delimited by lf
-    if (endPos == NULL) return 0;
-    length = endPos - startPos; //Get length of string to extract
-    if (length < (ARG_LENGTH - 1)) strncpy(_nic->netmask, startPos, length);
-    else return -1;
-    _nic->netmask[length] = 0; //Need to re 'null terminate the string' (because we chopped it up)
+    if (inet_aton(startPos + strlen("Mask:"), &_nic->netmask) == 0) return -1;
     return 1;
 
 }
@@ -1248,68 +1305,9 @@ int readFile(char output[], int outputLength, char fileName[]) {
     return result;
 }
 
-/*
-int parseWPASupplicantConfig(wifiNetwork networkList[], int listLength, char fileToParse[]) {
+int parseWPASupplicantConfig2(wifiNetworkList *list, char fileToParse[]) {
     /*
- * ******NOW DEPRECATED. USE parseWPASupplicantConfig2 instead *******
- * 
- * Parses the supplied file and populates the supplied network list
- * 
- * Allows access to a list of previously know networks
- * Returns the no. of networks read from the file or -1 on error
- * 
- * 
-     
-    unsigned int length = 0; //Holds total length of string to be extracted
-    int networkIndex = 0;
-    char fileContents[10000] = {0}; //Array to hold contents of wpa.conf file to be read
-
-    int ret = readFile(fileContents, 10000, fileToParse);
-    if (ret < 1) return -1; //If readFile returns 0, return
-
-
-    //Now we've read the supplied file, parse the contents
-    char *startPos, *endPos;
-    startPos = strstr(fileContents, "network"); //Get initial start point
-    if (startPos == NULL) {
-        return 0; //No network parameters identified in this file
-    }
-    do {
-        //Get next SSID
-        startPos = strstr(startPos, "ssid"); //Get initial start point
-        if (startPos == NULL) break;
-        startPos = strstr(startPos, "\""); //Start of SSID delimited by ' " '
-        if (startPos == NULL) break;
-        startPos += 1;
-        endPos = strstr(startPos, "\""); //End of SSID delimited by ' " '
-        if (endPos == NULL) break;
-        length = endPos - startPos;
-        if (length < ARG_LENGTH) //Don't run off the end of the array
-            strncpy(networkList[networkIndex].essid, startPos, length); //Copy ESSID
-
-        //Now get next psk
-        startPos = strstr(startPos, "psk"); //Get initial start point
-        if (startPos == NULL) break;
-        startPos = strstr(startPos, "\""); //Start of SSID delimited by ' " '
-        if (startPos == NULL) break;
-        startPos += 1;
-        endPos = strstr(startPos, "\""); //End of SSID delimited by ' " '
-        if (endPos == NULL) break;
-        length = endPos - startPos;
-        if (length < ARG_LENGTH) //Don't run off the end of the array
-            strncpy(networkList[networkIndex].passPhrase, startPos, length); //Copy passphrase
-
-        networkIndex++; //Increment counter   
-        startPos = strstr(startPos, "network"); //Get start pos    
-    } while ((startPos != NULL)&(networkIndex < listLength)); //Don't run off end of array
-
-
-    return networkIndex; //Return no. of networks identified in file
-}
- */
-int parseWPASupplicantConfig2(wifiNetwork networkList[], int listLength, char fileToParse[]) {
-    /*
-     * Parses the supplied file and populates the supplied network list
+     * Parses the supplied file and appends its networks to the supplied list
      * 
      * Allows access to a list of previously know networks
      * Returns the no. of networks read from the file or -1 on error
@@ -1332,20 +1330,24 @@ int parseWPASupplicantConfig2(wifiNetwork networkList[], int listLength, char fi
      * }
      * 
      * If the phrase "psk=" isn't detected within a network block, the function
-     * assumes no passphrase is present and writes " " int the passphrase field
+     * assumes no passphrase is present and leaves the network without a secret
      * 
      * Sample Usage:
-     *      wifiNetwork _wifiNetwork[10];               //Create array of structs
+     *      wifiNetworkList list;
      *      int n;
-     *      for (n = 0; n < 10; n++) initWiFiNetworkStruct(&_wifiNetwork[n]);   //init the array
-     *      int ret = parseWPASupplicantConfig2(_wifiNetwork, 10, "filename");  //Parse supplied file, populate array
+     *      initWiFiNetworkList(&list);
+     *      int ret = parseWPASupplicantConfig2(&list, "filename");  //Parse supplied file, populate list
      *      printf("no of network blocks found:%d\n", ret);         //Capture return value
      *      for (n = 0; n < ret; n++)
-     *      printf("%d: ESSID: %s\t psk: %s\n", n, _wifiNetwork[n].essid, _wifiNetwork[n].passPhrase); //Print retrieved ssid/psk values
+     *      printf("%d: ESSID: %.*s\t psk: %s\n", n, list.networks[n].essid.length, list.networks[n].essid.octets,
+     *              getWiFiNetworkSecret(&list, n)); //Print retrieved ssid/psk values
+     *      freeWiFiNetworkList(&list);
      * 
      */
     unsigned int length = 0; //Holds total length of string to be extracted
     int networkIndex = 0;
+    int index; //Position of the network being parsed within the list
+    int first = list->count; //Networks are appended after anything already in the list
     char fileContents[10000] = {0}; //Array to hold contents of wpa.conf file to be read
 
     int ret = readFile(fileContents, 10000, fileToParse);
@@ -1361,7 +1363,7 @@ int parseWPASupplicantConfig2(wifiNetwork networkList[], int listLength, char fi
     }
     //char testString[100] = {0};
     //strcpy(testString, "cake");
-    while ((startofNetworkBlock != NULL)&&(networkIndex < listLength)) { //Iterate through wpa config file contents
+    while (startofNetworkBlock != NULL) { //Iterate through wpa config file contents
         //Get start of network block
         startofNetworkBlock = strstr(startofNetworkBlock, "{"); //Get initial start point
         if (startofNetworkBlock == NULL) return 0; //No network parameters identified in this file
@@ -1401,19 +1403,21 @@ int parseWPASupplicantConfig2(wifiNetwork networkList[], int listLength, char fi
         }
         //Resultant 'arrayPosition' value should point to the last " before the \n
         length = &fileContents[arrayPosition] - startPos;
-        if (length < 1) return -1; //Duff length value
-        if (length < ARG_LENGTH) { //Don't run off the end of the array
-            strncpy(networkList[networkIndex].essid, startPos, length); //Copy ESSID
-        } else return -1;
-
-        //printf("SSID: %s\n", networkList[networkIndex].essid);
+        if ((length < 1) || (length > SSID_MAX_LENGTH)) { //Not a valid 802.11 SSID. Skip the block, not the file
+            printf("parseWPASupplicantConfig2(): %s: Skipping network block with a %d character SSID (1-%d allowed)\n",
+                    fileToParse, (int) (&fileContents[arrayPosition] - startPos), SSID_MAX_LENGTH);
+            startofNetworkBlock = strstr(endOfNetworkBlock, "network={"); //Get  start of next network block
+            continue;
+        }
+        index = appendWiFiNetwork(list);
+        if (index == -1) return -1;
+        memcpy(list->networks[index].essid.octets, startPos, length); //Copy ESSID
+        list->networks[index].essid.length = (uint8_t) length;
 
         //Now need to retrieve passphrase (if it exists)
         startPos = strstr(startofNetworkBlock, "psk="); //Return to start of current network block
         if ((startPos == NULL) || (startPos > endOfNetworkBlock)) { //No psk field found in this network block
-            nullTermStrlCpy(networkList[networkIndex].passPhrase, "\0",ARG_LENGTH); //Copy blank space + null terminator into passPhrase field
-            if (!strcmp(networkList[networkIndex].passPhrase, "\0"))
-                printf("No passphrase\n");
+            printf("No passphrase\n"); //Leave secret as -1
         } else { //psk field found within current network block
             startPos = strstr(startPos, "\""); //Start of passphrase delimited by '"'
             if ((startPos == NULL) || (startPos > endOfNetworkBlock)) break; //No start delimiter found, or not within network block
@@ -1440,15 +1444,13 @@ int parseWPASupplicantConfig2(wifiNetwork networkList[], int listLength, char fi
             //Resultant 'arrayPosition' value should point to the last " before the \n
             length = &fileContents[arrayPosition] - startPos;
             if (length < 1) return -1; //Duff length value
-            if (length < ARG_LENGTH) //Don't run off the end of the array
-                strncpy(networkList[networkIndex].passPhrase, startPos, length); //Copy ESSID
-            else return -1;
-            //printf("passphrase: %s\n", networkList[networkIndex].passPhrase);
+            if (setWiFiNetworkSecret(list, index, startPos, length) == -1) return -1; //Copy passphrase
         }
 
         networkIndex++; //Increment counter
         startofNetworkBlock = strstr(endOfNetworkBlock, "network={"); //Get  start of next network block
     }
+    list->count = first + networkIndex; //Drop a network block that was only half parsed
 
     return networkIndex; //Return no. of networks identified in file
 }
@@ -1465,6 +1467,10 @@ int createWPASupplicantConfig(char SSID[], char passPhrase[], char fileToWrite[]
      */
     FILE *fp; //Create pointer to a file
     char outputBuffer[1024] = {0};
+    if (strlen(SSID) > SSID_MAX_LENGTH) { //wpa_supplicant would reject it anyway
+        printf("createWPASupplicantConfig(): SSID longer than %d octets\n", SSID_MAX_LENGTH);
+        return -1;
+    }
     fp = fopen(fileToWrite, "r"); //open file for reading (just to test whether it exists already))
     if (fp == NULL) { //Easy, file doesn't exist so we can create a new one from scratch
         printf("%s doesn't exist, writing...\n", fileToWrite);
@@ -1499,43 +1505,45 @@ int createWPASupplicantConfig(char SSID[], char passPhrase[], char fileToWrite[]
         //5)Else:   Append new network block to existing file (open for appending, write, close))
 
         fclose(fp); //Close file 
-        wifiNetwork networkList[100]; //Create network list array (will store parsed SSIDs and keys))
-        int n, k;
-        for (n = 0; n < 100; n++) initWiFiNetworkStruct(&networkList[n]); //Init the array
-        int m = parseWPASupplicantConfig2(networkList, 100, fileToWrite); //Parse the supplied conf file
+        wifiNetworkList networkList; //Network list (will store parsed SSIDs and keys))
+        initWiFiNetworkList(&networkList);
+        int n;
+        int m = parseWPASupplicantConfig2(&networkList, fileToWrite); //Parse the supplied conf file
         if (m > 0) { //If sensible data successfully parsed. 'm' network blocks retrieved
-            for (n = 0; n < m; n++) { //Iterate through the key field looking for the supplied SSID
-                if (!strcmp(networkList[n].essid, SSID)) {
-                    //If SSID matched, strcmp() returns 0, and the following code executes
-                    printf("ESSID %s already exists in file %s. passPhrase changed from %s", SSID, fileToWrite, networkList[n].passPhrase);
-                    //bzero(networkList[n].passPhrase, ARG_LENGTH); //Empty existing passPhrase contents
-                    memset(networkList[n].passPhrase, 0, ARG_LENGTH); //Empty existing passPhrase contents
-                    nullTermStrlCpy(networkList[n].passPhrase, passPhrase,ARG_LENGTH); //Write supplied passPhrase into array
-                    printf(" to %s\n", networkList[n].passPhrase);
-
-                    //////////////NOW write entire array to disk overwriting original file
-                    fp = fopen(fileToWrite, "w+"); //Open file for reading and writing. Truncate to zero first
-                    if (fp == NULL) {
-                        perror("createWPASupplicantConfig().fopen(): (file can't be re-written). Error creating file");
-                        return -1;
-                    }
-                    fprintf(fp, "#Auto generated by createWPASupplicantConfig(). (reconstructed)\n"); //Write string to disk
-                    for (n = 0; n < m; n++) { //'m' networks were retrieved. Write them back to disk (reuse variable n))
-
-
-                        //Check to see whether a passohrase has been supplied (trying to match a zero length string)
-                        if (!strcmp(passPhrase, "\0")) //Is passphrase empty?
-                            snprintf(outputBuffer, 1024,"\nnetwork={\n\tssid=\"%s\"\n\tproto=RSN\n\tkey_mgmt=NONE\n}\n", networkList[n].essid); //Format string
-                        else //Passhphrase has been supplied
-                            snprintf(outputBuffer, 1024,"\nnetwork={\n\tssid=\"%s\"\n\tpsk=\"%s\"\n}\n", networkList[n].essid, networkList[n].passPhrase); //Format string
-
-                        fprintf(fp, outputBuffer); //Write string to disk
-                    }
-                    fclose(fp); //Close file
-                    return 1;
+            n = findESSIDinNetworkList(&networkList, SSID);
+            if (n > -1) {
+                printf("ESSID %s already exists in file %s. passPhrase changed from %s", SSID, fileToWrite, getWiFiNetworkSecret(&networkList, n));
+                if (!strcmp(passPhrase, "\0")) networkList.networks[n].secret = -1; //Now an open network
+                else setWiFiNetworkSecret(&networkList, n, passPhrase, strlen(passPhrase)); //Write supplied passPhrase into list
+                printf(" to %s\n", getWiFiNetworkSecret(&networkList, n));
+
+                //////////////NOW write entire list to disk overwriting original file
+                fp = fopen(fileToWrite, "w+"); //Open file for reading and writing. Truncate to zero first
+                if (fp == NULL) {
+                    perror("createWPASupplicantConfig().fopen(): (file can't be re-written). Error creating file");
+                    freeWiFiNetworkList(&networkList);
+                    return -1;
+                }
+                fprintf(fp, "#Auto generated by createWPASupplicantConfig(). (reconstructed)\n"); //Write string to disk
+                for (n = 0; n < m; n++) { //'m' networks were retrieved. Write them back to disk (reuse variable n))
+                    wifiNetwork *network = &networkList.networks[n];
+                    //Each network keeps its own passphrase (or lack of one)
+                    if (network->secret < 0) //Is passphrase empty?
+                        snprintf(outputBuffer, 1024,"\nnetwork={\n\tssid=\"%.*s\"\n\tproto=RSN\n\tkey_mgmt=NONE\n}\n",
+                            network->essid.length, network->essid.octets); //Format string
+                    else //Passhphrase has been supplied
+                        snprintf(outputBuffer, 1024,"\nnetwork={\n\tssid=\"%.*s\"\n\tpsk=\"%s\"\n}\n",
+                            network->essid.length, network->essid.octets, getWiFiNetworkSecret(&networkList, n)); //Format string
+
+                    fprintf(fp, outputBuffer); //Write string to disk
                 }
+                fclose(fp); //Close file
+                memset(outputBuffer, 0, 1024); //Don't leave a passphrase on the stack
+                freeWiFiNetworkList(&networkList);
+                return 1;
             }
         }
+        freeWiFiNetworkList(&networkList);
         //However, if the code makes it this far...
         /////////ESSID not present but file exists so append new SSID/key to file
         printf("ESSID %s not present in file %s. New network block appended..\n", SSID, fileToWrite);
@@ -1565,73 +1573,68 @@ int createWPASupplicantConfig(char SSID[], char passPhrase[], char fileToWrite[]
     return 1;
 }
 
-int findESSIDinConfigFile(wifiNetwork networkList[], int listLength, char fileToSearch[], char ESSIDtoMatch[]) {
+int findESSIDinNetworkList(wifiNetworkList *list, char ESSIDtoMatch[]) {
+    /*
+     * Searches an already populated network list (e.g from parseWPASupplicantConfig2()) for a specific ESSID.
+     * Returns the list index where the ESSID is first found, or -1 if not found
+     */
+    int n;
+    for (n = 0; n < list->count; n++) {
+        if (ssidMatches(&list->networks[n].essid, ESSIDtoMatch)) {
+            printf("Matching ESSID found at array position: %d\n", n);
+            return n;
+        }
+    }
+    return -1;
+}
+
+int findESSIDinConfigFile(wifiNetworkList *list, char fileToSearch[], char ESSIDtoMatch[]) {
     /*
      *Searches the supplied WPA config file for a specifi ESSID.
-     * If it finds it, it will return the array index no. where the ESSID is first found,
+     * If it finds it, it will return the list index where the ESSID is first found,
      * If not found, it will return -1;
      * 
-     * It will also populate the supplied wifiNetwork[] array with the list of networks found in the file
-     * by using the parseWPASupplicantConfig function
+     * It will also populate the supplied list with the networks found in the file
+     * by using the parseWPASupplicantConfig2 function
      * 
      */
-    int n;
     //1) Populate network list as described in fileToSearch
-    int noOfNetworks = parseWPASupplicantConfig2(networkList, listLength, fileToSearch);
+    int noOfNetworks = parseWPASupplicantConfig2(list, fileToSearch);
     printf("findESSIDinConfigFile(): No. of networks: %d\n", noOfNetworks);
     if (noOfNetworks < 1) {
         printf("findESSIDinConfigFile(): Supplied file contains no networks\n");
         return -1;
     }
     printf("Searching for %s\n", ESSIDtoMatch);
-    //2)Now iterate through networkList[] array looking for a match with ]
-    for (n = 0; n < noOfNetworks; n++) {
-        printf("%d, %s\n", n, networkList[n].essid);
-        if (!strcmp(networkList[n].essid, ESSIDtoMatch)) {
-            printf("Matching ESSID found at array position: %d\n", n);
-            return n;
-        }
-    }
-    //3)ESSID not found, so return -1;
-    return -1;
+    //2)Now iterate through the list looking for a match (returns -1 if not found)
+    return findESSIDinNetworkList(list, ESSIDtoMatch);
 
 }
 
 int deleteESSIDfromConfigFileByName(char fileName[], char ESSIDtoDelete[]) {
     /*
      * Attempts to remove an ESSID/passphrase key pair from the supplied file
-     * Currently it can handle a maximum list size of 250, but this seems a crazy 
-     * no. of WiFi networks
      */
-#define MAX_WIFI_LIST_LENGTH 250
-    wifiNetwork networkList[MAX_WIFI_LIST_LENGTH]; //Create network list array (will store SSIDs and keys))
+    wifiNetworkList networkList; //Network list (will store SSIDs and keys))
 
     int elementToDelete, noOfNetworks, n;
-    for (n = 0; n < MAX_WIFI_LIST_LENGTH; n++) initWiFiNetworkStruct(&networkList[n]); //Init the array
+    initWiFiNetworkList(&networkList);
     //1) Determine if the file contains the supplied ESSID
-    noOfNetworks = parseWPASupplicantConfig2(networkList, MAX_WIFI_LIST_LENGTH, fileName); //Determine how many networks are listed
+    noOfNetworks = parseWPASupplicantConfig2(&networkList, fileName); //Determine how many networks are listed
     printf("deleteESSIDfromConfigFile(): No. of networks: %d\n", noOfNetworks);
     if (noOfNetworks < 1) {
         //No networks present in file or file error
+        freeWiFiNetworkList(&networkList);
         return noOfNetworks;
     }
-    elementToDelete = findESSIDinConfigFile(networkList, MAX_WIFI_LIST_LENGTH, fileName, ESSIDtoDelete);
+    elementToDelete = findESSIDinNetworkList(&networkList, ESSIDtoDelete); //Already parsed, don't read the file again
 
 
     //2)
     if (elementToDelete != -1) { //If ESSID has been found
         printf("deleteESSIDfromConfigFile() ESSID %s found at array list location %d\n", ESSIDtoDelete, elementToDelete);
 
-        //First, duplicate the old file..
-        char cmdString[1024] = {0}; //Array to hold system command
-        char cmdResponse[1024] = {0}; //Array to hold response from command
-        snprintf(cmdString, 1024,"cp %s %s%s", fileName, fileName, ".backup"); //Format command string 'cp filename filename.backup'
-        printf("deleteESSIDfromConfigFile() cmdString: %s\n", cmdString);
-        int ret = sysCmd2(cmdString, cmdResponse, 1024); //Execute system command
-
-        if (ret > 0) {
-            printf("deleteESSIDfromConfigFile(). Can't create backup of %s\n", fileName);
-        }
+        //No .backup copy any more. The caller keeps versioned snapshots (see configSnapshots.c)
 
         //Next rewrite the file with 'no contents'
         FILE *fp; //Create pointer to a file
@@ -1639,6 +1642,7 @@ int deleteESSIDfromConfigFileByName(char fileName[], char ESSIDtoDelete[]) {
         fp = fopen(fileName, "w+"); //Open file for reading and writing. Truncate to zero first (same as deleting the contents)
         if (fp == NULL) {
             printf("deleteESSIDfromConfigFile(): Can't empty %s\n", fileName);
+            freeWiFiNetworkList(&networkList);
             return -1;
         }
         fclose(fp);
@@ -1646,6 +1650,7 @@ int deleteESSIDfromConfigFileByName(char fileName[], char ESSIDtoDelete[]) {
         fp = fopen(fileName, "a+"); //Open file for appending and reading. 
         if (fp == NULL) {
             printf("deleteESSIDfromConfigFile(): Can't append to %s\n", fileName);
+            freeWiFiNetworkList(&networkList);
             return -1;
         }
         n = 0;
@@ -1658,15 +1663,18 @@ int deleteESSIDfromConfigFileByName(char fileName[], char ESSIDtoDelete[]) {
 
         while (n < noOfNetworks) {
             if (n != elementToDelete) { //If this ESSID is NOT to be skipped, write it to fileName
+                wifiNetwork *network = &networkList.networks[n];
 
-                if (!strcmp(networkList[n].passPhrase, "\0")) { //Is passphrase field empty?
+                if (network->secret < 0) { //Is passphrase field empty?
                     //If so, write a special string to the file to tell wpa_supplicant that the network is open
                     //Should look like: proto=RSN
                     //                  key_mgmt=NONE
-                    snprintf(outputBuffer, 1024,"\nnetwork={\n\tssid=\"%s\"\n\tproto=RSN\n\tkey_mgmt=NONE\n}\n", networkList[n].essid); //Format string
+                    snprintf(outputBuffer, 1024,"\nnetwork={\n\tssid=\"%.*s\"\n\tproto=RSN\n\tkey_mgmt=NONE\n}\n",
+                            network->essid.length, network->essid.octets); //Format string
                     fprintf(fp, outputBuffer); //Write string to disk
                 } else { //Passphrase is present
-                    snprintf(outputBuffer, 1024,"\nnetwork={\n\tssid=\"%s\"\n\tpsk=\"%s\"\n}\n", networkList[n].essid, networkList[n].passPhrase); //Format string
+                    snprintf(outputBuffer, 1024,"\nnetwork={\n\tssid=\"%.*s\"\n\tpsk=\"%s\"\n}\n",
+                            network->essid.length, network->essid.octets, getWiFiNetworkSecret(&networkList, n)); //Format string
                     fprintf(fp, outputBuffer); //Write string to disk
                 }
             }
@@ -1674,9 +1682,12 @@ int deleteESSIDfromConfigFileByName(char fileName[], char ESSIDtoDelete[]) {
             n++;
         }
         fclose(fp);
+        memset(outputBuffer, 0, 1024); //Don't leave a passphrase on the stack
+        freeWiFiNetworkList(&networkList);
         return 1;
     } else { //ESSID has not been found
         printf("deleteESSIDfromConfigFile() ESSID %s not found.\n", ESSIDtoDelete);
+        freeWiFiNetworkList(&networkList);
         return 0;
     }
 
@@ -1748,10 +1759,9 @@ void testIPTools() {
         }
         if (key == 'd') {
             printf("d: findESSIDinConfigFile()\n");
-            wifiNetwork _wifiNetwork[50]; //Array to store wireless networks found
+            wifiNetworkList _wifiNetwork; //List to store wireless networks found
             int n;
-            for (n = 0; n < 50; n++)
-                initWiFiNetworkStruct(&_wifiNetwork[n]); //Clear struct contents
+            initWiFiNetworkList(&_wifiNetwork);
             char ssid[50] = {0};
             char fileToWrite[200] = {0};
             printf("Enter SSID: ");
@@ -1759,9 +1769,10 @@ void testIPTools() {
             flushstdin();
             printf("\nEnter file to read: ");
             scanf("%[^\n]s", fileToWrite);
-            n = findESSIDinConfigFile(_wifiNetwork, 50, fileToWrite, ssid);
+            n = findESSIDinConfigFile(&_wifiNetwork, fileToWrite, ssid);
             if (n>-1) printf("\nESSID %s found at array pos %d\n", ssid, n);
             else printf("\nESSID not found\n");
+            freeWiFiNetworkList(&_wifiNetwork);
         }
         if (key == 'e') {
             printf("e: getGateway()\n");
@@ -1774,7 +1785,7 @@ void testIPTools() {
             wifiNetwork _wifiNetwork;
             initWiFiNetworkStruct(&_wifiNetwork);
             int n = getWiFiConnStatus(&_wifiNetwork, "wlan0");
-            if (n == 1) printf("Connected to %s\n", _wifiNetwork.essid);
+            if (n == 1) printf("Connected to %.*s\n", _wifiNetwork.essid.length, _wifiNetwork.essid.octets);
             else printf("Not currently connected.\n");
         }
         if (key == 'g') {
@@ -1784,19 +1795,19 @@ void testIPTools() {
             char addr[100] = {0};
             printf("Enter address: ");
             scanf("%s", addr);
-            nullTermStrlCpy(_nic.address, addr,ARG_LENGTH);
+            inet_aton(addr, &_nic.address);
             char mask[100] = {0};
             printf("\nEnter Mask: ");
             scanf("%s", mask);
-            nullTermStrlCpy(_nic.netmask, mask,ARG_LENGTH);
+            inet_aton(mask, &_nic.netmask);
 
             char name[100] = {0};
             printf("\nEnter Interface Name: ");
             scanf("%s", name);
-            nullTermStrlCpy(_nic.name, name,ARG_LENGTH);
+            nullTermStrlCpy(_nic.name, name, NIC_NAME_LENGTH);
             printf("\n");
             int n = ifConfigSetNic(&_nic);
-            if (n == 0) printf("Couldn't configure nic: %s, %s, %s", _nic.name, _nic.address, _nic.netmask);
+            if (n == 0) printf("Couldn't configure nic: %s, %s, %s", _nic.name, addr, mask);
         }
         if (key == 'h') {
             printf("h: ifConfigGetNicStatus\n");
@@ -1805,10 +1816,12 @@ void testIPTools() {
             char name[100] = {0};
             printf("Enter interface name:\n");
             scanf("%s", name);
-            nullTermStrlCpy(_nic.name, name,ARG_LENGTH);
+            nullTermStrlCpy(_nic.name, name, NIC_NAME_LENGTH);
             int n = ifconfigGetNicStatus(&_nic);
             if (n == 1)printf("Interface %s UP\n", _nic.name);
-            printf("%s, %s\n", _nic.address, _nic.netmask);
+            char address[INET_ADDRSTRLEN], netmask[INET_ADDRSTRLEN];
+            printf("%s, %s\n", inet_ntop(AF_INET, &_nic.address, address, INET_ADDRSTRLEN),
+                    inet_ntop(AF_INET, &_nic.netmask, netmask, INET_ADDRSTRLEN));
         }
         if (key == 'i') {
             printf("i: iwScanCountNetworks()\n");
@@ -1818,20 +1831,20 @@ void testIPTools() {
         if (key == 'j') {
             printf("j: iwScanWrapper()\n");
             int networkIndex;
-            wifiNetwork _wifiNetwork[50]; //Array to store wireless networks found
-            int n;
-            for (n = 0; n < 50; n++)
-                initWiFiNetworkStruct(&_wifiNetwork[n]); //Clear struct contents
-            networkIndex = iwscanWrapper(_wifiNetwork, 50, "wlan0");
+            wifiNetworkList _wifiNetwork; //List to store wireless networks found
+            initWiFiNetworkList(&_wifiNetwork);
+            networkIndex = iwscanWrapper(&_wifiNetwork, "wlan0");
 
             int z;
 
             //Display names of networks found
             for (z = 0; z < networkIndex; z++) {
-                printf("%d:%s,\tQuality:%d,\tStrength:%ddBm,\tEncryption:%s\n",
-                        z, _wifiNetwork[z].essid, _wifiNetwork[z].sigQuality,
-                        _wifiNetwork[z].sigLevel, _wifiNetwork[z].encryption);
+                wifiNetwork *network = &_wifiNetwork.networks[z];
+                printf("%d:%.*s,\tQuality:%d,\tStrength:%ddBm,\tEncryption:%s\n",
+                        z, network->essid.length, network->essid.octets, network->sigQuality,
+                        network->sigLevel, network->encrypted ? "on" : "off");
             }
+            freeWiFiNetworkList(&_wifiNetwork);
         }
         if (key == 'k') {
             printf("k: removeAllgateways()\n");
@@ -28,31 +28,66 @@ extern "C" {
 //ADD MY OWN STUFF AFTER HERE
 //REMEMBER TO ADD: #include "iptools2.0.h" TO THE SOURCE FILE
 
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
 #define ARG_LENGTH  1024
+#define SSID_MAX_LENGTH 32      //802.11 limit. An SSID is up to 32 octets, not a C string
+#define NIC_NAME_LENGTH 16      //Same as the kernel's IFNAMSIZ
+#define MAC_LENGTH 6
+
+typedef struct {
+    uint8_t length;
+    uint8_t octets[SSID_MAX_LENGTH]; //Not null terminated. Print with "%.*s", length, octets
+} ssid80211;
 
 typedef struct Nic {
     //Struct to describe a network interface
-    char name[ARG_LENGTH]; //eg wlan0 etc (normally the same as the system name))
-    char address[ARG_LENGTH];
-    char netmask[ARG_LENGTH];
-    char broadcastAddress[ARG_LENGTH];
-    char gateway[ARG_LENGTH];
+    char name[NIC_NAME_LENGTH]; //eg wlan0 etc (normally the same as the system name))
+    struct in_addr address;
+    struct in_addr netmask;
+    struct in_addr broadcastAddress;
+    struct in_addr gateway;
+    struct in6_addr address6; //All zeros if the interface has no IPv6 address
+    uint8_t mac[MAC_LENGTH];
     int priority;
     int status; //Is interface up or down?
     int configured; //Has the interface been configured yet?
 } nic;
 
 typedef struct WiFiNetwork {
-    char essid[ARG_LENGTH];
-    int sigQuality;
-    int sigLevel;
-    char passPhrase[ARG_LENGTH];
-    char key[ARG_LENGTH];
+    ssid80211 essid;
+    uint8_t encrypted; //1 if iwlist reports 'Encryption key:on'
+    int16_t sigQuality;
+    int16_t sigLevel;
     int priority;
-    char desc[ARG_LENGTH];
-    char encryption[ARG_LENGTH];
+    int secret; //Offset of the passphrase in the owning wifiNetworkList's secret store, -1 if none
 } wifiNetwork; //Define new 'objects' with 'wifiNetwork', not 'WifiNetwork'
 
+typedef struct {
+    //Growable, contiguous list of networks. Passphrases are kept apart in 'secrets'
+    //so that walking the list only touches the small records
+    wifiNetwork *networks;
+    int count;
+    int capacity;
+    char *secrets; //'\0' separated passphrases, indexed by wifiNetwork.secret
+    size_t secretsUsed;
+    size_t secretsCapacity;
+} wifiNetworkList;
+
+int setSSID(ssid80211 *ssid, char text[]);
+char *ssidToString(ssid80211 *ssid, char output[], unsigned int outputLength);
+int ssidMatches(ssid80211 *ssid, char text[]);
+
+void initWiFiNetworkList(wifiNetworkList *list);
+void freeWiFiNetworkList(wifiNetworkList *list);
+int appendWiFiNetwork(wifiNetworkList *list);
+int setWiFiNetworkSecret(wifiNetworkList *list, int index, char secret[], unsigned int length);
+char *getWiFiNetworkSecret(wifiNetworkList *list, int index);
+int parseWPASupplicantConfig2(wifiNetworkList *list, char fileToParse[]);
+int findESSIDinNetworkList(wifiNetworkList *list, char ESSIDtoMatch[]);
+
 //AND BEFORE HERE
 #endif /* IPTOOLS2_0_H */
 
@@ -0,0 +1,275 @@
+/*
+ * In-memory index of the networks listed in wpa_supplicant.conf
+ *
+ * updateKnownNetworks() used to re-read and re-parse wpa_supplicant.conf on every page request, and
+ * deleteESSIDfromConfigFileByName() parsed it twice just to find out whether an SSID was in there.
+ * Instead the file is parsed once into an index of SSIDs, and knownNetworksWatcherThread() keeps
+ * the index up to date using inotify:-
+ *
+ *      -The directory holding the file is watched (not the file itself), so the index survives the file being
+ *       replaced by rename() (e.g rollbackConfigSnapshot(), or editors/tools that write a temp file first)
+ *      -Only events for our file name are acted on (IN_CLOSE_WRITE, IN_MOVED_TO, IN_CREATE, IN_DELETE etc)
+ *      -deleteESSIDfromConfigFileByName() truncates the file and then rewrites it, so events are allowed to settle
+ *       for KNOWN_NETWORKS_SETTLE_MS before the file is re-parsed
+ *      -The file's inode/size/mtime/ctime are recorded at every parse. If they haven't changed the re-parse is skipped,
+ *       so our own writes (followed by refreshKnownNetworks()) aren't parsed twice
+ *
+ * Every re-parse bumps a generation counter, so callers can cache anything they build from the
+ * index (e.g the html known networks list) and only rebuild it when the counter changes.
+ *
+ * If inotify isn't available, each lookup falls back to a stat() of the file (still no re-parse unless
+ * it has changed)
+ */
+
+#define _POSIX_C_SOURCE 200809L //For st_mtim with -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "iptools2.3.h"
+#include "knownNetworks.h"
+
+#define KNOWN_NETWORKS_SETTLE_MS 100 //Wait for the file to stop changing before re-parsing it
+#define KNOWN_NETWORKS_EVENT_BUFFER (4096)
+
+static char knownNetworksPath[PATH_MAX] = {0};
+static char knownNetworksFileName[NAME_MAX + 1] = {0}; //Just the file name (for matching inotify events)
+static pthread_mutex_t knownNetworksMutex = PTHREAD_MUTEX_INITIALIZER;
+static ssid80211 *knownESSIDs = NULL; //Contiguous vector of SSIDs, exactly knownNetworkCount long
+static int knownNetworkCount = 0;
+static int knownNetworksGeneration = 0; //Incremented every time the index is rebuilt
+static _Atomic int knownNetworksWatcherRunning = 0; //Written by the watcher thread, read by every lookup
+static struct stat knownNetworksFileInfo; //stat() of the file at the last parse
+static int knownNetworksFileInfoValid = 0;
+
+static int fileInfoChanged(struct stat *now, int exists) {
+    //Has the file changed since the last parse? Must be called with knownNetworksMutex held
+    if (knownNetworksFileInfoValid == 0) return 1;
+    if (exists == 0) return (knownNetworkCount > 0) || (knownNetworksFileInfo.st_ino != 0);
+    return (now->st_ino != knownNetworksFileInfo.st_ino) || (now->st_size != knownNetworksFileInfo.st_size) ||
+            (now->st_mtim.tv_sec != knownNetworksFileInfo.st_mtim.tv_sec) ||
+            (now->st_mtim.tv_nsec != knownNetworksFileInfo.st_mtim.tv_nsec) ||
+            (now->st_ctim.tv_sec != knownNetworksFileInfo.st_ctim.tv_sec) ||
+            (now->st_ctim.tv_nsec != knownNetworksFileInfo.st_ctim.tv_nsec);
+}
+
+static int rebuildKnownNetworks(int force) {
+    /*
+     * Re-parses the file into the index, unless it hasn't changed since last time (and force==0)
+     * Returns the number of known networks, or -1 on error (the old index is kept)
+     */
+    struct stat fileInfo;
+    pthread_mutex_lock(&knownNetworksMutex);
+    int exists = (stat(knownNetworksPath, &fileInfo) == 0);
+    if ((force == 0) && (fileInfoChanged(&fileInfo, exists) == 0)) {
+        int ret = knownNetworkCount;
+        pthread_mutex_unlock(&knownNetworksMutex);
+        return ret;
+    }
+
+    int found = 0;
+    ssid80211 *newESSIDs = NULL;
+    if (exists) {
+        //Keep only the SSIDs. The passphrases are wiped along with the parsed list
+        wifiNetworkList parsed;
+        initWiFiNetworkList(&parsed);
+        found = parseWPASupplicantConfig2(&parsed, knownNetworksPath);
+        if (found < 0) found = 0; //Unreadable. Treat as empty
+        if (found > 0) newESSIDs = malloc(found * sizeof (ssid80211));
+        if ((found > 0) && (newESSIDs == NULL)) {
+            freeWiFiNetworkList(&parsed);
+            pthread_mutex_unlock(&knownNetworksMutex);
+            return -1;
+        }
+        int n;
+        for (n = 0; n < found; n++) newESSIDs[n] = parsed.networks[n].essid;
+        freeWiFiNetworkList(&parsed);
+    } else {
+        memset(&fileInfo, 0, sizeof (fileInfo));
+    }
+
+    //Swap the new index in
+    free(knownESSIDs);
+    knownESSIDs = newESSIDs;
+    knownNetworkCount = found;
+    knownNetworksGeneration++;
+    knownNetworksFileInfo = fileInfo;
+    knownNetworksFileInfoValid = 1;
+    pthread_mutex_unlock(&knownNetworksMutex);
+    printf("rebuildKnownNetworks(): %d networks in %s\n", found, knownNetworksPath);
+    return found;
+}
+
+static void checkFreshness() {
+    //Without the watcher there's nothing to tell us the file has changed, so stat() it (cheap) on every lookup
+    if (knownNetworksWatcherRunning == 0) rebuildKnownNetworks(0);
+}
+
+void *knownNetworksWatcherThread(void *arg) {
+    /*
+     * Pthread: Blocks on the inotify fd. When our file changes, waits for the events to settle and
+     * then rebuilds the index
+     */
+    int fd = *((int*) arg); //Take local copy of arg
+    free(arg); //Free up memory requested by malloc
+    char events[KNOWN_NETWORKS_EVENT_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd inotifyPoll;
+    inotifyPoll.fd = fd;
+    inotifyPoll.events = POLLIN;
+
+    while (1) {
+        int changed = 0;
+        int timeout = -1; //Block until the first event, then only wait for the file to settle
+        while (1) {
+            int ret = poll(&inotifyPoll, 1, timeout);
+            if (ret < 0) {
+                if (errno == EINTR) continue;
+                perror("knownNetworksWatcherThread():poll()");
+                goto stop;
+            }
+            if (ret == 0) break; //Quiet for KNOWN_NETWORKS_SETTLE_MS
+            ssize_t length = read(fd, events, sizeof (events));
+            if (length <= 0) {
+                if ((length < 0) && (errno == EINTR)) continue;
+                perror("knownNetworksWatcherThread():read()");
+                goto stop;
+            }
+            char *ptr;
+            for (ptr = events; ptr < events + length;) {
+                struct inotify_event *event = (struct inotify_event*) ptr;
+                if (event->mask & IN_Q_OVERFLOW) changed = 1; //Lost events. Assume the worst
+                if ((event->len > 0) && (strcmp(event->name, knownNetworksFileName) == 0)) changed = 1;
+                if (event->mask & IN_IGNORED) { //Directory's gone. Nothing more will arrive
+                    printf("knownNetworksWatcherThread(): Watch removed\n");
+                    goto stop;
+                }
+                ptr += sizeof (struct inotify_event) +event->len;
+            }
+            if (changed) timeout = KNOWN_NETWORKS_SETTLE_MS;
+        }
+        if (changed) rebuildKnownNetworks(0);
+    }
+stop:
+    knownNetworksWatcherRunning = 0; //Lookups go back to checking the file themselves
+    close(fd);
+    return NULL;
+}
+
+int startKnownNetworksWatcher(char configPath[]) {
+    /*
+     * Parses configPath (wpa_supplicant.conf) into the index and starts knownNetworksWatcherThread()
+     * Returns 1 on success, -1 if the watcher couldn't be started (the index still works, see checkFreshness())
+     */
+    char pathCopy[PATH_MAX] = {0};
+    if ((configPath == NULL) || (strlen(configPath) == 0)) return -1;
+    pthread_mutex_lock(&knownNetworksMutex);
+    strncpy(knownNetworksPath, configPath, PATH_MAX - 1);
+    strncpy(pathCopy, configPath, PATH_MAX - 1);
+    strncpy(knownNetworksFileName, basename(pathCopy), NAME_MAX);
+    strncpy(pathCopy, configPath, PATH_MAX - 1);
+    knownNetworksFileInfoValid = 0;
+    pthread_mutex_unlock(&knownNetworksMutex);
+    rebuildKnownNetworks(1);
+
+    int notRunning = 0;
+    if (!atomic_compare_exchange_strong(&knownNetworksWatcherRunning, &notRunning, 1)) return 1; //Already running
+
+    int *fdPtr = malloc(sizeof (*fdPtr));
+    if (fdPtr == NULL) {
+        knownNetworksWatcherRunning = 0;
+        return -1;
+    }
+    *fdPtr = inotify_init1(IN_CLOEXEC);
+    if (*fdPtr < 0) {
+        perror("startKnownNetworksWatcher():inotify_init1()");
+        free(fdPtr);
+        knownNetworksWatcherRunning = 0;
+        return -1;
+    }
+    char *dir = dirname(pathCopy); //dirname() modifies pathCopy, hence the second copy above
+    if (inotify_add_watch(*fdPtr, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE) < 0) {
+        perror("startKnownNetworksWatcher():inotify_add_watch()");
+        close(*fdPtr);
+        free(fdPtr);
+        knownNetworksWatcherRunning = 0;
+        return -1;
+    }
+    pthread_t _knownNetworksWatcherThread;
+    if (pthread_create(&_knownNetworksWatcherThread, NULL, knownNetworksWatcherThread, (void*) fdPtr)) {
+        printf("Error creating knownNetworksWatcherThread thread.\n");
+        knownNetworksWatcherRunning = 0;
+        close(*fdPtr);
+        free(fdPtr);
+        return -1;
+    }
+    pthread_detach(_knownNetworksWatcherThread); //Don't care what happens to thread afterwards
+    printf("startKnownNetworksWatcher(): Watching %s in %s\n", knownNetworksFileName, dir);
+    return 1;
+}
+
+int refreshKnownNetworks() {
+    /*
+     * Brings the index up to date straight away (if the file has changed). Call after writing the file
+     * ourselves so that the next lookup sees the change without waiting for the watcher to settle.
+     * Returns the number of known networks, or -1 on error
+     */
+    return rebuildKnownNetworks(0);
+}
+
+int getKnownNetworksGeneration() {
+    //Changes whenever the index is rebuilt
+    checkFreshness();
+    pthread_mutex_lock(&knownNetworksMutex);
+    int ret = knownNetworksGeneration;
+    pthread_mutex_unlock(&knownNetworksMutex);
+    return ret;
+}
+
+int getKnownNetworkCount() {
+    checkFreshness();
+    pthread_mutex_lock(&knownNetworksMutex);
+    int ret = knownNetworkCount;
+    pthread_mutex_unlock(&knownNetworksMutex);
+    return ret;
+}
+
+int getKnownNetworkESSID(int index, char essid[], unsigned int length) {
+    /*
+     * Copies the SSID of known network 'index' into essid[]
+     * Returns the length of the SSID, or -1 if index is out of range
+     */
+    int ret = -1;
+    pthread_mutex_lock(&knownNetworksMutex);
+    if ((index >= 0) && (index < knownNetworkCount)) {
+        ssidToString(&knownESSIDs[index], essid, length);
+        ret = strlen(essid);
+    }
+    pthread_mutex_unlock(&knownNetworksMutex);
+    return ret;
+}
+
+int findKnownNetwork(char essid[]) {
+    /*
+     * Looks essid up in the index (no disk access).
+     * Returns its position in wpa_supplicant.conf (0 = first network) or -1 if not known
+     */
+    checkFreshness();
+    int ret = -1, n;
+    pthread_mutex_lock(&knownNetworksMutex);
+    for (n = 0; n < knownNetworkCount; n++) {
+        if (ssidMatches(&knownESSIDs[n], essid)) {
+            ret = n;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&knownNetworksMutex);
+    return ret;
+}
@@ -0,0 +1,39 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   knownNetworks.h
+ *
+ * inotify-backed index of the networks in wpa_supplicant.conf (see knownNetworks.c)
+ */
+
+#ifndef KNOWNNETWORKS_H
+#define KNOWNNETWORKS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "knownNetworks.h" TO THE SOURCE FILE
+
+int startKnownNetworksWatcher(char configPath[]);
+int refreshKnownNetworks();
+int getKnownNetworksGeneration();
+int getKnownNetworkCount();
+int getKnownNetworkESSID(int index, char essid[], unsigned int length);
+int findKnownNetwork(char essid[]);
+
+//AND BEFORE HERE
+#endif /* KNOWNNETWORKS_H */
+
@@ -0,0 +1,232 @@
+/*
+ * LED patterns
+ *
+ * Each LED is given a blink pattern: a string of '#' (on) and '.' (off), one character per LED_SLOT_MS. Rather
+ * than each LED being driven on its own (the status LED used to be rewritten every 20mS), the patterns of
+ * every LED are compiled into one schedule, as long as the lowest common multiple of their lengths. Each step
+ * of the schedule is a pair of bank-wide masks: the pins that are on, and the pins that are off, from that
+ * slot on. Only slots where some LED changes get a step. So driving the LEDs is one bank write (writeGPIOBank(),
+ * i.e a GPSET0 and GPCLR0 write on the /dev/mem backend) per step, however many LEDs there are, and nothing
+ * runs in between steps.
+ *
+ * The schedule is run by a task on the task scheduler (see taskScheduler.c). Where it is in the schedule comes
+ * from the monotonic clock, not a count of steps, so a late wake-up doesn't put it out of step. Changing a
+ * pattern compiles a new schedule and hands it to the task, which switches over on its next run and writes
+ * the full state of every LED for the current slot. Both schedules are lined up on the same clock, so LEDs
+ * whose patterns haven't changed carry on exactly as they were: there are no glitches.
+ *
+ * A schedule of one step (every LED steady on or off) is written once and the task stops. The next pattern
+ * change starts it again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "gpioBackend.h"
+#include "taskScheduler.h"
+#include "ledPatterns.h"
+
+typedef struct {
+    char name[16];
+    unsigned gpio;
+    char pattern[LED_PATTERN_MAX_SLOTS + 1];
+} ledEntry;
+
+static ledEntry leds[LED_MAX];
+static int noOfLEDs = 0;
+static ledSchedule *currentSchedule = NULL; //Only touched by the task
+static ledSchedule *nextSchedule = NULL; //Compiled, waiting for the task to pick it up
+static int ledTaskId = -1; //-1 while there's no task (never started, or stopped on a steady schedule)
+static pthread_mutex_t ledMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int isValidLEDPattern(const char pattern[]) {
+    int length = strlen(pattern);
+    if ((length == 0) || (length > LED_PATTERN_MAX_SLOTS)) return 0;
+    return strspn(pattern, "#.") == (size_t) length;
+}
+
+static int gcd(int a, int b) {
+    while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+ledSchedule *compileLEDSchedule(unsigned gpios[], const char *patterns[], int count) {
+    /*
+     * Compiles the patterns of 'count' LEDs (patterns[n] for the LED on gpios[n]) into a schedule.
+     * Returns the schedule (malloc()ed), or NULL if a pattern's invalid or the schedule would be too long
+     */
+    int length = 1;
+    int n;
+    for (n = 0; n < count; n++) {
+        if (!isValidLEDPattern(patterns[n])) return NULL;
+        int patternLength = strlen(patterns[n]);
+        length = length / gcd(length, patternLength) * patternLength;
+        if (length > LED_SCHEDULE_MAX_SLOTS) return NULL;
+    }
+
+    //Count the steps first: slots where any LED differs from the slot before (going round, for slot 0)
+    int slot, noOfSteps = 0;
+    for (slot = 0; slot < length; slot++) {
+        int previous = (slot + length - 1) % length;
+        for (n = 0; n < count; n++) {
+            int patternLength = strlen(patterns[n]);
+            if (patterns[n][slot % patternLength] != patterns[n][previous % patternLength]) break;
+        }
+        if ((n < count) || ((slot == 0) && (length == 1))) noOfSteps++;
+    }
+    if (noOfSteps == 0) noOfSteps = 1; //Nothing ever changes: one step, at slot 0
+
+    ledSchedule *schedule = malloc(sizeof (ledSchedule) + noOfSteps * sizeof (ledScheduleStep));
+    if (schedule == NULL) {
+        printf("compileLEDSchedule(): malloc()\n");
+        return NULL;
+    }
+    schedule->length = length;
+    schedule->noOfSteps = 0;
+    for (slot = 0; slot < length; slot++) {
+        int previous = (slot + length - 1) % length;
+        int changes = (slot == 0) && (noOfSteps == 1); //Always a step at 0 if there's only one
+        uint64_t setMask = 0, clearMask = 0;
+        for (n = 0; n < count; n++) {
+            int patternLength = strlen(patterns[n]);
+            char now = patterns[n][slot % patternLength];
+            if (now != patterns[n][previous % patternLength]) changes = 1;
+            if (now == '#') setMask |= 1ull << gpios[n];
+            else clearMask |= 1ull << gpios[n];
+        }
+        if (!changes) continue;
+        ledScheduleStep *step = &schedule->steps[schedule->noOfSteps++];
+        step->slot = slot;
+        step->setMask = setMask;
+        step->clearMask = clearMask;
+    }
+    return schedule;
+}
+
+static int findLEDScheduleStep(ledSchedule *schedule, int slot) {
+    //Returns the step in force at 'slot': the last one starting at or before it (or the last step, going round)
+    int low = 0, high = schedule->noOfSteps - 1, found = schedule->noOfSteps - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (schedule->steps[middle].slot <= slot) {
+            found = middle;
+            low = middle + 1;
+        } else high = middle - 1;
+    }
+    return found;
+}
+
+static uint32_t ledPatternTask(void *context) {
+    /*
+     * Scheduled task: Writes the LEDs' state for the current slot, then sleeps until the next step
+     */
+    pthread_mutex_lock(&ledMutex);
+    if (nextSchedule != NULL) {
+        free(currentSchedule);
+        currentSchedule = nextSchedule;
+        nextSchedule = NULL;
+    }
+    pthread_mutex_unlock(&ledMutex);
+    if (currentSchedule == NULL) return TASK_DONE;
+
+    ledSchedule *schedule = currentSchedule;
+    uint64_t now = getSchedulerTimeMs();
+    int slot = (now / LED_SLOT_MS) % schedule->length;
+    int step = findLEDScheduleStep(schedule, slot);
+    writeGPIOBank(schedule->steps[step].setMask, schedule->steps[step].clearMask);
+    if (schedule->noOfSteps == 1) { //Nothing changes until a pattern does
+        pthread_mutex_lock(&ledMutex);
+        int stop = (nextSchedule == NULL); //If not, we've been woken (runScheduledTaskNow()) to pick it up
+        if (stop) ledTaskId = -1; //So updateLEDSchedule() starts a new task
+        pthread_mutex_unlock(&ledMutex);
+        if (stop) return TASK_DONE;
+        return LED_SLOT_MS; //Ignored: already rescheduled for now
+    }
+
+    int nextSlot = schedule->steps[(step + 1) % schedule->noOfSteps].slot;
+    int slotsToGo = (nextSlot - slot + schedule->length) % schedule->length;
+    if (slotsToGo == 0) slotsToGo = schedule->length; //Only one step
+    return slotsToGo * LED_SLOT_MS - (now % LED_SLOT_MS);
+}
+
+static int updateLEDSchedule(void) {
+    /*
+     * Compiles the current patterns and hands the schedule to the task. Call with ledMutex held.
+     * Returns 0, or -1 if they couldn't be compiled (the old schedule carries on)
+     */
+    unsigned gpios[LED_MAX];
+    const char *patterns[LED_MAX];
+    int n;
+    for (n = 0; n < noOfLEDs; n++) {
+        gpios[n] = leds[n].gpio;
+        patterns[n] = leds[n].pattern;
+    }
+    ledSchedule *schedule = compileLEDSchedule(gpios, patterns, noOfLEDs);
+    if (schedule == NULL) return -1;
+    free(nextSchedule); //Never picked up. Replaced by this one
+    nextSchedule = schedule;
+    if (ledTaskId == -1) ledTaskId = addScheduledTask("ledPatterns", ledPatternTask, NULL, 0);
+    else runScheduledTaskNow(ledTaskId);
+    return 0;
+}
+
+int addLED(const char name[], unsigned gpio) {
+    /*
+     * Sets up gpio as an output for an LED (initially off). The task scheduler must be running.
+     * Returns the LED's no. (for setLEDPattern()), or -1 on failure
+     */
+    if (gpio >= GPIO_MAX_PINS) return -1;
+    pthread_mutex_lock(&ledMutex);
+    if (noOfLEDs == LED_MAX) {
+        printf("addLED(): No room for LED %s\n", name);
+        pthread_mutex_unlock(&ledMutex);
+        return -1;
+    }
+    ledEntry *led = &leds[noOfLEDs];
+    memset(led, 0, sizeof (ledEntry));
+    strncpy(led->name, name, sizeof (led->name) - 1);
+    led->gpio = gpio;
+    strcpy(led->pattern, LED_PATTERN_OFF);
+    setGPIOMode(gpio, PI_OUTPUT); //GPIO gpio as output
+    int id = noOfLEDs++;
+    if (updateLEDSchedule() < 0) id = -1;
+    pthread_mutex_unlock(&ledMutex);
+    return id;
+}
+
+int findLED(const char name[]) {
+    //Returns the no. of the LED called name, or -1 if there isn't one
+    pthread_mutex_lock(&ledMutex);
+    int n;
+    for (n = 0; n < noOfLEDs; n++) if (strcmp(leds[n].name, name) == 0) break;
+    pthread_mutex_unlock(&ledMutex);
+    return (n < noOfLEDs) ? n : -1;
+}
+
+int setLEDPattern(int led, const char pattern[]) {
+    /*
+     * Changes an LED's pattern (LED_PATTERN_SLOW etc.). Setting the pattern it already has costs nothing.
+     * Returns 0 on success, -1 if led doesn't exist or the pattern's invalid/won't fit in a schedule
+     */
+    pthread_mutex_lock(&ledMutex);
+    if ((led < 0) || (led >= noOfLEDs) || (!isValidLEDPattern(pattern))) {
+        pthread_mutex_unlock(&ledMutex);
+        return -1;
+    }
+    if (strcmp(leds[led].pattern, pattern) == 0) {
+        pthread_mutex_unlock(&ledMutex);
+        return 0;
+    }
+    char previous[LED_PATTERN_MAX_SLOTS + 1];
+    strcpy(previous, leds[led].pattern);
+    strcpy(leds[led].pattern, pattern);
+    int ret = updateLEDSchedule();
+    if (ret < 0) strcpy(leds[led].pattern, previous);
+    pthread_mutex_unlock(&ledMutex);
+    return ret;
+}
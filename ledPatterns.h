@@ -0,0 +1,63 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   ledPatterns.h
+ *
+ * Drives any no. of LEDs with blink patterns, compiled into one schedule of bank writes (see ledPatterns.c)
+ */
+
+#ifndef LEDPATTERNS_H
+#define LEDPATTERNS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "ledPatterns.h" TO THE SOURCE FILE
+
+#include <stdint.h>
+
+#define LED_MAX 8
+#define LED_SLOT_MS 125                 //Each character of a pattern lasts this long
+#define LED_PATTERN_MAX_SLOTS 64        //Max pattern length
+#define LED_SCHEDULE_MAX_SLOTS 4096     //Max length of the combined schedule (the LCM of the patterns' lengths)
+
+//Patterns: '#' = on, '.' = off, one character per LED_SLOT_MS. They all start together, every cycle
+#define LED_PATTERN_OFF "."
+#define LED_PATTERN_ON "#"
+#define LED_PATTERN_SLOW "########........"   //2 sec period
+#define LED_PATTERN_MEDIUM "##.."             //Half sec period
+#define LED_PATTERN_FAST "#."                 //Quarter sec period
+#define LED_PATTERN_ERROR "#.#.#..........."  //Three blinks every 2 sec
+
+typedef struct {
+    uint16_t slot; //Slot this step starts at
+    uint64_t setMask; //Pins on during this step (bit n = GPIO n)
+    uint64_t clearMask; //Pins off
+} ledScheduleStep;
+
+typedef struct {
+    int length; //In slots
+    int noOfSteps; //Only slots where something changes get a step
+    ledScheduleStep steps[]; //In slot order
+} ledSchedule;
+
+int addLED(const char name[], unsigned gpio);
+int findLED(const char name[]);
+int setLEDPattern(int led, const char pattern[]);
+ledSchedule *compileLEDSchedule(unsigned gpios[], const char *patterns[], int noOfLEDs);
+
+//AND BEFORE HERE
+#endif /* LEDPATTERNS_H */
@@ -9,9 +9,9 @@
  * do anything useful
  * 
  * --The Adhoc WEP LAN mode is temperamental. Sometimes you can connect to it, other times not.
- * If you do manage to connect, you should be given one of three possible IP addresses (192.168.0.16-18). The wlan0 card itself
+ * If you do manage to connect, you should be given an address from the dhcp pool (192.168.0.16-254, see -dhcprange). The wlan0 card itself
  * is statically assigned 192.168.0.11 when in this mode, so going to the web 192.168.0.11:20000 should give you the config page
- * The dhcp server is bound to wlan0 only
+ * The dhcp server only serves wlan0, plus any interfaces added with -dhcpif
  * 
  * Some function descriptions:-
  * 
@@ -53,12 +53,18 @@
  * 
  * renewDHCPLease()
  * ----------------
- * Invokes the terminal command dhclient -v to renew leases. However:-
- *          If setupMode=0: Renews leases for ALL interfaces (via dhclient -v)
+ * (Re)starts the built-in dhcp client per interface to renew leases (see dhcpClient.c). However:-
+ *          If setupMode=0: Renews leases for ALL interfaces (eth0, wlan0, wlan1)
  *          If setupMode=1: Assumes wlan0 is in use for Adhoc mode so only renews lease for eth0 and wlan1 (if installed)
+ * A client with a lease it got before (e.g wlan0 coming out of setup mode) asks for it straight back (INIT-REBOOT),
+ * which takes one round trip. SIGUSR2 shows each interface's lease, and how long it took to get
+ * 
+ * wpa_supplicant and hostapd (and udhcpc, with -udhcpc) are started in the foreground and supervised: reaped
+ * when they exit and restarted (with backoff) if they die (see processSupervisor.c). SIGUSR2 lists them
  * 
  * Known issues:-
- *          Raspian uses dhclient, whereas PiCore uses 'udhcpc -i wlan0' as it runs a different dhcp client daemon
+ *          -udhcpc runs 'udhcpc -f -i <interface>' instead of the built-in client, for systems that need their
+ *          own udhcpc scripts run (e.g to write resolv.conf)
  * 
  * 
  * 
@@ -128,6 +134,7 @@
  * 
  * USR1 mimics the GPI button press on pin 12 (causes piconfigserver to flip from normal to setup mode (or vice versa)
  * USR2 prints useful info to the stdin (like what the current mode is, listening port, etc).
+ * HUP re-reads the hostname (it's only read once otherwise), e.g after it's been changed.
  * 
  * --------
  * **To do**
@@ -195,9 +202,19 @@
 #include <pthread.h> //Remember to add -lpthread to linker options
 #include "iptools2.3.h"
 #include <signal.h>             //For the signal() line)
-#include "minimal_gpio.h"
+#include "gpioBackend.h"
+#include "gpioSim.h"
 #include <sys/types.h> 
 #include <fcntl.h>
+#include "fileSystemTools.h"
+#include "dhcpLeasePool.h"
+#include "dhcpServer2.h"
+#include "httpConfigServer.h"
+#include "wlanTransition.h"
+#include "modeCommandQueue.h"
+#include "deviceIdentity.h"
+#include "processSupervisor.h"
+#include "dhcpClient.h"
 
 /*
  * 
@@ -239,6 +256,7 @@ void main(int argc, char** argv) {
     sigaddset(&sigsToBlock, SIGINT); //Add SIGINT to our signal set
     sigaddset(&sigsToBlock, SIGUSR1); //Add SIGUSR1 to our signal set
     sigaddset(&sigsToBlock, SIGUSR2); //Add SIGUSR2 to our signal set
+    sigaddset(&sigsToBlock, SIGHUP); //Add SIGHUP to our signal set
     sigaddset(&sigsToBlock, SIGKILL); //Add SIGKILL to our signal set
 
     pthread_sigmask(SIG_BLOCK, &sigsToBlock, NULL); //Apply the mask to this and daughter threads
@@ -246,7 +264,7 @@ void main(int argc, char** argv) {
     char wpa_supplicantConfigPath[FIELD] = {0}; //Holds the path/name of the target wpa_supplicant file (supplied at runtime) 
     char hostapdPath[FIELD] = {0}; //Holds the path/name of the hostapd file to be invoked in 'host ap' setup mode
     int port = 0;
-    int useAlternativeDHCPClient = 0; //Determines whether we use (dhclient (Raspian) or udhcpc (TinyCore))
+    int useAlternativeDHCPClient = 0; //Determines whether we use the built-in dhcp client or udhcpc (TinyCore)
     int setupModeGPIPin=0;           //Which pin to connect the switch to
     int ledGPOPin=0;                //Which pin to connect the LED to
     //parse incoming arguments
@@ -294,7 +312,7 @@ void main(int argc, char** argv) {
         ////// Extract '-use-udhcpc' DHCP client
         for (n = 1; n < argc; n++) {
             if (strstr(argv[n], "-udhcpc") != NULL) { //Check for '-port'
-                printf("-udhcpc specified. udhcpc will be used instead of dhclient\n");
+                printf("-udhcpc specified. udhcpc will be used instead of the built-in dhcp client\n");
                 useAlternativeDHCPClient = 1;
             }
         }
@@ -337,6 +355,93 @@ void main(int argc, char** argv) {
         }
         
         
+        ////// Extra status LEDs
+        for (n = 1; n < argc; n++) {
+            if (strstr(argv[n], "-leds") != NULL) { //Check for '-leds'
+                if (argc >= (n + 2)) {//now check that there is at least one more argument
+                    if (setStatusLEDPins(argv[n + 1]) < 0) printf("Can't understand LED list: %s\n", argv[n + 1]);
+                } else printf("Missing LED list arg\n");
+            }
+        }
+
+        ////// Simulated GPIO (no hardware needed), with an optional script of inputs
+        for (n = 1; n < argc; n++) {
+            if (strstr(argv[n], "-simgpio") != NULL) { //Check for '-simgpio'
+                setGPIOBackend(GPIO_BACKEND_SIM);
+                if ((argc >= (n + 2)) && (argv[n + 1][0] != '-')) { //Is the next field a script rather than another option?
+                    if (runGPIOSimScript(argv[n + 1]) < 0) printf("Couldn't run gpio simulator script\n");
+                }
+            }
+        }
+
+        ////// Extract DHCP server address range (used in setup mode)
+        for (n = 1; n < argc; n++) {
+            if (strstr(argv[n], "-dhcprange") != NULL) { //Check for '-dhcprange'
+                if (argc >= (n + 3)) {//now check that there are at least two more arguments
+                    if (setDHCPServerRange(argv[n + 1], argv[n + 2]) == 0)
+                        printf("Supplied DHCP range: %s - %s\n", argv[n + 1], argv[n + 2]);
+                } else printf("Missing DHCP range args\n");
+            }
+        }
+
+        ////// Extract extra interfaces for the DHCP server (e.g wlan1 or a USB ethernet gadget)
+        for (n = 1; n < argc; n++) {
+            if (strstr(argv[n], "-dhcpif") != NULL) { //Check for '-dhcpif'
+                if (argc >= (n + 6)) {//now check that there are at least five more arguments
+                    if (addDHCPInterface(argv[n + 1], argv[n + 2], argv[n + 3], argv[n + 4], argv[n + 5]) == 0)
+                        printf("Supplied DHCP interface: %s (%s/%s) %s - %s\n", argv[n + 1], argv[n + 2], argv[n + 3], argv[n + 4], argv[n + 5]);
+                } else printf("Missing DHCP interface args\n");
+            }
+        }
+
+        ////// Disable DHCP Rapid Commit
+        for (n = 1; n < argc; n++) {
+            if (strstr(argv[n], "-norapidcommit") != NULL) { //Check for '-norapidcommit'
+                printf("-norapidcommit specified. DHCP clients will always get an offer first\n");
+                setDHCPRapidCommit(0);
+            }
+        }
+
+        ////// Extract DHCP lease file
+        for (n = 1; n < argc; n++) {
+            if (strstr(argv[n], "-dhcpleases") != NULL) { //Check for '-dhcpleases'
+                if (argc >= (n + 2)) {//now check that there is at least one more argument
+                    if (setDHCPLeaseFile(argv[n + 1]) == 0) printf("Supplied DHCP lease file: %s\n", argv[n + 1]);
+                } else printf("Missing DHCP lease file arg\n");
+            }
+        }
+
+        ////// Benchmark the DHCP lease pool, then exit
+        for (n = 1; n < argc; n++) {
+            if (strstr(argv[n], "-benchdhcppool") != NULL) { //Check for '-benchdhcppool'
+                int maxPoolSize = 65536;
+                if (argc >= (n + 2)) maxPoolSize = strtol(argv[n + 1], NULL, 10);
+                exit(benchmarkDHCPLeasePool(maxPoolSize) == 0 ? 0 : 1);
+            }
+        }
+
+        ////// Benchmark the DHCP server with synthetic clients on the loopback interface, then exit
+        for (n = 1; n < argc; n++) {
+            if (strstr(argv[n], "-benchdhcpserver") != NULL) { //Check for '-benchdhcpserver'
+                int maxPoolSize = 65536;
+                int noOfClients = 4096;
+                if (argc >= (n + 2)) maxPoolSize = strtol(argv[n + 1], NULL, 10);
+                if (argc >= (n + 3)) noOfClients = strtol(argv[n + 2], NULL, 10);
+                exit(benchmarkDHCPServer(maxPoolSize, noOfClients) == 0 ? 0 : 1);
+            }
+        }
+
+        ////// Benchmark read-write sessions against remount-per-write, then exit
+        for (n = 1; n < argc; n++) {
+            if (strstr(argv[n], "-benchremount") != NULL) { //Check for '-benchremount'
+                if (argc >= (n + 2)) {//now check that there is at least one more argument
+                    int iterations = 20;
+                    if (argc >= (n + 3)) iterations = strtol(argv[n + 2], NULL, 10);
+                    exit(benchmarkReadWriteSessions(argv[n + 1], iterations) == 0 ? 0 : 1);
+                } else printf("Missing mount point arg\n");
+            }
+        }
+
         ////// Extract usage/help
         for (n = 1; n < argc; n++) {
 
@@ -353,13 +458,29 @@ void main(int argc, char** argv) {
                 printf("\t-? or --help for this message\n");
 
                 printf("Options:\n--------\n");
-                printf("\t-udhcpc                  Use udhcpc (TinyCore) rather than dhclient (default) dhcp client\n");
+                printf("\t-udhcpc                  Use udhcpc (TinyCore) rather than the built-in dhcp client\n");
                 printf("\t-nogpio                  Disable setup mode switch input and status LED output\n");
                 printf("\t-gpi [pin] or -i [pin]   Specify  (native) gpi pin for mode switch (active low)\n");
                 printf("\t-gpo [pin] or -o [pin]   Specify  (native) gpo pin for status LED\n");                        
+                printf("\t-leds [name=pin,...]     Pins for more LEDs: link (wlan0 associated), mode (setup mode), dhcp (DHCP\n");
+                printf("\t\ttraffic) and error (couldn't change mode). e.g -leds link=24,mode=25,dhcp=26,error=27\n");
+                printf("\t-simgpio [script]        Simulate the gpio pins rather than using the hardware. Script drives the inputs\n");
+                printf("\t\t(e.g \"+5000,18=0,+3500,18=x\" holds the mode switch on gpio 18 for 3.5 sec after 5 sec. See gpioSim.c)\n");
+                printf("\t-dhcprange [first] [last] Addresses handed out in setup mode. (Default is 192.168.0.16 192.168.0.254)\n");
+                printf("\t-dhcpif [interface] [address] [netmask] [first] [last] Also run the DHCP server on another interface\n");
+                printf("\t\t(e.g -dhcpif usb0 192.168.7.1 255.255.255.0 192.168.7.16 192.168.7.254. Can be repeated)\n");
+                printf("\t-norapidcommit           Don't answer DHCP Rapid Commit (option 80) requests with an immediate ack\n");
+                printf("\t-dhcpleases [path/filename] File the DHCP leases are kept in, \"\" for none. (Default is /tmp/piconfigserver_dhcp.leases)\n");
+                printf("\nBenchmarks\n----------\n");
+                printf("\t-benchremount [mount point] [writes]   Time remount-per-write against read-write sessions\n");
+                printf("\t\t(mount point should be a scratch fs mounted read-only, e.g a loop-mounted image)\n");
+                printf("\t-benchdhcppool [max pool size]   Time DHCP lease allocation/lookup for pools of 3 up to max addresses\n");
+                printf("\t-benchdhcpserver [max pool size] [clients]   Time DORA/renew/release exchanges against the DHCP server on lo\n");
+                printf("\t\t(needs ports 67 and 68, so stop any other DHCP server/client first. Default 65536 4096)\n");
                 printf("\nSignals\n--------\n");
                 printf("\tUSR1: Set/Unset setup mode (mimics gpi button press. Tries hostapd mode, backs off to adhoc mode if unsuccesful.\n");
                 printf("\tUSR2: Get (display) current mode and other info.\n");
+                printf("\tHUP: Re-read the hostname (after it's been changed).\n");
                 printf("\t\te.g kill -s USR1 [pid] \n");
                 exit(1);
             }
@@ -428,6 +549,7 @@ void main(int argc, char** argv) {
     sigaddset(&sigsToCatch, SIGUSR1); //Add USR1 to our signal set
     sigaddset(&sigsToCatch, SIGUSR1); //Add USR1 to our signal set
     sigaddset(&sigsToCatch, SIGUSR2); //Add USR2 to our signal set
+    sigaddset(&sigsToCatch, SIGHUP); //Add HUP to our signal set
     sigaddset(&sigsToCatch, SIGKILL); //Add SIGKILL to our signal set
     sigaddset(&sigsToCatch, SIGTERM); //Add SIGTERM to our signal set
     sigaddset(&sigsToCatch, SIGINT); //Add SIGINT to our signal set
@@ -439,22 +561,9 @@ void main(int argc, char** argv) {
         switch (caught) { //Determine which of the messages has been received
             case SIGUSR1: //Put prog into setup mode
                 printf("SIGUSR1\n");
-                if (getSetupMode() == 0) {
-                    printf("Entering setup mode\n");
-                    printf("Configuring wlan0 in Host-AP mode\n");
-                    if (setSetupMode(2) < 1) { //Try to start (preferred) AP Host mode first
-                        printf("Couldn't start Host-AP setupMode\n"); //Couldn't start Host-AP mode
-                        if (setSetupMode(1) < 1) { //so try the adhoc AP mode instead
-                            printf("Couldn't start Adhoc-AP setupMode\n");
-                        }
-                    }
-
-                } else {//Or else, take it out of setup mode
-                    printf("Leaving setup mode\n");
-                    //printf("Reverting wlan0 in managed mode\n");
-                    if (setSetupMode(0) < 1) {
-                        printf("Couldn't stop setupMode\n");
-                    }
+                //Queued, so this loop is free to handle other signals while the mode changes
+                if (postModeCommand(MODE_TOGGLE) < 0) {
+                    printf("Couldn't queue setup mode change\n");
                 }
 
                 /////////////
@@ -469,6 +578,8 @@ void main(int argc, char** argv) {
 
                 unsigned int serialNo = getSerialNumber();
                 printf("Serial no: %x\n", serialNo);
+                const deviceIdentity *identity = getDeviceIdentity();
+                if (identity->model[0] != 0) printf("Model: %s (revision %x)\n", identity->model, identity->revision);
 
                 int mode = getSetupMode();
                 int httpListeningPort = getHTTPListeningPort();
@@ -489,7 +600,21 @@ void main(int argc, char** argv) {
                         break;
                 }
 
+                char transitionReport[FIELD] = {0};
+                if (printWlanTransitionReport(transitionReport, FIELD, "\n") > 0) printf("%s", transitionReport);
+                char processReport[FIELD] = {0};
+                if (printProcessSupervisorReport(processReport, FIELD, "\n") > 0) printf("%s", processReport);
+                char dhcpClientReport[FIELD] = {0};
+                if (printDHCPClientReport(dhcpClientReport, FIELD, "\n") > 0) printf("%s", dhcpClientReport);
 
+                break;
+            case SIGHUP: //Hostname changed. It's otherwise only read once (see deviceIdentity.c)
+                printf("SIGHUP\n");
+                if (refreshDeviceHostName() == 0) {
+                    char newHost[FIELD] = {0};
+                    getHostName(newHost, FIELD);
+                    printf("Host name now: %s\n", newHost);
+                }
                 break;
             case SIGKILL:
                 printf("SIGKILL: Stopping HttpConfigServer\n");
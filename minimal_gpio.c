@@ -47,6 +47,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include "minimal_gpio.h"
+#include "deviceIdentity.h"
 
 static volatile uint32_t  *gpioReg = MAP_FAILED;
 static volatile uint32_t  *systReg = MAP_FAILED;
@@ -132,58 +133,74 @@ unsigned gpioHardwareRevision(void)
    static unsigned rev = 0;
 
    FILE * filp;
-   char buf[512];
-   char term;
-   int chars=4; // number of chars in revision string 
+   const deviceIdentity *identity;
 
    if (rev) return rev;
 
    piModel = 0;
 
-   filp = fopen ("/proc/cpuinfo", "r");
+   /* /proc/cpuinfo is read once, by deviceIdentity.c */
+   identity = getDeviceIdentity();
 
-   if (filp != NULL)
+   if (strstr(identity->cpuModelName, "ARMv6") != NULL)
+   {
+      piModel = 1;
+      piPeriphBase = 0x20000000;
+      piBusAddr = 0x40000000;
+   }
+   else if ((strstr(identity->cpuModelName, "ARMv7") != NULL) ||
+            (strstr(identity->cpuModelName, "ARMv8") != NULL))
    {
-      while (fgets(buf, sizeof(buf), filp) != NULL)
+      piModel = 2;
+      piPeriphBase = 0x3F000000;
+      piBusAddr = 0xC0000000;
+   }
+
+   rev = identity->revision;
+
+   /* The model name can't tell a Pi 4 from a Pi 2/3 (both ARMv7 on a 32 bit OS), but
+      a new style revision code's processor field can */
+   if (rev & 0x800000)
+   {
+      switch ((rev >> 12) & 0xF)
       {
-         if (piModel == 0)
-         {
-            if (!strncasecmp("model name", buf, 10))
-            {
-               if (strstr (buf, "ARMv6") != NULL)
-               {
-                  piModel = 1;
-                  chars = 4;
-                  piPeriphBase = 0x20000000;
-                  piBusAddr = 0x40000000;
-               }
-               else if (strstr (buf, "ARMv7") != NULL)
-               {
-                  piModel = 2;
-                  chars = 6;
-                  piPeriphBase = 0x3F000000;
-                  piBusAddr = 0xC0000000;
-               }
-               else if (strstr (buf, "ARMv8") != NULL)
-               {
-                  piModel = 2;
-                  chars = 6;
-                  piPeriphBase = 0x3F000000;
-                  piBusAddr = 0xC0000000;
-               }
-            }
-         }
-
-         if (!strncasecmp("revision", buf, 8))
-         {
-            if (sscanf(buf+strlen(buf)-(chars+1),
-               "%x%c", &rev, &term) == 2)
-            {
-               if (term != '\n') rev = 0;
-            }
-         }
+         case 0: /* BCM2835 */
+            piModel = 1;
+            piPeriphBase = 0x20000000;
+            piBusAddr = 0x40000000;
+            break;
+         case 1: /* BCM2836 */
+         case 2: /* BCM2837 */
+            piModel = 2;
+            piPeriphBase = 0x3F000000;
+            piBusAddr = 0xC0000000;
+            break;
+         case 3: /* BCM2711 */
+            piModel = 4;
+            piPeriphBase = 0xFE000000;
+            piBusAddr = 0xC0000000;
+            break;
       }
+   }
+   else if (rev) /* Old style codes are all original (BCM2835) Pis */
+   {
+      piModel = 1;
+      piPeriphBase = 0x20000000;
+      piBusAddr = 0x40000000;
+   }
 
+   /* Best of all, the device tree says where the peripherals are: the parent (CPU) address in the
+      soc node's ranges. It's one cell on a Pi 1-3, two on a Pi 4 (first one 0) */
+   filp = fopen("/proc/device-tree/soc/ranges", "rb");
+   if (filp != NULL)
+   {
+      unsigned char ranges[12];
+      if (fread(ranges, 1, sizeof(ranges), filp) == sizeof(ranges))
+      {
+         uint32_t base = (ranges[4] << 24) | (ranges[5] << 16) | (ranges[6] << 8) | ranges[7];
+         if (base == 0) base = (ranges[8] << 24) | (ranges[9] << 16) | (ranges[10] << 8) | ranges[11];
+         if (base != 0) piPeriphBase = base;
+      }
       fclose(filp);
    }
    return rev;
@@ -210,7 +227,12 @@ int gpioInitialise(void)
 {
    int fd;
 
-   gpioHardwareRevision(); /* sets piModel, needed for peripherals address */
+   if (gpioHardwareRevision() == 0) /* sets piModel, needed for peripherals address */
+   {
+      /* Not a Pi. Mapping 'the GPIO registers' would scribble on whatever's at that address */
+      fprintf(stderr, "No Raspberry Pi revision code in /proc/cpuinfo\n");
+      return -1;
+   }
 
    fd = open("/dev/mem", O_RDWR | O_SYNC) ;
 
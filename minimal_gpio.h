@@ -96,6 +96,18 @@ static volatile uint32_t piBusAddr = 0x40000000;
 
 #define HIGH    1
 #define LOW    0
+
+int gpioInitialise(void);
+void gpioSetMode(unsigned gpio, unsigned mode);
+int gpioGetMode(unsigned gpio);
+void gpioSetPullUpDown(unsigned gpio, unsigned pud);
+int gpioRead(unsigned gpio);
+void gpioWrite(unsigned gpio, unsigned level);
+unsigned gpioHardwareRevision(void);
+void gpioClearBank1(uint32_t bits);
+void gpioClearBank2(uint32_t bits);
+void gpioSetBank1(uint32_t bits);
+void gpioSetBank2(uint32_t bits);
 //AND BEFORE HERE
 #endif /* MINIMAL_GPIO_H */
 
@@ -0,0 +1,212 @@
+/*
+ * Setup mode command queue
+ *
+ * Setup mode can be asked for from the button thread, the signal loop in main() and the http server thread,
+ * and each used to call setSetupMode() directly. Nothing stopped two of them doing so at once, and a mode change
+ * takes a while (hostapd, wpa_supplicant...), so a second button press or a web request part way through one
+ * would start another, or undo it.
+ *
+ * Now they all queue a command, and a single thread carries them out in order. It's the only thread that
+ * changes setup mode.
+ *      -The queue is a lock-free multiple producer, single consumer linked list (Dmitry Vyukov's intrusive MPSC
+ *       queue): queuing is an atomic exchange of the head and a store, so no caller ever blocks behind a mode
+ *       change in progress. The consumer sleeps on a sharedState until something's queued
+ *      -Everything queued by the time the consumer gets to it is one batch, and collapses into the single mode
+ *       it ends up asking for. If that's the mode we're already in, nothing is run
+ *      -A toggle queued while a transition was running is taken to be someone pressing again because nothing
+ *       seemed to be happening, not a request to undo it. It's answered with that transition's result
+ *      -Callers either fire and forget (postModeCommand()), or keep a reference to the command and wait for
+ *       its result (queueModeCommand() / waitModeCommand(), or runModeCommand() for both)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "modeCommandQueue.h"
+
+static modeCommand queueStub; //Always somewhere in the list, so it's never empty
+static modeCommand *_Atomic queueHead = &queueStub; //Most recently queued. Producers swap themselves in here
+static modeCommand *queueTail = &queueStub; //Next to be taken off. Consumer only
+static sharedState queueSignal = SHARED_STATE_INITIALIZER(0); //Set to 1 after each command is queued
+static sharedState queueRunning = SHARED_STATE_INITIALIZER(0);
+static _Atomic uint32_t runningTransition = 0; //No. of the transition in progress, 0 if none
+static pthread_t modeCommandThreadId;
+static modeApplyFunction applyMode = NULL;
+static modeQueryFunction queryMode = NULL;
+
+const char *modeToString(int mode) {
+    switch (mode) {
+        case MODE_NORMAL: return "normal";
+        case MODE_ADHOC: return "ad-hoc AP";
+        case MODE_HOSTAP: return "hostAP";
+        case MODE_SETUP: return "setup";
+        case MODE_TOGGLE: return "toggle";
+        default: return "unknown";
+    }
+}
+
+static void pushModeCommand(modeCommand *command) {
+    //Any thread
+    atomic_store_explicit(&command->next, NULL, memory_order_relaxed);
+    modeCommand *previous = atomic_exchange_explicit(&queueHead, command, memory_order_acq_rel);
+    atomic_store_explicit(&previous->next, command, memory_order_release); //Until this, the consumer can't see it
+}
+
+static modeCommand *popModeCommand(void) {
+    /*
+     * Consumer only. Returns the oldest command, or NULL if there isn't one (or a producer is half way through
+     * queuing it, in which case its signal will follow)
+     */
+    modeCommand *tail = queueTail;
+    modeCommand *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (tail == &queueStub) { //Skip over the stub
+        if (next == NULL) return NULL;
+        queueTail = next;
+        tail = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+    if (next != NULL) {
+        queueTail = next;
+        return tail;
+    }
+    if (tail != atomic_load_explicit(&queueHead, memory_order_acquire)) return NULL; //Half queued
+    pushModeCommand(&queueStub); //tail is the last one. Put the stub behind it so it can be taken
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next != NULL) {
+        queueTail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+void releaseModeCommand(modeCommand *command) {
+    //Drops a reference. The command's freed once neither the queue nor the caller has one
+    if (command == NULL) return;
+    if (atomic_fetch_sub(&command->references, 1) == 1) free(command);
+}
+
+static int isModeChange(int target, int current) {
+    if (target == MODE_SETUP) return current == MODE_NORMAL; //Either AP mode will do
+    return target != current;
+}
+
+static void *modeCommandThread(void *arg) {
+    /*
+     * PThread: Takes each batch of queued commands, works out the mode they add up to, and changes to it
+     */
+    uint32_t transitions = 0;
+    uint32_t lastTransition = 0; //No. of the last transition run, and how it went
+    int lastResult = MODE_COMMAND_DONE;
+    for (;;) {
+        setSharedState(&queueSignal, 0); //Before looking, so anything queued from here on sets it again
+        modeCommand *batch = NULL, *batchEnd = NULL;
+        int current = queryMode();
+        int target = current;
+        modeCommand *command;
+        while ((command = popModeCommand()) != NULL) {
+            atomic_store_explicit(&command->next, NULL, memory_order_relaxed); //Now links the batch
+            if (batchEnd == NULL) batch = command;
+            else atomic_store_explicit(&batchEnd->next, command, memory_order_relaxed);
+            batchEnd = command;
+
+            if ((command->mode == MODE_TOGGLE) && (command->overlapped != 0) && (command->overlapped == lastTransition)) {
+                command->coalesced = 1; //Pressed again while it was changing
+                continue;
+            }
+            if (command->mode == MODE_TOGGLE) target = (target == MODE_NORMAL) ? MODE_SETUP : MODE_NORMAL;
+            else target = command->mode;
+        }
+        if (batch == NULL) {
+            waitSharedStateChange(&queueSignal, 0, -1);
+            continue;
+        }
+
+        int previousResult = lastResult; //What the coalesced ones get
+        int result = MODE_COMMAND_DONE;
+        if (isModeChange(target, current)) {
+            printf("modeCommandThread(): Changing from %s to %s mode\n", modeToString(current), modeToString(target));
+            if (++transitions == 0) transitions = 1; //0 means none
+            atomic_store(&runningTransition, transitions);
+            result = (applyMode(target) > 0) ? MODE_COMMAND_DONE : MODE_COMMAND_FAILED;
+            atomic_store(&runningTransition, 0);
+            lastTransition = transitions;
+            lastResult = result;
+        } else printf("modeCommandThread(): Already in %s mode, nothing to do\n", modeToString(current));
+
+        while (batch != NULL) {
+            command = batch;
+            batch = atomic_load_explicit(&command->next, memory_order_relaxed);
+            setSharedState(&command->result, command->coalesced ? previousResult : result);
+            releaseModeCommand(command); //The queue's reference
+        }
+    }
+    return NULL;
+}
+
+int startModeCommandQueue(modeApplyFunction apply, modeQueryFunction query) {
+    /*
+     * Starts the thread that carries out mode commands. apply() is called on it to change mode, query() to
+     * find out what mode we're in. Returns 0 on success (or if it's already running), -1 on failure
+     */
+    if ((apply == NULL) || (query == NULL)) return -1;
+    if (compareAndSetSharedState(&queueRunning, 0, 1) == 0) return 0;
+    applyMode = apply;
+    queryMode = query;
+    if (pthread_create(&modeCommandThreadId, NULL, modeCommandThread, NULL)) {
+        printf("startModeCommandQueue(): Error creating mode command thread.\n");
+        setSharedState(&queueRunning, 0);
+        return -1;
+    }
+    return 0;
+}
+
+int isModeCommandQueueRunning(void) {
+    return getSharedState(&queueRunning);
+}
+
+modeCommand *queueModeCommand(int mode) {
+    /*
+     * Queues a request for mode (MODE_NORMAL etc.) and returns straight away. Wait for the result with
+     * waitModeCommand(), then releaseModeCommand() it.
+     * Returns NULL if the queue isn't running or the mode isn't valid
+     */
+    if ((mode < MODE_NORMAL) || (mode > MODE_TOGGLE) || (!isModeCommandQueueRunning())) return NULL;
+    modeCommand *command = (modeCommand *) calloc(1, sizeof (modeCommand));
+    if (command == NULL) {
+        perror("queueModeCommand(): calloc()");
+        return NULL;
+    }
+    command->mode = mode;
+    command->overlapped = atomic_load(&runningTransition);
+    atomic_init(&command->references, 2); //Queue + caller
+    initSharedState(&command->result, MODE_COMMAND_PENDING);
+    pushModeCommand(command);
+    setSharedState(&queueSignal, 1); //Wake the consumer
+    return command;
+}
+
+int postModeCommand(int mode) {
+    //Fire and forget. Returns 0 if queued, -1 if not
+    modeCommand *command = queueModeCommand(mode);
+    if (command == NULL) return -1;
+    releaseModeCommand(command);
+    return 0;
+}
+
+int waitModeCommand(modeCommand *command, int timeoutMs) {
+    /*
+     * Waits (timeoutMs = -1 for as long as it takes) for a queued command to be carried out.
+     * Returns MODE_COMMAND_DONE, MODE_COMMAND_FAILED, or MODE_COMMAND_PENDING if it timed out
+     */
+    if (command == NULL) return MODE_COMMAND_FAILED;
+    return waitSharedStateChange(&command->result, MODE_COMMAND_PENDING, timeoutMs);
+}
+
+int runModeCommand(int mode, int timeoutMs) {
+    //Queues mode and waits for it. Returns as waitModeCommand(), or MODE_COMMAND_FAILED if it couldn't be queued
+    modeCommand *command = queueModeCommand(mode);
+    if (command == NULL) return MODE_COMMAND_FAILED;
+    int result = waitModeCommand(command, timeoutMs);
+    releaseModeCommand(command);
+    return result;
+}
@@ -0,0 +1,68 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   modeCommandQueue.h
+ *
+ * Queue of requests to change setup mode, run one at a time on a thread of its own (see modeCommandQueue.c)
+ */
+
+#ifndef MODECOMMANDQUEUE_H
+#define MODECOMMANDQUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "modeCommandQueue.h" TO THE SOURCE FILE
+
+#include <stdint.h>
+#include "sharedState.h"
+
+//Modes that can be requested. 0-2 are the values of setupMode
+#define MODE_NORMAL 0
+#define MODE_ADHOC 1
+#define MODE_HOSTAP 2
+#define MODE_SETUP 3    //Either access point mode (hostAP, or ad-hoc if that fails)
+#define MODE_TOGGLE 4   //MODE_SETUP if in normal mode, else MODE_NORMAL. What the button and SIGUSR1 ask for
+
+//Result of a command
+#define MODE_COMMAND_PENDING 0
+#define MODE_COMMAND_DONE 1
+#define MODE_COMMAND_FAILED -1
+
+typedef int (*modeApplyFunction)(int mode); //Changes mode (never MODE_TOGGLE). Returns 1 on success, -1 on failure
+typedef int (*modeQueryFunction)(void); //Returns the current mode (0-2)
+
+typedef struct modeCommand {
+    struct modeCommand *_Atomic next;
+    int mode; //MODE_NORMAL etc.
+    uint32_t overlapped; //No. of the transition that was running when this was queued, 0 if none
+    int coalesced; //1 if it was a repeat of that transition, so was answered with its result
+    _Atomic int references; //The queue's, plus the caller's if it wants the result
+    sharedState result; //MODE_COMMAND_PENDING until it's been carried out
+} modeCommand;
+
+int startModeCommandQueue(modeApplyFunction apply, modeQueryFunction query);
+int isModeCommandQueueRunning(void);
+int postModeCommand(int mode);
+modeCommand *queueModeCommand(int mode);
+int waitModeCommand(modeCommand *command, int timeoutMs);
+void releaseModeCommand(modeCommand *command);
+int runModeCommand(int mode, int timeoutMs);
+const char *modeToString(int mode);
+
+//AND BEFORE HERE
+#endif /* MODECOMMANDQUEUE_H */
+
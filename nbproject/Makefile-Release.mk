@@ -35,12 +35,31 @@ OBJECTDIR=${CND_BUILDDIR}/${CND_CONF}/${CND_PLATFORM}
 
 # Object Files
 OBJECTFILES= \
+	${OBJECTDIR}/buttonGestures.o \
+	${OBJECTDIR}/configSnapshots.o \
+	${OBJECTDIR}/deviceIdentity.o \
+	${OBJECTDIR}/dhcpClient.o \
+	${OBJECTDIR}/dhcpLeasePool.o \
+	${OBJECTDIR}/dhcpOptions.o \
 	${OBJECTDIR}/dhcpServer2.o \
+	${OBJECTDIR}/fileSystemTools.o \
 	${OBJECTDIR}/getch_2.o \
+	${OBJECTDIR}/gpioBackend.o \
+	${OBJECTDIR}/gpioChip.o \
+	${OBJECTDIR}/gpioSim.o \
 	${OBJECTDIR}/httpConfigServer.o \
 	${OBJECTDIR}/iptools2.3.o \
+	${OBJECTDIR}/knownNetworks.o \
+	${OBJECTDIR}/ledPatterns.o \
 	${OBJECTDIR}/main.o \
-	${OBJECTDIR}/minimal_gpio.o
+	${OBJECTDIR}/minimal_gpio.o \
+	${OBJECTDIR}/modeCommandQueue.o \
+	${OBJECTDIR}/processSupervisor.o \
+	${OBJECTDIR}/routeTable.o \
+	${OBJECTDIR}/sharedState.o \
+	${OBJECTDIR}/taskScheduler.o \
+	${OBJECTDIR}/timerWheel.o \
+	${OBJECTDIR}/wlanTransition.o
 
 
 # C Compiler Flags
@@ -97,6 +116,101 @@ ${OBJECTDIR}/minimal_gpio.o: minimal_gpio.c
 	${RM} "$@.d"
 	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/minimal_gpio.o minimal_gpio.c
 
+${OBJECTDIR}/fileSystemTools.o: fileSystemTools.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/fileSystemTools.o fileSystemTools.c
+
+${OBJECTDIR}/configSnapshots.o: configSnapshots.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/configSnapshots.o configSnapshots.c
+
+${OBJECTDIR}/knownNetworks.o: knownNetworks.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/knownNetworks.o knownNetworks.c
+
+${OBJECTDIR}/dhcpLeasePool.o: dhcpLeasePool.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/dhcpLeasePool.o dhcpLeasePool.c
+
+${OBJECTDIR}/timerWheel.o: timerWheel.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/timerWheel.o timerWheel.c
+
+${OBJECTDIR}/dhcpOptions.o: dhcpOptions.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/dhcpOptions.o dhcpOptions.c
+
+${OBJECTDIR}/sharedState.o: sharedState.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/sharedState.o sharedState.c
+
+${OBJECTDIR}/taskScheduler.o: taskScheduler.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/taskScheduler.o taskScheduler.c
+
+${OBJECTDIR}/buttonGestures.o: buttonGestures.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/buttonGestures.o buttonGestures.c
+
+${OBJECTDIR}/gpioChip.o: gpioChip.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/gpioChip.o gpioChip.c
+
+${OBJECTDIR}/gpioBackend.o: gpioBackend.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/gpioBackend.o gpioBackend.c
+
+${OBJECTDIR}/gpioSim.o: gpioSim.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/gpioSim.o gpioSim.c
+
+${OBJECTDIR}/ledPatterns.o: ledPatterns.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/ledPatterns.o ledPatterns.c
+
+${OBJECTDIR}/wlanTransition.o: wlanTransition.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/wlanTransition.o wlanTransition.c
+
+${OBJECTDIR}/modeCommandQueue.o: modeCommandQueue.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/modeCommandQueue.o modeCommandQueue.c
+
+${OBJECTDIR}/deviceIdentity.o: deviceIdentity.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/deviceIdentity.o deviceIdentity.c
+
+${OBJECTDIR}/routeTable.o: routeTable.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/routeTable.o routeTable.c
+
+${OBJECTDIR}/processSupervisor.o: processSupervisor.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/processSupervisor.o processSupervisor.c
+
+${OBJECTDIR}/dhcpClient.o: dhcpClient.c 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -std=c99 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/dhcpClient.o dhcpClient.c
+
 # Subprojects
 .build-subprojects:
 
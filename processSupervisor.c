@@ -0,0 +1,495 @@
+/*
+ * Process supervisor
+ *
+ * wpa_supplicant, hostapd and the dhcp clients used to be started with system("... &") or 'wpa_supplicant -B',
+ * and found again afterwards with 'ps x | grep ... | awk' (three or four processes each time). Nothing ever
+ * waited for them: renewDHCPLeases() left its dhclients as zombies, a second start left two daemons running
+ * on the same interface, and a daemon that crashed wasn't noticed until someone looked.
+ *
+ * Now each one is started here, by name (e.g "wpa_supplicant.wlan0"), in the foreground:
+ *      -posix_spawnp() starts it, with the signals main() blocks unblocked again, stdin on /dev/null and in its
+ *       own process group (so a ^C at the terminal doesn't take wpa_supplicant down with us)
+ *      -We keep a pidfd for it (pidfd_open(2)), which goes readable when it exits. One thread sleeps in
+ *       epoll_wait() on all of them, reaps whichever has exited and, if it's a daemon, restarts it after
+ *       1s, 2s, 4s... up to a minute while it keeps dying. The backoff goes back to 1s once it's stayed up
+ *       for 30s
+ *      -Starting a name that's already running stops the old one first, so there's only ever one
+ *      -Its pid, state, uptime and restart count are a lookup (getSupervisedProcessInfo())
+ *
+ * Kernels before 5.3 have no pidfd_open(). There, the thread just checks on the children every 500mS.
+ *
+ * Stopping a process (stopSupervisedProcess()) sends SIGTERM, and SIGKILL if it's still there killAfterMs
+ * later. Processes someone else started (e.g the wpa_supplicant the OS starts at boot) can be found with
+ * findProcessPid(), which reads /proc rather than running ps.
+ */
+
+#define _GNU_SOURCE //syscall(), kill(), environ
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <spawn.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include "sharedState.h"
+#include "taskScheduler.h"
+#include "processSupervisor.h"
+
+#define SUPERVISOR_BACKOFF_MIN_MS 1000
+#define SUPERVISOR_BACKOFF_MAX_MS 60000
+#define SUPERVISOR_STABLE_MS 30000 //Up this long and the backoff starts again from SUPERVISOR_BACKOFF_MIN_MS
+#define SUPERVISOR_POLL_MS 500 //How often children are checked on without pidfds
+#define SUPERVISOR_STOP_MS 2000 //How long a running process gets to exit, when it's started again
+
+typedef struct {
+    int inUse;
+    char name[SUPERVISOR_NAME_LENGTH];
+    char arguments[SUPERVISOR_ARGS_LENGTH];
+    char *argv[SUPERVISOR_MAX_ARGS + 1]; //Point into arguments[]
+    int restartPolicy;
+    sharedState state; //PROCESS_RUNNING etc. Can be waited on
+    int pid;
+    int pidfd; //-1 if none
+    uint64_t startedMs;
+    uint64_t killAtMs; //When stopping: when it gets SIGKILL
+    uint64_t restartAtMs; //When waiting to restart
+    uint32_t backoffMs;
+    int restarts;
+    int exitStatus;
+} supervisedProcess;
+
+static supervisedProcess processes[SUPERVISOR_MAX_PROCESSES];
+static pthread_mutex_t supervisorMutex = PTHREAD_MUTEX_INITIALIZER; //Guards processes[]
+static pthread_once_t supervisorOnce = PTHREAD_ONCE_INIT;
+static int supervisorStarted = 0;
+static int epollFd = -1;
+static int wakeFd = -1; //eventfd. Wakes the thread to look at processes[] again
+static pthread_t supervisorThreadId;
+
+const char *processStateToString(int state) {
+    switch (state) {
+        case PROCESS_STOPPED: return "stopped";
+        case PROCESS_RUNNING: return "running";
+        case PROCESS_STOPPING: return "stopping";
+        case PROCESS_BACKOFF: return "waiting to restart";
+        case PROCESS_EXITED: return "exited";
+        case PROCESS_FAILED: return "failed to start";
+        default: return "unknown";
+    }
+}
+
+static void wakeSupervisor(void) {
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof (one)) < 0) perror("wakeSupervisor(): write()");
+}
+
+static supervisedProcess *findProcess(const char *name) {
+    //supervisorMutex held
+    int n;
+    for (n = 0; n < SUPERVISOR_MAX_PROCESSES; n++)
+        if ((processes[n].inUse) && (strcmp(processes[n].name, name) == 0)) return &processes[n];
+    return NULL;
+}
+
+static int spawnProcess(supervisedProcess *process) {
+    /*
+     * supervisorMutex held. Starts the process and watches its pidfd.
+     * Returns 0 on success, -1 if it couldn't be started
+     */
+    posix_spawnattr_t attributes;
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_init(&attributes);
+    posix_spawn_file_actions_init(&actions);
+    sigset_t noSignals, defaultSignals;
+    sigemptyset(&noSignals); //main() blocks these for sigwait(). Children shouldn't inherit that
+    sigemptyset(&defaultSignals);
+    sigaddset(&defaultSignals, SIGTERM);
+    sigaddset(&defaultSignals, SIGINT);
+    sigaddset(&defaultSignals, SIGHUP);
+    sigaddset(&defaultSignals, SIGUSR1);
+    sigaddset(&defaultSignals, SIGUSR2);
+    sigaddset(&defaultSignals, SIGPIPE); //Ignored by the http server
+    posix_spawnattr_setsigmask(&attributes, &noSignals);
+    posix_spawnattr_setsigdefault(&attributes, &defaultSignals);
+    posix_spawnattr_setpgroup(&attributes, 0);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 34)
+    posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1); //Not the http server's sockets
+#endif
+    pid_t pid;
+    int ret = posix_spawnp(&pid, process->argv[0], &actions, &attributes, process->argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+    if (ret != 0) {
+        printf("spawnProcess(): Couldn't start %s (%s): %s\n", process->name, process->argv[0], strerror(ret));
+        process->pid = 0;
+        setSharedState(&process->state, PROCESS_FAILED);
+        return -1;
+    }
+    process->pid = pid;
+    process->startedMs = getSchedulerTimeMs();
+    process->pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (process->pidfd >= 0) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof (event));
+        event.events = EPOLLIN;
+        event.data.fd = process->pidfd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, process->pidfd, &event) < 0) {
+            perror("spawnProcess(): epoll_ctl()");
+            close(process->pidfd);
+            process->pidfd = -1;
+        }
+    }
+    printf("spawnProcess(): Started %s, pid %d\n", process->name, pid);
+    setSharedState(&process->state, PROCESS_RUNNING);
+    return 0;
+}
+
+static void processExited(supervisedProcess *process, int status, uint64_t now) {
+    //supervisorMutex held. Decides what happens next
+    if (process->pidfd >= 0) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, process->pidfd, NULL);
+        close(process->pidfd);
+        process->pidfd = -1;
+    }
+    process->exitStatus = status;
+    process->pid = 0;
+    if (WIFSIGNALED(status)) printf("processExited(): %s killed by signal %d\n", process->name, WTERMSIG(status));
+    else printf("processExited(): %s exited with status %d\n", process->name, WEXITSTATUS(status));
+
+    if ((getSharedState(&process->state) == PROCESS_STOPPING) || (process->restartPolicy == PROCESS_RESTART_NEVER)) {
+        setSharedState(&process->state, (getSharedState(&process->state) == PROCESS_STOPPING) ? PROCESS_STOPPED : PROCESS_EXITED);
+        return;
+    }
+    if (now - process->startedMs >= SUPERVISOR_STABLE_MS) process->backoffMs = SUPERVISOR_BACKOFF_MIN_MS;
+    else if (process->backoffMs == 0) process->backoffMs = SUPERVISOR_BACKOFF_MIN_MS;
+    else if ((process->backoffMs *= 2) > SUPERVISOR_BACKOFF_MAX_MS) process->backoffMs = SUPERVISOR_BACKOFF_MAX_MS;
+    process->restartAtMs = now + process->backoffMs;
+    printf("processExited(): Restarting %s in %u mS\n", process->name, process->backoffMs);
+    setSharedState(&process->state, PROCESS_BACKOFF);
+}
+
+static int checkProcesses(void) {
+    /*
+     * supervisorMutex held. Reaps whatever's exited, sends SIGKILL to anything that's had long enough to stop,
+     * and restarts anything that's due.
+     * Returns how long (mS) epoll_wait() can sleep for before it needs to be called again (-1 for as long as it likes)
+     */
+    uint64_t now = getSchedulerTimeMs();
+    uint64_t nextMs = 0; //Soonest deadline. 0 for none
+    int polling = 0;
+    int n;
+    for (n = 0; n < SUPERVISOR_MAX_PROCESSES; n++) {
+        supervisedProcess *process = &processes[n];
+        if (!process->inUse) continue;
+        int state = getSharedState(&process->state);
+        if ((state == PROCESS_RUNNING) || (state == PROCESS_STOPPING)) {
+            int status;
+            int ret = waitpid(process->pid, &status, WNOHANG);
+            if ((ret == process->pid) || ((ret < 0) && (errno == ECHILD))) {
+                processExited(process, (ret < 0) ? -1 : status, now);
+                state = getSharedState(&process->state);
+            } else if ((state == PROCESS_STOPPING) && (now >= process->killAtMs)) {
+                printf("checkProcesses(): %s hasn't stopped. Killing pid %d\n", process->name, process->pid);
+                kill(process->pid, SIGKILL);
+                process->killAtMs = (uint64_t) - 1;
+            }
+        }
+        if ((state == PROCESS_BACKOFF) && (now >= process->restartAtMs)) {
+            process->restarts++;
+            spawnProcess(process);
+            state = getSharedState(&process->state);
+        }
+        //When to look again
+        uint64_t deadline = 0;
+        if (state == PROCESS_BACKOFF) deadline = process->restartAtMs;
+        if ((state == PROCESS_STOPPING) && (process->killAtMs != (uint64_t) - 1)) deadline = process->killAtMs;
+        if ((deadline != 0) && ((nextMs == 0) || (deadline < nextMs))) nextMs = deadline;
+        if (((state == PROCESS_RUNNING) || (state == PROCESS_STOPPING)) && (process->pidfd < 0)) polling = 1;
+    }
+    int timeoutMs = -1;
+    if (nextMs != 0) timeoutMs = (nextMs > now) ? (int) (nextMs - now) : 0;
+    if ((polling) && ((timeoutMs < 0) || (timeoutMs > SUPERVISOR_POLL_MS))) timeoutMs = SUPERVISOR_POLL_MS;
+    return timeoutMs;
+}
+
+static void *supervisorThread(void *arg) {
+    /*
+     * PThread: Sleeps until a child exits (its pidfd goes readable), something's due, or we're woken
+     */
+    (void) arg;
+    struct epoll_event events[SUPERVISOR_MAX_PROCESSES + 1];
+    for (;;) {
+        pthread_mutex_lock(&supervisorMutex);
+        int timeoutMs = checkProcesses();
+        pthread_mutex_unlock(&supervisorMutex);
+        int count = epoll_wait(epollFd, events, SUPERVISOR_MAX_PROCESSES + 1, timeoutMs);
+        if ((count < 0) && (errno != EINTR)) {
+            perror("supervisorThread(): epoll_wait()");
+            usleep(SUPERVISOR_POLL_MS * 1000);
+        }
+        int n;
+        for (n = 0; n < count; n++) {
+            if (events[n].data.fd == wakeFd) {
+                uint64_t value;
+                if (read(wakeFd, &value, sizeof (value)) < 0) perror("supervisorThread(): read()");
+            }
+        }
+        //pidfds are taken out of the set as their processes are reaped, so there's nothing to read from them
+    }
+    return NULL;
+}
+
+static void initProcessSupervisor(void) {
+    //Once only (pthread_once())
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if ((epollFd < 0) || (wakeFd < 0)) {
+        perror("initProcessSupervisor()");
+        return;
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof (event));
+    event.events = EPOLLIN;
+    event.data.fd = wakeFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) < 0) {
+        perror("initProcessSupervisor(): epoll_ctl()");
+        return;
+    }
+    int n;
+    for (n = 0; n < SUPERVISOR_MAX_PROCESSES; n++) {
+        initSharedState(&processes[n].state, PROCESS_STOPPED);
+        processes[n].pidfd = -1;
+    }
+    if (pthread_create(&supervisorThreadId, NULL, supervisorThread, NULL)) {
+        printf("initProcessSupervisor(): Error creating supervisor thread.\n");
+        return;
+    }
+    supervisorStarted = 1;
+}
+
+int startProcessSupervisor(void) {
+    //Starts the supervisor thread, if it isn't already. superviseProcess() calls it. Returns 0 on success, -1 on failure
+    pthread_once(&supervisorOnce, initProcessSupervisor);
+    return supervisorStarted ? 0 : -1;
+}
+
+int superviseProcess(const char *name, char *const argv[], int restartPolicy) {
+    /*
+     * Starts argv[0] (searched for on the PATH if it has no '/') with arguments argv[] (NULL terminated), under
+     * the given name. If a process of that name is already running, it's stopped first.
+     * It must stay in the foreground (e.g wpa_supplicant without -B, dhclient -d) to be watched.
+     * Returns its pid, or -1 if it couldn't be started
+     */
+    if ((name == NULL) || (argv == NULL) || (argv[0] == NULL) || (startProcessSupervisor() < 0)) return -1;
+    if (waitSupervisedProcess(name, 0) == 0) { //Still running
+        stopSupervisedProcess(name, SUPERVISOR_STOP_MS);
+        if (waitSupervisedProcess(name, SUPERVISOR_STOP_MS + 1000) == 0) {
+            printf("superviseProcess(): Couldn't stop the running %s\n", name);
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&supervisorMutex);
+    supervisedProcess *process = findProcess(name);
+    int n;
+    for (n = 0; (process == NULL) && (n < SUPERVISOR_MAX_PROCESSES); n++) {
+        if (!processes[n].inUse) {
+            process = &processes[n];
+            process->inUse = 1;
+            strncpy(process->name, name, SUPERVISOR_NAME_LENGTH - 1);
+            process->name[SUPERVISOR_NAME_LENGTH - 1] = 0;
+            process->restarts = 0;
+            process->exitStatus = -1;
+        }
+    }
+    if (process == NULL) {
+        pthread_mutex_unlock(&supervisorMutex);
+        printf("superviseProcess(): No room for %s. Already supervising %d processes\n", name, SUPERVISOR_MAX_PROCESSES);
+        return -1;
+    }
+    //Copy the arguments
+    int used = 0;
+    for (n = 0; (argv[n] != NULL) && (n < SUPERVISOR_MAX_ARGS); n++) {
+        int length = strlen(argv[n]) + 1;
+        if (used + length > SUPERVISOR_ARGS_LENGTH) break;
+        memcpy(process->arguments + used, argv[n], length);
+        process->argv[n] = process->arguments + used;
+        used += length;
+    }
+    process->argv[n] = NULL;
+    if (argv[n] != NULL) printf("superviseProcess(): Too many/too long arguments for %s. Truncated\n", name);
+    process->restartPolicy = restartPolicy;
+    process->backoffMs = 0;
+    int pid = (spawnProcess(process) == 0) ? process->pid : -1;
+    pthread_mutex_unlock(&supervisorMutex);
+    wakeSupervisor(); //Might need to poll it
+    return pid;
+}
+
+int stopSupervisedProcess(const char *name, uint32_t killAfterMs) {
+    /*
+     * Stops a process and doesn't restart it: SIGTERM now, then SIGKILL if it's still running killAfterMs later
+     * (straight away if killAfterMs = 0). Doesn't wait (see waitSupervisedProcess()).
+     * Returns its pid, or 0 if it wasn't running
+     */
+    if (startProcessSupervisor() < 0) return 0;
+    pthread_mutex_lock(&supervisorMutex);
+    supervisedProcess *process = findProcess(name);
+    int pid = 0;
+    if (process != NULL) {
+        int state = getSharedState(&process->state);
+        if ((state == PROCESS_RUNNING) || (state == PROCESS_STOPPING)) {
+            pid = process->pid;
+            uint64_t killAtMs = getSchedulerTimeMs() + killAfterMs;
+            if ((state == PROCESS_RUNNING) || (killAtMs < process->killAtMs)) process->killAtMs = killAtMs;
+            setSharedState(&process->state, PROCESS_STOPPING);
+            kill(pid, (killAfterMs == 0) ? SIGKILL : SIGTERM);
+        } else if (state == PROCESS_BACKOFF) setSharedState(&process->state, PROCESS_STOPPED); //Just don't restart it
+    }
+    pthread_mutex_unlock(&supervisorMutex);
+    if (pid > 0) wakeSupervisor();
+    return pid;
+}
+
+int waitSupervisedProcess(const char *name, int timeoutMs) {
+    /*
+     * Waits (timeoutMs = -1 for as long as it takes) until the process isn't running.
+     * Returns 1 once it isn't (or if there's no such process), 0 if it still is
+     */
+    if (startProcessSupervisor() < 0) return 1;
+    pthread_mutex_lock(&supervisorMutex);
+    supervisedProcess *process = findProcess(name);
+    pthread_mutex_unlock(&supervisorMutex); //Entries are never removed, so process stays valid
+    if (process == NULL) return 1;
+    uint64_t deadline = getSchedulerTimeMs() + ((timeoutMs > 0) ? timeoutMs : 0);
+    int state = getSharedState(&process->state);
+    while ((state == PROCESS_RUNNING) || (state == PROCESS_STOPPING)) {
+        int remaining = -1;
+        if (timeoutMs >= 0) {
+            uint64_t now = getSchedulerTimeMs();
+            if (now >= deadline) return 0;
+            remaining = deadline - now;
+        }
+        state = waitSharedStateChange(&process->state, state, remaining);
+    }
+    return 1;
+}
+
+int getSupervisedProcessInfo(const char *name, supervisedProcessInfo *info) {
+    //Fills in info for the named process. Returns 0, or -1 if there's no process of that name
+    memset(info, 0, sizeof (supervisedProcessInfo));
+    if (startProcessSupervisor() < 0) return -1;
+    pthread_mutex_lock(&supervisorMutex);
+    supervisedProcess *process = findProcess(name);
+    if (process != NULL) {
+        uint64_t now = getSchedulerTimeMs();
+        strcpy(info->name, process->name);
+        info->state = getSharedState(&process->state);
+        info->pid = process->pid;
+        if (process->pid > 0) info->uptimeMs = now - process->startedMs;
+        info->restarts = process->restarts;
+        info->exitStatus = process->exitStatus;
+        if ((info->state == PROCESS_BACKOFF) && (process->restartAtMs > now)) info->restartInMs = process->restartAtMs - now;
+    }
+    pthread_mutex_unlock(&supervisorMutex);
+    return (process != NULL) ? 0 : -1;
+}
+
+int getSupervisedPid(const char *name) {
+    //The pid of the named process, or 0 if it isn't running
+    supervisedProcessInfo info;
+    if (getSupervisedProcessInfo(name, &info) < 0) return 0;
+    return info.pid;
+}
+
+int printProcessSupervisorReport(char output[], int outputLength, const char *lineEnd) {
+    /*
+     * Writes one line per supervised process into output[] (state, pid, uptime, restarts, how it last exited),
+     * each ended with lineEnd ("\n", or "<br>" for the status page).
+     * Returns the no. of chars written, 0 if nothing's been started
+     */
+    if (outputLength < 1) return 0;
+    output[0] = 0;
+    if (startProcessSupervisor() < 0) return 0;
+    char names[SUPERVISOR_MAX_PROCESSES][SUPERVISOR_NAME_LENGTH];
+    int count = 0, n;
+    pthread_mutex_lock(&supervisorMutex);
+    for (n = 0; n < SUPERVISOR_MAX_PROCESSES; n++)
+        if (processes[n].inUse) strcpy(names[count++], processes[n].name);
+    pthread_mutex_unlock(&supervisorMutex);
+    if (count == 0) return 0;
+
+    int length = snprintf(output, outputLength, "Supervised processes:%s", lineEnd);
+    for (n = 0; (n < count) && (length < outputLength); n++) {
+        supervisedProcessInfo info;
+        if (getSupervisedProcessInfo(names[n], &info) < 0) continue;
+        length += snprintf(output + length, outputLength - length, "    %s: %s", info.name, processStateToString(info.state));
+        if ((info.pid > 0) && (length < outputLength))
+            length += snprintf(output + length, outputLength - length, ", pid %d, up %u s", info.pid, info.uptimeMs / 1000);
+        if ((info.state == PROCESS_BACKOFF) && (length < outputLength))
+            length += snprintf(output + length, outputLength - length, " (in %u mS)", info.restartInMs);
+        if ((info.restarts > 0) && (length < outputLength))
+            length += snprintf(output + length, outputLength - length, ", %d restart%s", info.restarts, (info.restarts == 1) ? "" : "s");
+        if ((info.exitStatus != -1) && (length < outputLength)) {
+            if (WIFSIGNALED(info.exitStatus))
+                length += snprintf(output + length, outputLength - length, ", last killed by signal %d", WTERMSIG(info.exitStatus));
+            else
+                length += snprintf(output + length, outputLength - length, ", last exit status %d", WEXITSTATUS(info.exitStatus));
+        }
+        if (length < outputLength) length += snprintf(output + length, outputLength - length, "%s", lineEnd);
+    }
+    return (length < outputLength) ? length : outputLength - 1;
+}
+
+int findProcessPid(const char *program, const char *argument) {
+    /*
+     * Finds a process we didn't start, by reading /proc/<pid>/cmdline. program is matched against the start of
+     * the file name of its argv[0] (so "wpa_supp" finds wpa_supplicant). If argument isn't NULL, one of its
+     * arguments must contain it too (e.g "wlan0" matches "-iwlan0").
+     * Returns the lowest matching pid, or 0 if there isn't one
+     */
+    DIR *proc = opendir("/proc");
+    if (proc == NULL) {
+        perror("findProcessPid(): opendir()");
+        return 0;
+    }
+    int found = 0;
+    pid_t self = getpid();
+    struct dirent *entry;
+    while ((entry = readdir(proc)) != NULL) {
+        char *end;
+        long pid = strtol(entry->d_name, &end, 10);
+        if ((*end != 0) || (pid <= 0) || (pid == self) || ((found != 0) && (pid > found))) continue;
+        char path[64];
+        snprintf(path, sizeof (path), "/proc/%ld/cmdline", pid);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue; //Gone already
+        char cmdline[1024];
+        int length = read(fd, cmdline, sizeof (cmdline) - 1);
+        close(fd);
+        if (length <= 0) continue; //Kernel thread
+        cmdline[length] = 0;
+
+        const char *file = strrchr(cmdline, '/');
+        file = (file != NULL) ? file + 1 : cmdline;
+        if (strncmp(file, program, strlen(program)) != 0) continue;
+        int matched = (argument == NULL);
+        int n = strlen(cmdline) + 1;
+        while ((!matched) && (n < length)) {
+            if (strstr(cmdline + n, argument) != NULL) matched = 1;
+            n += strlen(cmdline + n) + 1;
+        }
+        if (matched) found = pid;
+    }
+    closedir(proc);
+    return found;
+}
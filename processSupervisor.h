@@ -0,0 +1,72 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   processSupervisor.h
+ *
+ * Starts wpa_supplicant, hostapd and the dhcp clients, watches them and restarts them if they exit
+ * (see processSupervisor.c)
+ */
+
+#ifndef PROCESSSUPERVISOR_H
+#define PROCESSSUPERVISOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "processSupervisor.h" TO THE SOURCE FILE
+
+#include <stdint.h>
+
+#define SUPERVISOR_MAX_PROCESSES 16
+#define SUPERVISOR_NAME_LENGTH 32
+#define SUPERVISOR_MAX_ARGS 16
+#define SUPERVISOR_ARGS_LENGTH 512 //All of a process's arguments, null terminated, end to end
+
+//What happens when a process exits by itself
+#define PROCESS_RESTART_NEVER 0     //Runs once (e.g 'dhclient -r')
+#define PROCESS_RESTART_ALWAYS 1    //Daemons. Restarted after 1s, then 2s, 4s... up to a minute if it keeps dying
+
+//Process states
+#define PROCESS_STOPPED 0   //Stopped by stopSupervisedProcess(), or never started
+#define PROCESS_RUNNING 1
+#define PROCESS_STOPPING 2  //Sent SIGTERM. Gets SIGKILL if it hasn't gone in time
+#define PROCESS_BACKOFF 3   //Exited by itself. Waiting to be restarted
+#define PROCESS_EXITED 4    //Exited by itself, and isn't to be restarted
+#define PROCESS_FAILED 5    //Couldn't be started (e.g not installed)
+
+typedef struct {
+    char name[SUPERVISOR_NAME_LENGTH]; //e.g "wpa_supplicant.wlan0"
+    int state;
+    int pid; //0 unless it's running (or stopping)
+    uint32_t uptimeMs; //Since it was last started, if it's running
+    int restarts; //Times it's been restarted after exiting by itself
+    int exitStatus; //As waitpid() gave it, the last time it exited. -1 if it hasn't
+    uint32_t restartInMs; //If it's waiting to be restarted
+} supervisedProcessInfo;
+
+int startProcessSupervisor(void);
+int superviseProcess(const char *name, char *const argv[], int restartPolicy);
+int stopSupervisedProcess(const char *name, uint32_t killAfterMs);
+int waitSupervisedProcess(const char *name, int timeoutMs);
+int getSupervisedPid(const char *name);
+int getSupervisedProcessInfo(const char *name, supervisedProcessInfo *info);
+const char *processStateToString(int state);
+int printProcessSupervisorReport(char output[], int outputLength, const char *lineEnd);
+int findProcessPid(const char *program, const char *argument);
+
+//AND BEFORE HERE
+#endif /* PROCESSSUPERVISOR_H */
+
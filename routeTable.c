@@ -0,0 +1,244 @@
+/*
+ * Routing table
+ *
+ * getGateway() used to run `route -n` into a 10,000 byte buffer and look for the first line starting "0.0.0.0".
+ * That's a fork and exec every status page, and it only finds one default route, with no idea which interface
+ * it's on or whether it's the one actually in use. With eth0, wlan0 and wlan1 all up there are usually several.
+ *
+ * Here the main IPv4 table comes from one RTM_GETROUTE dump over rtnetlink, as a list of routeEntry structs
+ * (destination, gateway, interface, metric, flags...). While reading it, each interface's lowest metric default
+ * route is noted in an array indexed by ifindex, so "what's the default route on wlan0" is a lookup, and so is
+ * the default route in use (the lowest metric of all).
+ *
+ * A routeTable is a snapshot. Read it again for an up to date one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/route.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include "routeTable.h"
+
+#define ROUTE_DUMP_BUFFER_LENGTH 16384
+
+void initRouteTable(routeTable *table) {
+    memset(table, 0, sizeof (routeTable));
+    table->bestDefaultRoute = -1;
+    table->maxIfindex = -1;
+}
+
+void freeRouteTable(routeTable *table) {
+    free(table->routes);
+    free(table->defaultRoutes);
+    initRouteTable(table);
+}
+
+static routeEntry *addRouteEntry(routeTable *table) {
+    //Returns a new, zeroed entry on the end of the table, or NULL if out of memory
+    if (table->count == table->capacity) {
+        int capacity = (table->capacity == 0) ? 16 : table->capacity * 2;
+        routeEntry *routes = (routeEntry *) realloc(table->routes, capacity * sizeof (routeEntry));
+        if (routes == NULL) {
+            perror("addRouteEntry(): realloc()");
+            return NULL;
+        }
+        table->routes = routes;
+        table->capacity = capacity;
+    }
+    routeEntry *route = &table->routes[table->count++];
+    memset(route, 0, sizeof (routeEntry));
+    return route;
+}
+
+static void finishRouteEntry(routeTable *table, routeEntry *route) {
+    //Fills in the interface name and flags, and notes it if it's the best default route so far
+    if ((route->ifindex <= 0) || (if_indextoname(route->ifindex, route->interface) == NULL)) route->interface[0] = 0;
+    route->flags = RTF_UP;
+    if (route->gateway.s_addr != 0) route->flags |= RTF_GATEWAY;
+    if (route->prefixLength == 32) route->flags |= RTF_HOST;
+    if ((route->prefixLength != 0) || (route->ifindex <= 0)) return;
+
+    int n = route - table->routes;
+    if (route->ifindex <= table->maxIfindex) {
+        int current = table->defaultRoutes[route->ifindex];
+        if ((current < 0) || (route->metric < table->routes[current].metric)) table->defaultRoutes[route->ifindex] = n;
+    }
+    if ((table->bestDefaultRoute < 0) || (route->metric < table->routes[table->bestDefaultRoute].metric))
+        table->bestDefaultRoute = n;
+}
+
+static int growDefaultRoutes(routeTable *table, int ifindex) {
+    //Makes sure defaultRoutes[] goes up to ifindex. Returns 0, or -1 if out of memory
+    if (ifindex <= table->maxIfindex) return 0;
+    int *defaultRoutes = (int *) realloc(table->defaultRoutes, (ifindex + 1) * sizeof (int));
+    if (defaultRoutes == NULL) {
+        perror("growDefaultRoutes(): realloc()");
+        return -1;
+    }
+    int n;
+    for (n = table->maxIfindex + 1; n <= ifindex; n++) defaultRoutes[n] = -1;
+    table->defaultRoutes = defaultRoutes;
+    table->maxIfindex = ifindex;
+    return 0;
+}
+
+static void parseRouteMessage(routeTable *table, struct nlmsghdr *header) {
+    //Adds the route in an RTM_NEWROUTE message (one entry per next hop of a multipath route)
+    struct rtmsg *message = (struct rtmsg *) NLMSG_DATA(header);
+    int length = RTM_PAYLOAD(header);
+    if ((message->rtm_family != AF_INET) || (message->rtm_type != RTN_UNICAST)) return;
+
+    routeEntry route;
+    memset(&route, 0, sizeof (route));
+    route.prefixLength = message->rtm_dst_len;
+    route.protocol = message->rtm_protocol;
+    route.scope = message->rtm_scope;
+    uint32_t tableId = message->rtm_table;
+    struct rtattr *multipath = NULL;
+    struct rtattr *attr;
+    for (attr = RTM_RTA(message); RTA_OK(attr, length); attr = RTA_NEXT(attr, length)) {
+        switch (attr->rta_type) {
+            case RTA_DST: memcpy(&route.destination, RTA_DATA(attr), sizeof (struct in_addr));
+                break;
+            case RTA_GATEWAY: memcpy(&route.gateway, RTA_DATA(attr), sizeof (struct in_addr));
+                break;
+            case RTA_PREFSRC: memcpy(&route.source, RTA_DATA(attr), sizeof (struct in_addr));
+                break;
+            case RTA_OIF: route.ifindex = *(int *) RTA_DATA(attr);
+                break;
+            case RTA_PRIORITY: route.metric = *(uint32_t *) RTA_DATA(attr);
+                break;
+            case RTA_TABLE: tableId = *(uint32_t *) RTA_DATA(attr); //The real id, if it's more than 8 bits
+                break;
+            case RTA_MULTIPATH: multipath = attr;
+                break;
+        }
+    }
+    if (tableId != RT_TABLE_MAIN) return;
+
+    if (multipath == NULL) {
+        if (growDefaultRoutes(table, route.ifindex) < 0) return;
+        routeEntry *entry = addRouteEntry(table);
+        if (entry == NULL) return;
+        *entry = route;
+        finishRouteEntry(table, entry);
+        return;
+    }
+    //Each next hop has its own interface and gateway
+    struct rtnexthop *hop = (struct rtnexthop *) RTA_DATA(multipath);
+    int remaining = RTA_PAYLOAD(multipath);
+    while ((remaining >= (int) sizeof (struct rtnexthop)) && (hop->rtnh_len >= sizeof (struct rtnexthop)) && (hop->rtnh_len <= remaining)) {
+        routeEntry nextHop = route;
+        nextHop.ifindex = hop->rtnh_ifindex;
+        nextHop.gateway.s_addr = 0;
+        int hopLength = hop->rtnh_len - RTNH_LENGTH(0);
+        for (attr = RTNH_DATA(hop); RTA_OK(attr, hopLength); attr = RTA_NEXT(attr, hopLength))
+            if (attr->rta_type == RTA_GATEWAY) memcpy(&nextHop.gateway, RTA_DATA(attr), sizeof (struct in_addr));
+        if (growDefaultRoutes(table, nextHop.ifindex) < 0) return;
+        routeEntry *entry = addRouteEntry(table);
+        if (entry == NULL) return;
+        *entry = nextHop;
+        finishRouteEntry(table, entry);
+        remaining -= RTNH_ALIGN(hop->rtnh_len);
+        hop = RTNH_NEXT(hop);
+    }
+}
+
+int readRouteTable(routeTable *table) {
+    /*
+     * Reads the main IPv4 routing table into table (initRouteTable() it first. Anything already in it is replaced).
+     * Returns the no. of routes, or -1 on failure
+     */
+    freeRouteTable(table);
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        perror("readRouteTable(): socket()");
+        return -1;
+    }
+    struct {
+        struct nlmsghdr header;
+        struct rtmsg message;
+    } request;
+    memset(&request, 0, sizeof (request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof (struct rtmsg));
+    request.header.nlmsg_type = RTM_GETROUTE;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = 1;
+    request.message.rtm_family = AF_INET;
+    if (send(fd, &request, request.header.nlmsg_len, 0) < 0) {
+        perror("readRouteTable(): send()");
+        close(fd);
+        return -1;
+    }
+
+    char *buffer = (char *) malloc(ROUTE_DUMP_BUFFER_LENGTH);
+    int ret = -1, done = 0;
+    while ((buffer != NULL) && (!done)) {
+        int length = recv(fd, buffer, ROUTE_DUMP_BUFFER_LENGTH, 0);
+        if (length < 0) {
+            if (errno == EINTR) continue;
+            perror("readRouteTable(): recv()");
+            break;
+        }
+        if (length == 0) break;
+        struct nlmsghdr *header;
+        for (header = (struct nlmsghdr *) buffer; NLMSG_OK(header, length); header = NLMSG_NEXT(header, length)) {
+            if (header->nlmsg_type == NLMSG_DONE) {
+                done = 1;
+                ret = table->count;
+                break;
+            }
+            if (header->nlmsg_type == NLMSG_ERROR) {
+                struct nlmsgerr *error = (struct nlmsgerr *) NLMSG_DATA(header);
+                printf("readRouteTable(): netlink error %d\n", error->error);
+                done = 1;
+                break;
+            }
+            if (header->nlmsg_type == RTM_NEWROUTE) parseRouteMessage(table, header);
+        }
+    }
+    free(buffer);
+    close(fd);
+    return ret;
+}
+
+const routeEntry *getDefaultRoute(routeTable *table, int ifindex) {
+    //The interface's lowest metric default route, or NULL if it hasn't got one
+    if ((ifindex < 0) || (ifindex > table->maxIfindex) || (table->defaultRoutes[ifindex] < 0)) return NULL;
+    return &table->routes[table->defaultRoutes[ifindex]];
+}
+
+const routeEntry *getDefaultRouteByName(routeTable *table, const char *interface) {
+    return getDefaultRoute(table, if_nametoindex(interface));
+}
+
+const routeEntry *getBestDefaultRoute(routeTable *table) {
+    //The default route in use (lowest metric), or NULL if there isn't one
+    if (table->bestDefaultRoute < 0) return NULL;
+    return &table->routes[table->bestDefaultRoute];
+}
+
+int formatRouteEntry(const routeEntry *route, char output[], int outputLength) {
+    /*
+     * Describes a route, 'ip route' style, e.g "default via 192.168.3.1 dev wlan0 metric 303" or
+     * "192.168.3.0/24 dev wlan0 src 192.168.3.20". Returns the length written
+     */
+    char destination[INET_ADDRSTRLEN], gateway[INET_ADDRSTRLEN], source[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &route->destination, destination, INET_ADDRSTRLEN);
+    inet_ntop(AF_INET, &route->gateway, gateway, INET_ADDRSTRLEN);
+    inet_ntop(AF_INET, &route->source, source, INET_ADDRSTRLEN);
+    int length;
+    if (route->prefixLength == 0) length = snprintf(output, outputLength, "default");
+    else length = snprintf(output, outputLength, "%s/%u", destination, route->prefixLength);
+    if ((route->flags & RTF_GATEWAY) && (length < outputLength)) length += snprintf(output + length, outputLength - length, " via %s", gateway);
+    if ((route->interface[0] != 0) && (length < outputLength)) length += snprintf(output + length, outputLength - length, " dev %s", route->interface);
+    if ((route->source.s_addr != 0) && (length < outputLength)) length += snprintf(output + length, outputLength - length, " src %s", source);
+    if ((route->metric != 0) && (length < outputLength)) length += snprintf(output + length, outputLength - length, " metric %u", route->metric);
+    return (length < outputLength) ? length : outputLength - 1;
+}
@@ -0,0 +1,66 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   routeTable.h
+ *
+ * IPv4 routing table, read with one rtnetlink dump (see routeTable.c)
+ */
+
+#ifndef ROUTETABLE_H
+#define ROUTETABLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "routeTable.h" TO THE SOURCE FILE
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include <net/if.h>
+
+typedef struct {
+    struct in_addr destination;
+    uint8_t prefixLength; //0 for a default route
+    struct in_addr gateway; //0.0.0.0 if directly connected
+    struct in_addr source; //Preferred source address, 0.0.0.0 if none
+    int ifindex;
+    char interface[IF_NAMESIZE];
+    uint32_t metric;
+    uint8_t protocol; //RTPROT_KERNEL, RTPROT_BOOT, RTPROT_DHCP etc.
+    uint8_t scope; //RT_SCOPE_UNIVERSE, RT_SCOPE_LINK etc.
+    unsigned short flags; //As 'route -n' shows them: RTF_UP, RTF_GATEWAY, RTF_HOST
+} routeEntry;
+
+typedef struct {
+    routeEntry *routes; //In the order the kernel listed them
+    int count;
+    int capacity;
+    int *defaultRoutes; //defaultRoutes[ifindex] = the interface's lowest metric default route (index into routes[]), -1 if none
+    int maxIfindex;
+    int bestDefaultRoute; //Lowest metric default route on any interface (the one that's used), -1 if none
+} routeTable;
+
+void initRouteTable(routeTable *table);
+int readRouteTable(routeTable *table);
+void freeRouteTable(routeTable *table);
+const routeEntry *getDefaultRoute(routeTable *table, int ifindex);
+const routeEntry *getDefaultRouteByName(routeTable *table, const char *interface);
+const routeEntry *getBestDefaultRoute(routeTable *table);
+int formatRouteEntry(const routeEntry *route, char output[], int outputLength);
+
+//AND BEFORE HERE
+#endif /* ROUTETABLE_H */
+
@@ -0,0 +1,108 @@
+/*
+ * State shared between threads (setup mode, the DHCP server's state etc.)
+ *
+ * These used to be plain volatile ints, which say nothing about ordering (a thread could see a flag change before
+ * the data it guards), and anything that needed to wait for one polled it with sleep(), so reacted up to a second
+ * late, or span on it. A sharedState is a C11 atomic int:
+ *      -getSharedState() is an acquire load, setSharedState() is sequentially consistent, so anything written
+ *       before a set is visible to a thread that sees the new value
+ *      -waitSharedState() / waitSharedStateChange() sleep in the kernel (futex) until the value changes, and
+ *       setSharedState() wakes them straight away. No CPU is used while waiting
+ *      -If nobody's waiting (the usual case), setting is just an atomic exchange, with no system call.
+ *       The waiter count is incremented before the waiter checks the value, and the setter reads it after
+ *       changing the value (both sequentially consistent), so a wake-up can't be missed. FUTEX_WAIT re-checks
+ *       the value in the kernel as well, so a change between the check and going to sleep isn't missed either
+ */
+
+#define _GNU_SOURCE //syscall()
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "sharedState.h"
+
+_Static_assert(sizeof (_Atomic int) == sizeof (int), "futex needs a plain 32 bit int");
+
+void initSharedState(sharedState *state, int value) {
+    atomic_init(&state->value, value);
+    atomic_init(&state->waiters, 0);
+}
+
+int getSharedState(sharedState *state) {
+    return atomic_load_explicit(&state->value, memory_order_acquire);
+}
+
+static void wakeWaiters(sharedState *state) {
+    if (atomic_load(&state->waiters) == 0) return; //Nobody to wake
+    if (syscall(SYS_futex, (int *) &state->value, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0) == -1)
+        perror("wakeWaiters(): futex()");
+}
+
+int setSharedState(sharedState *state, int value) {
+    //Sets the state, waking any threads waiting for it to change. Returns the previous value
+    int previous = atomic_exchange(&state->value, value);
+    if (previous != value) wakeWaiters(state);
+    return previous;
+}
+
+int compareAndSetSharedState(sharedState *state, int expected, int value) {
+    //Sets the state to value only if it's currently expected. Returns 1 if it was set, 0 if not
+    if (!atomic_compare_exchange_strong(&state->value, &expected, value)) return 0;
+    if (expected != value) wakeWaiters(state);
+    return 1;
+}
+
+static int waitUntil(sharedState *state, int value, int equal, int timeoutMs) {
+    /*
+     * Sleeps until the state is (equal = 1) or isn't (equal = 0) value, or timeoutMs has passed (-1 for no timeout).
+     * Returns the last value seen
+     */
+    struct timespec deadline, now, remaining;
+    if (timeoutMs >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeoutMs / 1000;
+        deadline.tv_nsec += (timeoutMs % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    atomic_fetch_add(&state->waiters, 1);
+    int current;
+    while (((current = atomic_load(&state->value)) == value) != equal) {
+        struct timespec *timeout = NULL;
+        if (timeoutMs >= 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            remaining.tv_sec = deadline.tv_sec - now.tv_sec;
+            remaining.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+            if (remaining.tv_nsec < 0) {
+                remaining.tv_sec--;
+                remaining.tv_nsec += 1000000000L;
+            }
+            if (remaining.tv_sec < 0) break; //Timed out
+            timeout = &remaining;
+        }
+        //Only sleeps if the value is still 'current'. EAGAIN (it's changed) and EINTR just mean look again
+        if ((syscall(SYS_futex, (int *) &state->value, FUTEX_WAIT_PRIVATE, current, timeout, NULL, 0) == -1) &&
+                (errno != EAGAIN) && (errno != EINTR) && (errno != ETIMEDOUT)) {
+            perror("waitUntil(): futex()");
+            break;
+        }
+    }
+    atomic_fetch_sub(&state->waiters, 1);
+    return current;
+}
+
+int waitSharedState(sharedState *state, int value, int timeoutMs) {
+    //Waits until the state is value (timeoutMs = -1 to wait forever). Returns 0 once it is, -1 if it timed out
+    return (waitUntil(state, value, 1, timeoutMs) == value) ? 0 : -1;
+}
+
+int waitSharedStateChange(sharedState *state, int from, int timeoutMs) {
+    //Waits until the state isn't 'from' (timeoutMs = -1 to wait forever). Returns the new value, or 'from' if it timed out
+    return waitUntil(state, from, 0, timeoutMs);
+}
@@ -0,0 +1,48 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   sharedState.h
+ *
+ * An int shared between threads, that threads can wait on (see sharedState.c)
+ */
+
+#ifndef SHAREDSTATE_H
+#define SHAREDSTATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "sharedState.h" TO THE SOURCE FILE
+
+#include <stdatomic.h>
+
+typedef struct {
+    _Atomic int value; //Also the futex word
+    _Atomic int waiters; //No. of threads waiting. setSharedState() only makes a system call if there are any
+} sharedState;
+
+#define SHARED_STATE_INITIALIZER(initialValue) {initialValue, 0} //For globals. Zeroed globals start at 0 without it
+
+void initSharedState(sharedState *state, int value);
+int getSharedState(sharedState *state);
+int setSharedState(sharedState *state, int value);
+int compareAndSetSharedState(sharedState *state, int expected, int value);
+int waitSharedState(sharedState *state, int value, int timeoutMs);
+int waitSharedStateChange(sharedState *state, int from, int timeoutMs);
+
+//AND BEFORE HERE
+#endif /* SHAREDSTATE_H */
+
@@ -0,0 +1,252 @@
+/*
+ * Task scheduler
+ *
+ * Runs the program's periodic jobs (flashing the status LED, polling the WiFi connection state etc.) from one
+ * thread. These used to each have a thread of their own that slept in a loop: four 'square wave' threads
+ * toggling a flag, an LED thread sampling those flags every 20mS and a WiFi thread sleeping for 2 seconds. So
+ * about 50 wake-ups a second, and five stacks, on a device that's normally doing nothing.
+ *
+ * Here each job is a task function that returns how long until it next wants to run. Tasks are timers on a
+ * timerWheel (see timerWheel.c) ticking in mS, and the thread blocks on a timerfd armed (CLOCK_MONOTONIC,
+ * absolute) for the earliest one. So the thread only wakes when something is actually due.
+ *
+ * Tasks are called without the scheduler's mutex held, so a slow one (e.g the WiFi poll, which runs iwconfig)
+ * doesn't hold up adding or waking other tasks, only running them. Tasks can be added, removed or woken early
+ * from any thread: that just re-arms the timerfd, which the scheduler thread is blocked reading.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include "timerWheel.h"
+#include "sharedState.h"
+#include "taskScheduler.h"
+
+typedef struct {
+    const char *name;
+    scheduledTask task; //NULL if the slot's free
+    void *context;
+    uint32_t generation; //Bumped each time the slot's reused, so a task removed while running isn't rescheduled
+} taskSchedulerEntry;
+
+static taskSchedulerEntry tasks[TASK_SCHEDULER_MAX_TASKS];
+static timerWheel taskWheel; //Timer id = task no. Ticks are mS since schedulerEpochMs
+static uint64_t schedulerEpochMs = 0;
+static int schedulerTimerFd = -1;
+static pthread_t schedulerThreadId;
+static pthread_mutex_t schedulerMutex = PTHREAD_MUTEX_INITIALIZER;
+static sharedState schedulerHalt = SHARED_STATE_INITIALIZER(0);
+
+uint64_t getSchedulerTimeMs(void) {
+    //CLOCK_MONOTONIC in mS. Tasks that flash things use it to work out where they are in a cycle
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static uint32_t schedulerNow(void) {
+    return (uint32_t) (getSchedulerTimeMs() - schedulerEpochMs);
+}
+
+static void armSchedulerTimer(void) {
+    /*
+     * Arms the timerfd for the earliest scheduled task (or disarms it if there aren't any).
+     * There are only ever a handful of tasks, so they're just scanned. Call with schedulerMutex held
+     */
+    struct itimerspec when;
+    memset(&when, 0, sizeof (when));
+    int found = 0;
+    uint32_t earliest = 0;
+    int n;
+    for (n = 0; n < TASK_SCHEDULER_MAX_TASKS; n++) {
+        if (!isTimerScheduled(&taskWheel, n)) continue;
+        uint32_t expires = taskWheel.entries[n].expires;
+        if ((!found) || ((int32_t) (expires - earliest) < 0)) earliest = expires;
+        found = 1;
+    }
+    if (found) {
+        //The wheel has already processed taskWheel.now, so anything due by then fires on the next tick
+        if ((int32_t) (earliest - taskWheel.now) < 1) earliest = taskWheel.now + 1;
+        //Relative to now, not schedulerEpochMs + earliest: wheel time is 32 bits and wraps after ~49.7 days
+        uint64_t now = getSchedulerTimeMs();
+        int32_t delay = (int32_t) (earliest - (uint32_t) (now - schedulerEpochMs));
+        uint64_t due = now + ((delay > 0) ? delay : 0);
+        when.it_value.tv_sec = due / 1000;
+        when.it_value.tv_nsec = (due % 1000) * 1000000;
+    }
+    if (timerfd_settime(schedulerTimerFd, TFD_TIMER_ABSTIME, &when, NULL) < 0)
+        perror("armSchedulerTimer(): timerfd_settime()");
+}
+
+typedef struct {
+    int ids[TASK_SCHEDULER_MAX_TASKS];
+    int count;
+} dueTaskList;
+
+static void collectDueTask(int id, void *context) {
+    dueTaskList *due = (dueTaskList *) context;
+    if (due->count < TASK_SCHEDULER_MAX_TASKS) due->ids[due->count++] = id;
+}
+
+static void *taskSchedulerThread(void *arg) {
+    /*
+     * PThread: Sleeps on the timerfd until the next task is due, then runs everything that is
+     */
+    while (getSharedState(&schedulerHalt) == 0) {
+        uint64_t expirations;
+        if (read(schedulerTimerFd, &expirations, sizeof (expirations)) < 0) {
+            if (errno == EINTR) continue;
+            perror("taskSchedulerThread(): read()");
+            break;
+        }
+        if (getSharedState(&schedulerHalt) != 0) break;
+
+        //Take a copy of what's due, then run them unlocked
+        dueTaskList due;
+        taskSchedulerEntry run[TASK_SCHEDULER_MAX_TASKS];
+        due.count = 0;
+        pthread_mutex_lock(&schedulerMutex);
+        advanceTimerWheel(&taskWheel, schedulerNow(), collectDueTask, &due);
+        int n;
+        for (n = 0; n < due.count; n++) run[n] = tasks[due.ids[n]];
+        pthread_mutex_unlock(&schedulerMutex);
+
+        for (n = 0; n < due.count; n++) {
+            if (run[n].task == NULL) continue;
+            uint32_t delayMs = run[n].task(run[n].context);
+
+            int id = due.ids[n];
+            pthread_mutex_lock(&schedulerMutex);
+            if ((tasks[id].task != NULL) && (tasks[id].generation == run[n].generation)) { //Not removed meanwhile
+                if (delayMs == TASK_DONE) {
+                    cancelTimer(&taskWheel, id);
+                    tasks[id].task = NULL;
+                } else if (!isTimerScheduled(&taskWheel, id)) //Unless it was woken early while it ran
+                    scheduleTimer(&taskWheel, id, schedulerNow() + delayMs);
+            }
+            pthread_mutex_unlock(&schedulerMutex);
+        }
+
+        pthread_mutex_lock(&schedulerMutex);
+        armSchedulerTimer();
+        pthread_mutex_unlock(&schedulerMutex);
+    }
+    return NULL;
+}
+
+int startTaskScheduler(void) {
+    /*
+     * Starts the scheduler thread. Tasks can only be added once it's started.
+     * Returns 0 on success (or if it's already running), -1 on failure
+     */
+    pthread_mutex_lock(&schedulerMutex);
+    if (schedulerTimerFd != -1) {
+        pthread_mutex_unlock(&schedulerMutex);
+        return 0;
+    }
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (fd < 0) {
+        perror("startTaskScheduler(): timerfd_create()");
+        pthread_mutex_unlock(&schedulerMutex);
+        return -1;
+    }
+    if (initTimerWheel(&taskWheel, TASK_SCHEDULER_MAX_TASKS, 0) < 0) {
+        close(fd);
+        pthread_mutex_unlock(&schedulerMutex);
+        return -1;
+    }
+    memset(tasks, 0, sizeof (tasks));
+    schedulerEpochMs = getSchedulerTimeMs();
+    schedulerTimerFd = fd;
+    setSharedState(&schedulerHalt, 0);
+    if (pthread_create(&schedulerThreadId, NULL, taskSchedulerThread, NULL)) {
+        printf("startTaskScheduler(): Error creating scheduler thread.\n");
+        freeTimerWheel(&taskWheel);
+        close(fd);
+        schedulerTimerFd = -1;
+        pthread_mutex_unlock(&schedulerMutex);
+        return -1;
+    }
+    pthread_mutex_unlock(&schedulerMutex);
+    return 0;
+}
+
+void stopTaskScheduler(void) {
+    //Stops the scheduler thread and drops every task. Must not be called from a task
+    pthread_mutex_lock(&schedulerMutex);
+    if (schedulerTimerFd == -1) {
+        pthread_mutex_unlock(&schedulerMutex);
+        return;
+    }
+    setSharedState(&schedulerHalt, 1);
+    struct itimerspec now;
+    memset(&now, 0, sizeof (now));
+    now.it_value.tv_nsec = 1; //Expire straight away, to wake the thread
+    timerfd_settime(schedulerTimerFd, 0, &now, NULL);
+    pthread_mutex_unlock(&schedulerMutex);
+
+    pthread_join(schedulerThreadId, NULL);
+
+    pthread_mutex_lock(&schedulerMutex);
+    close(schedulerTimerFd);
+    schedulerTimerFd = -1;
+    freeTimerWheel(&taskWheel);
+    memset(tasks, 0, sizeof (tasks));
+    pthread_mutex_unlock(&schedulerMutex);
+}
+
+int addScheduledTask(const char *name, scheduledTask task, void *context, uint32_t delayMs) {
+    /*
+     * Adds a task, first run in delayMs (0 = as soon as possible). After that it runs again whenever the
+     * interval it returns has elapsed, until it returns TASK_DONE or is removed.
+     * Returns the task id, or -1 if the scheduler isn't running or there's no room
+     */
+    pthread_mutex_lock(&schedulerMutex);
+    if ((schedulerTimerFd == -1) || (task == NULL)) {
+        pthread_mutex_unlock(&schedulerMutex);
+        return -1;
+    }
+    int id;
+    for (id = 0; id < TASK_SCHEDULER_MAX_TASKS; id++) if (tasks[id].task == NULL) break;
+    if (id == TASK_SCHEDULER_MAX_TASKS) {
+        printf("addScheduledTask(): No room for task %s\n", name);
+        pthread_mutex_unlock(&schedulerMutex);
+        return -1;
+    }
+    tasks[id].name = name;
+    tasks[id].task = task;
+    tasks[id].context = context;
+    tasks[id].generation++;
+    scheduleTimer(&taskWheel, id, schedulerNow() + delayMs);
+    armSchedulerTimer();
+    pthread_mutex_unlock(&schedulerMutex);
+    return id;
+}
+
+void removeScheduledTask(int id) {
+    //The task won't be called again (although it may be running right now, on the scheduler thread)
+    if ((id < 0) || (id >= TASK_SCHEDULER_MAX_TASKS)) return;
+    pthread_mutex_lock(&schedulerMutex);
+    if ((schedulerTimerFd != -1) && (tasks[id].task != NULL)) {
+        cancelTimer(&taskWheel, id);
+        tasks[id].task = NULL;
+        armSchedulerTimer();
+    }
+    pthread_mutex_unlock(&schedulerMutex);
+}
+
+void runScheduledTaskNow(int id) {
+    //Brings a task's next run forward to now. E.g so the status LED changes as soon as the mode does
+    if ((id < 0) || (id >= TASK_SCHEDULER_MAX_TASKS)) return;
+    pthread_mutex_lock(&schedulerMutex);
+    if ((schedulerTimerFd != -1) && (tasks[id].task != NULL)) {
+        scheduleTimer(&taskWheel, id, schedulerNow());
+        armSchedulerTimer();
+    }
+    pthread_mutex_unlock(&schedulerMutex);
+}
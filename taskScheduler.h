@@ -0,0 +1,46 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   taskScheduler.h
+ *
+ * One thread that runs periodic jobs (status LED, WiFi polling etc.) off a timer wheel (see taskScheduler.c)
+ */
+
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "taskScheduler.h" TO THE SOURCE FILE
+
+#include <stdint.h>
+
+#define TASK_SCHEDULER_MAX_TASKS 16
+
+//A task returns the no. of mS until it wants to run again, or TASK_DONE to be removed
+typedef uint32_t (*scheduledTask)(void *context);
+#define TASK_DONE 0
+
+int startTaskScheduler(void);
+void stopTaskScheduler(void);
+int addScheduledTask(const char *name, scheduledTask task, void *context, uint32_t delayMs);
+void removeScheduledTask(int id);
+void runScheduledTaskNow(int id);
+uint64_t getSchedulerTimeMs(void);
+
+//AND BEFORE HERE
+#endif /* TASKSCHEDULER_H */
@@ -0,0 +1,141 @@
+/*
+ * Hierarchical timer wheel
+ *
+ * Timers are identified by a small integer id (e.g a lease no.) and live in a pre-allocated array, so
+ * scheduling and cancelling never allocate memory and are O(1).
+ *
+ * There are TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SLOTS (64) slots. A level 0 slot covers one tick,
+ * a level 1 slot 64 ticks, level 2 4096 ticks and level 3 262144 ticks. So with one tick a second,
+ * timers up to about 194 days away are held directly. Anything further out sits in the top level and is
+ * re-filed each time it comes round.
+ *
+ * Each tick, advanceTimerWheel() fires everything in the current level 0 slot. Every 64 ticks the next
+ * level 1 slot is 'cascaded': its timers are re-filed into level 0 (and so on up the levels). So the
+ * work per tick is constant, apart from the timers that actually fire or move down a level. A timer
+ * only ever moves down, so it's touched at most TIMER_WHEEL_LEVELS times before it fires.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "timerWheel.h"
+
+static void unlinkTimer(timerWheel *wheel, int id) {
+    timerWheelEntry *entry = &wheel->entries[id];
+    if (entry->prev != -1) wheel->entries[entry->prev].next = entry->next;
+    else wheel->heads[entry->level][entry->slot] = entry->next;
+    if (entry->next != -1) wheel->entries[entry->next].prev = entry->prev;
+    entry->level = -1;
+    wheel->pending--;
+}
+
+static void fileTimer(timerWheel *wheel, int id, int cascading) {
+    /*
+     * Puts a timer in the right slot for its expiry time, relative to wheel->now.
+     * When cascading, the current level 0 slot is about to be processed, so a timer due now goes there.
+     * Otherwise it's already been processed, so anything due goes in the next one
+     */
+    timerWheelEntry *entry = &wheel->entries[id];
+    uint32_t expires = entry->expires;
+    if ((int32_t) (expires - wheel->now) < (cascading ? 0 : 1)) expires = wheel->now + (cascading ? 0 : 1);
+    uint32_t delta = expires - wheel->now;
+    int level = 0;
+    while ((level < TIMER_WHEEL_LEVELS - 1) && (delta >= (1u << (TIMER_WHEEL_SLOT_BITS * (level + 1))))) level++;
+    if ((level == TIMER_WHEEL_LEVELS - 1) && (delta >= (1u << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS))))
+        expires = wheel->now + (1u << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS)) - 1; //Too far out. Re-filed when it comes round
+    int slot = (expires >> (TIMER_WHEEL_SLOT_BITS * level)) & (TIMER_WHEEL_SLOTS - 1);
+
+    entry->level = level;
+    entry->slot = slot;
+    entry->prev = -1;
+    entry->next = wheel->heads[level][slot];
+    if (entry->next != -1) wheel->entries[entry->next].prev = id;
+    wheel->heads[level][slot] = id;
+    wheel->pending++;
+}
+
+int initTimerWheel(timerWheel *wheel, int noOfEntries, uint32_t now) {
+    //Returns 0 on success, -1 if the entries couldn't be allocated
+    memset(wheel, 0, sizeof (timerWheel));
+    wheel->entries = malloc(noOfEntries * sizeof (timerWheelEntry));
+    if (wheel->entries == NULL) {
+        printf("initTimerWheel(): malloc()\n");
+        return -1;
+    }
+    wheel->noOfEntries = noOfEntries;
+    wheel->now = now;
+    clearTimerWheel(wheel);
+    return 0;
+}
+
+void freeTimerWheel(timerWheel *wheel) {
+    free(wheel->entries);
+    memset(wheel, 0, sizeof (timerWheel));
+}
+
+void clearTimerWheel(timerWheel *wheel) {
+    //Cancels every timer
+    memset(wheel->heads, 0xFF, sizeof (wheel->heads)); //All -1
+    int n;
+    for (n = 0; n < wheel->noOfEntries; n++) wheel->entries[n].level = -1;
+    wheel->pending = 0;
+}
+
+void scheduleTimer(timerWheel *wheel, int id, uint32_t expires) {
+    //(Re)schedules timer id to fire at tick 'expires'
+    if ((id < 0) || (id >= wheel->noOfEntries)) return;
+    if (wheel->entries[id].level != -1) unlinkTimer(wheel, id);
+    wheel->entries[id].expires = expires;
+    fileTimer(wheel, id, 0);
+}
+
+void cancelTimer(timerWheel *wheel, int id) {
+    if ((id < 0) || (id >= wheel->noOfEntries)) return;
+    if (wheel->entries[id].level != -1) unlinkTimer(wheel, id);
+}
+
+int isTimerScheduled(timerWheel *wheel, int id) {
+    if ((id < 0) || (id >= wheel->noOfEntries)) return 0;
+    return wheel->entries[id].level != -1;
+}
+
+static void cascade(timerWheel *wheel, int level) {
+    //Re-files the timers in the current slot of 'level' (they'll all land in lower levels)
+    int slot = (wheel->now >> (TIMER_WHEEL_SLOT_BITS * level)) & (TIMER_WHEEL_SLOTS - 1);
+    int id = wheel->heads[level][slot];
+    wheel->heads[level][slot] = -1;
+    while (id != -1) {
+        int next = wheel->entries[id].next;
+        wheel->pending--;
+        fileTimer(wheel, id, 1);
+        id = next;
+    }
+}
+
+int advanceTimerWheel(timerWheel *wheel, uint32_t now, void (*expired)(int id, void *context), void *context) {
+    /*
+     * Processes every tick up to and including 'now', calling expired() for each timer that fires.
+     * expired() may schedule or cancel timers (including the one that fired).
+     * Returns the no. of timers fired
+     */
+    int fired = 0;
+    while ((int32_t) (now - wheel->now) > 0) {
+        wheel->now++;
+        //At each level boundary, bring the next slot of the level above down
+        int level;
+        for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+            if ((wheel->now & ((1u << (TIMER_WHEEL_SLOT_BITS * level)) - 1)) != 0) break;
+        }
+        for (level = level - 1; level >= 1; level--) cascade(wheel, level); //Highest first
+
+        int slot = wheel->now & (TIMER_WHEEL_SLOTS - 1);
+        int id;
+        while ((id = wheel->heads[0][slot]) != -1) {
+            unlinkTimer(wheel, id);
+            fired++;
+            if (expired != NULL) expired(id, context);
+        }
+        if (wheel->pending == 0) wheel->now = now; //Nothing left to fire, skip straight to 'now'
+    }
+    return fired;
+}
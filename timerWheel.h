@@ -0,0 +1,62 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   timerWheel.h
+ *
+ * Hierarchical timer wheel (see timerWheel.c)
+ */
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "timerWheel.h" TO THE SOURCE FILE
+
+#include <stdint.h>
+
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS) //Slots per level
+
+typedef struct {
+    int32_t next; //Next/previous timer in the same slot, -1 for none
+    int32_t prev;
+    uint32_t expires; //Tick the timer is due
+    int16_t level; //-1 if not scheduled
+    int16_t slot;
+} timerWheelEntry;
+
+typedef struct {
+    uint32_t now; //Last tick processed
+    int32_t heads[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]; //First timer in each slot, -1 for none
+    timerWheelEntry *entries; //One per timer id
+    int noOfEntries;
+    int pending; //No. of timers scheduled
+} timerWheel;
+
+int initTimerWheel(timerWheel *wheel, int noOfEntries, uint32_t now);
+void freeTimerWheel(timerWheel *wheel);
+void clearTimerWheel(timerWheel *wheel);
+void scheduleTimer(timerWheel *wheel, int id, uint32_t expires);
+void cancelTimer(timerWheel *wheel, int id);
+int isTimerScheduled(timerWheel *wheel, int id);
+int advanceTimerWheel(timerWheel *wheel, uint32_t now, void (*expired)(int id, void *context), void *context);
+
+//AND BEFORE HERE
+#endif /* TIMERWHEEL_H */
+
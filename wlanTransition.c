@@ -0,0 +1,619 @@
+/*
+ * wlan mode transitions
+ *
+ * Going into or out of setup mode means a run of commands (stop wpa_supplicant, take wlan0 down, change its
+ * mode, bring it up, start hostapd...). Each of them used to be followed by a sleep() long enough for the
+ * slowest case, and changing back to managed mode was tried up to 10 times a second apart, so a mode change
+ * took 10-20 seconds however quickly the hardware actually got there.
+ *
+ * Here a transition is a list of steps. Each step runs its action and then waits for whatever shows the action
+ * has taken effect, and moves on as soon as it has:
+ *      link up/down            rtnetlink RTMGRP_LINK notifications, checked against the interface flags
+ *      interface type          nl80211 "config" multicast notifications, checked with NL80211_CMD_GET_INTERFACE
+ *                              (wext only drivers don't announce mode changes, so SIOCGIWMODE is polled instead)
+ *      hostapd running         hostapd's control socket: STATUS, then the AP-ENABLED event
+ *      process gone            a pidfd (kill(pid, 0) polled on kernels without pidfd_open())
+ * Every step has a timeout, and can have its action re-run if it hasn't taken after retryMs. Each wait
+ * subscribes first and then checks the current state, so a change that happens before the wait starts isn't
+ * missed.
+ *
+ * How long each step of the last transition took is kept in a report, for the status page and SIGUSR2.
+ */
+
+#define _GNU_SOURCE //syscall()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/genetlink.h>
+#include <linux/nl80211.h>
+#include <linux/wireless.h>
+#include <linux/if_ether.h> //ETH_ALEN
+#include "taskScheduler.h"
+#include "wlanTransition.h"
+
+#define WLAN_POLL_MS 50 //How often state is polled when there's nothing to wait on
+#define NETLINK_BUFFER_LENGTH 8192
+#define HOSTAPD_REPLY_LENGTH 4096
+
+static wlanTransitionReport transitionReport;
+static pthread_mutex_t transitionReportMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t transitionRunMutex = PTHREAD_MUTEX_INITIALIZER; //One transition at a time
+
+static pthread_once_t nl80211Once = PTHREAD_ONCE_INIT;
+static int nl80211Family = -1; //Generic netlink family id. -1 if there's no nl80211
+static int nl80211ConfigGroup = -1; //The "config" multicast group (interface type changes etc.)
+
+static uint32_t remainingMs(uint64_t deadline) {
+    uint64_t now = getSchedulerTimeMs();
+    return (now >= deadline) ? 0 : (uint32_t) (deadline - now);
+}
+
+static int waitReadable(int fd, uint64_t deadline) {
+    /*
+     * Waits until fd is readable or deadline (getSchedulerTimeMs()) has passed.
+     * If fd is -1 there's nothing to wait on, so it just waits WLAN_POLL_MS, for the caller to look again.
+     * Returns 1 if the caller should look again, 0 if the deadline's passed
+     */
+    for (;;) {
+        uint32_t remaining = remainingMs(deadline);
+        if (remaining == 0) return 0;
+        if (fd < 0) {
+            usleep(((remaining < WLAN_POLL_MS) ? remaining : WLAN_POLL_MS) * 1000);
+            return 1;
+        }
+        struct pollfd p;
+        p.fd = fd;
+        p.events = POLLIN;
+        p.revents = 0;
+        int ret = poll(&p, 1, remaining);
+        if (ret > 0) return 1;
+        if (ret == 0) return 0;
+        if (errno != EINTR) {
+            perror("waitReadable(): poll()");
+            return 0;
+        }
+    }
+}
+
+static void drainSocket(int fd) {
+    //Discards whatever's queued. The waits only use notifications as a cue to look again
+    char buffer[NETLINK_BUFFER_LENGTH];
+    while (recv(fd, buffer, sizeof (buffer), MSG_DONTWAIT) > 0);
+}
+
+static int openNetlinkSocket(int protocol, uint32_t groups) {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol);
+    if (fd < 0) {
+        perror("openNetlinkSocket(): socket()");
+        return -1;
+    }
+    struct sockaddr_nl local;
+    memset(&local, 0, sizeof (local));
+    local.nl_family = AF_NETLINK;
+    local.nl_groups = groups;
+    if (bind(fd, (struct sockaddr *) &local, sizeof (local)) < 0) {
+        perror("openNetlinkSocket(): bind()");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int getLinkFlags(const char *interface) {
+    //Returns the interface's IFF_ flags, or -1 if there's no such interface
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof (ifr));
+    strncpy(ifr.ifr_name, interface, IF_NAMESIZE - 1);
+    int ret = ioctl(fd, SIOCGIFFLAGS, &ifr);
+    close(fd);
+    if (ret < 0) return -1;
+    return ifr.ifr_flags & 0xFFFF;
+}
+
+int waitWlanLink(const char *interface, int up, uint32_t timeoutMs) {
+    /*
+     * Waits for interface to be (administratively) up if up=1, or down if up=0.
+     * Returns 1 once it is, 0 on timeout, -1 if there's no such interface
+     */
+    uint64_t deadline = getSchedulerTimeMs() + timeoutMs;
+    int fd = openNetlinkSocket(NETLINK_ROUTE, RTMGRP_LINK); //Before looking, so a change in between isn't missed
+    int ret;
+    for (;;) {
+        int flags = getLinkFlags(interface);
+        if (flags < 0) {
+            printf("waitWlanLink(): No interface %s\n", interface);
+            ret = -1;
+            break;
+        }
+        if (((flags & IFF_UP) != 0) == (up != 0)) {
+            ret = 1;
+            break;
+        }
+        if (waitReadable(fd, deadline) == 0) {
+            ret = 0;
+            break;
+        }
+        if (fd >= 0) drainSocket(fd);
+    }
+    if (fd >= 0) close(fd);
+    return ret;
+}
+
+static struct nlattr *findNetlinkAttr(void *attrs, int length, int type) {
+    //Returns attribute type from a run of attributes, or NULL
+    struct nlattr *attr = (struct nlattr *) attrs;
+    while ((length >= NLA_HDRLEN) && (attr->nla_len >= NLA_HDRLEN) && (attr->nla_len <= length)) {
+        if ((attr->nla_type & NLA_TYPE_MASK) == type) return attr;
+        length -= NLA_ALIGN(attr->nla_len);
+        attr = (struct nlattr *) ((char *) attr + NLA_ALIGN(attr->nla_len));
+    }
+    return NULL;
+}
+
+#define NETLINK_ATTR_DATA(attr) ((void *) ((char *) (attr) + NLA_HDRLEN))
+#define NETLINK_ATTR_LENGTH(attr) ((int) (attr)->nla_len - NLA_HDRLEN)
+
+static int genericNetlinkRequest(int fd, int family, int command, int attrType, const void *attrData, int attrLength,
+        char reply[], int replyLength, void **attrs) {
+    /*
+     * Sends a generic netlink request carrying one attribute and reads the reply into reply[].
+     * Sets *attrs to the reply's attributes. Returns their length, or -1 on failure
+     */
+    struct {
+        struct nlmsghdr header;
+        struct genlmsghdr genl;
+        char attrs[64];
+    } request;
+    memset(&request, 0, sizeof (request));
+    request.header.nlmsg_type = family;
+    request.header.nlmsg_flags = NLM_F_REQUEST;
+    request.header.nlmsg_seq = 1;
+    request.genl.cmd = command;
+    request.genl.version = 1;
+    struct nlattr *attr = (struct nlattr *) request.attrs;
+    attr->nla_type = attrType;
+    attr->nla_len = NLA_HDRLEN + attrLength;
+    memcpy(NETLINK_ATTR_DATA(attr), attrData, attrLength);
+    request.header.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN) + NLA_ALIGN(attr->nla_len);
+
+    if (send(fd, &request, request.header.nlmsg_len, 0) < 0) {
+        perror("genericNetlinkRequest(): send()");
+        return -1;
+    }
+    int length = recv(fd, reply, replyLength, 0);
+    if (length < 0) {
+        perror("genericNetlinkRequest(): recv()");
+        return -1;
+    }
+    struct nlmsghdr *header = (struct nlmsghdr *) reply;
+    if ((!NLMSG_OK(header, length)) || (header->nlmsg_type == NLMSG_ERROR)) return -1; //e.g not a wireless interface
+    if (header->nlmsg_len < NLMSG_LENGTH(GENL_HDRLEN)) return -1;
+    *attrs = (char *) NLMSG_DATA(header) + GENL_HDRLEN;
+    return header->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+}
+
+static void findNL80211(void) {
+    //Looks up nl80211's generic netlink family id and "config" multicast group. Once only
+    int fd = openNetlinkSocket(NETLINK_GENERIC, 0);
+    if (fd < 0) return;
+    char reply[NETLINK_BUFFER_LENGTH];
+    void *attrs;
+    int length = genericNetlinkRequest(fd, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, CTRL_ATTR_FAMILY_NAME,
+            NL80211_GENL_NAME, strlen(NL80211_GENL_NAME) + 1, reply, sizeof (reply), &attrs);
+    close(fd);
+    if (length < 0) {
+        printf("findNL80211(): No nl80211. Interface types will be polled\n");
+        return;
+    }
+    struct nlattr *id = findNetlinkAttr(attrs, length, CTRL_ATTR_FAMILY_ID);
+    struct nlattr *groups = findNetlinkAttr(attrs, length, CTRL_ATTR_MCAST_GROUPS);
+    if (id == NULL) return;
+    nl80211Family = *(uint16_t *) NETLINK_ATTR_DATA(id);
+    if (groups == NULL) return;
+    //Groups is a nested list of nested (name, id) pairs
+    struct nlattr *group = (struct nlattr *) NETLINK_ATTR_DATA(groups);
+    int remaining = NETLINK_ATTR_LENGTH(groups);
+    while ((remaining >= NLA_HDRLEN) && (group->nla_len >= NLA_HDRLEN) && (group->nla_len <= remaining)) {
+        struct nlattr *name = findNetlinkAttr(NETLINK_ATTR_DATA(group), NETLINK_ATTR_LENGTH(group), CTRL_ATTR_MCAST_GRP_NAME);
+        struct nlattr *groupId = findNetlinkAttr(NETLINK_ATTR_DATA(group), NETLINK_ATTR_LENGTH(group), CTRL_ATTR_MCAST_GRP_ID);
+        if ((name != NULL) && (groupId != NULL) && (strcmp((char *) NETLINK_ATTR_DATA(name), NL80211_MULTICAST_GROUP_CONFIG) == 0))
+            nl80211ConfigGroup = *(uint32_t *) NETLINK_ATTR_DATA(groupId);
+        remaining -= NLA_ALIGN(group->nla_len);
+        group = (struct nlattr *) ((char *) group + NLA_ALIGN(group->nla_len));
+    }
+}
+
+static int getWextInterfaceType(const char *interface) {
+    //Interface type through the old wireless extensions ioctl. Same values as nl80211
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return WLAN_IFTYPE_UNKNOWN;
+    struct iwreq request;
+    memset(&request, 0, sizeof (request));
+    strncpy(request.ifr_name, interface, IF_NAMESIZE - 1);
+    int ret = ioctl(fd, SIOCGIWMODE, &request);
+    close(fd);
+    if (ret < 0) return WLAN_IFTYPE_UNKNOWN;
+    switch (request.u.mode) {
+        case IW_MODE_ADHOC: return WLAN_IFTYPE_ADHOC;
+        case IW_MODE_INFRA: return WLAN_IFTYPE_STATION;
+        case IW_MODE_MASTER: return WLAN_IFTYPE_AP;
+        default: return WLAN_IFTYPE_UNKNOWN;
+    }
+}
+
+int getWlanInterfaceType(const char *interface) {
+    /*
+     * Returns WLAN_IFTYPE_ADHOC, WLAN_IFTYPE_STATION or WLAN_IFTYPE_AP (or another nl80211 interface type),
+     * or WLAN_IFTYPE_UNKNOWN if interface isn't a wireless interface
+     */
+    pthread_once(&nl80211Once, findNL80211);
+    unsigned int ifindex = if_nametoindex(interface);
+    if (ifindex == 0) return WLAN_IFTYPE_UNKNOWN;
+    if (nl80211Family < 0) return getWextInterfaceType(interface);
+
+    int fd = openNetlinkSocket(NETLINK_GENERIC, 0);
+    if (fd < 0) return WLAN_IFTYPE_UNKNOWN;
+    char reply[NETLINK_BUFFER_LENGTH];
+    void *attrs;
+    uint32_t index = ifindex;
+    int length = genericNetlinkRequest(fd, nl80211Family, NL80211_CMD_GET_INTERFACE, NL80211_ATTR_IFINDEX,
+            &index, sizeof (index), reply, sizeof (reply), &attrs);
+    close(fd);
+    if (length < 0) return getWextInterfaceType(interface);
+    struct nlattr *iftype = findNetlinkAttr(attrs, length, NL80211_ATTR_IFTYPE);
+    if (iftype == NULL) return WLAN_IFTYPE_UNKNOWN;
+    return *(uint32_t *) NETLINK_ATTR_DATA(iftype);
+}
+
+int isWlanAssociated(const char *interface) {
+    /*
+     * Returns 1 if interface is a station associated with an access point, 0 if not. Asks the driver for the
+     * access point's address (SIOCGIWAP, what iwconfig shows as "Access Point:") instead of running iwconfig
+     */
+    static const uint8_t notAssociated[][ETH_ALEN] = {//What drivers report when there isn't one
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF},
+        {0x44, 0x44, 0x44, 0x44, 0x44, 0x44}
+    };
+    if (getWlanInterfaceType(interface) != WLAN_IFTYPE_STATION) return 0; //Ad-hoc cells and APs don't associate
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return 0;
+    struct iwreq request;
+    memset(&request, 0, sizeof (request));
+    strncpy(request.ifr_name, interface, IF_NAMESIZE - 1);
+    int ret = ioctl(fd, SIOCGIWAP, &request);
+    close(fd);
+    if (ret < 0) return 0;
+    unsigned int n;
+    for (n = 0; n < sizeof (notAssociated) / sizeof (notAssociated[0]); n++)
+        if (memcmp(request.u.ap_addr.sa_data, notAssociated[n], ETH_ALEN) == 0) return 0;
+    return 1;
+}
+
+int waitWlanInterfaceType(const char *interface, int iftype, uint32_t timeoutMs) {
+    /*
+     * Waits for interface to become iftype (WLAN_IFTYPE_STATION etc.).
+     * Returns 1 once it is, 0 on timeout, -1 if there's no such interface
+     */
+    uint64_t deadline = getSchedulerTimeMs() + timeoutMs;
+    pthread_once(&nl80211Once, findNL80211);
+    int fd = -1;
+    if (nl80211ConfigGroup >= 0) {
+        fd = openNetlinkSocket(NETLINK_GENERIC, 0);
+        if ((fd >= 0) && (setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &nl80211ConfigGroup, sizeof (nl80211ConfigGroup)) < 0)) {
+            perror("waitWlanInterfaceType(): setsockopt()");
+            close(fd);
+            fd = -1; //Poll instead
+        }
+    }
+    int ret;
+    for (;;) {
+        if (if_nametoindex(interface) == 0) {
+            printf("waitWlanInterfaceType(): No interface %s\n", interface);
+            ret = -1;
+            break;
+        }
+        if (getWlanInterfaceType(interface) == iftype) {
+            ret = 1;
+            break;
+        }
+        if (waitReadable(fd, deadline) == 0) {
+            ret = 0;
+            break;
+        }
+        if (fd >= 0) drainSocket(fd);
+    }
+    if (fd >= 0) close(fd);
+    return ret;
+}
+
+static int checkHostapdMessage(char message[]) {
+    /*
+     * Looks at a message from hostapd's control socket: an event ("<3>AP-ENABLED") or a reply to STATUS.
+     * Returns 1 if it says the AP's up, -1 if it says it won't be, else 0
+     */
+    if (message[0] == '<') {
+        char *event = strchr(message, '>');
+        if (event == NULL) return 0;
+        event++;
+        if (strncmp(event, "AP-ENABLED", 10) == 0) return 1;
+        if ((strncmp(event, "AP-DISABLED", 11) == 0) || (strncmp(event, "CTRL-EVENT-TERMINATING", 22) == 0)) return -1;
+        return 0;
+    }
+    char *state = strstr(message, "state=");
+    if ((state != NULL) && ((state == message) || (state[-1] == '\n')) && (strncmp(state + 6, "ENABLED", 7) == 0)) return 1;
+    return 0;
+}
+
+int waitHostapdEnabled(const char *interface, uint32_t timeoutMs) {
+    /*
+     * Waits for the hostapd running on interface to report that the access point is up, through its control
+     * socket (HOSTAPD_CTRL_DIR/interface). The socket won't exist until hostapd has got going, so that's
+     * waited for first, with inotify on the directory.
+     * Returns 1 once the AP's up, 0 on timeout, -1 if hostapd says it failed
+     */
+    uint64_t deadline = getSchedulerTimeMs() + timeoutMs;
+    mkdir(HOSTAPD_CTRL_DIR, 0750); //So it can be watched. hostapd would create it anyway
+    int watch = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if ((watch >= 0) && (inotify_add_watch(watch, HOSTAPD_CTRL_DIR, IN_CREATE | IN_MOVED_TO | IN_ATTRIB) < 0)) {
+        close(watch);
+        watch = -1; //Poll instead
+    }
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("waitHostapdEnabled(): socket()");
+        if (watch >= 0) close(watch);
+        return -1;
+    }
+    struct sockaddr_un local;
+    memset(&local, 0, sizeof (local));
+    local.sun_family = AF_UNIX;
+    bind(fd, (struct sockaddr *) &local, sizeof (sa_family_t)); //Autobind, so hostapd has somewhere to reply to
+    struct sockaddr_un remote;
+    memset(&remote, 0, sizeof (remote));
+    remote.sun_family = AF_UNIX;
+    snprintf(remote.sun_path, sizeof (remote.sun_path), "%s/%s", HOSTAPD_CTRL_DIR, interface);
+
+    int ret = 0;
+    int connected = 0;
+    while (!connected) {
+        if (connect(fd, (struct sockaddr *) &remote, sizeof (remote)) == 0) {
+            connected = 1;
+            break;
+        }
+        if ((errno != ENOENT) && (errno != ECONNREFUSED)) { //Refused = stale socket left by a killed hostapd
+            perror("waitHostapdEnabled(): connect()");
+            ret = -1;
+            break;
+        }
+        if (waitReadable(watch, deadline) == 0) break;
+        if (watch >= 0) {
+            char events[1024];
+            while (read(watch, events, sizeof (events)) > 0);
+        }
+    }
+    if (watch >= 0) close(watch);
+
+    if (connected) {
+        //Subscribe to events, then ask where it's got to in case the AP's already up
+        int attached = (send(fd, "ATTACH", 6, 0) == 6);
+        send(fd, "STATUS", 6, 0);
+        while (ret == 0) {
+            if (waitReadable(fd, deadline) == 0) break;
+            char message[HOSTAPD_REPLY_LENGTH];
+            int length = recv(fd, message, sizeof (message) - 1, MSG_DONTWAIT);
+            if (length < 0) {
+                if ((errno == EAGAIN) || (errno == EINTR)) continue;
+                perror("waitHostapdEnabled(): recv()"); //e.g hostapd has gone
+                ret = -1;
+                break;
+            }
+            message[length] = 0;
+            if ((strncmp(message, "FAIL", 4) == 0) && attached) attached = 0; //ATTACH refused
+            ret = checkHostapdMessage(message);
+            if ((ret == 0) && (!attached) && (message[0] != '<')) {
+                //No events coming, so keep asking
+                usleep(WLAN_POLL_MS * 1000);
+                send(fd, "STATUS", 6, 0);
+            }
+        }
+        if (attached) send(fd, "DETACH", 6, 0);
+    }
+    close(fd);
+    return ret;
+}
+
+int waitProcessExit(int pid, uint32_t timeoutMs) {
+    /*
+     * Waits for process pid to exit (it needn't be our child).
+     * Returns 1 once it has (or if pid <= 0), 0 on timeout
+     */
+    if (pid <= 0) return 1;
+    uint64_t deadline = getSchedulerTimeMs() + timeoutMs;
+    int fd = syscall(SYS_pidfd_open, pid, 0);
+    if ((fd < 0) && (errno == ESRCH)) return 1;
+    int ret;
+    for (;;) {
+        if ((fd < 0) && (kill(pid, 0) < 0) && (errno == ESRCH)) {
+            ret = 1;
+            break;
+        }
+        if (waitReadable(fd, deadline) == 0) {
+            ret = 0;
+            break;
+        }
+        if (fd >= 0) { //A pidfd is readable once the process has exited
+            ret = 1;
+            break;
+        }
+    }
+    if (fd >= 0) close(fd);
+    return ret;
+}
+
+const char *wlanStepResultToString(int result) {
+    switch (result) {
+        case WLAN_STEP_PENDING: return "pending";
+        case WLAN_STEP_RUNNING: return "running";
+        case WLAN_STEP_READY: return "ready";
+        case WLAN_STEP_SKIPPED: return "skipped";
+        case WLAN_STEP_TIMEOUT: return "timed out";
+        case WLAN_STEP_FAILED: return "failed";
+        default: return "unknown";
+    }
+}
+
+static int runStepWait(const wlanStep *step, wlanTransitionRun *run, uint32_t timeoutMs) {
+    switch (step->waitFor) {
+        case WLAN_WAIT_LINK_DOWN: return waitWlanLink(run->interface, 0, timeoutMs);
+        case WLAN_WAIT_LINK_UP: return waitWlanLink(run->interface, 1, timeoutMs);
+        case WLAN_WAIT_IFTYPE: return waitWlanInterfaceType(run->interface, step->waitArg, timeoutMs);
+        case WLAN_WAIT_HOSTAPD: return waitHostapdEnabled(run->interface, timeoutMs);
+        case WLAN_WAIT_PROCESS_EXIT: return waitProcessExit(run->waitPid, timeoutMs);
+        default: return 1;
+    }
+}
+
+static void setStepTiming(int n, int result, int attempts, uint32_t elapsedMs) {
+    pthread_mutex_lock(&transitionReportMutex);
+    transitionReport.currentStep = n;
+    transitionReport.steps[n].result = result;
+    transitionReport.steps[n].attempts = attempts;
+    transitionReport.steps[n].elapsedMs = elapsedMs;
+    pthread_mutex_unlock(&transitionReportMutex);
+}
+
+int runWlanTransition(const char *name, const char *interface, const wlanStep steps[], int stepCount, void *context) {
+    /*
+     * Runs steps[] in order on interface. A step that fails, or isn't ready by its timeout, stops the
+     * transition there. context is passed to the step actions (in wlanTransitionRun).
+     * Returns 1 if every step completed, else -1
+     */
+    if ((stepCount < 1) || (stepCount > WLAN_TRANSITION_MAX_STEPS)) {
+        printf("runWlanTransition(): %s: Bad no. of steps: %d\n", name, stepCount);
+        return -1;
+    }
+    pthread_mutex_lock(&transitionRunMutex);
+    wlanTransitionRun run;
+    memset(&run, 0, sizeof (run));
+    strncpy(run.interface, interface, IF_NAMESIZE - 1);
+    run.context = context;
+
+    pthread_mutex_lock(&transitionReportMutex);
+    memset(&transitionReport, 0, sizeof (transitionReport));
+    strncpy(transitionReport.name, name, WLAN_TRANSITION_NAME_LENGTH - 1);
+    strncpy(transitionReport.interface, interface, IF_NAMESIZE - 1);
+    transitionReport.state = WLAN_TRANSITION_RUNNING;
+    transitionReport.started = time(NULL);
+    transitionReport.stepCount = stepCount;
+    int n;
+    for (n = 0; n < stepCount; n++) transitionReport.steps[n].name = steps[n].name;
+    pthread_mutex_unlock(&transitionReportMutex);
+
+    uint64_t start = getSchedulerTimeMs();
+    int ret = 1;
+    for (n = 0; n < stepCount; n++) {
+        const wlanStep *step = &steps[n];
+        uint64_t stepStart = getSchedulerTimeMs();
+        uint64_t deadline = stepStart + step->timeoutMs;
+        setStepTiming(n, WLAN_STEP_RUNNING, 0, 0);
+        int result = WLAN_STEP_TIMEOUT;
+        run.attempt = 0;
+        run.waitPid = 0;
+        do {
+            run.attempt++;
+            int acted = (step->action == NULL) ? 1 : step->action(&run);
+            if (acted < 0) {
+                result = WLAN_STEP_FAILED;
+                break;
+            }
+            if (acted == 0) {
+                result = WLAN_STEP_SKIPPED;
+                break;
+            }
+            uint32_t waitMs = remainingMs(deadline);
+            if ((step->retryMs > 0) && (waitMs > step->retryMs)) waitMs = step->retryMs;
+            int ready = runStepWait(step, &run, waitMs);
+            if (ready > 0) {
+                result = WLAN_STEP_READY;
+                break;
+            }
+            if (ready < 0) {
+                result = WLAN_STEP_FAILED;
+                break;
+            }
+            if (step->retryMs > 0) printf("runWlanTransition(): %s: %s not ready after %d attempt(s)\n", name, step->name, run.attempt);
+        } while ((step->retryMs > 0) && (remainingMs(deadline) > 0));
+
+        uint32_t elapsed = (uint32_t) (getSchedulerTimeMs() - stepStart);
+        setStepTiming(n, result, run.attempt, elapsed);
+        printf("runWlanTransition(): %s: %s: %s in %u mS\n", name, step->name, wlanStepResultToString(result), elapsed);
+        if ((result == WLAN_STEP_TIMEOUT) || (result == WLAN_STEP_FAILED)) {
+            ret = -1;
+            break;
+        }
+    }
+
+    uint32_t elapsed = (uint32_t) (getSchedulerTimeMs() - start);
+    pthread_mutex_lock(&transitionReportMutex);
+    transitionReport.state = (ret == 1) ? WLAN_TRANSITION_DONE : WLAN_TRANSITION_FAILED;
+    transitionReport.elapsedMs = elapsed;
+    pthread_mutex_unlock(&transitionReportMutex);
+    printf("runWlanTransition(): %s %s in %u mS\n", name, (ret == 1) ? "completed" : "failed", elapsed);
+    pthread_mutex_unlock(&transitionRunMutex);
+    return ret;
+}
+
+void getWlanTransitionReport(wlanTransitionReport *report) {
+    //Copies the report on the last (or current) transition
+    pthread_mutex_lock(&transitionReportMutex);
+    *report = transitionReport;
+    pthread_mutex_unlock(&transitionReportMutex);
+}
+
+int printWlanTransitionReport(char output[], int outputLength, const char *lineEnd) {
+    /*
+     * Writes the step timings of the last (or current) transition into output[], one line per step, each line
+     * ended with lineEnd ("\n", or "<br>" for the status page).
+     * Returns the no. of chars written, 0 if no transition has been run
+     */
+    wlanTransitionReport report;
+    getWlanTransitionReport(&report);
+    if ((outputLength < 1) || (report.state == WLAN_TRANSITION_IDLE)) {
+        if (outputLength > 0) output[0] = 0;
+        return 0;
+    }
+    const char *state = (report.state == WLAN_TRANSITION_RUNNING) ? "in progress" :
+            (report.state == WLAN_TRANSITION_DONE) ? "completed" : "failed";
+    int length = snprintf(output, outputLength, "Last wlan transition: %s (%s), %s", report.name, report.interface, state);
+    if ((report.state != WLAN_TRANSITION_RUNNING) && (length < outputLength))
+        length += snprintf(output + length, outputLength - length, " in %u mS", report.elapsedMs);
+    if (length < outputLength) length += snprintf(output + length, outputLength - length, "%s", lineEnd);
+    int n;
+    for (n = 0; (n < report.stepCount) && (length < outputLength); n++) {
+        wlanStepTiming *step = &report.steps[n];
+        if ((step->result == WLAN_STEP_PENDING) || (step->result == WLAN_STEP_RUNNING))
+            length += snprintf(output + length, outputLength - length, "    %s: %s%s", step->name,
+                wlanStepResultToString(step->result), lineEnd);
+        else
+            length += snprintf(output + length, outputLength - length, "    %s: %s, %u mS%s%s", step->name,
+                wlanStepResultToString(step->result), step->elapsedMs, (step->attempts > 1) ? " (retried)" : "", lineEnd);
+    }
+    return (length < outputLength) ? length : outputLength - 1;
+}
@@ -0,0 +1,117 @@
+/*
+ * To change this license header, choose License Headers in Project Properties.
+ * To change this template file, choose Tools | Templates
+ * and open the template in the editor.
+ */
+
+/*
+ * File:   wlanTransition.h
+ *
+ * Steps wlan0 between normal and access point modes, waiting on what the kernel/hostapd report rather than
+ * sleeping (see wlanTransition.c)
+ */
+
+#ifndef WLANTRANSITION_H
+#define WLANTRANSITION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+//ADD MY OWN STUFF AFTER HERE
+//REMEMBER TO ADD: #include "wlanTransition.h" TO THE SOURCE FILE
+
+#include <stdint.h>
+#include <time.h>
+#include <net/if.h>
+
+#define WLAN_TRANSITION_MAX_STEPS 12
+#define WLAN_TRANSITION_NAME_LENGTH 32
+#define HOSTAPD_CTRL_DIR "/var/run/hostapd" //hostapd's ctrl_interface. The generated hostapd config points here
+
+//What a step waits for once its action has run
+#define WLAN_WAIT_NONE 0
+#define WLAN_WAIT_LINK_DOWN 1       //Interface administratively down
+#define WLAN_WAIT_LINK_UP 2         //Interface administratively up
+#define WLAN_WAIT_IFTYPE 3          //Interface type (nl80211) == waitArg
+#define WLAN_WAIT_HOSTAPD 4         //hostapd says the AP is enabled
+#define WLAN_WAIT_PROCESS_EXIT 5    //The process the action left in waitPid has gone
+
+//Interface types (the nl80211 values)
+#define WLAN_IFTYPE_UNKNOWN -1
+#define WLAN_IFTYPE_ADHOC 1
+#define WLAN_IFTYPE_STATION 2
+#define WLAN_IFTYPE_AP 3
+
+//Step results
+#define WLAN_STEP_PENDING 0
+#define WLAN_STEP_RUNNING 1
+#define WLAN_STEP_READY 2
+#define WLAN_STEP_SKIPPED 3     //Action had nothing to do
+#define WLAN_STEP_TIMEOUT 4
+#define WLAN_STEP_FAILED 5
+
+//Transition states
+#define WLAN_TRANSITION_IDLE 0  //Nothing run yet
+#define WLAN_TRANSITION_RUNNING 1
+#define WLAN_TRANSITION_DONE 2
+#define WLAN_TRANSITION_FAILED 3
+
+typedef struct {
+    char interface[IF_NAMESIZE];
+    void *context; //Whatever the caller passed to runWlanTransition()
+    int attempt; //1 the first time a step's action runs, 2 on its first retry etc.
+    int waitPid; //Set by an action before a WLAN_WAIT_PROCESS_EXIT step
+} wlanTransitionRun;
+
+//Returns 1 to go on to the step's wait, 0 if there was nothing to do (the wait's skipped), -1 on failure
+typedef int (*wlanStepAction)(wlanTransitionRun *run);
+
+typedef struct {
+    const char *name;
+    wlanStepAction action; //NULL to just wait
+    int waitFor; //WLAN_WAIT_NONE etc.
+    int waitArg; //Interface type for WLAN_WAIT_IFTYPE
+    uint32_t timeoutMs;
+    uint32_t retryMs; //Run the action again if not ready after this long (0 = once only)
+} wlanStep;
+
+typedef struct {
+    const char *name;
+    int result; //WLAN_STEP_PENDING etc.
+    int attempts;
+    uint32_t elapsedMs; //Action + wait
+} wlanStepTiming;
+
+typedef struct {
+    char name[WLAN_TRANSITION_NAME_LENGTH];
+    char interface[IF_NAMESIZE];
+    int state; //WLAN_TRANSITION_IDLE etc.
+    int currentStep; //While running
+    time_t started;
+    uint32_t elapsedMs;
+    int stepCount;
+    wlanStepTiming steps[WLAN_TRANSITION_MAX_STEPS];
+} wlanTransitionReport;
+
+int runWlanTransition(const char *name, const char *interface, const wlanStep steps[], int stepCount, void *context);
+void getWlanTransitionReport(wlanTransitionReport *report);
+int printWlanTransitionReport(char output[], int outputLength, const char *lineEnd);
+const char *wlanStepResultToString(int result);
+int getWlanInterfaceType(const char *interface);
+int isWlanAssociated(const char *interface);
+int waitWlanLink(const char *interface, int up, uint32_t timeoutMs);
+int waitWlanInterfaceType(const char *interface, int iftype, uint32_t timeoutMs);
+int waitHostapdEnabled(const char *interface, uint32_t timeoutMs);
+int waitProcessExit(int pid, uint32_t timeoutMs);
+
+//AND BEFORE HERE
+#endif /* WLANTRANSITION_H */
+